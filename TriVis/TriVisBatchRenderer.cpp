@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisBatchRenderer.h"
+
+#include <atomic>
+#include <sstream>
+
+#include <boost/thread.hpp>
+
+TriVisBatchRenderer::TriVisBatchRenderer() {
+  width = 512;
+  height = 512;
+  selection = Failed;
+}
+
+std::size_t TriVisBatchRenderer::render(const std::vector<OGRGeometry *> &geometries, const std::vector<long> &fids, const std::string &directory, unsigned int numThreads) {
+  if (numThreads < 1) numThreads = 1;
+  
+  // Every worker takes the next unrendered feature, so large features do not hold back the rest
+  std::atomic<std::size_t> nextFeature(0), numRendered(0);
+  boost::thread_group workers;
+  for (unsigned int currentThread = 0; currentThread < numThreads; ++currentThread) {
+    workers.create_thread([this, &geometries, &fids, &directory, &nextFeature, &numRendered]() {
+      while (true) {
+        std::size_t currentFeature = nextFeature++;
+        if (currentFeature >= geometries.size()) break;
+        if (renderFeature(geometries[currentFeature], fids[currentFeature], directory)) ++numRendered;
+      }
+    });
+  } workers.join_all();
+  return numRendered;
+}
+
+bool TriVisBatchRenderer::renderFeature(OGRGeometry *geometry, long fid, const std::string &directory) {
+  if (selection == Changed && geometry->IsValid()) return false;
+  
+  // The triangulation is kept tagged after the repair
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(geometry);
+  if (selection == Failed && !outGeometry->IsEmpty() && outGeometry->IsValid()) {
+    delete outGeometry;
+    return false;
+  }
+  
+  TriVisRasterizer rasterizer(width, height);
+  drawFeature(geometry, prepair, outGeometry, rasterizer);
+  delete outGeometry;
+  
+  std::stringstream filename;
+  filename << directory << "/feature_" << fid << ".png";
+  return rasterizer.writePNG(filename.str());
+}
+
+void TriVisBatchRenderer::drawFeature(OGRGeometry *geometry, Polygon_repair &prepair, OGRGeometry *outGeometry, TriVisRasterizer &rasterizer) {
+  TriVisBuffer input, triangulation, taggedTriangulation, output;
+  TriVisBufferBuilder::buildInput(geometry, input);
+  TriVisBufferBuilder::buildTriangulation(prepair.triangulation, triangulation);
+  TriVisBufferBuilder::buildTaggedTriangulation(prepair.triangulation, taggedTriangulation);
+  TriVisBufferBuilder::buildOutput(outGeometry, output);
+  
+  // Framed on the input, which the triangulation and the output lie within.
+  // The input goes over the triangulation, so edges that cancelled out still show
+  OGREnvelope envelope;
+  geometry->getEnvelope(&envelope);
+  rasterizer.frame(envelope.MinX, envelope.MinY, envelope.MaxX, envelope.MaxY);
+  rasterizer.drawTriangles(taggedTriangulation);
+  rasterizer.drawLines(triangulation);
+  rasterizer.drawLines(input);
+  rasterizer.drawLines(output);
+}
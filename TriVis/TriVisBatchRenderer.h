@@ -0,0 +1,57 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisBatchRenderer_h
+#define TriVis_TriVisBatchRenderer_h
+
+#include <string>
+#include <vector>
+
+#include "TriVisBufferBuilder.h"
+#include "TriVisRasterizer.h"
+
+// Repairs features and renders each one to a PNG without OpenGL or a window,
+// using the same layer buffers and colours as the viewer. The tagged faces
+// are drawn first, then the triangulation edges, the input rings and the
+// output rings on top
+class TriVisBatchRenderer {
+public:
+  enum Selection {
+    All = 0,
+    Changed,  // The input is not valid, so the repair changed it
+    Failed    // The output is empty or not valid
+  };
+  
+  unsigned int width, height;
+  Selection selection;
+  
+  TriVisBatchRenderer();
+  
+  // Every feature is written to directory/feature_<fid>.png, returns how many were
+  std::size_t render(const std::vector<OGRGeometry *> &geometries, const std::vector<long> &fids, const std::string &directory, unsigned int numThreads);
+
+//private:
+  bool renderFeature(OGRGeometry *geometry, long fid, const std::string &directory);
+  void drawFeature(OGRGeometry *geometry, Polygon_repair &prepair, OGRGeometry *outGeometry, TriVisRasterizer &rasterizer);
+};
+
+#endif
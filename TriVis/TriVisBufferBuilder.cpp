@@ -0,0 +1,170 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisBufferBuilder.h"
+#include "TriVisColours.h"
+
+#include <CGAL/Unique_hash_map.h>
+
+static const std::uint32_t noIndex = 0xffffffff;
+
+void TriVisBufferBuilder::buildInput(OGRGeometry *geometry, TriVisBuffer &buffer) {
+  std::size_t numRingVertices = countRingVertices(geometry);
+  buffer.positions.reserve(buffer.positions.size()+2*numRingVertices);
+  buffer.colours.reserve(buffer.colours.size()+numRingVertices);
+  buffer.elements.reserve(buffer.elements.size()+2*numRingVertices);
+  addRings(geometry, buffer);
+}
+
+void TriVisBufferBuilder::buildTriangulation(prepair::Triangulation &triangulation, TriVisBuffer &buffer) {
+  // A vertex is stored at most once per edge colour
+  CGAL::Unique_hash_map<prepair::Triangulation::Vertex_handle, std::uint32_t> constrainedIndex(noIndex, triangulation.number_of_vertices());
+  CGAL::Unique_hash_map<prepair::Triangulation::Vertex_handle, std::uint32_t> unconstrainedIndex(noIndex, triangulation.number_of_vertices());
+  
+  // Euler: the finite edges of a triangulation are V+F-1
+  std::size_t numEdges = triangulation.number_of_vertices()+triangulation.number_of_faces();
+  buffer.positions.reserve(buffer.positions.size()+2*triangulation.number_of_vertices());
+  buffer.colours.reserve(buffer.colours.size()+triangulation.number_of_vertices());
+  buffer.elements.reserve(buffer.elements.size()+2*numEdges);
+  
+  for (prepair::Triangulation::Finite_edges_iterator currentEdge = triangulation.finite_edges_begin(); currentEdge != triangulation.finite_edges_end(); ++currentEdge) {
+    bool isConstrained = triangulation.is_constrained(*currentEdge);
+    CGAL::Unique_hash_map<prepair::Triangulation::Vertex_handle, std::uint32_t> &index = isConstrained ? constrainedIndex : unconstrainedIndex;
+    std::uint8_t colour = isConstrained ? constrainedEdgeColour : unconstrainedEdgeColour;
+    prepair::Triangulation::Vertex_handle endpoints[2] = {currentEdge->first->vertex(prepair::Triangulation::cw(currentEdge->second)),
+                                                        currentEdge->first->vertex(prepair::Triangulation::ccw(currentEdge->second))};
+    for (int currentEndpoint = 0; currentEndpoint < 2; ++currentEndpoint) {
+      if (index[endpoints[currentEndpoint]] == noIndex) {
+        index[endpoints[currentEndpoint]] = addVertex(CGAL::to_double(endpoints[currentEndpoint]->point().x()),
+                                                      CGAL::to_double(endpoints[currentEndpoint]->point().y()),
+                                                      colour, buffer);
+      } buffer.elements.push_back(index[endpoints[currentEndpoint]]);
+    }
+  }
+}
+
+void TriVisBufferBuilder::buildTaggedTriangulation(prepair::Triangulation &triangulation, TriVisBuffer &buffer) {
+  CGAL::Unique_hash_map<prepair::Triangulation::Vertex_handle, std::uint32_t> index(noIndex, triangulation.number_of_vertices());
+  buffer.positions.reserve(buffer.positions.size()+2*triangulation.number_of_vertices());
+  buffer.colours.reserve(buffer.colours.size()+triangulation.number_of_vertices());
+  buffer.elements.reserve(buffer.elements.size()+3*triangulation.number_of_faces());
+  
+  for (prepair::Triangulation::Finite_faces_iterator currentFace = triangulation.finite_faces_begin(); currentFace != triangulation.finite_faces_end(); ++currentFace) {
+    if (!currentFace->info().is_in_interior()) continue;
+    for (int currentVertex = 0; currentVertex < 3; ++currentVertex) {
+      prepair::Triangulation::Vertex_handle vertex = currentFace->vertex(currentVertex);
+      if (index[vertex] == noIndex) {
+        index[vertex] = addVertex(CGAL::to_double(vertex->point().x()), CGAL::to_double(vertex->point().y()), interiorFaceColour, buffer);
+      } buffer.elements.push_back(index[vertex]);
+    }
+  }
+}
+
+void TriVisBufferBuilder::buildQuality(prepair::Triangulation &triangulation, TriVisBuffer &buffer, Quality *quality) {
+  // Only the flagged faces are stored, so the layer can be drawn over any other
+  Triangulation_quality analysis;
+  Quality result = analysis.compute(triangulation);
+  if (quality != NULL) *quality = result;
+  const std::vector<std::uint8_t> &faceFlags = analysis.get_face_flags();
+  for (std::size_t currentFace = 0; currentFace < faceFlags.size(); ++currentFace) {
+    if (faceFlags[currentFace] == 0) continue;
+    std::uint8_t colour = (faceFlags[currentFace] & Triangulation_quality::Near_collinear_constraint) ? nearCollinearFaceColour : sliverFaceColour;
+    
+    // Flagged faces are mostly isolated, so their vertices are not shared
+    std::uint32_t vertices[3] = {analysis.first_vertex[currentFace], analysis.second_vertex[currentFace], analysis.third_vertex[currentFace]};
+    for (int currentVertex = 0; currentVertex < 3; ++currentVertex) {
+      buffer.elements.push_back(addVertex(analysis.x[vertices[currentVertex]], analysis.y[vertices[currentVertex]], colour, buffer));
+    }
+  }
+}
+
+void TriVisBufferBuilder::buildOutput(OGRGeometry *geometry, TriVisBuffer &buffer) {
+  buildInput(geometry, buffer);
+}
+
+std::size_t TriVisBufferBuilder::countRingVertices(OGRGeometry *geometry) {
+  std::size_t numRingVertices = 0;
+  switch (geometry->getGeometryType()) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      numRingVertices += polygon->getExteriorRing()->getNumPoints();
+      for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
+        numRingVertices += polygon->getInteriorRing(currentRing)->getNumPoints();
+      } break;
+    }
+    
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int currentPolygon = 0; currentPolygon < multipolygon->getNumGeometries(); ++currentPolygon) {
+        numRingVertices += countRingVertices(multipolygon->getGeometryRef(currentPolygon));
+      } break;
+    }
+    
+    default:
+      break;
+  } return numRingVertices;
+}
+
+void TriVisBufferBuilder::addRings(OGRGeometry *geometry, TriVisBuffer &buffer) {
+  switch (geometry->getGeometryType()) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      addRing(polygon->getExteriorRing(), exteriorRingColour, buffer);
+      for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
+        addRing(polygon->getInteriorRing(currentRing), interiorRingColour, buffer);
+      } break;
+    }
+    
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int currentPolygon = 0; currentPolygon < multipolygon->getNumGeometries(); ++currentPolygon) {
+        addRings(multipolygon->getGeometryRef(currentPolygon), buffer);
+      } break;
+    }
+    
+    default:
+      std::cerr << "Error: Input type not supported" << std::endl;
+      break;
+  }
+}
+
+void TriVisBufferBuilder::addRing(OGRLinearRing *ring, std::uint8_t colour, TriVisBuffer &buffer) {
+  int numPoints = ring->getNumPoints();
+  if (numPoints < 2) return;
+  
+  // The closing vertex is shared with the first one
+  if (ring->getX(0) == ring->getX(numPoints-1) && ring->getY(0) == ring->getY(numPoints-1)) --numPoints;
+  std::uint32_t firstIndex = (std::uint32_t)buffer.numVertices();
+  for (int currentVertex = 0; currentVertex < numPoints; ++currentVertex) {
+    addVertex(ring->getX(currentVertex), ring->getY(currentVertex), colour, buffer);
+    buffer.elements.push_back(firstIndex+currentVertex);
+    buffer.elements.push_back(currentVertex+1 < numPoints ? firstIndex+currentVertex+1 : firstIndex);
+  }
+}
+
+std::uint32_t TriVisBufferBuilder::addVertex(double x, double y, std::uint8_t colour, TriVisBuffer &buffer) {
+  std::uint32_t index = (std::uint32_t)buffer.numVertices();
+  buffer.positions.push_back(x);
+  buffer.positions.push_back(y);
+  buffer.colours.push_back(colour);
+  return index;
+}
@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisBufferBuilder_h
+#define TriVis_TriVisBufferBuilder_h
+
+#include <vector>
+#include <cstdint>
+
+#include "Polygon_repair.h"
+#include "Triangulation_quality.h"
+#include "TriVisFeatureTable.h"
+
+// One layer as indexed geometry: every vertex has a full precision x, y
+// position and a colour from the palette in TriVisColours.h, and elements are indices into them (pairs
+// for lines, triples for triangles)
+struct TriVisBuffer {
+  std::vector<double> positions;
+  std::vector<std::uint8_t> colours;
+  std::vector<std::uint32_t> elements;
+  TriVisFeatureTable features;
+  
+  std::size_t numVertices() const {
+    return positions.size()/2;
+  }
+  
+  // Whatever is built between these two calls belongs to the feature
+  void beginFeature(long fid) {
+    features.beginFeature(fid, numVertices(), elements.size());
+  }
+  
+  void endFeature() {
+    features.endFeature(positions.data(), numVertices(), elements.size());
+  }
+  
+  void clear() {
+    positions.clear();
+    colours.clear();
+    elements.clear();
+    features.clear();
+  }
+};
+
+// Builds the layer buffers without any OpenGL dependency. Every builder
+// appends to the given buffer, so several features can share one buffer
+class TriVisBufferBuilder {
+public:
+  static void buildInput(OGRGeometry *geometry, TriVisBuffer &buffer);
+  static void buildTriangulation(prepair::Triangulation &triangulation, TriVisBuffer &buffer);
+  static void buildTaggedTriangulation(prepair::Triangulation &triangulation, TriVisBuffer &buffer);
+  static void buildQuality(prepair::Triangulation &triangulation, TriVisBuffer &buffer, Quality *quality = NULL);
+  static void buildOutput(OGRGeometry *geometry, TriVisBuffer &buffer);
+
+private:
+  static std::size_t countRingVertices(OGRGeometry *geometry);
+  static void addRings(OGRGeometry *geometry, TriVisBuffer &buffer);
+  static void addRing(OGRLinearRing *ring, std::uint8_t colour, TriVisBuffer &buffer);
+  static std::uint32_t addVertex(double x, double y, std::uint8_t colour, TriVisBuffer &buffer);
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisColours_h
+#define TriVis_TriVisColours_h
+
+#include <cstdint>
+
+// The colour scheme shared by the viewer and the offscreen renderer. Vertices
+// store the index of their colour in the palette, which is resolved in the
+// fragment shader, so a colour costs one byte per vertex instead of three floats
+static const unsigned int numPaletteColours = 7;
+static const float palette[numPaletteColours][3] = {
+  {0.0f, 0.0f, 0.0f},
+  {1.0f, 0.0f, 0.0f},
+  {0.7f, 0.7f, 0.7f},
+  {1.0f, 1.0f, 0.0f},
+  {1.0f, 1.0f, 1.0f},
+  {1.0f, 0.0f, 1.0f},
+  {1.0f, 0.5f, 0.0f}
+};
+
+static const std::uint8_t exteriorRingColour = 0;
+static const std::uint8_t interiorRingColour = 1;
+static const std::uint8_t constrainedEdgeColour = 0;
+static const std::uint8_t unconstrainedEdgeColour = 2;
+static const std::uint8_t interiorFaceColour = 3;
+static const std::uint8_t currentEventColour = 1;
+static const std::uint8_t backgroundColour = 4;
+static const std::uint8_t sliverFaceColour = 5;
+static const std::uint8_t nearCollinearFaceColour = 6;
+
+// Unknown indices are drawn in black, as in the shader
+inline const float *paletteColour(std::uint8_t index) {
+  return index < numPaletteColours ? palette[index] : palette[0];
+}
+
+#endif
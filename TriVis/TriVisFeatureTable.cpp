@@ -0,0 +1,95 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisFeatureTable.h"
+
+#include <algorithm>
+#include <limits>
+
+static bool compareFids(const TriVisFeatureRange &range, long fid) {
+  return range.fid < fid;
+}
+
+TriVisFeatureTable::TriVisFeatureTable() {
+  isSorted = true;
+}
+
+void TriVisFeatureTable::beginFeature(long fid, std::size_t numVertices, std::size_t numElements) {
+  if (!ranges.empty() && ranges.back().fid >= fid) isSorted = false;
+  TriVisFeatureRange range;
+  range.fid = fid;
+  range.firstVertex = numVertices;
+  range.numVertices = 0;
+  range.firstElement = numElements;
+  range.numElements = 0;
+  ranges.push_back(range);
+}
+
+void TriVisFeatureTable::endFeature(const double *positions, std::size_t numVertices, std::size_t numElements) {
+  TriVisFeatureRange &range = ranges.back();
+  range.numVertices = numVertices-range.firstVertex;
+  range.numElements = numElements-range.firstElement;
+  
+  range.minX = range.minY = std::numeric_limits<double>::max();
+  range.maxX = range.maxY = -std::numeric_limits<double>::max();
+  for (std::size_t currentVertex = range.firstVertex; currentVertex < numVertices; ++currentVertex) {
+    range.minX = std::min(range.minX, positions[2*currentVertex]);
+    range.minY = std::min(range.minY, positions[2*currentVertex+1]);
+    range.maxX = std::max(range.maxX, positions[2*currentVertex]);
+    range.maxY = std::max(range.maxY, positions[2*currentVertex+1]);
+  }
+}
+
+void TriVisFeatureTable::clear() {
+  ranges.clear();
+  isSorted = true;
+}
+
+const TriVisFeatureRange *TriVisFeatureTable::find(long fid) const {
+  if (isSorted) {
+    std::vector<TriVisFeatureRange>::const_iterator range = std::lower_bound(ranges.begin(), ranges.end(), fid, compareFids);
+    if (range != ranges.end() && range->fid == fid) return &*range;
+    return NULL;
+  }
+  
+  for (std::vector<TriVisFeatureRange>::const_iterator range = ranges.begin(); range != ranges.end(); ++range) {
+    if (range->fid == fid) return &*range;
+  } return NULL;
+}
+
+void TriVisFeatureTable::getPrimitiveFeatures(unsigned int primitiveSize, std::size_t numElements, std::vector<std::uint32_t> &primitiveFeatures) const {
+  primitiveFeatures.assign(numElements/primitiveSize, (std::uint32_t)ranges.size());
+  for (std::size_t currentFeature = 0; currentFeature < ranges.size(); ++currentFeature) {
+    std::size_t firstPrimitive = ranges[currentFeature].firstElement/primitiveSize;
+    std::size_t numPrimitives = ranges[currentFeature].numElements/primitiveSize;
+    std::fill(primitiveFeatures.begin()+firstPrimitive, primitiveFeatures.begin()+firstPrimitive+numPrimitives, (std::uint32_t)currentFeature);
+  }
+}
+
+void TriVisFeatureTable::getIndices(const std::vector<long> &fids, std::vector<std::uint32_t> &indices) const {
+  indices.clear();
+  for (std::vector<long>::const_iterator currentFid = fids.begin(); currentFid != fids.end(); ++currentFid) {
+    const TriVisFeatureRange *range = find(*currentFid);
+    if (range != NULL) indices.push_back((std::uint32_t)(range-&ranges.front()));
+  } std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
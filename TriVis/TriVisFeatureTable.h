@@ -0,0 +1,63 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisFeatureTable_h
+#define TriVis_TriVisFeatureTable_h
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Where the vertices and elements of one feature are in a layer buffer
+struct TriVisFeatureRange {
+  long fid;
+  std::size_t firstVertex, numVertices;
+  std::size_t firstElement, numElements;
+  double minX, minY, maxX, maxY;
+};
+
+// Per-feature ranges of a layer, filled while the layer is built. Features
+// are kept in load order, and looking one up is a binary search as long as
+// they were added with increasing fids
+class TriVisFeatureTable {
+public:
+  std::vector<TriVisFeatureRange> ranges;
+  
+  TriVisFeatureTable();
+  
+  void beginFeature(long fid, std::size_t numVertices, std::size_t numElements);
+  void endFeature(const double *positions, std::size_t numVertices, std::size_t numElements);
+  void clear();
+  
+  const TriVisFeatureRange *find(long fid) const;
+  
+  // The index of the feature of every primitive, or the number of features if it has none
+  void getPrimitiveFeatures(unsigned int primitiveSize, std::size_t numElements, std::vector<std::uint32_t> &primitiveFeatures) const;
+  
+  // The sorted indices of the features with the given fids
+  void getIndices(const std::vector<long> &fids, std::vector<std::uint32_t> &indices) const;
+
+//private:
+  bool isSorted;
+};
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisLoader.h"
+
+#include <fstream>
+
+TriVisLoader::TriVisLoader() {
+  // Registering drivers is not thread-safe, so it is done here and not in the worker
+  OGRRegisterAll();
+  
+  loading = false;
+  cancelled = false;
+  currentProgress = 0.0f;
+  currentStage = "Idle";
+  for (int currentLayer = 0; currentLayer < NumLayers; ++currentLayer) layers[currentLayer] = NULL;
+  snapshot = NULL;
+  replay = NULL;
+}
+
+TriVisLoader::~TriVisLoader() {
+  cancel();
+  if (worker.joinable()) worker.join();
+  discardLayers();
+}
+
+void TriVisLoader::load(const std::string &filename) {
+  cancel();
+  if (worker.joinable()) worker.join();
+  discardLayers();
+  
+  cancelled = false;
+  currentProgress = 0.0f;
+  currentStage = "Reading";
+  loading = true;
+  worker = boost::thread(&TriVisLoader::run, this, filename);
+}
+
+void TriVisLoader::cancel() {
+  cancelled = true;
+}
+
+bool TriVisLoader::isLoading() const {
+  return loading;
+}
+
+bool TriVisLoader::hasPendingLayers() const {
+  for (int currentLayer = 0; currentLayer < NumLayers; ++currentLayer) {
+    if (layers[currentLayer].load(std::memory_order_acquire) != NULL) return true;
+  } return snapshot.load(std::memory_order_acquire) != NULL || replay.load(std::memory_order_acquire) != NULL;
+}
+
+float TriVisLoader::progress() const {
+  return currentProgress;
+}
+
+const char *TriVisLoader::stage() const {
+  return currentStage;
+}
+
+TriVisBuffer *TriVisLoader::takeLayer(Layer layer) {
+  return layers[layer].exchange(NULL, std::memory_order_acquire);
+}
+
+Triangulation_snapshot *TriVisLoader::takeSnapshot() {
+  return snapshot.exchange(NULL, std::memory_order_acquire);
+}
+
+TriVisReplay *TriVisLoader::takeReplay() {
+  return replay.exchange(NULL, std::memory_order_acquire);
+}
+
+void TriVisLoader::run(std::string filename) {
+  if (filename.size() >= 5 && filename.compare(filename.size()-5, 5, ".snap") == 0) {
+    runSnapshot(filename);
+    return;
+  } if (filename.size() >= 7 && filename.compare(filename.size()-7, 7, ".events") == 0) {
+    runReplay(filename);
+    return;
+  }
+  
+  std::vector<OGRGeometry *> geometries;
+  std::vector<long> fids;
+  if (!read(filename, geometries, fids)) {
+    currentStage = "Error";
+    loading = false;
+    return;
+  }
+  
+  // Empty layers replace those of the previous file. Every layer slot only
+  // ever holds the newest buffer, so they cannot be uploaded out of order
+  publish(Triangulation, new TriVisBuffer());
+  publish(TaggedTriangulation, new TriVisBuffer());
+  publish(Output, new TriVisBuffer());
+  publish(Quality, new TriVisBuffer());
+  
+  // All the features of a layer go into one buffer, with a range per feature
+  TriVisBuffer *buffer = new TriVisBuffer();
+  for (std::size_t currentFeature = 0; currentFeature < geometries.size(); ++currentFeature) {
+    buffer->beginFeature(fids[currentFeature]);
+    TriVisBufferBuilder::buildInput(geometries[currentFeature], *buffer);
+    buffer->endFeature();
+  } publish(Input, buffer);
+  currentProgress = 0.1f;
+  
+  TriVisBuffer *triangulation = new TriVisBuffer();
+  TriVisBuffer *quality = new TriVisBuffer();
+  TriVisBuffer *taggedTriangulation = new TriVisBuffer();
+  TriVisBuffer *output = new TriVisBuffer();
+  for (std::size_t currentFeature = 0; currentFeature < geometries.size(); ++currentFeature) {
+    if (!cancelled) repair(geometries[currentFeature], fids[currentFeature], currentFeature, geometries.size(),
+                           *triangulation, *quality, *taggedTriangulation, *output);
+    delete geometries[currentFeature];
+  }
+  
+  if (!cancelled) {
+    publish(Triangulation, triangulation);
+    publish(Quality, quality);
+    publish(TaggedTriangulation, taggedTriangulation);
+    publish(Output, output);
+    currentProgress = 1.0f;
+  } else {
+    delete triangulation;
+    delete quality;
+    delete taggedTriangulation;
+    delete output;
+  }
+  
+  currentStage = cancelled ? "Cancelled" : "Done";
+  loading = false;
+}
+
+void TriVisLoader::repair(OGRGeometry *geometry, long fid, std::size_t featureIndex, std::size_t numFeatures,
+                          TriVisBuffer &triangulation, TriVisBuffer &quality, TriVisBuffer &taggedTriangulation, TriVisBuffer &output) {
+  // The rings are inserted one by one so that progress can be reported, and
+  // the budget stops the insertion and the tagging between edges once cancelled
+  currentStage = "Triangulating";
+  Polygon_repair prepair;
+  prepair.budget.cancelled = &cancelled;
+  std::vector<std::vector<Polygon_repair::Point> > rings;
+  prepair.get_rings(geometry, rings);
+  prepair.remove_duplicate_rings(rings);
+  prepair.locate_hints.reset(rings);
+  std::size_t numPoints = 0, numInsertedPoints = 0;
+  for (std::vector<std::vector<Polygon_repair::Point> >::const_iterator currentRing = rings.begin(); currentRing != rings.end(); ++currentRing) {
+    numPoints += currentRing->size();
+  } for (std::vector<std::vector<Polygon_repair::Point> >::const_iterator currentRing = rings.begin(); currentRing != rings.end(); ++currentRing) {
+    if (cancelled) return;
+    prepair.insert_odd_even_ring(*currentRing);
+    numInsertedPoints += currentRing->size();
+    currentProgress = 0.1f+0.9f*(featureIndex+0.7f*numInsertedPoints/numPoints)/numFeatures;
+  } if (cancelled) return;
+  
+  triangulation.beginFeature(fid);
+  TriVisBufferBuilder::buildTriangulation(prepair.triangulation, triangulation);
+  triangulation.endFeature();
+  quality.beginFeature(fid);
+  TriVisBufferBuilder::buildQuality(prepair.triangulation, quality);
+  quality.endFeature();
+  
+  currentStage = "Tagging";
+  prepair.tag_odd_even();
+  if (cancelled) return;
+  taggedTriangulation.beginFeature(fid);
+  TriVisBufferBuilder::buildTaggedTriangulation(prepair.triangulation, taggedTriangulation);
+  taggedTriangulation.endFeature();
+  currentProgress = 0.1f+0.9f*(featureIndex+0.85f)/numFeatures;
+  
+  currentStage = "Reconstructing";
+  prepair.prune_exact_numbers();
+  OGRGeometry *outGeometry = prepair.reconstruct();
+  output.beginFeature(fid);
+  TriVisBufferBuilder::buildOutput(outGeometry, output);
+  output.endFeature();
+  delete outGeometry;
+  currentProgress = 0.1f+0.9f*(featureIndex+1.0f)/numFeatures;
+}
+
+void TriVisLoader::runSnapshot(const std::string &filename) {
+  // Nothing to repair, the mapped file is handed over as is
+  Triangulation_snapshot *newSnapshot = new Triangulation_snapshot();
+  if (!newSnapshot->open(filename.c_str())) {
+    delete newSnapshot;
+    currentStage = "Error";
+    loading = false;
+    return;
+  }
+  
+  TriVisBuffer *buffer = new TriVisBuffer();
+  if (newSnapshot->header().output_size > 0) {
+    OGRGeometry *outGeometry = NULL;
+    if (OGRGeometryFactory::createFromWkb(const_cast<unsigned char *>(newSnapshot->output()), NULL, &outGeometry, (int)newSnapshot->header().output_size) == OGRERR_NONE) {
+      TriVisBufferBuilder::buildOutput(outGeometry, *buffer);
+      delete outGeometry;
+    } else std::cerr << "Error: Could not read the output in the snapshot" << std::endl;
+  }
+  
+  Triangulation_snapshot *previous = snapshot.exchange(newSnapshot, std::memory_order_release);
+  if (previous != NULL) delete previous;
+  publish(Output, buffer);
+  publish(Quality, new TriVisBuffer());
+  currentProgress = 1.0f;
+  currentStage = "Done";
+  loading = false;
+}
+
+void TriVisLoader::runReplay(const std::string &filename) {
+  // The events are only read here, they are applied on the GL thread as the replay advances
+  TriVisReplay *newReplay = new TriVisReplay();
+  if (!newReplay->open(filename)) {
+    delete newReplay;
+    currentStage = "Error";
+    loading = false;
+    return;
+  }
+  
+  TriVisReplay *previous = replay.exchange(newReplay, std::memory_order_release);
+  if (previous != NULL) delete previous;
+  currentProgress = 1.0f;
+  currentStage = "Done";
+  loading = false;
+}
+
+bool TriVisLoader::read(const std::string &filename, std::vector<OGRGeometry *> &geometries, std::vector<long> &fids) {
+  
+  // One WKT per line, numbered from zero
+  if (filename.size() >= 4 && filename.compare(filename.size()-4, 4, ".txt") == 0) {
+    std::ifstream file(filename.c_str());
+    if (!file.is_open()) {
+      std::cerr << "Error: Could not open file" << std::endl;
+      return false;
+    } std::string line;
+    for (long currentLine = 0; std::getline(file, line) && !cancelled; ++currentLine) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+      std::vector<char> cstr(line.begin(), line.end());
+      cstr.push_back('\0');
+      char *wktPointer = &cstr[0];
+      OGRGeometry *geometry = NULL;
+      if (OGRGeometryFactory::createFromWkt(&wktPointer, NULL, &geometry) != OGRERR_NONE) {
+        std::cerr << "Error: Could not read WKT on line " << currentLine+1 << std::endl;
+        continue;
+      } add(geometry, currentLine, geometries, fids);
+    }
+  }
+  
+  else {
+    OGRDataSource *dataSource = OGRSFDriverRegistrar::Open(filename.c_str(), false);
+    if (dataSource == NULL) {
+      std::cerr << "Error: Could not open file" << std::endl;
+      return false;
+    } OGRLayer *dataLayer = dataSource->GetLayer(0);
+    dataLayer->ResetReading();
+    OGRFeature *feature;
+    while (!cancelled && (feature = dataLayer->GetNextFeature()) != NULL) {
+      if (feature->GetGeometryRef() != NULL) add(feature->GetGeometryRef()->clone(), feature->GetFID(), geometries, fids);
+      OGRFeature::DestroyFeature(feature);
+    } OGRDataSource::DestroyDataSource(dataSource);
+  }
+  
+  if (geometries.empty()) {
+    std::cerr << "Error: No polygons or multipolygons in file" << std::endl;
+    return false;
+  } return true;
+}
+
+void TriVisLoader::add(OGRGeometry *geometry, long fid, std::vector<OGRGeometry *> &geometries, std::vector<long> &fids) {
+  if (geometry->getGeometryType() != wkbPolygon && geometry->getGeometryType() != wkbMultiPolygon) {
+    std::cerr << "Error: Feature " << fid << " is not a polygon or multipolygon" << std::endl;
+    delete geometry;
+    return;
+  } geometries.push_back(geometry);
+  fids.push_back(fid);
+}
+
+void TriVisLoader::publish(Layer layer, TriVisBuffer *buffer) {
+  // A layer that was not taken yet is superseded
+  TriVisBuffer *previous = layers[layer].exchange(buffer, std::memory_order_release);
+  if (previous != NULL) delete previous;
+}
+
+void TriVisLoader::discardLayers() {
+  for (int currentLayer = 0; currentLayer < NumLayers; ++currentLayer) {
+    TriVisBuffer *buffer = takeLayer((Layer)currentLayer);
+    if (buffer != NULL) delete buffer;
+  } Triangulation_snapshot *pendingSnapshot = takeSnapshot();
+  if (pendingSnapshot != NULL) delete pendingSnapshot;
+  TriVisReplay *pendingReplay = takeReplay();
+  if (pendingReplay != NULL) delete pendingReplay;
+}
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisLoader_h
+#define TriVis_TriVisLoader_h
+
+#include <string>
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+#include "TriVisBufferBuilder.h"
+#include "Triangulation_snapshot.h"
+#include "TriVisReplay.h"
+
+// Reads, repairs and builds the layer buffers of all the features in a file
+// on a worker thread.
+// Every finished layer is published through an atomic pointer, which the
+// GL thread takes over with takeLayer() and uploads on its next frame
+class TriVisLoader {
+public:
+  enum Layer {
+    Input = 0,
+    Triangulation,
+    TaggedTriangulation,
+    Output,
+    Quality,
+    NumLayers
+  };
+  
+  TriVisLoader();
+  ~TriVisLoader();
+  
+  void load(const std::string &filename);
+  void cancel();
+  
+  bool isLoading() const;
+  bool hasPendingLayers() const;
+  float progress() const;
+  const char *stage() const;
+  
+  // Returns NULL if the layer is not (yet) ready, the caller owns the buffer otherwise
+  TriVisBuffer *takeLayer(Layer layer);
+  
+  // Snapshots replace the input, triangulation and tagged triangulation layers
+  Triangulation_snapshot *takeSnapshot();
+  
+  // Replays replace all the layers while they are open
+  TriVisReplay *takeReplay();
+
+//private:
+  boost::thread worker;
+  std::atomic<bool> loading, cancelled;
+  std::atomic<float> currentProgress;
+  std::atomic<const char *> currentStage;
+  std::atomic<TriVisBuffer *> layers[NumLayers];
+  std::atomic<Triangulation_snapshot *> snapshot;
+  std::atomic<TriVisReplay *> replay;
+  
+  void run(std::string filename);
+  void runSnapshot(const std::string &filename);
+  void runReplay(const std::string &filename);
+  bool read(const std::string &filename, std::vector<OGRGeometry *> &geometries, std::vector<long> &fids);
+  void add(OGRGeometry *geometry, long fid, std::vector<OGRGeometry *> &geometries, std::vector<long> &fids);
+  void repair(OGRGeometry *geometry, long fid, std::size_t featureIndex, std::size_t numFeatures,
+              TriVisBuffer &triangulation, TriVisBuffer &quality, TriVisBuffer &taggedTriangulation, TriVisBuffer &output);
+  void publish(Layer layer, TriVisBuffer *buffer);
+  void discardLayers();
+};
+
+#endif
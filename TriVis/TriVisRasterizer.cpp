@@ -0,0 +1,207 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisRasterizer.h"
+#include "TriVisColours.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+
+// CRC-32 as used by PNG, the table is built before any worker thread starts
+struct TriVisCrcTable {
+  std::uint32_t entries[256];
+  
+  TriVisCrcTable() {
+    for (std::uint32_t currentEntry = 0; currentEntry < 256; ++currentEntry) {
+      std::uint32_t value = currentEntry;
+      for (int currentBit = 0; currentBit < 8; ++currentBit) value = (value & 1) ? 0xedb88320 ^ (value >> 1) : value >> 1;
+      entries[currentEntry] = value;
+    }
+  }
+};
+
+static const TriVisCrcTable crcTable;
+
+TriVisRasterizer::TriVisRasterizer(unsigned int width, unsigned int height) {
+  this->width = width;
+  this->height = height;
+  pixels.resize(3*width*height);
+  clear();
+  frame(0.0, 0.0, width, height);
+}
+
+void TriVisRasterizer::clear() {
+  for (std::size_t currentPixel = 0; currentPixel < width*height; ++currentPixel) {
+    pixels[3*currentPixel+0] = (std::uint8_t)(255.0f*palette[backgroundColour][0]+0.5f);
+    pixels[3*currentPixel+1] = (std::uint8_t)(255.0f*palette[backgroundColour][1]+0.5f);
+    pixels[3*currentPixel+2] = (std::uint8_t)(255.0f*palette[backgroundColour][2]+0.5f);
+  }
+}
+
+void TriVisRasterizer::frame(double minX, double minY, double maxX, double maxY) {
+  // Same aspect ratio in both axes, centred, with a small margin
+  this->minX = minX;
+  this->minY = minY;
+  double margin = 0.05*std::min(width, height);
+  double scaleX = maxX > minX ? (width-2.0*margin)/(maxX-minX) : HUGE_VAL;
+  double scaleY = maxY > minY ? (height-2.0*margin)/(maxY-minY) : HUGE_VAL;
+  scale = std::min(scaleX, scaleY);
+  if (scale == HUGE_VAL) scale = 1.0;
+  offsetX = (width-scale*(maxX-minX))/2.0;
+  offsetY = (height-scale*(maxY-minY))/2.0;
+}
+
+void TriVisRasterizer::drawLines(const TriVisBuffer &buffer) {
+  for (std::size_t currentElement = 0; currentElement+1 < buffer.elements.size(); currentElement += 2) {
+    double x0, y0, x1, y1;
+    toPixel(buffer, buffer.elements[currentElement], x0, y0);
+    toPixel(buffer, buffer.elements[currentElement+1], x1, y1);
+    const float *colour = paletteColour(buffer.colours[buffer.elements[currentElement]]);
+    
+    // One pixel per step along the longest axis
+    double steps = std::max(std::fabs(x1-x0), std::fabs(y1-y0));
+    if (steps > 4.0*(width+height)) continue;
+    int numSteps = (int)std::ceil(steps);
+    for (int currentStep = 0; currentStep <= numSteps; ++currentStep) {
+      double t = numSteps == 0 ? 0.0 : (double)currentStep/numSteps;
+      setPixel((int)std::floor(x0+t*(x1-x0)), (int)std::floor(y0+t*(y1-y0)), colour);
+    }
+  }
+}
+
+void TriVisRasterizer::drawTriangles(const TriVisBuffer &buffer) {
+  for (std::size_t currentElement = 0; currentElement+2 < buffer.elements.size(); currentElement += 3) {
+    double x[3], y[3];
+    for (int currentVertex = 0; currentVertex < 3; ++currentVertex) toPixel(buffer, buffer.elements[currentElement+currentVertex], x[currentVertex], y[currentVertex]);
+    const float *colour = paletteColour(buffer.colours[buffer.elements[currentElement]]);
+    double area = (x[1]-x[0])*(y[2]-y[0])-(x[2]-x[0])*(y[1]-y[0]);
+    if (area == 0.0) continue;
+    
+    // Pixel centres inside all three edges, whatever the orientation of the triangle
+    int minPixelX = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+    int maxPixelX = std::min((int)width-1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+    int minPixelY = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+    int maxPixelY = std::min((int)height-1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+    for (int pixelY = minPixelY; pixelY <= maxPixelY; ++pixelY) {
+      double centreY = pixelY+0.5;
+      for (int pixelX = minPixelX; pixelX <= maxPixelX; ++pixelX) {
+        double centreX = pixelX+0.5;
+        double w0 = (x[2]-x[1])*(centreY-y[1])-(y[2]-y[1])*(centreX-x[1]);
+        double w1 = (x[0]-x[2])*(centreY-y[2])-(y[0]-y[2])*(centreX-x[2]);
+        double w2 = (x[1]-x[0])*(centreY-y[0])-(y[1]-y[0])*(centreX-x[0]);
+        if (area > 0.0 ? (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0) : (w0 <= 0.0 && w1 <= 0.0 && w2 <= 0.0)) setPixel(pixelX, pixelY, colour);
+      }
+    }
+  }
+}
+
+bool TriVisRasterizer::writePNG(const std::string &filename) const {
+  std::vector<std::uint8_t> png;
+  const std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  png.insert(png.end(), signature, signature+8);
+  
+  // 8-bit RGB, no interlacing
+  std::vector<std::uint8_t> header;
+  appendBigEndian(header, width);
+  appendBigEndian(header, height);
+  const std::uint8_t format[] = {8, 2, 0, 0, 0};
+  header.insert(header.end(), format, format+5);
+  appendChunk(png, "IHDR", header);
+  
+  // Every row starts with filter type 0 (none)
+  std::vector<std::uint8_t> rows;
+  rows.reserve((3*width+1)*height);
+  for (unsigned int currentRow = 0; currentRow < height; ++currentRow) {
+    rows.push_back(0);
+    rows.insert(rows.end(), pixels.begin()+3*width*currentRow, pixels.begin()+3*width*(currentRow+1));
+  }
+  
+  // A zlib stream made of stored deflate blocks, followed by the Adler-32 of the rows
+  std::vector<std::uint8_t> data;
+  data.reserve(rows.size()+5*(rows.size()/65535+1)+6);
+  data.push_back(0x78);
+  data.push_back(0x01);
+  std::size_t firstByte = 0;
+  do {
+    std::size_t blockSize = std::min(rows.size()-firstByte, (std::size_t)65535);
+    data.push_back(firstByte+blockSize == rows.size() ? 1 : 0);
+    data.push_back(blockSize & 0xff);
+    data.push_back((blockSize >> 8) & 0xff);
+    data.push_back(~blockSize & 0xff);
+    data.push_back((~blockSize >> 8) & 0xff);
+    data.insert(data.end(), rows.begin()+firstByte, rows.begin()+firstByte+blockSize);
+    firstByte += blockSize;
+  } while (firstByte < rows.size());
+  std::uint32_t a = 1, b = 0;
+  for (std::size_t currentByte = 0; currentByte < rows.size(); ++currentByte) {
+    a = (a+rows[currentByte])%65521;
+    b = (b+a)%65521;
+  } appendBigEndian(data, (b << 16) | a);
+  appendChunk(png, "IDAT", data);
+  appendChunk(png, "IEND", std::vector<std::uint8_t>());
+  
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not create " << filename << std::endl;
+    return false;
+  } file.write(reinterpret_cast<const char *>(png.data()), png.size());
+  if (!file.good()) {
+    std::cerr << "Error: Could not write " << filename << std::endl;
+    return false;
+  } return true;
+}
+
+void TriVisRasterizer::toPixel(const TriVisBuffer &buffer, std::uint32_t vertex, double &x, double &y) const {
+  // Image rows go down
+  x = offsetX+scale*(buffer.positions[2*vertex+0]-minX);
+  y = height-(offsetY+scale*(buffer.positions[2*vertex+1]-minY));
+}
+
+void TriVisRasterizer::setPixel(int x, int y, const float *colour) {
+  if (x < 0 || y < 0 || x >= (int)width || y >= (int)height) return;
+  std::uint8_t *pixel = &pixels[3*((std::size_t)width*y+x)];
+  for (int currentChannel = 0; currentChannel < 3; ++currentChannel) pixel[currentChannel] = (std::uint8_t)(255.0f*colour[currentChannel]+0.5f);
+}
+
+void TriVisRasterizer::appendChunk(std::vector<std::uint8_t> &png, const char *type, const std::vector<std::uint8_t> &data) {
+  appendBigEndian(png, (std::uint32_t)data.size());
+  std::size_t typeStart = png.size();
+  png.insert(png.end(), type, type+4);
+  png.insert(png.end(), data.begin(), data.end());
+  appendBigEndian(png, crc(&png[typeStart], 4+data.size()));
+}
+
+void TriVisRasterizer::appendBigEndian(std::vector<std::uint8_t> &bytes, std::uint32_t value) {
+  bytes.push_back((value >> 24) & 0xff);
+  bytes.push_back((value >> 16) & 0xff);
+  bytes.push_back((value >> 8) & 0xff);
+  bytes.push_back(value & 0xff);
+}
+
+std::uint32_t TriVisRasterizer::crc(const std::uint8_t *bytes, std::size_t numBytes) {
+  std::uint32_t value = 0xffffffff;
+  for (std::size_t currentByte = 0; currentByte < numBytes; ++currentByte) value = crcTable.entries[(value ^ bytes[currentByte]) & 0xff] ^ (value >> 8);
+  return value ^ 0xffffffff;
+}
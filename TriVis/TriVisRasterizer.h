@@ -0,0 +1,60 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisRasterizer_h
+#define TriVis_TriVisRasterizer_h
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "TriVisBufferBuilder.h"
+
+// Draws layer buffers into an RGB image in memory, so that they can be
+// rendered without OpenGL or a window. Lines are one pixel wide and
+// triangles are filled with the colour of their first vertex, as in the
+// viewer where all the vertices of a primitive share a colour
+class TriVisRasterizer {
+public:
+  TriVisRasterizer(unsigned int width, unsigned int height);
+  
+  void clear();
+  void frame(double minX, double minY, double maxX, double maxY);
+  void drawLines(const TriVisBuffer &buffer);
+  void drawTriangles(const TriVisBuffer &buffer);
+  
+  // Uncompressed, so no zlib is needed
+  bool writePNG(const std::string &filename) const;
+
+//private:
+  unsigned int width, height;
+  std::vector<std::uint8_t> pixels;
+  double minX, minY, scale, offsetX, offsetY;
+  
+  void toPixel(const TriVisBuffer &buffer, std::uint32_t vertex, double &x, double &y) const;
+  void setPixel(int x, int y, const float *colour);
+  static void appendChunk(std::vector<std::uint8_t> &png, const char *type, const std::vector<std::uint8_t> &data);
+  static void appendBigEndian(std::vector<std::uint8_t> &bytes, std::uint32_t value);
+  static std::uint32_t crc(const std::uint8_t *bytes, std::size_t numBytes);
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <iostream>
+
+#include <boost/thread.hpp>
+
+#include "TriVisLoader.h"
+#include "TriVisBatchRenderer.h"
+
+// trivis_render FILE DIRECTORY [all|changed|failed] repairs every feature in
+// FILE and writes PNGs to DIRECTORY. It needs neither Cocoa nor OpenGL
+int main(int argc, const char * argv[]) {
+  if (argc < 3 || argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " FILE DIRECTORY [all|changed|failed]" << std::endl;
+    return 1;
+  }
+  
+  TriVisBatchRenderer renderer;
+  if (argc > 3 && std::strcmp(argv[3], "all") == 0) renderer.selection = TriVisBatchRenderer::All;
+  else if (argc > 3 && std::strcmp(argv[3], "changed") == 0) renderer.selection = TriVisBatchRenderer::Changed;
+  else if (argc > 3 && std::strcmp(argv[3], "failed") != 0) {
+    std::cerr << "Error: Unknown selection " << argv[3] << std::endl;
+    return 1;
+  }
+  
+  // The loader is only used to read, its constructor registers the drivers
+  TriVisLoader loader;
+  std::vector<OGRGeometry *> geometries;
+  std::vector<long> fids;
+  if (!loader.read(argv[1], geometries, fids)) return 1;
+  std::size_t numRendered = renderer.render(geometries, fids, argv[2], boost::thread::hardware_concurrency());
+  std::cout << "Rendered " << numRendered << " of " << geometries.size() << " features" << std::endl;
+  for (std::size_t currentFeature = 0; currentFeature < geometries.size(); ++currentFeature) delete geometries[currentFeature];
+  return 0;
+}
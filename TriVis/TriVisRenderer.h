@@ -37,10 +37,17 @@ struct TriVisSceneWrapper;
   float movementSpeed, rotationSpeed;
 }
 
-- (void) loadInput:(unsigned int)numVertices vertices:(GLfloat *)vertices;
-- (void) loadTriangulation:(unsigned int)numVertices vertices:(GLfloat *)vertices;
-- (void) loadTaggedTriangulation:(unsigned int)numVertices vertices:(GLfloat *)vertices;
-- (void) loadOutput:(unsigned int)numVertices vertices:(GLfloat *)vertices;
+- (void) loadInput:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements;
+- (void) loadTriangulation:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements;
+- (void) loadTaggedTriangulation:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements;
+- (void) loadOutput:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements;
+
+- (void) loadFile:(NSString *)filename;
+- (void) cancelLoading;
+- (BOOL) isLoading;
+- (float) loadingProgress;
+- (NSString *) loadingStage;
+- (void) uploadLoadedLayers;
 
 - (id) initWithDefaultFBO:(GLuint) defaultFBOName;
 - (void) resizeWithFrame:(NSRect)frame;
@@ -53,7 +60,16 @@ struct TriVisSceneWrapper;
 - (void) rotateBy:(CGFloat)degrees;
 - (void) center;
 
+- (void) selectNextFeature;
+- (void) selectPreviousFeature;
+- (void) showAllFeatures;
+
+- (BOOL) playReplay;
+- (void) stepReplay;
+- (void) restartReplay;
+
 - (void) viewMode:(unsigned int)mode;
+- (void) toggleQuality;
 
 - (void) movingLeft:(BOOL)ml;
 - (void) movingRight:(BOOL)mr;
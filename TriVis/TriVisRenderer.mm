@@ -22,27 +22,97 @@
 
 #import "TriVisRenderer.h"
 #import "TriVisScene.h"
+#import "TriVisLoader.h"
 
 struct TriVisSceneWrapper {
   TriVisScene *scene;
+  TriVisLoader *loader;
 };
 
 @implementation TriVisRenderer
 
-- (void) loadInput:(unsigned int)numVertices vertices:(GLfloat *)vertices {
-  sceneWrapper->scene->loadInput(numVertices, vertices);
+- (void) loadInput:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements {
+  sceneWrapper->scene->loadInput(numVertices, positions, colours, numElements, elements);
 }
 
-- (void) loadTriangulation:(unsigned int)numVertices vertices:(GLfloat *)vertices {
-  sceneWrapper->scene->loadTriangulation(numVertices, vertices);
+- (void) loadTriangulation:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements {
+  sceneWrapper->scene->loadTriangulation(numVertices, positions, colours, numElements, elements);
 }
 
-- (void) loadTaggedTriangulation:(unsigned int)numVertices vertices:(GLfloat *)vertices {
-  sceneWrapper->scene->loadTaggedTriangulation(numVertices, vertices);
+- (void) loadTaggedTriangulation:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements {
+  sceneWrapper->scene->loadTaggedTriangulation(numVertices, positions, colours, numElements, elements);
 }
 
-- (void) loadOutput:(unsigned int)numVertices vertices:(GLfloat *)vertices {
-  sceneWrapper->scene->loadOutput(numVertices, vertices);
+- (void) loadOutput:(unsigned int)numVertices positions:(GLdouble *)positions colours:(GLubyte *)colours numElements:(unsigned int)numElements elements:(GLuint *)elements {
+  sceneWrapper->scene->loadOutput(numVertices, positions, colours, numElements, elements);
+}
+
+- (void) loadFile:(NSString *)filename {
+  sceneWrapper->loader->load([filename UTF8String]);
+}
+
+- (void) cancelLoading {
+  sceneWrapper->loader->cancel();
+}
+
+- (BOOL) isLoading {
+  return sceneWrapper->loader->isLoading() || sceneWrapper->loader->hasPendingLayers();
+}
+
+- (float) loadingProgress {
+  return sceneWrapper->loader->progress();
+}
+
+- (NSString *) loadingStage {
+  return [NSString stringWithUTF8String:sceneWrapper->loader->stage()];
+}
+
+- (void) uploadLoadedLayers {
+  // Called from the GL thread, the buffers were built by the loader's worker
+  TriVisBuffer *buffer = sceneWrapper->loader->takeLayer(TriVisLoader::Input);
+  if (buffer != NULL) {
+    sceneWrapper->scene->loadInput(buffer->numVertices(), buffer->positions.data(), buffer->colours.data(), buffer->elements.size(), buffer->elements.data(), &buffer->features);
+    sceneWrapper->scene->center();
+    delete buffer;
+  }
+  
+  buffer = sceneWrapper->loader->takeLayer(TriVisLoader::Triangulation);
+  if (buffer != NULL) {
+    sceneWrapper->scene->loadTriangulation(buffer->numVertices(), buffer->positions.data(), buffer->colours.data(), buffer->elements.size(), buffer->elements.data(), &buffer->features);
+    delete buffer;
+  }
+  
+  buffer = sceneWrapper->loader->takeLayer(TriVisLoader::Quality);
+  if (buffer != NULL) {
+    sceneWrapper->scene->loadQuality(buffer->numVertices(), buffer->positions.data(), buffer->colours.data(), buffer->elements.size(), buffer->elements.data(), &buffer->features);
+    delete buffer;
+  }
+  
+  buffer = sceneWrapper->loader->takeLayer(TriVisLoader::TaggedTriangulation);
+  if (buffer != NULL) {
+    sceneWrapper->scene->loadTaggedTriangulation(buffer->numVertices(), buffer->positions.data(), buffer->colours.data(), buffer->elements.size(), buffer->elements.data(), &buffer->features);
+    delete buffer;
+  }
+  
+  Triangulation_snapshot *snapshot = sceneWrapper->loader->takeSnapshot();
+  if (snapshot != NULL) {
+    const Snapshot_header &header = snapshot->header();
+    sceneWrapper->scene->loadSnapshot(header.number_of_vertices, snapshot->vertices(), header.number_of_faces, header.number_of_interior_faces, snapshot->faces(), snapshot->face_bits());
+    sceneWrapper->scene->center();
+    delete snapshot;
+  }
+  
+  TriVisReplay *replay = sceneWrapper->loader->takeReplay();
+  if (replay != NULL) {
+    sceneWrapper->scene->loadReplay(replay);
+    sceneWrapper->scene->center();
+  }
+  
+  buffer = sceneWrapper->loader->takeLayer(TriVisLoader::Output);
+  if (buffer != NULL) {
+    sceneWrapper->scene->loadOutput(buffer->numVertices(), buffer->positions.data(), buffer->colours.data(), buffer->elements.size(), buffer->elements.data(), &buffer->features);
+    delete buffer;
+  }
 }
 
 - (void) resizeWithFrame:(NSRect)frame {
@@ -57,6 +127,7 @@ struct TriVisSceneWrapper {
   // Allocate the scene object
   sceneWrapper = new TriVisSceneWrapper();
   sceneWrapper->scene = new TriVisScene();
+  sceneWrapper->loader = new TriVisLoader();
   
   NSString *vertexShaderPath = [[NSBundle mainBundle] pathForResource:@"vertex" ofType:@"glsl"];
   NSStringEncoding encoding;
@@ -82,6 +153,7 @@ struct TriVisSceneWrapper {
 - (void) render {
 //  NSLog(@"[TriVisRenderer render]");
   
+  [self uploadLoadedLayers];
   sceneWrapper->scene->render();
 }
 
@@ -92,11 +164,13 @@ struct TriVisSceneWrapper {
   if (sceneWrapper->scene->movingUp) sceneWrapper->scene->move(0.0, -seconds*movementSpeed*sceneWrapper->scene->scale);
   if (sceneWrapper->scene->rotatingCW) sceneWrapper->scene->rotateBy(seconds*rotationSpeed);
   if (sceneWrapper->scene->rotatingCCW) sceneWrapper->scene->rotateBy(-seconds*rotationSpeed);
+  if (sceneWrapper->scene->playingReplay) sceneWrapper->scene->stepReplay(1);
 }
 
 - (void) dealloc {
   NSLog(@"[TriVisRenderer dealloc]");
   
+  delete sceneWrapper->loader;
   delete sceneWrapper->scene;
 }
 
@@ -117,6 +191,32 @@ struct TriVisSceneWrapper {
   sceneWrapper->scene->center();
 }
 
+- (void) selectNextFeature {
+  sceneWrapper->scene->selectNextFeature(1);
+}
+
+- (void) selectPreviousFeature {
+  sceneWrapper->scene->selectNextFeature(-1);
+}
+
+- (void) showAllFeatures {
+  sceneWrapper->scene->clearSelection();
+}
+
+- (BOOL) playReplay {
+  sceneWrapper->scene->playingReplay = !sceneWrapper->scene->playingReplay && sceneWrapper->scene->replay != NULL;
+  isAnimating = sceneWrapper->scene->needsToAnimate();
+  return sceneWrapper->scene->playingReplay;
+}
+
+- (void) stepReplay {
+  sceneWrapper->scene->stepReplay(1);
+}
+
+- (void) restartReplay {
+  sceneWrapper->scene->restartReplay();
+}
+
 - (void) viewMode:(unsigned int)mode {
   sceneWrapper->scene->showInput = false;
   sceneWrapper->scene->showTriangulation = false;
@@ -147,6 +247,10 @@ struct TriVisSceneWrapper {
   }
 }
 
+- (void) toggleQuality {
+  sceneWrapper->scene->showQuality = !sceneWrapper->scene->showQuality;
+}
+
 - (void) movingLeft: (BOOL)ml {
   sceneWrapper->scene->movingLeft = ml;
   if (ml) isAnimating = YES;
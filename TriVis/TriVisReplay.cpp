@@ -0,0 +1,290 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisReplay.h"
+
+#include <algorithm>
+
+static const std::uint32_t noSlot = 0xffffffff;
+
+TriVisReplay::TriVisReplay() : slots(noSlot) {
+  currentEvent = 0;
+  numDroppedEvents = 0;
+  originX = originY = 0.0;
+  numUploadedVertices = 0;
+  numConstrainedElements = numUnconstrainedElements = numEventElements = 0;
+  firstUnconstrainedElement = firstEventElement = 0;
+  numExpectedVertices = 2;
+  numPoolElements = 0;
+  isOverflowing = false;
+  builtDimension = -1;
+  currentVisit = 0;
+  isFullyDirty = true;
+}
+
+bool TriVisReplay::open(const std::string &filename) {
+  if (!Event_recorder::read(filename, events, numDroppedEvents)) return false;
+  if (numDroppedEvents > 0) std::cerr << "Error: " << numDroppedEvents << " events were dropped, the replay will differ" << std::endl;
+  
+  // Every vertex inserted by an event is close to its first point
+  if (!events.empty()) {
+    originX = events.front().a[0];
+    originY = events.front().a[1];
+  } numExpectedVertices = maxVertices();
+  restart();
+  return true;
+}
+
+void TriVisReplay::restart() {
+  triangulation.clear();
+  slots.clear(noSlot);
+  slotVertices.assign(2, Triangulation::Vertex_handle());
+  neighbours.assign(2, std::vector<Neighbour>());
+  visits.assign(2, 0);
+  expansions.assign(2, 0);
+  currentVisit = 0;
+  currentEvent = 0;
+  vertices.assign(4, 0.0f);
+  numUploadedVertices = 0;
+  rebuildElements(6*numExpectedVertices);
+  setEventElements();
+}
+
+void TriVisReplay::step(std::size_t numEvents) {
+  // The edges that change are around the vertices of the events
+  queuedVertices.clear();
+  for (std::size_t stepped = 0; stepped < numEvents && currentEvent < events.size(); ++stepped) {
+    const Triangulation_event &event = events[currentEvent];
+    triangulation.apply(event);
+    queuedVertices.push_back(triangulation.nearest_vertex(Triangulation::event_point(event.a)));
+    if (event.type != Triangulation_event::Insert_vertex) queuedVertices.push_back(triangulation.nearest_vertex(Triangulation::event_point(event.b)));
+    ++currentEvent;
+  } updateElements();
+  setEventElements();
+}
+
+bool TriVisReplay::isFinished() const {
+  return currentEvent >= events.size();
+}
+
+void TriVisReplay::takeDirtyRanges(std::vector<std::pair<std::size_t, std::size_t> > &ranges) {
+  ranges.clear();
+  if (isFullyDirty) ranges.push_back(std::make_pair((std::size_t)0, elements.size()));
+  else {
+    std::sort(dirtyElements.begin(), dirtyElements.end());
+    for (std::vector<std::size_t>::const_iterator element = dirtyElements.begin(); element != dirtyElements.end(); ++element) {
+      if (!ranges.empty() && ranges.back().first+ranges.back().second >= *element) ranges.back().second = *element+2-ranges.back().first;
+      else ranges.push_back(std::make_pair(*element, (std::size_t)2));
+    } ranges.push_back(std::make_pair(firstEventElement, (std::size_t)2));
+  } dirtyElements.clear();
+  isFullyDirty = false;
+}
+
+std::size_t TriVisReplay::numVertices() const {
+  return vertices.size()/2;
+}
+
+// Only insertions and intersections add vertices, at most one each
+std::size_t TriVisReplay::maxVertices() const {
+  std::size_t numInserting = 0;
+  for (std::vector<Triangulation_event>::const_iterator event = events.begin(); event != events.end(); ++event) {
+    if (event->type == Triangulation_event::Insert_vertex ||
+        event->type == Triangulation_event::Insert_intersection) ++numInserting;
+  } return 2+numInserting;
+}
+
+// A triangulation has at most 3V edges, in either pool, plus the event
+std::size_t TriVisReplay::maxElements() const {
+  return 2*6*numExpectedVertices+2;
+}
+
+std::uint32_t TriVisReplay::slot(Triangulation::Vertex_handle vertex) {
+  if (slots[vertex] == noSlot) {
+    slots[vertex] = (std::uint32_t)numVertices();
+    vertices.push_back(0.0f);
+    vertices.push_back(0.0f);
+    setVertex(slots[vertex], CGAL::to_double(vertex->point().x()), CGAL::to_double(vertex->point().y()));
+    slotVertices.push_back(vertex);
+    neighbours.push_back(std::vector<Neighbour>());
+    visits.push_back(0);
+    expansions.push_back(0);
+  } return slots[vertex];
+}
+
+void TriVisReplay::setVertex(std::size_t slot, double x, double y) {
+  vertices[2*slot+0] = (float)(x-originX);
+  vertices[2*slot+1] = (float)(y-originY);
+}
+
+void TriVisReplay::rebuildElements(std::size_t numElementsPerPool) {
+  numPoolElements = numElementsPerPool;
+  firstUnconstrainedElement = numPoolElements;
+  firstEventElement = 2*numPoolElements;
+  elements.assign(2*numPoolElements+2, 0);
+  numConstrainedElements = numUnconstrainedElements = 0;
+  freeConstrainedElements.clear();
+  freeUnconstrainedElements.clear();
+  for (std::vector<std::vector<Neighbour> >::iterator vertexNeighbours = neighbours.begin(); vertexNeighbours != neighbours.end(); ++vertexNeighbours) {
+    vertexNeighbours->clear();
+  }
+  
+  isOverflowing = false;
+  for (Triangulation::Finite_edges_iterator currentEdge = triangulation.finite_edges_begin(); currentEdge != triangulation.finite_edges_end(); ++currentEdge) {
+    addEdge(slot(currentEdge->first->vertex(Triangulation::cw(currentEdge->second))),
+            slot(currentEdge->first->vertex(Triangulation::ccw(currentEdge->second))),
+            triangulation.is_constrained(*currentEdge));
+    if (isOverflowing) {
+      rebuildElements(2*numPoolElements);
+      return;
+    }
+  } builtDimension = triangulation.dimension();
+  dirtyElements.clear();
+  isFullyDirty = true;
+}
+
+void TriVisReplay::updateElements() {
+  // Below two dimensions the triangulation is tiny and has no faces to circulate around
+  if (triangulation.dimension() < 2 || builtDimension < 2) {
+    rebuildElements(numPoolElements);
+    return;
+  }
+  
+  ++currentVisit;
+  while (!queuedVertices.empty()) {
+    Triangulation::Vertex_handle vertex = queuedVertices.back();
+    queuedVertices.pop_back();
+    if (vertex == Triangulation::Vertex_handle() || triangulation.is_infinite(vertex)) continue;
+    std::uint32_t vertexSlot = slot(vertex);
+    if (visits[vertexSlot] == currentVisit) continue;
+    visits[vertexSlot] = currentVisit;
+    updateVertex(vertex);
+  } if (isOverflowing) rebuildElements(2*numPoolElements);
+}
+
+// Compares the edges around a vertex with the ones in the pools
+void TriVisReplay::updateVertex(Triangulation::Vertex_handle vertex) {
+  std::uint32_t vertexSlot = slot(vertex);
+  std::vector<Neighbour> edges;
+  Triangulation::Edge_circulator currentEdge = triangulation.incident_edges(vertex), lastEdge = currentEdge;
+  do {
+    if (triangulation.is_infinite(currentEdge)) continue;
+    Triangulation::Vertex_handle other = currentEdge->first->vertex(Triangulation::cw(currentEdge->second));
+    if (other == vertex) other = currentEdge->first->vertex(Triangulation::ccw(currentEdge->second));
+    Neighbour neighbour;
+    neighbour.vertex = slot(other);
+    neighbour.element = 0;
+    neighbour.isConstrained = triangulation.is_constrained(*currentEdge);
+    edges.push_back(neighbour);
+  } while (++currentEdge != lastEdge);
+  
+  for (std::size_t currentNeighbour = 0; currentNeighbour < neighbours[vertexSlot].size();) {
+    const Neighbour &neighbour = neighbours[vertexSlot][currentNeighbour];
+    bool isKept = false;
+    for (std::vector<Neighbour>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+      if (edge->vertex == neighbour.vertex && edge->isConstrained == neighbour.isConstrained) isKept = true;
+    } if (isKept) {
+      ++currentNeighbour;
+      continue;
+    } queueNeighbours(vertexSlot);
+    queueNeighbours(neighbour.vertex);
+    removeEdge(vertexSlot, currentNeighbour);
+  }
+  
+  for (std::vector<Neighbour>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge) {
+    bool isStored = false;
+    for (std::vector<Neighbour>::const_iterator neighbour = neighbours[vertexSlot].begin(); neighbour != neighbours[vertexSlot].end(); ++neighbour) {
+      if (edge->vertex == neighbour->vertex && edge->isConstrained == neighbour->isConstrained) isStored = true;
+    } if (isStored) continue;
+    addEdge(vertexSlot, edge->vertex, edge->isConstrained);
+    queueNeighbours(vertexSlot);
+    queueNeighbours(edge->vertex);
+  }
+}
+
+void TriVisReplay::addEdge(std::uint32_t first, std::uint32_t second, bool isConstrained) {
+  std::vector<std::size_t> &freeElements = isConstrained ? freeConstrainedElements : freeUnconstrainedElements;
+  std::size_t &numUsedElements = isConstrained ? numConstrainedElements : numUnconstrainedElements;
+  Neighbour neighbour;
+  neighbour.isConstrained = isConstrained;
+  if (!freeElements.empty()) {
+    neighbour.element = freeElements.back();
+    freeElements.pop_back();
+  } else if (numUsedElements+2 <= numPoolElements) {
+    neighbour.element = (isConstrained ? 0 : firstUnconstrainedElement)+numUsedElements;
+    numUsedElements += 2;
+  } else {
+    isOverflowing = true;
+    return;
+  }
+  
+  elements[neighbour.element+0] = first;
+  elements[neighbour.element+1] = second;
+  dirtyElements.push_back(neighbour.element);
+  neighbour.vertex = second;
+  neighbours[first].push_back(neighbour);
+  neighbour.vertex = first;
+  neighbours[second].push_back(neighbour);
+}
+
+void TriVisReplay::removeEdge(std::uint32_t vertex, std::size_t neighbour) {
+  Neighbour removed = neighbours[vertex][neighbour];
+  elements[removed.element+0] = elements[removed.element+1] = 0;
+  dirtyElements.push_back(removed.element);
+  (removed.isConstrained ? freeConstrainedElements : freeUnconstrainedElements).push_back(removed.element);
+  neighbours[vertex][neighbour] = neighbours[vertex].back();
+  neighbours[vertex].pop_back();
+  std::vector<Neighbour> &otherNeighbours = neighbours[removed.vertex];
+  for (std::size_t currentNeighbour = 0; currentNeighbour < otherNeighbours.size(); ++currentNeighbour) {
+    if (otherNeighbours[currentNeighbour].element != removed.element) continue;
+    otherNeighbours[currentNeighbour] = otherNeighbours.back();
+    otherNeighbours.pop_back();
+    break;
+  }
+}
+
+// Edges that change are within one vertex of another edge that changed, e.g.
+// the two diagonals of a flip, so the neighbours of both ends are checked too
+void TriVisReplay::queueNeighbours(std::uint32_t vertex) {
+  if (expansions[vertex] == currentVisit || slotVertices[vertex] == Triangulation::Vertex_handle()) return;
+  expansions[vertex] = currentVisit;
+  queuedVertices.push_back(slotVertices[vertex]);
+  for (std::vector<Neighbour>::const_iterator neighbour = neighbours[vertex].begin(); neighbour != neighbours[vertex].end(); ++neighbour) {
+    queuedVertices.push_back(slotVertices[neighbour->vertex]);
+  } Triangulation::Vertex_circulator currentNeighbour = triangulation.incident_vertices(slotVertices[vertex]), lastNeighbour = currentNeighbour;
+  do {
+    if (!triangulation.is_infinite(currentNeighbour)) queuedVertices.push_back(currentNeighbour);
+  } while (++currentNeighbour != lastNeighbour);
+}
+
+// The next event to be applied, a single point is drawn as a degenerate line
+void TriVisReplay::setEventElements() {
+  numEventElements = 0;
+  elements[firstEventElement+0] = elements[firstEventElement+1] = 0;
+  if (currentEvent < events.size()) {
+    const Triangulation_event &event = events[currentEvent];
+    setVertex(0, event.a[0], event.a[1]);
+    if (event.type == Triangulation_event::Insert_vertex) setVertex(1, event.a[0], event.a[1]);
+    else setVertex(1, event.b[0], event.b[1]);
+    elements[firstEventElement+1] = 1;
+    numEventElements = 2;
+  }
+}
@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisReplay_h
+#define TriVis_TriVisReplay_h
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Definitions.h"
+
+// Rebuilds a triangulation from the events recorded by prepair, a few at a
+// time. Vertices keep their slot in the vertex buffer once they have one, and
+// edges keep their place in the element buffer until they are removed, so
+// every step only appends vertices and patches the elements of the edges that
+// changed. Slots 0 and 1 hold the endpoints of the current event
+class TriVisReplay {
+public:
+  typedef prepair::Triangulation Triangulation;
+  
+  std::vector<Triangulation_event> events;
+  std::size_t currentEvent;
+  std::uint64_t numDroppedEvents;
+  Triangulation triangulation;
+  
+  // Vertices are x, y offsets from the origin
+  double originX, originY;
+  std::vector<float> vertices;
+  std::size_t numUploadedVertices;
+  
+  // A pool of constrained edges, a pool of unconstrained edges and the current
+  // event. Pools are drawn up to their highest used element, removed edges
+  // are left as degenerate lines until their place is reused
+  std::vector<std::uint32_t> elements;
+  std::size_t numConstrainedElements, numUnconstrainedElements, numEventElements;
+  std::size_t firstUnconstrainedElement, firstEventElement;
+  
+  TriVisReplay();
+  
+  bool open(const std::string &filename);
+  void restart();
+  void step(std::size_t numEvents);
+  bool isFinished() const;
+  
+  // The first element and number of elements of every range changed since the last call
+  void takeDirtyRanges(std::vector<std::pair<std::size_t, std::size_t> > &ranges);
+  
+  std::size_t numVertices() const;
+  std::size_t maxVertices() const;
+  std::size_t maxElements() const;
+
+//private:
+  // Both ends of an edge list it, with the element where it starts
+  struct Neighbour {
+    std::uint32_t vertex;
+    std::size_t element;
+    bool isConstrained;
+  };
+  
+  CGAL::Unique_hash_map<Triangulation::Vertex_handle, std::uint32_t> slots;
+  std::vector<Triangulation::Vertex_handle> slotVertices;
+  std::vector<std::vector<Neighbour> > neighbours;
+  std::size_t numExpectedVertices, numPoolElements;
+  std::vector<std::size_t> freeConstrainedElements, freeUnconstrainedElements;
+  bool isOverflowing;
+  int builtDimension;
+  
+  // Vertices are visited once and their neighbours queued once per step
+  std::size_t currentVisit;
+  std::vector<std::size_t> visits, expansions;
+  std::vector<Triangulation::Vertex_handle> queuedVertices;
+  
+  std::vector<std::size_t> dirtyElements;
+  bool isFullyDirty;
+  
+  std::uint32_t slot(Triangulation::Vertex_handle vertex);
+  void setVertex(std::size_t slot, double x, double y);
+  void rebuildElements(std::size_t numElementsPerPool);
+  void updateElements();
+  void updateVertex(Triangulation::Vertex_handle vertex);
+  void addEdge(std::uint32_t first, std::uint32_t second, bool isConstrained);
+  void removeEdge(std::uint32_t vertex, std::size_t neighbour);
+  void queueNeighbours(std::uint32_t vertex);
+  void setEventElements();
+};
+
+#endif
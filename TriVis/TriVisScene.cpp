@@ -21,6 +21,14 @@
  */
 
 #include "TriVisScene.h"
+#include "TriVisReplay.h"
+#include "TriVisColours.h"
+
+#include <cmath>
+#include <unordered_set>
+
+// Large layers are copied into their buffers this much at a time
+static const std::size_t streamChunkSize = 4 << 20;
 
 TriVisScene::TriVisScene() {
   std::cout << "TriVisScene::TriVisScene()" << std::endl;
@@ -28,7 +36,8 @@ TriVisScene::TriVisScene() {
   width = 800;
   height = 600;
   
-  cameraPosition = GLKVector2Make(0.0, 0.0);
+  cameraPosition[0] = cameraPosition[1] = 0.0;
+  angle = 0.0;
   angle = 0.0;
   scale = 0.001;
   
@@ -48,6 +57,11 @@ TriVisScene::TriVisScene() {
   showTriangulation = false;
   showTaggedTriangulation = false;
   showOutput = false;
+  showQuality = false;
+  snapshotLoaded = false;
+  replay = NULL;
+  playingReplay = false;
+  replayVertexCapacity = replayElementCapacity = 0;
 }
 
 TriVisScene::~TriVisScene() {
@@ -58,20 +72,39 @@ TriVisScene::~TriVisScene() {
   glDeleteShader(vertexShader);
   
   glDeleteBuffers(1, &vboTest);
+  glDeleteBuffers(1, &cboTest);
   glDeleteVertexArrays(1, &vaoTest);
   glDeleteBuffers(1, &eboTest);
   
   glDeleteBuffers(1, &vboInput);
+  glDeleteBuffers(1, &cboInput);
+  glDeleteBuffers(1, &eboInput);
   glDeleteVertexArrays(1, &vaoInput);
   
   glDeleteBuffers(1, &vboTriangulation);
+  glDeleteBuffers(1, &cboTriangulation);
+  glDeleteBuffers(1, &eboTriangulation);
   glDeleteVertexArrays(1, &vaoTriangulation);
   
   glDeleteBuffers(1, &vboTaggedTriangulation);
+  glDeleteBuffers(1, &cboTaggedTriangulation);
+  glDeleteBuffers(1, &eboTaggedTriangulation);
   glDeleteVertexArrays(1, &vaoTaggedTriangulation);
   
   glDeleteBuffers(1, &vboOutput);
+  glDeleteBuffers(1, &cboOutput);
+  glDeleteBuffers(1, &eboOutput);
   glDeleteVertexArrays(1, &vaoOutput);
+  
+  glDeleteBuffers(1, &vboQuality);
+  glDeleteBuffers(1, &cboQuality);
+  glDeleteBuffers(1, &eboQuality);
+  glDeleteVertexArrays(1, &vaoQuality);
+  
+  glDeleteBuffers(1, &vboReplay);
+  glDeleteBuffers(1, &eboReplay);
+  glDeleteVertexArrays(1, &vaoReplay);
+  closeReplay();
 }
 
 void TriVisScene::createVertexShader(const char *source) {
@@ -121,171 +154,375 @@ void TriVisScene::initGL() {
   
   // Get the matrices and put the current values
   uniMVP = glGetUniformLocation(shaderProgram, "mvp");
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
+  loadMVPMatrix(0.0, 0.0);
+  
+  // The palette does not change
+  GLint uniPalette = glGetUniformLocation(shaderProgram, "palette");
+  glUniform3fv(uniPalette, numPaletteColours, &palette[0][0]);
   
   // Create objects for test
   glGenVertexArrays(1, &vaoTest);
   glGenBuffers(1, &vboTest);
+  glGenBuffers(1, &cboTest);
   glGenBuffers(1, &eboTest);
+  specifyLayout(vaoTest, vboTest, cboTest, eboTest);
   
   // Create objects for input
   glGenVertexArrays(1, &vaoInput);
   glGenBuffers(1, &vboInput);
+  glGenBuffers(1, &cboInput);
+  glGenBuffers(1, &eboInput);
+  specifyLayout(vaoInput, vboInput, cboInput, eboInput);
   
   // Create objects for triangulation
   glGenVertexArrays(1, &vaoTriangulation);
   glGenBuffers(1, &vboTriangulation);
+  glGenBuffers(1, &cboTriangulation);
+  glGenBuffers(1, &eboTriangulation);
+  specifyLayout(vaoTriangulation, vboTriangulation, cboTriangulation, eboTriangulation);
   
   // Create objects for tagged triangulation
   glGenVertexArrays(1, &vaoTaggedTriangulation);
   glGenBuffers(1, &vboTaggedTriangulation);
+  glGenBuffers(1, &cboTaggedTriangulation);
+  glGenBuffers(1, &eboTaggedTriangulation);
+  specifyLayout(vaoTaggedTriangulation, vboTaggedTriangulation, cboTaggedTriangulation, eboTaggedTriangulation);
   
   // Create objects for output
   glGenVertexArrays(1, &vaoOutput);
   glGenBuffers(1, &vboOutput);
+  glGenBuffers(1, &cboOutput);
+  glGenBuffers(1, &eboOutput);
+  specifyLayout(vaoOutput, vboOutput, cboOutput, eboOutput);
+  
+  // Create objects for the quality overlay
+  glGenVertexArrays(1, &vaoQuality);
+  glGenBuffers(1, &vboQuality);
+  glGenBuffers(1, &cboQuality);
+  glGenBuffers(1, &eboQuality);
+  specifyLayout(vaoQuality, vboQuality, cboQuality, eboQuality);
+  
+  // Create objects for replays
+  glGenVertexArrays(1, &vaoReplay);
+  glGenBuffers(1, &vboReplay);
+  glGenBuffers(1, &eboReplay);
+  
+  // Replays only have positions, the colours are set per kind of edge when drawing
+  specifyLayout(vaoReplay, vboReplay, 0, eboReplay);
   
   loadTestData();
 }
 
+// The matrices are column-major like in OpenGL and kept in double precision,
+// since at UTM or RD coordinates the translations alone would lose
+// centimetres in float
+static void multiplyMatrices(const GLdouble *a, const GLdouble *b, GLdouble *result) {
+  for (int column = 0; column < 4; ++column) {
+    for (int row = 0; row < 4; ++row) {
+      result[4*column+row] = 0.0;
+      for (int k = 0; k < 4; ++k) result[4*column+row] += a[4*k+row]*b[4*column+k];
+    }
+  }
+}
+
+static void makeIdentity(GLdouble *matrix) {
+  for (int element = 0; element < 16; ++element) matrix[element] = element%5 == 0 ? 1.0 : 0.0;
+}
+
 void TriVisScene::recomputeModelMatrix() {
-  model = GLKMatrix4MakeTranslation((minBounds.v[0]+maxBounds.v[0])/2.0, (minBounds.v[1]+maxBounds.v[1])/2.0, 0.0);
-  model = GLKMatrix4RotateZ(model, angle/57.29577951308233);
-  model = GLKMatrix4Translate(model, -(minBounds.v[0]+maxBounds.v[0])/2.0, -(minBounds.v[1]+maxBounds.v[1])/2.0, 0.0);
+  // Rotation around the centre of the bounds
+  GLdouble c = cos(angle/57.29577951308233), s = sin(angle/57.29577951308233);
+  GLdouble centreX = (minBounds[0]+maxBounds[0])/2.0, centreY = (minBounds[1]+maxBounds[1])/2.0;
+  makeIdentity(model);
+  model[0] = c;
+  model[1] = s;
+  model[4] = -s;
+  model[5] = c;
+  model[12] = centreX-c*centreX+s*centreY;
+  model[13] = centreY-s*centreX-c*centreY;
   recomputeMVPMatrix();
 }
 
 void TriVisScene::recomputeViewMatrix() {
-  view = GLKMatrix4MakeLookAt(cameraPosition.v[0], cameraPosition.v[1], 0.0, cameraPosition.v[0], cameraPosition.v[1], 1.0, 0.0, 1.0, 0.0);
+  // Same as GLKMatrix4MakeLookAt from the camera towards +z with +y up
+  makeIdentity(view);
+  view[0] = -1.0;
+  view[10] = -1.0;
+  view[12] = cameraPosition[0];
+  view[13] = -cameraPosition[1];
   recomputeMVPMatrix();
 }
 
 void TriVisScene::recomputeProjectionMatrix() {
-  projection = GLKMatrix4MakeOrtho(-width*scale, width*scale, -height*scale, height*scale, -10.0, 10.0);
+  // Same as GLKMatrix4MakeOrtho(-width*scale, width*scale, -height*scale, height*scale, -10.0, 10.0)
+  makeIdentity(projection);
+  projection[0] = 1.0/(width*scale);
+  projection[5] = 1.0/(height*scale);
+  projection[10] = -0.1;
   recomputeMVPMatrix();
 }
 
 void TriVisScene::recomputeMVPMatrix() {
-  mvp = GLKMatrix4Multiply(projection, GLKMatrix4Multiply(view, model));
+  GLdouble viewModel[16];
+  multiplyMatrices(view, model, viewModel);
+  multiplyMatrices(projection, viewModel, mvp);
 }
 
-void TriVisScene::loadInput(std::size_t numVertices, GLfloat *vertices) {
-  std::cout << "Loading " << numVertices << " input vertices..." << std::endl;
-  glBindBuffer(GL_ARRAY_BUFFER, vboInput);
-  glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(GLfloat), vertices, GL_STATIC_DRAW);
+void TriVisScene::loadMVPMatrix(double originX, double originY) {
+  // mvp times a translation to the origin, so the large terms cancel out in
+  // double precision and what is left is small enough for a float
+  GLfloat matrix[16];
+  for (int element = 0; element < 12; ++element) matrix[element] = mvp[element];
+  for (int row = 0; row < 4; ++row) matrix[12+row] = mvp[row]*originX+mvp[4+row]*originY+mvp[12+row];
+  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, matrix);
+}
+
+void TriVisScene::loadBuffers(GLuint vao, GLuint vbo, GLuint cbo, GLuint ebo, TriVisTiling &tiling, TriVisFeatureTable &layerFeatures, unsigned int primitiveSize, std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
+  // Features are selected through the tiles, where each one is a contiguous range per leaf
+  layerFeatures.clear();
+  std::vector<std::uint32_t> primitiveFeatures;
+  if (features != NULL && !features->ranges.empty()) {
+    layerFeatures = *features;
+    layerFeatures.getPrimitiveFeatures(primitiveSize, numElements, primitiveFeatures);
+  }
   
-  glBindVertexArray(vaoInput);
+  // The vertices and elements are uploaded in tile order, the tiles themselves stay on the CPU for culling
+  tiling.build(positions, colours, numVertices, elements, numElements, primitiveSize, primitiveFeatures.empty() ? NULL : primitiveFeatures.data());
+  std::cout << "Tiled into " << tiling.tiles.size() << " tiles with " << tiling.vertexColours.size() << " vertices and " << tiling.elements.size() << " elements" << std::endl;
   
-  // Specify the layout of the vertex data
+  // The element buffer binding is part of the VAO state
+  glBindVertexArray(vao);
+  streamBuffer(GL_ARRAY_BUFFER, vbo, tiling.vertices.size()*sizeof(GLfloat), tiling.vertices.data());
+  streamBuffer(GL_ARRAY_BUFFER, cbo, tiling.vertexColours.size()*sizeof(GLubyte), tiling.vertexColours.data());
+  streamBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo, tiling.elements.size()*sizeof(GLuint), tiling.elements.data());
+  std::vector<float>().swap(tiling.vertices);
+  std::vector<std::uint8_t>().swap(tiling.vertexColours);
+  std::vector<std::uint32_t>().swap(tiling.elements);
+  
+  // Without colours, they are set per layer when drawing
+  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
+  if (colours != NULL) glEnableVertexAttribArray(colAttrib);
+  else glDisableVertexAttribArray(colAttrib);
+}
+
+void TriVisScene::specifyLayout(GLuint vao, GLuint vbo, GLuint cbo, GLuint ebo) {
+  // The layout refers to the buffer objects and not to their storage, so it stays valid when they are refilled
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
   GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glEnableVertexAttribArray(posAttrib);
   glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), 0);
+                        2*sizeof(GLfloat), 0);
   GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
-  glEnableVertexAttribArray(colAttrib);
-  glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), (void *)(2*sizeof(float)));
-  
-  maxBounds = minBounds = GLKVector2Make(vertices[0], vertices[1]);
-  for (std::size_t currentVertex = 1; currentVertex < numVertices/5; ++currentVertex) {
-    if (vertices[5*currentVertex+0] < minBounds.v[0]) minBounds.v[0] = vertices[5*currentVertex+0];
-    if (vertices[5*currentVertex+1] < minBounds.v[1]) minBounds.v[1] = vertices[5*currentVertex+1];
-    if (vertices[5*currentVertex+0] > maxBounds.v[0]) maxBounds.v[0] = vertices[5*currentVertex+0];
-    if (vertices[5*currentVertex+1] > maxBounds.v[1]) maxBounds.v[1] = vertices[5*currentVertex+1];
-  } std::cout << "Bounds: Min(" << minBounds.v[0] << ", " << minBounds.v[1] << ") Max(" << maxBounds.v[0] << ", " << maxBounds.v[1] << ")" << std::endl;
+  if (cbo != 0) {
+    glBindBuffer(GL_ARRAY_BUFFER, cbo);
+    glEnableVertexAttribArray(colAttrib);
+    glVertexAttribIPointer(colAttrib, 1, GL_UNSIGNED_BYTE,
+                           sizeof(GLubyte), 0);
+  } else glDisableVertexAttribArray(colAttrib);
+}
+
+void TriVisScene::streamBuffer(GLenum target, GLuint buffer, std::size_t size, const GLvoid *data) {
+  // Buffers are reused between loads. Respecifying the storage orphans the
+  // old one, so the driver does not wait for the frames still drawing from
+  // it, and the storage only changes size for a much larger or smaller layer
+  glBindBuffer(target, buffer);
+  std::size_t &capacity = bufferCapacities[buffer];
+  if (size > capacity || 4*size < capacity) capacity = size;
+  glBufferData(target, capacity, NULL, GL_DYNAMIC_DRAW);
+  for (std::size_t offset = 0; offset < size; offset += streamChunkSize) {
+    glBufferSubData(target, offset, std::min(streamChunkSize, size-offset), static_cast<const GLubyte *>(data)+offset);
+  }
+}
+
+void TriVisScene::loadInput(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
+  std::cout << "Loading " << numVertices << " input vertices..." << std::endl;
+  loadBuffers(vaoInput, vboInput, cboInput, eboInput, tilingInput, featuresInput, 2, numVertices, positions, colours, numElements, elements, features);
+  snapshotLoaded = false;
+  closeReplay();
+  selectedFeatures.clear();
+  
+  computeBounds(numVertices, positions);
+  std::cout << "Bounds: Min(" << minBounds[0] << ", " << minBounds[1] << ") Max(" << maxBounds[0] << ", " << maxBounds[1] << ")" << std::endl;
   
   showTest = false;
   showInput = true;
 }
 
-void TriVisScene::loadTriangulation(std::size_t numVertices, GLfloat *vertices) {
+void TriVisScene::loadTriangulation(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
   std::cout << "Loading " << numVertices << " triangulation vertices..." << std::endl;
-  glBindBuffer(GL_ARRAY_BUFFER, vboTriangulation);
-  glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-  
-  glBindVertexArray(vaoTriangulation);
-  
-  // Specify the layout of the vertex data
-  GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-  glEnableVertexAttribArray(posAttrib);
-  glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), 0);
-  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
-  glEnableVertexAttribArray(colAttrib);
-  glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), (void *)(2*sizeof(float)));
+  loadBuffers(vaoTriangulation, vboTriangulation, cboTriangulation, eboTriangulation, tilingTriangulation, featuresTriangulation, 2, numVertices, positions, colours, numElements, elements, features);
 }
 
-void TriVisScene::loadTaggedTriangulation(std::size_t numVertices, GLfloat *vertices) {
+void TriVisScene::loadTaggedTriangulation(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
   std::cout << "Loading " << numVertices << " tagged triangulation vertices..." << std::endl;
-  glBindBuffer(GL_ARRAY_BUFFER, vboTaggedTriangulation);
-  glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(GLfloat), vertices, GL_STATIC_DRAW);
-  
-  glBindVertexArray(vaoTaggedTriangulation);
-  
-  // Specify the layout of the vertex data
-  GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-  glEnableVertexAttribArray(posAttrib);
-  glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), 0);
-  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
-  glEnableVertexAttribArray(colAttrib);
-  glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), (void *)(2*sizeof(float)));
+  loadBuffers(vaoTaggedTriangulation, vboTaggedTriangulation, cboTaggedTriangulation, eboTaggedTriangulation, tilingTaggedTriangulation, featuresTaggedTriangulation, 3, numVertices, positions, colours, numElements, elements, features);
 }
 
-void TriVisScene::loadOutput(std::size_t numVertices, GLfloat *vertices) {
+void TriVisScene::loadOutput(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
   std::cout << "Loading " << numVertices << " output vertices..." << std::endl;
-  glBindBuffer(GL_ARRAY_BUFFER, vboOutput);
-  glBufferData(GL_ARRAY_BUFFER, numVertices*sizeof(GLfloat), vertices, GL_STATIC_DRAW);
+  loadBuffers(vaoOutput, vboOutput, cboOutput, eboOutput, tilingOutput, featuresOutput, 2, numVertices, positions, colours, numElements, elements, features);
+}
+
+void TriVisScene::loadQuality(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features) {
+  std::cout << "Loading " << numElements/3 << " flagged faces..." << std::endl;
+  loadBuffers(vaoQuality, vboQuality, cboQuality, eboQuality, tilingQuality, featuresQuality, 3, numVertices, positions, colours, numElements, elements, features);
+}
+
+void TriVisScene::loadSnapshot(std::size_t numVertices, const GLdouble *vertices, std::size_t numFaces, std::size_t numInteriorFaces, const GLuint *faces, const GLubyte *faceBits) {
+  std::cout << "Loading snapshot with " << numVertices << " vertices and " << numFaces << " faces..." << std::endl;
+  
+  // Constrained edges stand in for the input, each is stored once
+  std::vector<GLuint> constrainedEdges;
+  std::unordered_set<std::uint64_t> seenEdges;
+  for (std::size_t currentFace = 0; currentFace < numFaces; ++currentFace) {
+    for (int currentEdge = 0; currentEdge < 3; ++currentEdge) {
+      if ((faceBits[currentFace] & (1 << currentEdge)) == 0) continue;
+      GLuint a = faces[3*currentFace+(currentEdge+1)%3], b = faces[3*currentFace+(currentEdge+2)%3];
+      if (!seenEdges.insert(((std::uint64_t)std::min(a, b) << 32) | std::max(a, b)).second) continue;
+      constrainedEdges.push_back(a);
+      constrainedEdges.push_back(b);
+    }
+  }
   
-  glBindVertexArray(vaoOutput);
+  // Interior faces are the first ones in a snapshot
+  // A snapshot is a single feature and its colours are set per layer when drawing
+  loadBuffers(vaoInput, vboInput, cboInput, eboInput, tilingInput, featuresInput, 2, numVertices, vertices, NULL, constrainedEdges.size(), constrainedEdges.data(), NULL);
+  loadBuffers(vaoTriangulation, vboTriangulation, cboTriangulation, eboTriangulation, tilingTriangulation, featuresTriangulation, 3, numVertices, vertices, NULL, 3*numFaces, faces, NULL);
+  loadBuffers(vaoTaggedTriangulation, vboTaggedTriangulation, cboTaggedTriangulation, eboTaggedTriangulation, tilingTaggedTriangulation, featuresTaggedTriangulation, 3, numVertices, vertices, NULL, 3*numInteriorFaces, faces, NULL);
+  snapshotLoaded = true;
+  closeReplay();
+  selectedFeatures.clear();
   
-  // Specify the layout of the vertex data
-  GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-  glEnableVertexAttribArray(posAttrib);
-  glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), 0);
-  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
-  glEnableVertexAttribArray(colAttrib);
-  glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), (void *)(2*sizeof(float)));
+  computeBounds(numVertices, vertices);
+  
+  showTest = false;
+  showInput = true;
+}
+
+void TriVisScene::loadReplay(TriVisReplay *newReplay) {
+  closeReplay();
+  replay = newReplay;
+  std::cout << "Loading replay with " << replay->events.size() << " events..." << std::endl;
+  
+  // The buffers are allocated once for the whole replay, every step only updates them in place
+  replayVertexCapacity = replay->maxVertices();
+  replayElementCapacity = replay->maxElements();
+  glBindVertexArray(vaoReplay);
+  glBindBuffer(GL_ARRAY_BUFFER, vboReplay);
+  glBufferData(GL_ARRAY_BUFFER, 2*replayVertexCapacity*sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboReplay);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, replayElementCapacity*sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+  uploadReplay();
+  
+  // Every point of the final triangulation appears in some event
+  std::vector<GLdouble> eventPoints;
+  eventPoints.reserve(4*replay->events.size());
+  for (std::vector<Triangulation_event>::const_iterator currentEvent = replay->events.begin(); currentEvent != replay->events.end(); ++currentEvent) {
+    eventPoints.insert(eventPoints.end(), currentEvent->a, currentEvent->a+2);
+    if (currentEvent->type != Triangulation_event::Insert_vertex) eventPoints.insert(eventPoints.end(), currentEvent->b, currentEvent->b+2);
+  } computeBounds(eventPoints.size()/2, eventPoints.data());
+  
+  snapshotLoaded = false;
+  selectedFeatures.clear();
+  showTest = false;
+}
+
+void TriVisScene::uploadReplay() {
+  if (replay == NULL) return;
+  glBindVertexArray(vaoReplay);
+  glBindBuffer(GL_ARRAY_BUFFER, vboReplay);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboReplay);
+  
+  // Only if an event added more vertices than expected
+  if (replay->numVertices() > replayVertexCapacity) {
+    replayVertexCapacity = 2*replay->numVertices();
+    glBufferData(GL_ARRAY_BUFFER, 2*replayVertexCapacity*sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    replay->numUploadedVertices = 0;
+  } if (replay->elements.size() > replayElementCapacity) {
+    replayElementCapacity = replay->elements.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, replayElementCapacity*sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+  }
+  
+  // The current event moves every step, the other vertices never do, so only new ones are sent
+  std::size_t firstVertex = replay->numUploadedVertices < 2 ? 2 : replay->numUploadedVertices;
+  glBufferSubData(GL_ARRAY_BUFFER, 0, 4*sizeof(GLfloat), replay->vertices.data());
+  if (replay->numVertices() > firstVertex) {
+    glBufferSubData(GL_ARRAY_BUFFER, 2*firstVertex*sizeof(GLfloat), 2*(replay->numVertices()-firstVertex)*sizeof(GLfloat), replay->vertices.data()+2*firstVertex);
+  } replay->numUploadedVertices = replay->numVertices();
+  
+  // Only the edges that an event added, removed or changed are sent. Growing the pools makes the whole buffer dirty
+  std::vector<std::pair<std::size_t, std::size_t> > dirtyRanges;
+  replay->takeDirtyRanges(dirtyRanges);
+  for (std::vector<std::pair<std::size_t, std::size_t> >::const_iterator dirtyRange = dirtyRanges.begin(); dirtyRange != dirtyRanges.end(); ++dirtyRange) {
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, dirtyRange->first*sizeof(GLuint), dirtyRange->second*sizeof(GLuint), replay->elements.data()+dirtyRange->first);
+  }
+}
+
+void TriVisScene::stepReplay(std::size_t numEvents) {
+  if (replay == NULL) return;
+  replay->step(numEvents);
+  uploadReplay();
+  if (replay->isFinished()) playingReplay = false;
+}
+
+void TriVisScene::restartReplay() {
+  if (replay == NULL) return;
+  replay->restart();
+  uploadReplay();
+}
+
+void TriVisScene::closeReplay() {
+  if (replay != NULL) delete replay;
+  replay = NULL;
+  playingReplay = false;
+}
+
+void TriVisScene::computeBounds(std::size_t numVertices, const GLdouble *positions) {
+  if (numVertices == 0) return;
+  minBounds[0] = maxBounds[0] = positions[0];
+  minBounds[1] = maxBounds[1] = positions[1];
+  for (std::size_t currentVertex = 1; currentVertex < numVertices; ++currentVertex) {
+    if (positions[2*currentVertex+0] < minBounds[0]) minBounds[0] = positions[2*currentVertex+0];
+    if (positions[2*currentVertex+1] < minBounds[1]) minBounds[1] = positions[2*currentVertex+1];
+    if (positions[2*currentVertex+0] > maxBounds[0]) maxBounds[0] = positions[2*currentVertex+0];
+    if (positions[2*currentVertex+1] > maxBounds[1]) maxBounds[1] = positions[2*currentVertex+1];
+  }
 }
 
 void TriVisScene::loadTestData() {
   
-  minBounds = GLKVector2Make(-0.5f, -0.5f);
-  maxBounds = GLKVector2Make(0.5f, 0.5f);
+  minBounds[0] = minBounds[1] = -0.5;
+  maxBounds[0] = maxBounds[1] = 0.5;
   
   GLfloat vertices[] = {
-    -0.5f,  0.5f, 1.0f, 0.0f, 0.0f, // Top-left
-    0.5f,  0.5f, 0.0f, 1.0f, 0.0f, // Top-right
-    0.5f, -0.5f, 0.0f, 0.0f, 1.0f, // Bottom-right
-    -0.5f, -0.5f, 1.0f, 1.0f, 1.0f  // Bottom-left
+    -0.5f,  0.5f, // Top-left
+    0.5f,  0.5f, // Top-right
+    0.5f, -0.5f, // Bottom-right
+    -0.5f, -0.5f  // Bottom-left
   };
   
-  glBindBuffer(GL_ARRAY_BUFFER, vboTest);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  GLubyte colours[] = {
+    interiorRingColour,
+    interiorFaceColour,
+    unconstrainedEdgeColour,
+    exteriorRingColour
+  };
   
   GLuint elements[] = {
     0, 1, 2,
     2, 3, 0
   };
   
+  // The layout was specified when creating the objects
+  glBindVertexArray(vaoTest);
+  glBindBuffer(GL_ARRAY_BUFFER, vboTest);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, cboTest);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(colours), colours, GL_STATIC_DRAW);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboTest);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), elements, GL_STATIC_DRAW);
-  
-  glBindVertexArray(vaoTest);
-  
-  // Specify the layout of the vertex data
-  GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-  glEnableVertexAttribArray(posAttrib);
-  glVertexAttribPointer(posAttrib, 2, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), 0);
-  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
-  glEnableVertexAttribArray(colAttrib);
-  glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE,
-                        5*sizeof(float), (void *)(2*sizeof(float)));
-  
 }
 
 void TriVisScene::resize(GLfloat width, GLfloat height) {
@@ -293,14 +530,13 @@ void TriVisScene::resize(GLfloat width, GLfloat height) {
   this->width = width;
   this->height = height;
   recomputeProjectionMatrix();
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
   glViewport(0, 0, width, height);
 }
 
 void TriVisScene::move(float x, float y) {
 //  std::cout << "TriVisScene::move(" << x << ", " << y << ")" << std::endl;
   if (x == 0.0 && y == 0.0) return;
-  moveTo(this->cameraPosition.v[0]+x, this->cameraPosition.v[1]+y);
+  moveTo(this->cameraPosition[0]+x, this->cameraPosition[1]+y);
 }
 
 void TriVisScene::scaleBy(float s) {
@@ -308,88 +544,179 @@ void TriVisScene::scaleBy(float s) {
   if (s == 1.0) return;
   this->scale *= s;
   recomputeProjectionMatrix();
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
 }
 
 void TriVisScene::rotateBy(float degrees) {
 //  std::cout << "TriVisScene::rotateBy(" << degrees << ")" << std::endl;
   angle += degrees;
   recomputeModelMatrix();
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
 }
 
 void TriVisScene::center() {
   angle = 0.0;
   recomputeModelMatrix();
-  
-  this->cameraPosition.v[0] = (minBounds.v[0]+maxBounds.v[0])/2.0;
-  this->cameraPosition.v[1] = (minBounds.v[1]+maxBounds.v[1])/2.0;
+  frame(minBounds[0], minBounds[1], maxBounds[0], maxBounds[1]);
+}
+
+void TriVisScene::frame(double minX, double minY, double maxX, double maxY) {
+  this->cameraPosition[0] = (minX+maxX)/2.0;
+  this->cameraPosition[1] = (minY+maxY)/2.0;
   recomputeViewMatrix();
   
-  GLfloat maxScaleX = (maxBounds.v[0]-minBounds.v[0])/width;
-  GLfloat maxScaleY = (maxBounds.v[1]-minBounds.v[1])/height;
+  GLfloat maxScaleX = (maxX-minX)/width;
+  GLfloat maxScaleY = (maxY-minY)/height;
 //  std::cout << "Current scale: " << scale << std::endl;
 //  std::cout << "Max scales: X=" << maxScaleX << " Y=" << maxScaleY << std::endl;
   if (maxScaleX > maxScaleY) {
     this->scale = maxScaleX/1.8;
   } else {
     this->scale = maxScaleY/1.8;
-  } recomputeProjectionMatrix();
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
+  } if (this->scale <= 0.0) this->scale = 0.001;
+  recomputeProjectionMatrix();
+}
+
+void TriVisScene::selectFeatures(const std::vector<long> &fids) {
+  selectedFeatures = fids;
+}
+
+void TriVisScene::selectNextFeature(int step) {
+  // Steps through the features of the input in load order and frames the selected one
+  if (featuresInput.ranges.empty()) return;
+  std::ptrdiff_t numFeatures = featuresInput.ranges.size();
+  std::ptrdiff_t currentFeature = -1;
+  if (selectedFeatures.size() == 1) {
+    for (std::ptrdiff_t feature = 0; feature < numFeatures; ++feature) {
+      if (featuresInput.ranges[feature].fid == selectedFeatures.front()) {
+        currentFeature = feature;
+        break;
+      }
+    }
+  } if (currentFeature == -1) currentFeature = step > 0 ? -1 : 0;
+  currentFeature = ((currentFeature+step)%numFeatures+numFeatures)%numFeatures;
+  
+  const TriVisFeatureRange &range = featuresInput.ranges[currentFeature];
+  selectedFeatures.assign(1, range.fid);
+  std::cout << "Feature " << range.fid << " (" << currentFeature+1 << "/" << numFeatures << ")" << std::endl;
+  if (range.numVertices > 0) {
+    angle = 0.0;
+    recomputeModelMatrix();
+    frame(range.minX, range.minY, range.maxX, range.maxY);
+  }
+}
+
+void TriVisScene::clearSelection() {
+  selectedFeatures.clear();
 }
 
-void TriVisScene::moveTo(float x, float y) {
+void TriVisScene::moveTo(double x, double y) {
 //  std::cout << "TriVisScene::moveTo()" << std::endl;
-  this->cameraPosition = GLKVector2Make(x, y);
+  this->cameraPosition[0] = x;
+  this->cameraPosition[1] = y;
   recomputeViewMatrix();
-  glUniformMatrix4fv(uniMVP, 1, GL_FALSE, mvp.m);
+}
+
+TriVisView TriVisScene::visibleView() {
+  // The projection spans 2*scale units per pixel, and the model matrix rotates around the centre of the bounds
+  return TriVisView(cameraPosition[0], cameraPosition[1], width*scale, height*scale, 2.0*scale,
+                    angle, (minBounds[0]+maxBounds[0])/2.0, (minBounds[1]+maxBounds[1])/2.0);
+}
+
+void TriVisScene::drawTiles(GLuint vao, GLenum mode, const TriVisTiling &tiling, const TriVisFeatureTable &features, const TriVisView &visible) {
+  drawRanges.clear();
+  if (selectedFeatures.empty()) tiling.cull(visible, drawRanges);
+  else {
+    features.getIndices(selectedFeatures, selectedIndices);
+    tiling.select(visible, selectedIndices, drawRanges);
+  } drawElementRanges(vao, mode);
+}
+
+void TriVisScene::drawElementRanges(GLuint vao, GLenum mode) {
+  // The ranges with the same origin go in a single call, the arrays are reused between frames
+  glBindVertexArray(vao);
+  std::size_t firstRange = 0;
+  while (firstRange < drawRanges.size()) {
+    drawCounts.clear();
+    drawOffsets.clear();
+    std::size_t currentRange = firstRange;
+    while (currentRange < drawRanges.size() &&
+           drawRanges[currentRange].originX == drawRanges[firstRange].originX &&
+           drawRanges[currentRange].originY == drawRanges[firstRange].originY) {
+      drawCounts.push_back((GLsizei)drawRanges[currentRange].numElements);
+      drawOffsets.push_back((const GLvoid *)(drawRanges[currentRange].firstElement*sizeof(GLuint)));
+      ++currentRange;
+    } loadMVPMatrix(drawRanges[firstRange].originX, drawRanges[firstRange].originY);
+    glMultiDrawElements(mode, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), (GLsizei)drawCounts.size());
+    firstRange = currentRange;
+  }
+}
+
+void TriVisScene::drawReplay() {
+  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
+  loadMVPMatrix(replay->originX, replay->originY);
+  glBindVertexArray(vaoReplay);
+  glVertexAttribI1ui(colAttrib, unconstrainedEdgeColour);
+  glDrawElements(GL_LINES, (GLsizei)replay->numUnconstrainedElements, GL_UNSIGNED_INT, (const GLvoid *)(replay->firstUnconstrainedElement*sizeof(GLuint)));
+  glVertexAttribI1ui(colAttrib, constrainedEdgeColour);
+  glDrawElements(GL_LINES, (GLsizei)replay->numConstrainedElements, GL_UNSIGNED_INT, 0);
+  glVertexAttribI1ui(colAttrib, currentEventColour);
+  glDrawElements(GL_LINES, (GLsizei)replay->numEventElements, GL_UNSIGNED_INT, (const GLvoid *)(replay->firstEventElement*sizeof(GLuint)));
 }
 
 void TriVisScene::render() {
 //  std::cout << "TriVisScene::render()" << std::endl;
   
-  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glClearColor(palette[backgroundColour][0], palette[backgroundColour][1], palette[backgroundColour][2], 1.0f);
   glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
   
   if (showTest) {
+    loadMVPMatrix(0.0, 0.0);
     glBindVertexArray(vaoTest);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboTest);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
   }
   
+  // A replay replaces all the layers
+  if (replay != NULL) {
+    drawReplay();
+    return;
+  }
+  
+  TriVisView visible = visibleView();
+  
+  // Snapshot layers have no per-vertex colours and their triangulation is made of faces
+  GLint colAttrib = glGetAttribLocation(shaderProgram, "color");
+  
   if (showInput) {
-    glBindBuffer(GL_ARRAY_BUFFER, vboInput);
-    glBindVertexArray(vaoInput);
-    int size;
-    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-    glDrawArrays(GL_LINES, 0, size/sizeof(GLfloat));
+    if (snapshotLoaded) glVertexAttribI1ui(colAttrib, constrainedEdgeColour);
+    drawTiles(vaoInput, GL_LINES, tilingInput, featuresInput, visible);
   }
   
   if (showTaggedTriangulation) {
-    glBindBuffer(GL_ARRAY_BUFFER, vboTaggedTriangulation);
-    glBindVertexArray(vaoTaggedTriangulation);
-    int size;
-    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-    glDrawArrays(GL_TRIANGLES, 0, size/sizeof(GLfloat));
+    if (snapshotLoaded) glVertexAttribI1ui(colAttrib, interiorFaceColour);
+    drawTiles(vaoTaggedTriangulation, GL_TRIANGLES, tilingTaggedTriangulation, featuresTaggedTriangulation, visible);
   }
   
   if (showTriangulation) {
-    glBindBuffer(GL_ARRAY_BUFFER, vboTriangulation);
-    glBindVertexArray(vaoTriangulation);
-    int size;
-    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-    glDrawArrays(GL_LINES, 0, size/sizeof(GLfloat));
+    if (snapshotLoaded) {
+      glVertexAttribI1ui(colAttrib, unconstrainedEdgeColour);
+      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+      drawTiles(vaoTriangulation, GL_TRIANGLES, tilingTriangulation, featuresTriangulation, visible);
+      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      glVertexAttribI1ui(colAttrib, constrainedEdgeColour);
+      drawTiles(vaoInput, GL_LINES, tilingInput, featuresInput, visible);
+    } else drawTiles(vaoTriangulation, GL_LINES, tilingTriangulation, featuresTriangulation, visible);
   }
   
   if (showOutput) {
-    glBindBuffer(GL_ARRAY_BUFFER, vboOutput);
-    glBindVertexArray(vaoOutput);
-    int size;
-    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-    glDrawArrays(GL_LINES, 0, size/sizeof(GLfloat));
+    drawTiles(vaoOutput, GL_LINES, tilingOutput, featuresOutput, visible);
+  }
+  
+  // Slivers and near-collinear constraints go over whatever else is shown
+  if (showQuality && !snapshotLoaded) {
+    drawTiles(vaoQuality, GL_TRIANGLES, tilingQuality, featuresQuality, visible);
   }
 }
 
 bool TriVisScene::needsToAnimate() {
-  return (movingLeft||movingRight||movingDown||movingUp||rotatingCW||rotatingCCW);
+  return (movingLeft||movingRight||movingDown||movingUp||rotatingCW||rotatingCCW||playingReplay);
 }
\ No newline at end of file
@@ -25,26 +25,45 @@
 
 #include <iostream>
 #include <vector>
+#include <unordered_map>
 #include <OpenGL/gl3.h>
-#include <GLKit/GLKMath.h>
+
+#include "TriVisTiling.h"
+#include "TriVisFeatureTable.h"
+
+class TriVisReplay;
 
 class TriVisScene {
 public:
-  GLKVector2 cameraPosition;
+  GLdouble cameraPosition[2];
   GLfloat scale, angle;
   GLfloat width, height;
   
-  GLKVector2 minBounds, maxBounds;
-  GLKMatrix4 model, view, projection, mvp;
+  GLdouble minBounds[2], maxBounds[2];
+  GLdouble model[16], view[16], projection[16], mvp[16];
   
   GLuint vertexShader, fragmentShader, shaderProgram;
   GLint uniMVP;
-  GLuint vboInput, vaoInput;
-  GLuint vboTriangulation, vaoTriangulation;
-  GLuint vboTaggedTriangulation, vaoTaggedTriangulation;
-  GLuint vboOutput, vaoOutput;
-  GLuint vboTest, vaoTest, eboTest;
-  bool showInput, showTriangulation, showTaggedTriangulation, showOutput, showTest;
+  GLuint vboInput, cboInput, vaoInput, eboInput;
+  GLuint vboTriangulation, cboTriangulation, vaoTriangulation, eboTriangulation;
+  GLuint vboTaggedTriangulation, cboTaggedTriangulation, vaoTaggedTriangulation, eboTaggedTriangulation;
+  GLuint vboOutput, cboOutput, vaoOutput, eboOutput;
+  GLuint vboQuality, cboQuality, vaoQuality, eboQuality;
+  std::unordered_map<GLuint, std::size_t> bufferCapacities;
+  bool snapshotLoaded;
+  GLuint vboReplay, vaoReplay, eboReplay;
+  std::size_t replayVertexCapacity, replayElementCapacity;
+  TriVisReplay *replay;
+  bool playingReplay;
+  TriVisTiling tilingInput, tilingTriangulation, tilingTaggedTriangulation, tilingOutput, tilingQuality;
+  TriVisFeatureTable featuresInput, featuresTriangulation, featuresTaggedTriangulation, featuresOutput, featuresQuality;
+  std::vector<long> selectedFeatures;
+  std::vector<std::uint32_t> selectedIndices;
+  std::vector<TriVisDrawRange> drawRanges;
+  std::vector<GLsizei> drawCounts;
+  std::vector<const GLvoid *> drawOffsets;
+  GLuint vboTest, cboTest, vaoTest, eboTest;
+  bool showInput, showTriangulation, showTaggedTriangulation, showOutput, showQuality, showTest;
   
   TriVisScene();
   ~TriVisScene();
@@ -57,11 +76,23 @@ public:
   void recomputeViewMatrix();
   void recomputeProjectionMatrix();
   void recomputeMVPMatrix();
+  void loadMVPMatrix(double originX, double originY);
   
-  void loadInput(std::size_t numVertices, GLfloat *vertices);
-  void loadTriangulation(std::size_t numVertices, GLfloat *vertices);
-  void loadTaggedTriangulation(std::size_t numVertices, GLfloat *vertices);
-  void loadOutput(std::size_t numVertices, GLfloat *vertices);
+  void specifyLayout(GLuint vao, GLuint vbo, GLuint cbo, GLuint ebo);
+  void streamBuffer(GLenum target, GLuint buffer, std::size_t size, const GLvoid *data);
+  void loadBuffers(GLuint vao, GLuint vbo, GLuint cbo, GLuint ebo, TriVisTiling &tiling, TriVisFeatureTable &layerFeatures, unsigned int primitiveSize, std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features);
+  void loadInput(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features = NULL);
+  void loadTriangulation(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features = NULL);
+  void loadTaggedTriangulation(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features = NULL);
+  void loadOutput(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features = NULL);
+  void loadQuality(std::size_t numVertices, const GLdouble *positions, const GLubyte *colours, std::size_t numElements, const GLuint *elements, const TriVisFeatureTable *features = NULL);
+  void loadSnapshot(std::size_t numVertices, const GLdouble *vertices, std::size_t numFaces, std::size_t numInteriorFaces, const GLuint *faces, const GLubyte *faceBits);
+  void loadReplay(TriVisReplay *newReplay);
+  void uploadReplay();
+  void stepReplay(std::size_t numEvents);
+  void restartReplay();
+  void closeReplay();
+  void computeBounds(std::size_t numVertices, const GLdouble *positions);
   void loadTestData();
   
   void resize(GLfloat width, GLfloat height);
@@ -70,8 +101,17 @@ public:
   void scaleBy(float s);
   void rotateBy(float degrees);
   void center();
+  void frame(double minX, double minY, double maxX, double maxY);
+  
+  void selectFeatures(const std::vector<long> &fids);
+  void selectNextFeature(int step);
+  void clearSelection();
   
-  void moveTo(float x, float y);
+  void moveTo(double x, double y);
+  TriVisView visibleView();
+  void drawTiles(GLuint vao, GLenum mode, const TriVisTiling &tiling, const TriVisFeatureTable &features, const TriVisView &visible);
+  void drawElementRanges(GLuint vao, GLenum mode);
+  void drawReplay();
   void render();
   
   bool needsToAnimate();
@@ -0,0 +1,345 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisTiling.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+static const std::size_t notSimplified = std::numeric_limits<std::size_t>::max();
+static const std::uint32_t notEncoded = std::numeric_limits<std::uint32_t>::max();
+
+struct CompareFeatures {
+  const std::uint32_t *features;
+  
+  CompareFeatures(const std::uint32_t *features) : features(features) {}
+  
+  bool operator()(std::size_t a, std::size_t b) const {
+    return features[a] < features[b];
+  }
+};
+
+TriVisView::TriVisView(double cameraX, double cameraY, double halfWidth, double halfHeight, double pixelSize) {
+  minX = cameraX-halfWidth;
+  minY = cameraY-halfHeight;
+  maxX = cameraX+halfWidth;
+  maxY = cameraY+halfHeight;
+  this->pixelSize = pixelSize;
+}
+
+TriVisView::TriVisView(double cameraX, double cameraY, double halfWidth, double halfHeight, double pixelSize,
+                       double degrees, double rotationCentreX, double rotationCentreY) {
+  // The model matrix rotates the data around the rotation centre, so the
+  // viewport is rotated back to get the visible part in data coordinates
+  double radians = degrees/57.29577951308233;
+  double c = cos(radians), s = sin(radians);
+  double dx = cameraX-rotationCentreX, dy = cameraY-rotationCentreY;
+  double centreX = rotationCentreX+c*dx+s*dy;
+  double centreY = rotationCentreY-s*dx+c*dy;
+  double rotatedHalfWidth = fabs(c)*halfWidth+fabs(s)*halfHeight;
+  double rotatedHalfHeight = fabs(s)*halfWidth+fabs(c)*halfHeight;
+  minX = centreX-rotatedHalfWidth;
+  minY = centreY-rotatedHalfHeight;
+  maxX = centreX+rotatedHalfWidth;
+  maxY = centreY+rotatedHalfHeight;
+  this->pixelSize = pixelSize;
+}
+
+bool TriVisTile::isSimplified() const {
+  return firstSimplifiedElement != notSimplified;
+}
+
+TriVisTiling::TriVisTiling() {
+  maxPrimitivesPerTile = 4096;
+  maxDepth = 16;
+  simplificationResolution = 128;
+  positions = NULL;
+  colours = NULL;
+  inputElements = NULL;
+  inputFeatures = NULL;
+  primitiveSize = 2;
+}
+
+void TriVisTiling::build(const double *positions, const std::uint8_t *colours, std::size_t numVertices, const std::uint32_t *elements, std::size_t numElements, unsigned int primitiveSize, const std::uint32_t *features) {
+  clear();
+  this->positions = positions;
+  this->colours = colours;
+  this->inputElements = elements;
+  this->inputFeatures = features;
+  this->primitiveSize = primitiveSize;
+  buildTiles(numVertices, numElements);
+}
+
+void TriVisTiling::buildTiles(std::size_t numVertices, std::size_t numElements) {
+  std::size_t numPrimitives = numElements/primitiveSize;
+  if (numPrimitives > 0) {
+    primitiveBounds.resize(4*numPrimitives);
+    primitiveCentroids.resize(2*numPrimitives);
+    std::vector<std::size_t> primitives(numPrimitives);
+    for (std::size_t currentPrimitive = 0; currentPrimitive < numPrimitives; ++currentPrimitive) {
+      double *bounds = &primitiveBounds[4*currentPrimitive];
+      const std::uint32_t *primitiveElements = &inputElements[primitiveSize*currentPrimitive];
+      bounds[0] = bounds[2] = positions[2*primitiveElements[0]];
+      bounds[1] = bounds[3] = positions[2*primitiveElements[0]+1];
+      double sumX = 0.0, sumY = 0.0;
+      for (unsigned int currentVertex = 0; currentVertex < primitiveSize; ++currentVertex) {
+        double x = positions[2*primitiveElements[currentVertex]];
+        double y = positions[2*primitiveElements[currentVertex]+1];
+        bounds[0] = std::min(bounds[0], x);
+        bounds[1] = std::min(bounds[1], y);
+        bounds[2] = std::max(bounds[2], x);
+        bounds[3] = std::max(bounds[3], y);
+        sumX += x;
+        sumY += y;
+      } primitiveCentroids[2*currentPrimitive] = sumX/primitiveSize;
+      primitiveCentroids[2*currentPrimitive+1] = sumY/primitiveSize;
+      primitives[currentPrimitive] = currentPrimitive;
+    }
+    
+    encodedVertices.assign(numVertices, notEncoded);
+    vertices.reserve(2*numVertices);
+    vertexColours.reserve(numVertices);
+    elements.reserve(2*numElements);
+    if (inputFeatures != NULL) primitiveFeatures.reserve(numPrimitives);
+    buildTile(primitives, 0);
+    
+    // Simplified versions go after all the full detail ones, each with its own vertices
+    std::size_t simplifiedOffset = elements.size();
+    elements.insert(elements.end(), simplifiedElements.begin(), simplifiedElements.end());
+    for (std::vector<TriVisTile>::iterator currentTile = tiles.begin(); currentTile != tiles.end(); ++currentTile) {
+      if (!currentTile->isSimplified()) continue;
+      currentTile->firstSimplifiedElement += simplifiedOffset;
+      encode(currentTile->firstSimplifiedElement, currentTile->numSimplifiedElements, currentTile->originX, currentTile->originY);
+    }
+  }
+  
+  // Only needed while building
+  std::vector<double>().swap(primitiveBounds);
+  std::vector<double>().swap(primitiveCentroids);
+  std::vector<std::uint32_t>().swap(simplifiedElements);
+  std::vector<std::uint32_t>().swap(encodedVertices);
+  positions = NULL;
+  colours = NULL;
+  inputElements = NULL;
+  inputFeatures = NULL;
+}
+
+void TriVisTiling::clear() {
+  tiles.clear();
+  vertices.clear();
+  vertexColours.clear();
+  elements.clear();
+  primitiveFeatures.clear();
+}
+
+void TriVisTiling::cull(const TriVisView &view, std::vector<TriVisDrawRange> &ranges) const {
+  if (tiles.empty()) return;
+  cullTile(0, view, ranges);
+}
+
+void TriVisTiling::select(const TriVisView &view, const std::vector<std::uint32_t> &features, std::vector<TriVisDrawRange> &ranges) const {
+  if (tiles.empty() || primitiveFeatures.empty() || features.empty()) return;
+  selectTile(0, view, features, ranges);
+}
+
+std::uint64_t TriVisTiling::getColour(std::uint32_t vertex) const {
+  if (colours == NULL) return 0;
+  return colours[vertex];
+}
+
+int TriVisTiling::buildTile(std::vector<std::size_t> &primitives, unsigned int depth) {
+  // Tiles are referred to by index since the vector grows during recursion
+  int tileIndex = (int)tiles.size();
+  tiles.push_back(TriVisTile());
+  TriVisTile tile;
+  for (int currentChild = 0; currentChild < 4; ++currentChild) tile.children[currentChild] = -1;
+  
+  tile.minX = tile.minY = std::numeric_limits<double>::max();
+  tile.maxX = tile.maxY = -std::numeric_limits<double>::max();
+  double minCentroidX = std::numeric_limits<double>::max(), minCentroidY = std::numeric_limits<double>::max();
+  double maxCentroidX = -std::numeric_limits<double>::max(), maxCentroidY = -std::numeric_limits<double>::max();
+  for (std::vector<std::size_t>::const_iterator currentPrimitive = primitives.begin(); currentPrimitive != primitives.end(); ++currentPrimitive) {
+    const double *bounds = &primitiveBounds[4**currentPrimitive];
+    tile.minX = std::min(tile.minX, bounds[0]);
+    tile.minY = std::min(tile.minY, bounds[1]);
+    tile.maxX = std::max(tile.maxX, bounds[2]);
+    tile.maxY = std::max(tile.maxY, bounds[3]);
+    minCentroidX = std::min(minCentroidX, primitiveCentroids[2**currentPrimitive]);
+    minCentroidY = std::min(minCentroidY, primitiveCentroids[2**currentPrimitive+1]);
+    maxCentroidX = std::max(maxCentroidX, primitiveCentroids[2**currentPrimitive]);
+    maxCentroidY = std::max(maxCentroidY, primitiveCentroids[2**currentPrimitive+1]);
+  } tile.originX = (tile.minX+tile.maxX)/2.0;
+  tile.originY = (tile.minY+tile.maxY)/2.0;
+  
+  simplify(primitives, tile);
+  
+  // Leaves are written in depth-first order, so the full detail version of
+  // any subtree is a contiguous range as well
+  tile.firstElement = elements.size();
+  bool isLeaf = primitives.size() <= maxPrimitivesPerTile || depth >= maxDepth ||
+                (minCentroidX == maxCentroidX && minCentroidY == maxCentroidY);
+  if (isLeaf) {
+    if (inputFeatures != NULL) {
+      std::stable_sort(primitives.begin(), primitives.end(), CompareFeatures(inputFeatures));
+    } for (std::vector<std::size_t>::const_iterator currentPrimitive = primitives.begin(); currentPrimitive != primitives.end(); ++currentPrimitive) {
+      for (unsigned int currentVertex = 0; currentVertex < primitiveSize; ++currentVertex) {
+        elements.push_back(inputElements[primitiveSize**currentPrimitive+currentVertex]);
+      } if (inputFeatures != NULL) primitiveFeatures.push_back(inputFeatures[*currentPrimitive]);
+    } tile.numElements = elements.size()-tile.firstElement;
+    encode(tile.firstElement, tile.numElements, tile.originX, tile.originY);
+    tiles[tileIndex] = tile;
+    return tileIndex;
+  }
+  
+  // Split by the centroids so that every primitive lands in exactly one child
+  double midX = (minCentroidX+maxCentroidX)/2.0;
+  double midY = (minCentroidY+maxCentroidY)/2.0;
+  std::vector<std::size_t> quadrants[4];
+  for (std::vector<std::size_t>::const_iterator currentPrimitive = primitives.begin(); currentPrimitive != primitives.end(); ++currentPrimitive) {
+    int quadrant = (primitiveCentroids[2**currentPrimitive] > midX ? 1 : 0) +
+                   (primitiveCentroids[2**currentPrimitive+1] > midY ? 2 : 0);
+    quadrants[quadrant].push_back(*currentPrimitive);
+  } std::vector<std::size_t>().swap(primitives);
+  
+  for (int currentQuadrant = 0; currentQuadrant < 4; ++currentQuadrant) {
+    if (quadrants[currentQuadrant].empty()) continue;
+    tile.children[currentQuadrant] = buildTile(quadrants[currentQuadrant], depth+1);
+  } tile.numElements = elements.size()-tile.firstElement;
+  tiles[tileIndex] = tile;
+  return tileIndex;
+}
+
+void TriVisTiling::simplify(const std::vector<std::size_t> &primitives, TriVisTile &tile) {
+  tile.firstSimplifiedElement = simplifiedElements.size();
+  double cellSize = std::max(tile.maxX-tile.minX, tile.maxY-tile.minY)/simplificationResolution;
+  
+  // Vertices of different colours are not merged so that the classes stay visible
+  std::unordered_map<std::uint64_t, std::uint32_t> representatives;
+  std::unordered_set<std::uint64_t> lines;
+  std::uint32_t simplified[3];
+  for (std::vector<std::size_t>::const_iterator currentPrimitive = primitives.begin(); currentPrimitive != primitives.end(); ++currentPrimitive) {
+    for (unsigned int currentVertex = 0; currentVertex < primitiveSize; ++currentVertex) {
+      std::uint32_t vertex = inputElements[primitiveSize**currentPrimitive+currentVertex];
+      double x = positions[2*vertex], y = positions[2*vertex+1];
+      std::uint64_t cellX = 0, cellY = 0;
+      if (cellSize > 0.0) {
+        cellX = std::min((std::uint64_t)((x-tile.minX)/cellSize), (std::uint64_t)simplificationResolution-1);
+        cellY = std::min((std::uint64_t)((y-tile.minY)/cellSize), (std::uint64_t)simplificationResolution-1);
+      } std::uint64_t colour = getColour(vertex);
+      std::uint64_t key = (colour << 40) | (cellY*simplificationResolution+cellX);
+      std::unordered_map<std::uint64_t, std::uint32_t>::iterator representative = representatives.find(key);
+      if (representative == representatives.end()) {
+        representative = representatives.insert(std::make_pair(key, vertex)).first;
+      } simplified[currentVertex] = representative->second;
+    }
+    
+    // Skip what collapsed into a point (or a segment for triangles) and duplicate lines
+    if (simplified[0] == simplified[1]) continue;
+    if (primitiveSize == 3) {
+      if (simplified[1] == simplified[2] || simplified[2] == simplified[0]) continue;
+    } else {
+      std::uint64_t line = ((std::uint64_t)std::min(simplified[0], simplified[1]) << 32) | std::max(simplified[0], simplified[1]);
+      if (!lines.insert(line).second) continue;
+    } for (unsigned int currentVertex = 0; currentVertex < primitiveSize; ++currentVertex) {
+      simplifiedElements.push_back(simplified[currentVertex]);
+    }
+  } tile.numSimplifiedElements = simplifiedElements.size()-tile.firstSimplifiedElement;
+  
+  // Not worth the memory when little was removed, the children (or the leaf) are drawn instead
+  if (2*tile.numSimplifiedElements > primitiveSize*primitives.size()) {
+    simplifiedElements.resize(tile.firstSimplifiedElement);
+    tile.firstSimplifiedElement = notSimplified;
+    tile.numSimplifiedElements = 0;
+  }
+}
+
+void TriVisTiling::encode(std::size_t firstElement, std::size_t numElements, double originX, double originY) {
+  // Vertices shared by several ranges are duplicated, each copy relative to the origin of its range
+  std::size_t firstVertex = vertexColours.size();
+  for (std::size_t currentElement = firstElement; currentElement < firstElement+numElements; ++currentElement) {
+    std::uint32_t vertex = elements[currentElement];
+    if (encodedVertices[vertex] == notEncoded || encodedVertices[vertex] < firstVertex) {
+      encodedVertices[vertex] = (std::uint32_t)vertexColours.size();
+      vertices.push_back((float)(positions[2*vertex]-originX));
+      vertices.push_back((float)(positions[2*vertex+1]-originY));
+      vertexColours.push_back(colours != NULL ? colours[vertex] : 0);
+    } elements[currentElement] = encodedVertices[vertex];
+  }
+}
+
+void TriVisTiling::cullTile(int tileIndex, const TriVisView &view, std::vector<TriVisDrawRange> &ranges) const {
+  const TriVisTile &tile = tiles[tileIndex];
+  if (!isVisible(tile, view)) return;
+  
+  // Simplified cells are at most a pixel across at this size on screen
+  double extent = std::max(tile.maxX-tile.minX, tile.maxY-tile.minY);
+  if (tile.isSimplified() && extent <= simplificationResolution*view.pixelSize) {
+    addRange(tile.firstSimplifiedElement, tile.numSimplifiedElements, tile, ranges);
+  } else if (tile.isLeaf()) {
+    addRange(tile.firstElement, tile.numElements, tile, ranges);
+  } else {
+    for (int currentChild = 0; currentChild < 4; ++currentChild) {
+      if (tile.children[currentChild] >= 0) cullTile(tile.children[currentChild], view, ranges);
+    }
+  }
+}
+
+void TriVisTiling::selectTile(int tileIndex, const TriVisView &view, const std::vector<std::uint32_t> &features, std::vector<TriVisDrawRange> &ranges) const {
+  const TriVisTile &tile = tiles[tileIndex];
+  if (!isVisible(tile, view)) return;
+  
+  if (!tile.isLeaf()) {
+    for (int currentChild = 0; currentChild < 4; ++currentChild) {
+      if (tile.children[currentChild] >= 0) selectTile(tile.children[currentChild], view, features, ranges);
+    } return;
+  }
+  
+  // Every feature is a contiguous run of primitives in a leaf
+  std::vector<std::uint32_t>::const_iterator firstPrimitive = primitiveFeatures.begin()+tile.firstElement/primitiveSize;
+  std::vector<std::uint32_t>::const_iterator lastPrimitive = firstPrimitive+tile.numElements/primitiveSize;
+  for (std::vector<std::uint32_t>::const_iterator currentFeature = features.begin(); currentFeature != features.end(); ++currentFeature) {
+    std::pair<std::vector<std::uint32_t>::const_iterator, std::vector<std::uint32_t>::const_iterator> run = std::equal_range(firstPrimitive, lastPrimitive, *currentFeature);
+    addRange(primitiveSize*(run.first-primitiveFeatures.begin()), primitiveSize*(run.second-run.first), tile, ranges);
+  }
+}
+
+bool TriVisTiling::isVisible(const TriVisTile &tile, const TriVisView &view) {
+  return tile.maxX >= view.minX && tile.minX <= view.maxX &&
+         tile.maxY >= view.minY && tile.minY <= view.maxY;
+}
+
+void TriVisTiling::addRange(std::size_t firstElement, std::size_t numElements, const TriVisTile &tile, std::vector<TriVisDrawRange> &ranges) {
+  if (numElements == 0) return;
+  if (!ranges.empty() && ranges.back().firstElement+ranges.back().numElements == firstElement &&
+      ranges.back().originX == tile.originX && ranges.back().originY == tile.originY) {
+    ranges.back().numElements += numElements;
+    return;
+  } TriVisDrawRange range;
+  range.firstElement = firstElement;
+  range.numElements = numElements;
+  range.originX = tile.originX;
+  range.originY = tile.originY;
+  ranges.push_back(range);
+}
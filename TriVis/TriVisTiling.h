@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisTiling_h
+#define TriVis_TriVisTiling_h
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// The part of the plane that is visible, as an axis-aligned box around the
+// rotated viewport. pixelSize is the size of a screen pixel in world units
+struct TriVisView {
+  double minX, minY, maxX, maxY;
+  double pixelSize;
+  
+  TriVisView(double cameraX, double cameraY, double halfWidth, double halfHeight, double pixelSize);
+  TriVisView(double cameraX, double cameraY, double halfWidth, double halfHeight, double pixelSize,
+             double degrees, double rotationCentreX, double rotationCentreY);
+};
+
+// The vertices of a range are offsets from its origin
+struct TriVisDrawRange {
+  std::size_t firstElement;
+  std::size_t numElements;
+  double originX, originY;
+};
+
+// A quadtree node. The full detail range covers all the primitives below the
+// node, and the simplified range is a coarser version of the same primitives
+struct TriVisTile {
+  double minX, minY, maxX, maxY;
+  double originX, originY;
+  int children[4];
+  std::size_t firstElement, numElements;
+  std::size_t firstSimplifiedElement, numSimplifiedElements;
+  
+  bool isLeaf() const {
+    return children[0] < 0 && children[1] < 0 && children[2] < 0 && children[3] < 0;
+  }
+  
+  bool isSimplified() const;
+};
+
+// Spatial tiling of an indexed layer, built on the CPU without any OpenGL
+// dependency. The elements are reordered so that every leaf and every
+// simplified version is a contiguous range; simplification snaps vertices to
+// a representative existing vertex in each cell of a grid over the tile.
+// Every such range gets its own block of vertices, stored as x, y float
+// offsets from the centre of the tile, with their palette colours in a
+// separate array. Their precision
+// thus depends on the size of the tile and not on the magnitude of the
+// coordinates, which in UTM or RD is enough to merge vertices a few
+// centimetres apart when they are stored as floats
+class TriVisTiling {
+public:
+  std::vector<TriVisTile> tiles;
+  std::vector<float> vertices;
+  std::vector<std::uint8_t> vertexColours;
+  std::vector<std::uint32_t> elements;
+  
+  // The feature of every full detail primitive, which are sorted by feature in each leaf
+  std::vector<std::uint32_t> primitiveFeatures;
+  
+  std::size_t maxPrimitivesPerTile;
+  unsigned int maxDepth;
+  unsigned int simplificationResolution;
+  
+  TriVisTiling();
+  
+  // Positions are x, y and colours one palette index per vertex. Without
+  // colours (such as in a snapshot) the vertices get index 0, and without features nothing
+  // can be selected
+  void build(const double *positions, const std::uint8_t *colours, std::size_t numVertices, const std::uint32_t *elements, std::size_t numElements, unsigned int primitiveSize, const std::uint32_t *features = NULL);
+  void clear();
+  
+  // Appends the ranges of elements to draw, merging consecutive ones
+  void cull(const TriVisView &view, std::vector<TriVisDrawRange> &ranges) const;
+  
+  // Same but in full detail and only for the given (sorted) features
+  void select(const TriVisView &view, const std::vector<std::uint32_t> &features, std::vector<TriVisDrawRange> &ranges) const;
+
+//private:
+  const double *positions;
+  const std::uint8_t *colours;
+  const std::uint32_t *inputElements;
+  const std::uint32_t *inputFeatures;
+  unsigned int primitiveSize;
+  std::vector<double> primitiveBounds;
+  std::vector<double> primitiveCentroids;
+  std::vector<std::uint32_t> simplifiedElements;
+  std::vector<std::uint32_t> encodedVertices;
+  
+  void buildTiles(std::size_t numVertices, std::size_t numElements);
+  std::uint64_t getColour(std::uint32_t vertex) const;
+  int buildTile(std::vector<std::size_t> &primitives, unsigned int depth);
+  void simplify(const std::vector<std::size_t> &primitives, TriVisTile &tile);
+  void encode(std::size_t firstElement, std::size_t numElements, double originX, double originY);
+  void cullTile(int tile, const TriVisView &view, std::vector<TriVisDrawRange> &ranges) const;
+  void selectTile(int tile, const TriVisView &view, const std::vector<std::uint32_t> &features, std::vector<TriVisDrawRange> &ranges) const;
+  static bool isVisible(const TriVisTile &tile, const TriVisView &view);
+  static void addRange(std::size_t firstElement, std::size_t numElements, const TriVisTile &tile, std::vector<TriVisDrawRange> &ranges);
+};
+
+#endif
@@ -40,8 +40,9 @@
   
   float scrollingSensitivity, rotationSensitivity;
   
-  // Test stuff
-  struct Polygon_repairWrapper *prepairWrapper;
+  // Background loading
+  NSTimer *loadingTimer;
+  NSString *loadingFilename;
 }
 
 - (IBAction) openFile:(id)sender;
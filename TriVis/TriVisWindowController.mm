@@ -22,12 +22,6 @@
 
 #import "TriVisWindowController.h"
 
-#import "Polygon_repair.h"
-
-struct Polygon_repairWrapper {
-  Polygon_repair *prepair;
-};
-
 @implementation TriVisWindowController
 
 - (id)initWithWindow:(NSWindow *)window {
@@ -41,8 +35,7 @@ struct Polygon_repairWrapper {
     scrollingSensitivity = 5.0;
     rotationSensitivity = 2.0;
     
-    prepairWrapper = new Polygon_repairWrapper();
-    prepairWrapper->prepair = new Polygon_repair();
+    loadingTimer = nil;
   }
   
   return self;
@@ -124,6 +117,18 @@ struct Polygon_repairWrapper {
 //  NSLog(@"Pressed key: %i", c);
   switch (c) {
     
+      // [A/a] show all features
+    case 0:
+      [view->renderer showAllFeatures];
+      [view drawView];
+      break;
+      
+      // [S/s] apply the next event of a replay
+    case 1:
+      [view->renderer stepReplay];
+      [view drawView];
+      break;
+      
       // [F/f] toggles full-screen mode
     case 3:
 			if(fullscreenWindow == nil) {
@@ -138,6 +143,18 @@ struct Polygon_repairWrapper {
       [view drawView];
       break;
       
+      // [Q/q] show or hide slivers and near-collinear constraints
+    case 12:
+      [view->renderer toggleQuality];
+      [view drawView];
+      break;
+      
+      // [R/r] restart a replay
+    case 15:
+      [view->renderer restartReplay];
+      [view drawView];
+      break;
+      
       // [1-4] set view mode
     case 18:
     case 19:
@@ -154,21 +171,41 @@ struct Polygon_repairWrapper {
 			} [self openFile:self];
       break;
       
+      // [P/p] select the previous feature
+    case 35:
+      [view->renderer selectPreviousFeature];
+      [view drawView];
+      break;
+      
       // [</,] rotate CCW
     case 43:
       [self startAnimation];
       [view->renderer rotatingCCW:true];
       break;
       
+      // [N/n] select the next feature
+    case 45:
+      [view->renderer selectNextFeature];
+      [view drawView];
+      break;
+      
       // [>/.] rotate CW
     case 47:
       [self startAnimation];
       [view->renderer rotatingCW:true];
       break;
       
-      // [Esc] closes full-screen mode
+      // [Space] play or pause a replay
+    case 49:
+      if ([view->renderer playReplay]) [self startAnimation];
+      else [self stopAnimation];
+      break;
+      
+      // [Esc] cancels loading or closes full-screen mode
 		case 53:
-			if (fullscreenWindow != nil) {
+      if ([view->renderer isLoading]) {
+        [view->renderer cancelLoading];
+      } else if (fullscreenWindow != nil) {
 				[self goWindow];
 			} return;
       
@@ -276,13 +313,33 @@ struct Polygon_repairWrapper {
 }
 
 - (void) stopAnimation {
-	if (!view->renderer->isAnimating) {
+	if (!view->renderer->isAnimating && ![view->renderer isLoading]) {
 		CVDisplayLinkStop(view->displayLink);
 	}
 }
 
+- (void) startLoading:(NSString *)filename {
+  // The display link keeps drawing (and so uploading finished layers) while loading
+  [self startAnimation];
+  loadingFilename = [filename lastPathComponent];
+  [loadingTimer invalidate];
+  loadingTimer = [NSTimer scheduledTimerWithTimeInterval:0.1 target:self selector:@selector(updateLoading:) userInfo:nil repeats:YES];
+}
+
+- (void) updateLoading:(NSTimer *)timer {
+  if ([view->renderer isLoading]) {
+    [[self currentWindow] setTitle:[NSString stringWithFormat:@"%@ - %@ (%.0f%%)", loadingFilename, [view->renderer loadingStage], 100.0*[view->renderer loadingProgress]]];
+    return;
+  }
+  
+  [timer invalidate];
+  loadingTimer = nil;
+  [[self currentWindow] setTitle:[NSString stringWithFormat:@"%@ - %@", loadingFilename, [view->renderer loadingStage]]];
+  [self stopAnimation];
+}
+
 - (IBAction) openFile:(id)sender {
-  NSArray *fileTypes = [NSArray arrayWithObjects:@"shp", @"geojson", @"txt", nil];
+  NSArray *fileTypes = [NSArray arrayWithObjects:@"shp", @"geojson", @"txt", @"snap", @"events", nil];
   NSOpenPanel *openPanel = [NSOpenPanel openPanel];
   
   [openPanel setAllowsMultipleSelection:NO];
@@ -296,309 +353,9 @@ struct Polygon_repairWrapper {
       NSString *filename = [[urls objectAtIndex:0] path];
 //      NSLog(@"Opening %@", filename);
       
-      OGRRegisterAll();
-      OGRGeometry *inGeometry, *outGeometry;
-      OGRDataSource *dataSource;
-      OGRLayer *dataLayer;
-      OGRFeature *feature;
-      
-      if ([filename hasSuffix:@".txt"]) {
-        NSStringEncoding *encoding = nullptr;
-        NSString *fileContents = [NSString stringWithContentsOfFile:filename usedEncoding:encoding error:NULL];
-        char *cstr = new char[[fileContents length]+1];
-        std::strcpy(cstr, [fileContents UTF8String]);
-//        std::cout << "WKT: " << cstr;
-        OGRGeometryFactory::createFromWkt(&cstr, NULL, &inGeometry);
-      }
-      
-      else {
-        dataSource = OGRSFDriverRegistrar::Open([filename UTF8String], false);
-        if (dataSource == NULL) {
-          NSLog(@"Error: Could not open file");
-          return;
-        } dataLayer = dataSource->GetLayer(0);
-        dataLayer->ResetReading();
-        feature = dataLayer->GetNextFeature();
-        if (feature->GetGeometryRef()->getGeometryType() == wkbPolygon ||
-            feature->GetGeometryRef()->getGeometryType() == wkbMultiPolygon) {
-          inGeometry = feature->GetGeometryRef();
-        } else {
-          NSLog(@"Error: Feature is not a polygon or multipolygon");
-          return;
-        }
-      }
-      
-//      char *input_wkt;
-//      inGeometry->exportToWkt(&input_wkt);
-//      NSLog(@"Input polygon: %s", input_wkt);
-      
-      std::vector<GLfloat> inputVertices;
-      if (inGeometry->getGeometryType() == wkbPolygon) {
-        OGRPolygon *polygon = static_cast<OGRPolygon *>(inGeometry);
-
-        for (int currentVertex = 0; currentVertex < polygon->getExteriorRing()->getNumPoints(); ++currentVertex) {
-          inputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex));
-          inputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex));
-          inputVertices.push_back(0.0);
-          inputVertices.push_back(0.0);
-          inputVertices.push_back(0.0);
-          if (currentVertex+1 < polygon->getExteriorRing()->getNumPoints()) {
-            inputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex+1));
-            inputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex+1));
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-          } else {
-            inputVertices.push_back(polygon->getExteriorRing()->getX(0));
-            inputVertices.push_back(polygon->getExteriorRing()->getY(0));
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-          }
-        }
-        for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
-          for (int currentVertex = 0; currentVertex < polygon->getInteriorRing(currentRing)->getNumPoints(); ++currentVertex) {
-            inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex));
-            inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex));
-            inputVertices.push_back(1.0);
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-            if (currentVertex+1 < polygon->getInteriorRing(currentRing)->getNumPoints()) {
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex+1));
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex+1));
-              inputVertices.push_back(1.0);
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-            } else {
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(0));
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(0));
-              inputVertices.push_back(1.0);
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-            }
-          }
-        }
-      } else if (inGeometry->getGeometryType() == wkbMultiPolygon) {
-        OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(inGeometry);
-        
-        for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
-          OGRPolygon *polygon = static_cast<OGRPolygon *>(multipolygon->getGeometryRef(current_polygon));
-          
-          for (int currentVertex = 0; currentVertex < polygon->getExteriorRing()->getNumPoints(); ++currentVertex) {
-            inputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex));
-            inputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex));
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-            inputVertices.push_back(0.0);
-            if (currentVertex+1 < polygon->getExteriorRing()->getNumPoints()) {
-              inputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex+1));
-              inputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex+1));
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-            } else {
-              inputVertices.push_back(polygon->getExteriorRing()->getX(0));
-              inputVertices.push_back(polygon->getExteriorRing()->getY(0));
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-            }
-          }
-          for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
-            for (int currentVertex = 0; currentVertex < polygon->getInteriorRing(currentRing)->getNumPoints(); ++currentVertex) {
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex));
-              inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex));
-              inputVertices.push_back(1.0);
-              inputVertices.push_back(0.0);
-              inputVertices.push_back(0.0);
-              if (currentVertex+1 < polygon->getInteriorRing(currentRing)->getNumPoints()) {
-                inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex+1));
-                inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex+1));
-                inputVertices.push_back(1.0);
-                inputVertices.push_back(0.0);
-                inputVertices.push_back(0.0);
-              } else {
-                inputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(0));
-                inputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(0));
-                inputVertices.push_back(1.0);
-                inputVertices.push_back(0.0);
-                inputVertices.push_back(0.0);
-              }
-            }
-          }
-        }
-      }
-      
-//      for (unsigned int currentVertex = 0; currentVertex < vertices.size(); ++currentVertex) {
-//        std::cout << vertices[currentVertex] << " ";
-//        if (currentVertex % 5 == 4) std::cout << std::endl;
-//      }
-      
-      [view->renderer loadInput:inputVertices.size() vertices:inputVertices.data()];
-      
-      prepairWrapper->prepair->insert_odd_even_constraints(inGeometry);
-      
-      if (![filename hasSuffix:@".txt"]) {
-        OGRFeature::DestroyFeature(feature);
-        OGRDataSource::DestroyDataSource(dataSource);
-      }
-      
-      std::vector<GLfloat> triangulationVertices;
-      for (prepair::Triangulation::Finite_edges_iterator current_edge = prepairWrapper->prepair->triangulation.finite_edges_begin(); current_edge != prepairWrapper->prepair->triangulation.finite_edges_end(); ++current_edge) {
-        triangulationVertices.push_back(CGAL::to_double(current_edge->first->vertex(prepair::Triangulation::cw(current_edge->second))->point().x()));
-        triangulationVertices.push_back(CGAL::to_double(current_edge->first->vertex(prepair::Triangulation::cw(current_edge->second))->point().y()));
-        if (prepairWrapper->prepair->triangulation.is_constrained(*current_edge)) {
-          triangulationVertices.push_back(0.0);
-          triangulationVertices.push_back(0.0);
-          triangulationVertices.push_back(0.0);
-        } else {
-          triangulationVertices.push_back(0.7);
-          triangulationVertices.push_back(0.7);
-          triangulationVertices.push_back(0.7);
-        }
-        
-        triangulationVertices.push_back(CGAL::to_double(current_edge->first->vertex(prepair::Triangulation::ccw(current_edge->second))->point().x()));
-        triangulationVertices.push_back(CGAL::to_double(current_edge->first->vertex(prepair::Triangulation::ccw(current_edge->second))->point().y()));
-        if (prepairWrapper->prepair->triangulation.is_constrained(*current_edge)) {
-          triangulationVertices.push_back(0.0);
-          triangulationVertices.push_back(0.0);
-          triangulationVertices.push_back(0.0);
-        } else {
-          triangulationVertices.push_back(0.7);
-          triangulationVertices.push_back(0.7);
-          triangulationVertices.push_back(0.7);
-        }
-      }
-      
-      [view->renderer loadTriangulation:triangulationVertices.size() vertices:triangulationVertices.data()];
-      
-      prepairWrapper->prepair->tag_odd_even();
-      
-      std::vector<GLfloat> taggedTriangulationVertices;
-      for (prepair::Triangulation::Finite_faces_iterator current_face = prepairWrapper->prepair->triangulation.finite_faces_begin(); current_face != prepairWrapper->prepair->triangulation.finite_faces_end(); ++current_face) {
-        if (current_face->info().is_in_interior()) {
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(0)->point().x()));
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(0)->point().y()));
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(0.0);
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(1)->point().x()));
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(1)->point().y()));
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(0.0);
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(2)->point().x()));
-          taggedTriangulationVertices.push_back(CGAL::to_double(current_face->vertex(2)->point().y()));
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(1.0);
-          taggedTriangulationVertices.push_back(0.0);
-        }
-      }
-      
-      [view->renderer loadTaggedTriangulation:taggedTriangulationVertices.size() vertices:taggedTriangulationVertices.data()];
-      
-      outGeometry = prepairWrapper->prepair->reconstruct();
-      
-      std::vector<GLfloat> outputVertices;
-      if (outGeometry->getGeometryType() == wkbPolygon) {
-        OGRPolygon *polygon = static_cast<OGRPolygon *>(outGeometry);
-        
-        for (int currentVertex = 0; currentVertex < polygon->getExteriorRing()->getNumPoints(); ++currentVertex) {
-          outputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex));
-          outputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex));
-          outputVertices.push_back(0.0);
-          outputVertices.push_back(0.0);
-          outputVertices.push_back(0.0);
-          if (currentVertex+1 < polygon->getExteriorRing()->getNumPoints()) {
-            outputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex+1));
-            outputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex+1));
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-          } else {
-            outputVertices.push_back(polygon->getExteriorRing()->getX(0));
-            outputVertices.push_back(polygon->getExteriorRing()->getY(0));
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-          }
-        }
-        for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
-          for (int currentVertex = 0; currentVertex < polygon->getInteriorRing(currentRing)->getNumPoints(); ++currentVertex) {
-            outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex));
-            outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex));
-            outputVertices.push_back(1.0);
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-            if (currentVertex+1 < polygon->getInteriorRing(currentRing)->getNumPoints()) {
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex+1));
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex+1));
-              outputVertices.push_back(1.0);
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-            } else {
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(0));
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(0));
-              outputVertices.push_back(1.0);
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-            }
-          }
-        }
-      } else if (outGeometry->getGeometryType() == wkbMultiPolygon) {
-        OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(inGeometry);
-        
-        for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
-          OGRPolygon *polygon = static_cast<OGRPolygon *>(multipolygon->getGeometryRef(current_polygon));
-          
-          for (int currentVertex = 0; currentVertex < polygon->getExteriorRing()->getNumPoints(); ++currentVertex) {
-            outputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex));
-            outputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex));
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-            outputVertices.push_back(0.0);
-            if (currentVertex+1 < polygon->getExteriorRing()->getNumPoints()) {
-              outputVertices.push_back(polygon->getExteriorRing()->getX(currentVertex+1));
-              outputVertices.push_back(polygon->getExteriorRing()->getY(currentVertex+1));
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-            } else {
-              outputVertices.push_back(polygon->getExteriorRing()->getX(0));
-              outputVertices.push_back(polygon->getExteriorRing()->getY(0));
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-            }
-          }
-          for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
-            for (int currentVertex = 0; currentVertex < polygon->getInteriorRing(currentRing)->getNumPoints(); ++currentVertex) {
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex));
-              outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex));
-              outputVertices.push_back(1.0);
-              outputVertices.push_back(0.0);
-              outputVertices.push_back(0.0);
-              if (currentVertex+1 < polygon->getInteriorRing(currentRing)->getNumPoints()) {
-                outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(currentVertex+1));
-                outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(currentVertex+1));
-                outputVertices.push_back(1.0);
-                outputVertices.push_back(0.0);
-                outputVertices.push_back(0.0);
-              } else {
-                outputVertices.push_back(polygon->getInteriorRing(currentRing)->getX(0));
-                outputVertices.push_back(polygon->getInteriorRing(currentRing)->getY(0));
-                outputVertices.push_back(1.0);
-                outputVertices.push_back(0.0);
-                outputVertices.push_back(0.0);
-              }
-            }
-          }
-        }
-      }
-      
-      [view->renderer loadOutput:outputVertices.size() vertices:outputVertices.data()];
-      
-      [view->renderer center];
+      // Reading and repairing happen on the loader's worker, the layers are uploaded as they are ready
+      [view->renderer loadFile:filename];
+      [self startLoading:filename];
     }
   }];
 }
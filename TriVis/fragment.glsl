@@ -1,9 +1,12 @@
 #version 150
 
-in vec3 Color;
+flat in uint ColorIndex;
+
+// Same as the palette in TriVisColours.h, unknown indices are black
+uniform vec3 palette[8];
 
 out vec4 outColor;
 
 void main() {
-  outColor = vec4(Color, 1.0);
+  outColor = vec4(ColorIndex < 8u ? palette[ColorIndex] : vec3(0.0), 1.0);
 }
\ No newline at end of file
@@ -22,22 +22,35 @@
 // Compile-time options
 // * if the code crashes, try to compile with EXACT_CONSTRUCTIONS so that
 //   robust arithmetic is used
+// * RECORD_EVENTS makes the triangulation able to record how it is built,
+//   see Triangulation_events.h
 
 #define EXACT_CONSTRUCTIONS
 //#define COORDS_3D
+//#define RECORD_EVENTS
 
 #ifndef DEFINITIONS_H
 #define DEFINITIONS_H
 
 #include "Triangle_info.h"
 #include "Edge_info.h"
+#include "Triangulation_events.h"
+#include "Work_budget.h"
 
 // STL
 #include <fstream>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
 
 // OGR
 #include <gdal/ogrsf_frmts.h>
 
+// Boost
+#include <boost/functional/hash.hpp>
+
 // CGAL
 #ifdef EXACT_CONSTRUCTIONS
 #include <CGAL/Exact_predicates_exact_constructions_kernel.h>
@@ -48,6 +61,7 @@
 #include <CGAL/Projection_traits_xy_3.h>
 #endif
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Unique_hash_map.h>
 
 #include "Compact_constrained_triangulation_face_base_2.h"
 #include "Triangulation_face_base_with_info_on_face_and_halfedges_2.h"
@@ -63,7 +77,7 @@ namespace prepair {
   typedef CGAL::Exact_predicates_inexact_constructions_kernel TK;
   typedef CGAL::Exact_predicates_tag IT;
 #endif
-  
+
 #ifdef COORDS_3D
   typedef CGAL::Projection_traits_xy_3<TK> K;
 #else
@@ -75,7 +89,11 @@ namespace prepair {
   typedef Triangulation_face_base_with_info_on_face_and_halfedges_2<Triangle_info, Edge_info, K, FB> FBWI;
   typedef CGAL::Triangulation_data_structure_2<VB, FBWI> TDS;
   typedef CGAL::Constrained_Delaunay_triangulation_2<K, TDS, IT> CDT;
+#ifdef RECORD_EVENTS
+  typedef Enhanced_constrained_triangulation_2<CDT, Event_recorder> Triangulation;
+#else
   typedef Enhanced_constrained_triangulation_2<CDT> Triangulation;
+#endif
   
   typedef K::Point_2 Point;
   typedef K::Vector_2 Vector;
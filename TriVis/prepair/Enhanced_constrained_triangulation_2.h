@@ -25,43 +25,49 @@
 #ifndef ENHANCED_TRIANGULATION_2_H
 #define ENHANCED_TRIANGULATION_2_H
 
-template <class T>
+// Recorder is a policy that is told about every step of the construction,
+// see Triangulation_events.h. The default one compiles to nothing
+template <class T, class Recorder = No_event_recorder>
 class Enhanced_constrained_triangulation_2;
 
-template <class T>
+template <class T, class Recorder>
 class Is_Delaunay {
 public:
   typedef T Triangulation;
   typedef typename Triangulation::List_edges List_edges;
   
-  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<T> &et, List_edges &e) {
+  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<T, Recorder> &et, List_edges &e) {
     std::cout << "Unknown triangulation: cannot make Delaunay" << std::endl;
   }
 };
 
-template <class K, class TDS, class Itag>
-class Is_Delaunay<CGAL::Constrained_Delaunay_triangulation_2<K, TDS, Itag> > {
+template <class K, class TDS, class Itag, class Recorder>
+class Is_Delaunay<CGAL::Constrained_Delaunay_triangulation_2<K, TDS, Itag>, Recorder> {
 public:
   typedef CGAL::Constrained_Delaunay_triangulation_2<K, TDS, Itag> Triangulation;
   typedef typename Triangulation::List_edges List_edges;
   
-  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<Triangulation> &et, List_edges &e) {
-    et.propagating_flip(e);
+  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<Triangulation, Recorder> &et, List_edges &e) {
+    for (typename List_edges::const_iterator current_edge = e.begin(); current_edge != e.end(); ++current_edge) {
+      et.recorder.record(Triangulation_event::Flip,
+                         current_edge->first->vertex(et.cw(current_edge->second))->point(),
+                         current_edge->first->vertex(et.ccw(current_edge->second))->point());
+    } et.propagating_flip(e);
   }
 };
 
-template <class K, class TDS, class Itag>
-class Is_Delaunay<CGAL::Constrained_triangulation_2<K, TDS, Itag> > {
+template <class K, class TDS, class Itag, class Recorder>
+class Is_Delaunay<CGAL::Constrained_triangulation_2<K, TDS, Itag>, Recorder> {
 public:
   typedef CGAL::Constrained_triangulation_2<K, TDS, Itag> Triangulation;
   typedef typename Triangulation::List_edges List_edges;
   
-  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<Triangulation> &et, List_edges &e) {
+  static void if_Delaunay_make_Delaunay(Enhanced_constrained_triangulation_2<Triangulation, Recorder> &et, List_edges &e) {
     // Do nothing
   }
 };
 
-template <class T>
+template <class T, class Recorder>
 class Enhanced_constrained_triangulation_2 : public T {
 public:
   typedef typename T::Point Point;
@@ -73,6 +79,13 @@ public:
   typedef typename T::List_faces List_faces;
   typedef typename T::List_edges List_edges;
   
+  Recorder recorder;
+  
+  // Every constraint insertion, including the recursive ones, spends a step. Ignored if NULL
+  Work_budget *budget;
+  
+  Enhanced_constrained_triangulation_2() : budget(NULL) {}
+  
   Vertex_handle insert(const Point &p, Face_handle f = Face_handle()) {
     // std::cout << "Enhanced_triangulation_2::insert(const Point &, Face_handle)" << std::endl;
     Locate_type location_type;
@@ -84,6 +97,7 @@ public:
   Vertex_handle insert(const Point &p, Locate_type &lt, Face_handle loc, int li) {
     // std::cout << "Enhanced_triangulation_2::insert(const Point &, Locate_type &, Face_handle, int)" << std::endl;
     // TODO: Read and reset info on faces & edges that are split because of the insertion
+    if (lt != T::VERTEX) recorder.record(Triangulation_event::Insert_vertex, p);
     return T::insert(p, lt, loc, li);
   }
   
@@ -95,6 +109,7 @@ public:
   
   void odd_even_insert_constraint(Vertex_handle va, Vertex_handle vb) {
     CGAL_triangulation_precondition(va != vb);
+    if (budget != NULL && !budget->spend()) return;
     
     // If [va, vb] lies on an existing edge
     Vertex_handle vertex_on_other_end;
@@ -102,11 +117,15 @@ public:
     int vertex_opposite_to_incident_edge;
     if (T::includes_edge(va, vb, vertex_on_other_end, incident_face, vertex_opposite_to_incident_edge)) {
       if (T::is_constrained(Edge(incident_face, vertex_opposite_to_incident_edge))) {
+        recorder.record(Triangulation_event::Remove_constraint, va->point(), vertex_on_other_end->point());
         T::remove_constrained_edge(incident_face, vertex_opposite_to_incident_edge);
         List_edges possibly_non_Delaunay_edges;
         possibly_non_Delaunay_edges.push_back(Edge(incident_face, vertex_opposite_to_incident_edge));
-        Is_Delaunay<T>::if_Delaunay_make_Delaunay(*this, possibly_non_Delaunay_edges);
-      } else T::mark_constraint(incident_face, vertex_opposite_to_incident_edge);
+        Is_Delaunay<T, Recorder>::if_Delaunay_make_Delaunay(*this, possibly_non_Delaunay_edges);
+      } else {
+        recorder.record(Triangulation_event::Mark_constraint, va->point(), vertex_on_other_end->point());
+        T::mark_constraint(incident_face, vertex_opposite_to_incident_edge);
+      }
       if (vertex_on_other_end != vb) odd_even_insert_constraint(vertex_on_other_end, vb);
       return;
     }
@@ -116,6 +135,7 @@ public:
     List_edges conflict_boundary_ab, conflict_boundary_ba;
     Vertex_handle intersection;
     if (T::find_intersected_faces(va, vb, intersected_faces, conflict_boundary_ab, conflict_boundary_ba, intersection)) {
+      recorder.record(Triangulation_event::Insert_intersection, va->point(), vb->point());
       if (intersection != va && intersection != vb) {
         odd_even_insert_constraint(va, intersection);
         odd_even_insert_constraint(intersection, vb);
@@ -124,11 +144,85 @@ public:
     }
     
     // Otherwise
+    recorder.record(Triangulation_event::Triangulate_hole, va->point(), vb->point());
     T::triangulate_hole(intersected_faces, conflict_boundary_ab, conflict_boundary_ba);
     if (intersection != vb) {
       odd_even_insert_constraint(intersection, vb);
     }
   }
+  
+  // The point of a recorded event
+  static Point event_point(const double coordinates[3]) {
+#ifdef COORDS_3D
+    return Point(coordinates[0], coordinates[1], coordinates[2]);
+#else
+    return Point(coordinates[0], coordinates[1]);
+#endif
+  }
+  
+  // Repeats a recorded step. Vertices created by intersections were recorded
+  // with rounded coordinates, so they are matched to the nearest vertex
+  void apply(const Triangulation_event &event) {
+    Point a = event_point(event.a);
+    Point b = event_point(event.b);
+    if (event.type == Triangulation_event::Insert_vertex) {
+      insert(a);
+      return;
+    }
+    
+    Vertex_handle va = nearest_vertex(a);
+    Vertex_handle vb = nearest_vertex(b);
+    if (va == Vertex_handle() || vb == Vertex_handle() || va == vb) return;
+    Face_handle incident_face;
+    int vertex_opposite_to_incident_edge;
+    switch (event.type) {
+      case Triangulation_event::Mark_constraint: {
+        if (T::is_edge(va, vb, incident_face, vertex_opposite_to_incident_edge)) T::mark_constraint(incident_face, vertex_opposite_to_incident_edge);
+        break;
+      }
+      
+      case Triangulation_event::Remove_constraint: {
+        if (T::is_edge(va, vb, incident_face, vertex_opposite_to_incident_edge)) T::remove_constrained_edge(incident_face, vertex_opposite_to_incident_edge);
+        break;
+      }
+      
+      case Triangulation_event::Flip: {
+        if (!T::is_edge(va, vb, incident_face, vertex_opposite_to_incident_edge)) break;
+        List_edges possibly_non_Delaunay_edges;
+        possibly_non_Delaunay_edges.push_back(Edge(incident_face, vertex_opposite_to_incident_edge));
+        Is_Delaunay<T, Recorder>::if_Delaunay_make_Delaunay(*this, possibly_non_Delaunay_edges);
+        break;
+      }
+      
+      // Finding the intersected faces is what splits crossed constraints
+      case Triangulation_event::Insert_intersection:
+      case Triangulation_event::Triangulate_hole: {
+        List_faces intersected_faces;
+        List_edges conflict_boundary_ab, conflict_boundary_ba;
+        Vertex_handle intersection;
+        if (T::find_intersected_faces(va, vb, intersected_faces, conflict_boundary_ab, conflict_boundary_ba, intersection)) break;
+        if (event.type == Triangulation_event::Triangulate_hole) T::triangulate_hole(intersected_faces, conflict_boundary_ab, conflict_boundary_ba);
+        break;
+      }
+      
+      default:
+        break;
+    }
+  }
+  
+  Vertex_handle nearest_vertex(const Point &p) {
+    if (T::dimension() < 0) return Vertex_handle();
+    Locate_type location_type;
+    int location_vertex;
+    Face_handle location = T::locate(p, location_type, location_vertex);
+    if (location_type == T::VERTEX) return location->vertex(location_vertex);
+    Vertex_handle nearest;
+    for (int vertex = 0; vertex < 3; ++vertex) {
+      if (location->vertex(vertex) == Vertex_handle() || T::is_infinite(location->vertex(vertex))) continue;
+      if (nearest == Vertex_handle() ||
+          CGAL::compare_distance_to_point(p, location->vertex(vertex)->point(), nearest->point()) == CGAL::SMALLER) nearest = location->vertex(vertex);
+    } return nearest;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Feature_reader.h"
+
+// Boost
+#include <boost/bind.hpp>
+
+Feature_reader::Feature_reader(OGRLayer *layer, std::size_t capacity) : layer(layer), first_fid(OGRNullFID), last_fid(OGRNullFID), shard(0), number_of_shards(1), ring(capacity < 1 ? 1 : capacity), first_ready(0), number_ready(0), finished(false), stopping(false) {}
+
+Feature_reader::~Feature_reader() {
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    stopping = true;
+    not_full.notify_all();
+  } if (reader.joinable()) reader.join();
+  
+  // Features read ahead but never asked for
+  for (std::size_t current_feature = 0; current_feature < number_ready; ++current_feature) {
+    delete ring[(first_ready+current_feature)%ring.size()].geometry;
+  }
+}
+
+void Feature_reader::set_fid_range(long first_fid, long last_fid) {
+  this->first_fid = first_fid;
+  this->last_fid = last_fid;
+}
+
+void Feature_reader::set_shard(std::size_t shard, std::size_t number_of_shards) {
+  this->shard = shard;
+  this->number_of_shards = number_of_shards;
+}
+
+void Feature_reader::start() {
+  layer->ResetReading();
+  reader = boost::thread(boost::bind(&Feature_reader::read, this));
+}
+
+bool Feature_reader::next(OGRGeometry *&geometry, long &fid) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while (number_ready == 0 && !finished) not_empty.wait(lock);
+  if (number_ready == 0) return false;
+  geometry = ring[first_ready].geometry;
+  fid = ring[first_ready].fid;
+  first_ready = (first_ready+1)%ring.size();
+  --number_ready;
+  not_full.notify_one();
+  return true;
+}
+
+void Feature_reader::read() {
+  while (true) {
+    OGRFeature *feature = layer->GetNextFeature();
+    if (feature == NULL) break;
+    Read_feature read_feature;
+    read_feature.fid = feature->GetFID();
+    if ((first_fid != OGRNullFID && (read_feature.fid < first_fid || read_feature.fid > last_fid)) ||
+        (number_of_shards > 1 && (read_feature.fid < 0 || (std::size_t)read_feature.fid % number_of_shards != shard))) {
+      OGRFeature::DestroyFeature(feature);
+      
+      // Long runs of rejected features would otherwise keep a stopped reader going
+      boost::lock_guard<boost::mutex> lock(mutex);
+      if (stopping) return;
+      continue;
+    } read_feature.geometry = feature->StealGeometry();
+    OGRFeature::DestroyFeature(feature);
+    
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (number_ready == ring.size() && !stopping) not_full.wait(lock);
+    if (stopping) {
+      delete read_feature.geometry;
+      return;
+    } ring[(first_ready+number_ready)%ring.size()] = read_feature;
+    ++number_ready;
+    not_empty.notify_one();
+  }
+  
+  boost::lock_guard<boost::mutex> lock(mutex);
+  finished = true;
+  not_empty.notify_all();
+}
@@ -0,0 +1,81 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef FEATUREREADER_H
+#define FEATUREREADER_H
+
+// STL
+#include <vector>
+
+// OGR
+#include <gdal/ogrsf_frmts.h>
+
+// Boost
+#include <boost/thread.hpp>
+
+// Reads the features of a layer on a thread of its own, so that reading and
+// decoding overlap with the repair. Up to capacity geometries wait in a ring
+// buffer for next(). Spatial and attribute filters are set on the layer
+// before start(). The layer must not be used by anything else until the
+// reader is destroyed
+class Feature_reader {
+public:
+  Feature_reader(OGRLayer *layer, std::size_t capacity);
+  ~Feature_reader();
+  
+  // Only features with first_fid <= FID <= last_fid are handed over. Putting
+  // the range in the attribute filter as well lets the drivers that can, e.g.
+  // those backed by a database, skip the rest without reading it. Called
+  // before start()
+  void set_fid_range(long first_fid, long last_fid);
+  
+  // Only features whose FID is shard modulo number_of_shards are handed over.
+  // The others are dropped before their geometry is taken. Called before start()
+  void set_shard(std::size_t shard, std::size_t number_of_shards);
+  
+  void start();
+  
+  // Waits for the next feature and hands over its geometry, which is NULL for
+  // features without one. Returns false only once the layer is exhausted, and
+  // from then on
+  bool next(OGRGeometry *&geometry, long &fid);
+
+//private:
+  struct Read_feature {
+    OGRGeometry *geometry;
+    long fid;
+  };
+  
+  OGRLayer *layer;
+  long first_fid, last_fid;
+  std::size_t shard, number_of_shards;
+  std::vector<Read_feature> ring;
+  std::size_t first_ready, number_ready;
+  bool finished, stopping;
+  boost::mutex mutex;
+  boost::condition_variable not_empty, not_full;
+  boost::thread reader;
+  
+  void read();
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef LOCATEHINTS_H
+#define LOCATEHINTS_H
+
+// STL
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// CGAL
+#include <CGAL/number_utils.h>
+
+// A coarse grid over the input that keeps the last vertex inserted in every
+// cell. Walking from the previous vertex is fast along a ring, but the first
+// vertex of a ring can be anywhere, and a walk from the end of the previous
+// ring may then cross the whole triangulation. Vertices are never removed
+// during the construction, so their handles stay valid while faces come and go
+template <class T>
+class Locate_hints {
+public:
+  typedef typename T::Vertex_handle Vertex_handle;
+  typedef typename T::Face_handle Face_handle;
+  typedef typename T::Point Point;
+  
+  Locate_hints() : number_of_columns(0), number_of_rows(0), number_of_filled_cells(0) {}
+  
+  // Covers the bounding box of the rings with about one cell per points_per_cell points
+  void reset(const std::vector<std::vector<Point> > &rings, std::size_t points_per_cell = 16) {
+    clear();
+    std::size_t number_of_points = 0;
+    for (typename std::vector<std::vector<Point> >::const_iterator current_ring = rings.begin(); current_ring != rings.end(); ++current_ring) {
+      for (typename std::vector<Point>::const_iterator current_point = current_ring->begin(); current_point != current_ring->end(); ++current_point) {
+        double x = CGAL::to_double(current_point->x()), y = CGAL::to_double(current_point->y());
+        if (number_of_points == 0) {
+          min_x = max_x = x;
+          min_y = max_y = y;
+        } else {
+          min_x = std::min(min_x, x);
+          max_x = std::max(max_x, x);
+          min_y = std::min(min_y, y);
+          max_y = std::max(max_y, y);
+        } ++number_of_points;
+      }
+    }
+    
+    // A single ring does not need hints
+    if (rings.size() < 2) return;
+    
+    // Square cells as far as the aspect ratio of the bounding box allows
+    double number_of_cells = std::min(std::max(1.0, (double)number_of_points/points_per_cell), 1048576.0);
+    double width = std::max(max_x-min_x, 1e-300), height = std::max(max_y-min_y, 1e-300);
+    double cell_size = std::sqrt(width*height/number_of_cells);
+    number_of_columns = (std::size_t)std::min(std::max(std::ceil(width/cell_size), 1.0), number_of_cells);
+    number_of_rows = (std::size_t)std::min(std::max(std::ceil(height/cell_size), 1.0), number_of_cells);
+    cell_width = width/number_of_columns;
+    cell_height = height/number_of_rows;
+    cells.assign(number_of_columns*number_of_rows, Vertex_handle());
+    number_of_filled_cells = 0;
+  }
+  
+  void clear() {
+    cells.clear();
+    number_of_columns = number_of_rows = 0;
+    number_of_filled_cells = 0;
+  }
+  
+  bool empty() const {
+    return cells.empty();
+  }
+  
+  void insert(Vertex_handle vertex) {
+    if (cells.empty()) return;
+    Vertex_handle &cell = cells[cell_of(vertex->point())];
+    if (cell == Vertex_handle()) ++number_of_filled_cells;
+    cell = vertex;
+  }
+  
+  // A face incident to the vertex in the nearest non-empty cell, searching
+  // square rings of cells around the one of the point
+  Face_handle hint(const Point &point, Face_handle fallback) const {
+    // Nothing inserted yet (e.g. the first ring), so there is nothing to search
+    if (number_of_filled_cells == 0) return fallback;
+    std::size_t cell = cell_of(point);
+    long column = (long)(cell%number_of_columns), row = (long)(cell/number_of_columns);
+    long max_radius = (long)std::max(number_of_columns, number_of_rows);
+    for (long radius = 0; radius < max_radius; ++radius) {
+      for (long current_row = row-radius; current_row <= row+radius; ++current_row) {
+        if (current_row < 0 || current_row >= (long)number_of_rows) continue;
+        
+        // Only the first and last columns of the rows in between are on the ring
+        long step = (radius == 0 || current_row == row-radius || current_row == row+radius) ? 1 : 2*radius;
+        for (long current_column = column-radius; current_column <= column+radius; current_column += step) {
+          if (current_column < 0 || current_column >= (long)number_of_columns) continue;
+          Vertex_handle vertex = cells[current_row*number_of_columns+current_column];
+          if (vertex != Vertex_handle()) return vertex->face();
+        }
+      }
+    } return fallback;
+  }
+
+//private:
+  std::vector<Vertex_handle> cells;
+  std::size_t number_of_columns, number_of_rows;
+  std::size_t number_of_filled_cells;
+  double min_x, min_y, max_x, max_y;
+  double cell_width, cell_height;
+  
+  std::size_t cell_of(const Point &point) const {
+    double column = std::floor((CGAL::to_double(point.x())-min_x)/cell_width);
+    double row = std::floor((CGAL::to_double(point.y())-min_y)/cell_height);
+    column = std::min(std::max(column, 0.0), (double)(number_of_columns-1));
+    row = std::min(std::max(row, 0.0), (double)(number_of_rows-1));
+    return (std::size_t)row*number_of_columns+(std::size_t)column;
+  }
+};
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Part_files.h"
+
+// STL
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+  struct Part_line {
+    long fid;
+    std::size_t part;
+    std::streamoff offset;
+  };
+  
+  struct Compare_part_line_fids {
+    bool operator()(const Part_line &a, const Part_line &b) const {
+      return a.fid < b.fid;
+    }
+  };
+  
+  // Adds the FID and the offset of every feature of a part to lines. Returns false if the part is missing or malformed
+  bool index_part(std::ifstream &part, const std::string &file_name, std::size_t shard, std::size_t number_of_shards, std::vector<Part_line> &lines) {
+    if (!part.is_open()) {
+      std::cerr << "Error: Part " << shard << " of " << number_of_shards << " is missing" << std::endl;
+      return false;
+    }
+    
+    std::stringstream expected_header;
+    expected_header << "# part " << shard << "/" << number_of_shards;
+    std::string line;
+    if (!std::getline(part, line) || line != expected_header.str()) {
+      std::cerr << "Error: " << file_name << " does not start with '" << expected_header.str() << "'" << std::endl;
+      return false;
+    }
+    
+    std::size_t features = 0;
+    while (true) {
+      Part_line part_line;
+      part_line.part = shard;
+      part_line.offset = part.tellg();
+      if (!std::getline(part, line)) {
+        std::cerr << "Error: " << file_name << " is truncated" << std::endl;
+        return false;
+      }
+      
+      if (line.compare(0, 6, "# end ") == 0) {
+        std::stringstream end(line.substr(6));
+        std::size_t end_features;
+        if (!(end >> end_features) || end_features != features) {
+          std::cerr << "Error: " << file_name << " has " << features << " features instead of " << line.substr(6) << std::endl;
+          return false;
+        } return true;
+      }
+      
+      std::size_t tab = line.find('\t');
+      std::stringstream fid(line.substr(0, tab));
+      if (tab == std::string::npos || !(fid >> part_line.fid)) {
+        std::cerr << "Error: " << file_name << " has a malformed line after " << features << " features" << std::endl;
+        return false;
+      } if (part_line.fid < 0 || (std::size_t)part_line.fid % number_of_shards != shard) {
+        std::cerr << "Error: " << file_name << " has feature " << part_line.fid << " of another shard" << std::endl;
+        return false;
+      } lines.push_back(part_line);
+      ++features;
+    }
+  }
+}
+
+std::string get_part_file_name(const std::string &parts_directory, std::size_t shard, std::size_t number_of_shards) {
+  std::stringstream file_name;
+  file_name << parts_directory << "/part_" << shard << "_of_" << number_of_shards << ".txt";
+  return file_name.str();
+}
+
+Part_writer::Part_writer() : features(0) {}
+
+bool Part_writer::open(const std::string &parts_directory, std::size_t shard, std::size_t number_of_shards) {
+  file_name = get_part_file_name(parts_directory, shard, number_of_shards);
+  features = 0;
+  file.open((file_name+".tmp").c_str());
+  if (!file.is_open()) return false;
+  file << "# part " << shard << "/" << number_of_shards << std::endl;
+  return true;
+}
+
+bool Part_writer::is_open() const {
+  return file.is_open();
+}
+
+void Part_writer::write(long fid, const std::string &wkt) {
+  file << fid << "\t" << wkt << std::endl;
+  ++features;
+}
+
+void Part_writer::write_not_repaired(long fid, const std::string &reason) {
+  file << fid << "\t# " << reason << std::endl;
+  ++features;
+}
+
+bool Part_writer::close() {
+  file << "# end " << features << std::endl;
+  file.close();
+  return !file.fail() && std::rename((file_name+".tmp").c_str(), file_name.c_str()) == 0;
+}
+
+bool merge_parts(const std::string &parts_directory, std::size_t number_of_shards, std::size_t input_features, std::ostream &output) {
+  std::vector<std::string> file_names;
+  std::vector<std::ifstream *> parts;
+  std::vector<Part_line> lines;
+  bool is_complete = true;
+  for (std::size_t current_shard = 0; current_shard < number_of_shards; ++current_shard) {
+    file_names.push_back(get_part_file_name(parts_directory, current_shard, number_of_shards));
+    parts.push_back(new std::ifstream(file_names.back().c_str(), std::ios::in));
+    if (!index_part(*parts.back(), file_names.back(), current_shard, number_of_shards, lines)) is_complete = false;
+  }
+  
+  // Parts can list their features in any order, but only once
+  if (is_complete) {
+    std::sort(lines.begin(), lines.end(), Compare_part_line_fids());
+    for (std::size_t current_line = 1; current_line < lines.size(); ++current_line) {
+      if (lines[current_line].fid != lines[current_line-1].fid) continue;
+      std::cerr << "Error: " << file_names[lines[current_line].part] << " has feature " << lines[current_line].fid << " more than once" << std::endl;
+      is_complete = false;
+      break;
+    }
+  } if (is_complete && lines.size() != input_features) {
+    std::cerr << "Error: The parts have " << lines.size() << " features but the input has " << input_features << std::endl;
+    is_complete = false;
+  }
+  
+  std::size_t features_not_repaired = 0;
+  if (is_complete) {
+    std::string line;
+    for (std::vector<Part_line>::const_iterator current_line = lines.begin(); current_line != lines.end(); ++current_line) {
+      std::ifstream &part = *parts[current_line->part];
+      part.clear();
+      part.seekg(current_line->offset);
+      std::getline(part, line);
+      std::size_t tab = line.find('\t');
+      if (line.compare(tab+1, 2, "# ") == 0) {
+        std::cerr << "Warning: Feature " << current_line->fid << " was not repaired: " << line.substr(tab+3) << std::endl;
+        ++features_not_repaired;
+      } else output << line.substr(tab+1) << std::endl;
+    }
+  }
+  
+  for (std::vector<std::ifstream *>::iterator part = parts.begin(); part != parts.end(); ++part) {
+    delete *part;
+  } if (!is_complete) return false;
+  std::cerr << "Merged " << lines.size()-features_not_repaired << " features from " << number_of_shards << " parts" << std::endl;
+  return true;
+}
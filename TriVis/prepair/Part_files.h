@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef PARTFILES_H
+#define PARTFILES_H
+
+// STL
+#include <string>
+#include <fstream>
+#include <ostream>
+
+// Sharded runs write the features whose FID is I modulo N to part I of N,
+// and --merge puts the parts back together. A part starts with a
+// "# part I/N" line, has a "FID<tab>WKT" line per feature, or a
+// "FID<tab># REASON" line for a feature that was not repaired, in any order,
+// and ends with a "# end FEATURES" line
+
+std::string get_part_file_name(const std::string &parts_directory, std::size_t shard, std::size_t number_of_shards);
+
+// Writes to a temporary file that only becomes the part once it is closed,
+// so parts appear complete or not at all
+class Part_writer {
+public:
+  Part_writer();
+  
+  bool open(const std::string &parts_directory, std::size_t shard, std::size_t number_of_shards);
+  bool is_open() const;
+  void write(long fid, const std::string &wkt);
+  void write_not_repaired(long fid, const std::string &reason);
+  
+  // Ends the part and moves it in place. Returns false if it could not be written
+  bool close();
+
+//private:
+  std::string file_name;
+  std::ofstream file;
+  std::size_t features;
+};
+
+// Writes the features of all the parts to output in FID order. Only the FID
+// and the offset of every line are kept in memory. Returns false if a part
+// is missing or malformed, if a FID is repeated or if the parts do not have
+// the input_features of the input between them
+bool merge_parts(const std::string &parts_directory, std::size_t number_of_shards, std::size_t input_features, std::ostream &output);
+
+#endif
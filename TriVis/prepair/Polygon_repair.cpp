@@ -21,6 +21,12 @@
 
 #include "Polygon_repair.h"
 
+// Boost
+#include <boost/bind.hpp>
+
+// Interior components are reconstructed in parallel in groups of about this many faces
+static const std::size_t faces_per_reconstruction_task = 4096;
+
 bool Polygon_repair::is_iso_and_ogc_valid(OGRGeometry *in_geometry, const std::string &pre_text, bool time_results) {
   // TODO: Implement
   triangulation.clear();
@@ -28,7 +34,7 @@ bool Polygon_repair::is_iso_and_ogc_valid(OGRGeometry *in_geometry, const std::s
   bool is_valid = true;
   
   this_time = time(NULL);
-  switch (in_geometry->getGeometryType()) {
+  switch (wkbFlatten(in_geometry->getGeometryType())) {
     case wkbLineString: {
       OGRLinearRing *ring = static_cast<OGRLinearRing *>(in_geometry);
       
@@ -106,20 +112,28 @@ bool Polygon_repair::is_iso_and_ogc_valid(OGRGeometry *in_geometry, const std::s
   
 }
 
-OGRGeometry *Polygon_repair::repair_odd_even(OGRGeometry *in_geometry, bool time_results) {
+OGRGeometry *Polygon_repair::repair_odd_even(OGRGeometry *in_geometry, bool time_results, double min_area) {
   triangulation.clear();
+  walk_start_location = Triangulation::Face_handle();
+  input_heights.clear();
+  if (in_geometry->getCoordinateDimension() == 3) get_input_heights(in_geometry);
   std::time_t this_time, total_time;
   
   this_time = time(NULL);
   insert_odd_even_constraints(in_geometry);
   total_time = time(NULL)-this_time;
   if (time_results) std::cout << "Triangulation: " << total_time/60 << " minutes " << total_time%60 << " seconds." << std::endl;
+  if (budget.is_exhausted()) return new OGRPolygon();
   
   this_time = time(NULL);
   tag_odd_even();
+  if (budget.is_exhausted()) return new OGRPolygon();
+  if (min_area > 0.0) remove_small_parts(min_area);
   total_time = time(NULL)-this_time;
   if (time_results) std::cout << "Tagging: " << total_time/60 << " minutes " << total_time%60 << " seconds." << std::endl;
   
+  prune_exact_numbers(time_results);
+  
   this_time = time(NULL);
   OGRGeometry *out_geometry = reconstruct();
   total_time = time(NULL)-this_time;
@@ -128,14 +142,14 @@ OGRGeometry *Polygon_repair::repair_odd_even(OGRGeometry *in_geometry, bool time
   return out_geometry;
 }
 
-OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool time_results) {
+OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool time_results, double min_area) {
   std::time_t this_time, total_time;
   std::list<OGRGeometry *> repaired_parts;   // bool indicates if outer/inner are flipped
   
   this_time = time(NULL);
-  switch (in_geometry->getGeometryType()) {
+  switch (wkbFlatten(in_geometry->getGeometryType())) {
     case wkbLineString: {
-      return repair_odd_even(in_geometry, time_results);
+      return repair_odd_even(in_geometry, time_results, min_area);
       break;
     }
       
@@ -149,6 +163,7 @@ OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool tim
       
       this_time = time(NULL);
       triangulation.clear();
+      walk_start_location = Triangulation::Face_handle();
       for (std::list<OGRGeometry *>::iterator current_part = repaired_parts.begin(); current_part != repaired_parts.end(); ++current_part) {
         insert_all_constraints(*current_part);
       } total_time = time(NULL)-this_time;
@@ -172,6 +187,7 @@ OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool tim
       
       this_time = time(NULL);
       triangulation.clear();
+      walk_start_location = Triangulation::Face_handle();
       for (std::list<OGRGeometry *>::iterator current_part = repaired_parts.begin(); current_part != repaired_parts.end(); ++current_part) {
         insert_all_constraints(*current_part);
       } total_time = time(NULL)-this_time;
@@ -191,6 +207,16 @@ OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool tim
       break;
   }
   
+  if (budget.is_exhausted()) return new OGRPolygon();
+  if (min_area > 0.0) remove_small_parts(min_area);
+  prune_exact_numbers(time_results);
+  
+  // The repaired parts already have heights at their intersections
+  input_heights.clear();
+  for (std::list<OGRGeometry *>::iterator current_part = repaired_parts.begin(); current_part != repaired_parts.end(); ++current_part) {
+    if ((*current_part)->getCoordinateDimension() == 3) get_input_heights(*current_part);
+  }
+  
   this_time = time(NULL);
   OGRGeometry *out_geometry = reconstruct();
   total_time = time(NULL)-this_time;
@@ -199,10 +225,221 @@ OGRGeometry *Polygon_repair::repair_point_set(OGRGeometry *in_geometry, bool tim
   return out_geometry;
 }
 
+void Polygon_repair::repair_coverage(std::vector<OGRGeometry *> &in_geometries, std::vector<OGRGeometry *> &out_geometries, std::vector<std::size_t> &failed_features, bool time_results) {
+  triangulation.clear();
+  walk_start_location = Triangulation::Face_handle();
+  input_heights.clear();
+  vertex_heights.clear();
+  failed_features.clear();
+  for (std::size_t current_feature = 0; current_feature < in_geometries.size(); ++current_feature) {
+    if (in_geometries[current_feature]->getCoordinateDimension() == 3) get_input_heights(in_geometries[current_feature]);
+  } std::time_t this_time, total_time;
+  
+  // Every segment goes in once as a plain constraint, so a boundary shared by
+  // two features is inserted and intersected only once
+  this_time = time(NULL);
+  std::vector<std::vector<std::vector<Triangulation::Vertex_handle> > > feature_rings(in_geometries.size());
+  for (std::size_t current_feature = 0; current_feature < in_geometries.size() && !budget.is_exhausted(); ++current_feature) {
+    std::vector<std::vector<Point> > rings;
+    get_rings(in_geometries[current_feature], rings);
+    for (std::vector<std::vector<Point> >::iterator current_ring = rings.begin(); current_ring != rings.end(); ++current_ring) {
+      feature_rings[current_feature].push_back(std::vector<Triangulation::Vertex_handle>());
+      std::vector<Triangulation::Vertex_handle> &ring_vertices = feature_rings[current_feature].back();
+      for (std::vector<Point>::iterator current_point = current_ring->begin(); current_point != current_ring->end(); ++current_point) {
+        ring_vertices.push_back(triangulation.insert(*current_point, walk_start_location));
+        walk_start_location = triangulation.incident_faces(ring_vertices.back());
+      } for (std::size_t current_vertex = 0; current_vertex < ring_vertices.size(); ++current_vertex) {
+        if (!budget.spend()) break;
+        Triangulation::Vertex_handle va = ring_vertices[current_vertex], vb = ring_vertices[(current_vertex+1)%ring_vertices.size()];
+        if (va != vb) triangulation.insert_constraint(va, vb);
+      }
+    }
+  } total_time = time(NULL)-this_time;
+  if (time_results) std::cout << "Triangulation: " << total_time/60 << " minutes " << total_time%60 << " seconds." << std::endl;
+  
+  out_geometries.clear();
+  if (budget.is_exhausted()) {
+    for (std::size_t current_feature = 0; current_feature < in_geometries.size(); ++current_feature) {
+      out_geometries.push_back(new OGRPolygon());
+    } return;
+  }
+  
+  // With the triangulation finished, each feature's segments are followed
+  // through the pieces they were split into to find the features of every edge
+  this_time = time(NULL);
+  Edge_features edge_features;
+  for (std::size_t current_feature = 0; current_feature < feature_rings.size(); ++current_feature) {
+    bool labelled = true;
+    for (std::vector<std::vector<Triangulation::Vertex_handle> >::iterator current_ring = feature_rings[current_feature].begin(); current_ring != feature_rings[current_feature].end(); ++current_ring) {
+      for (std::size_t current_vertex = 0; current_vertex < current_ring->size(); ++current_vertex) {
+        Triangulation::Vertex_handle va = (*current_ring)[current_vertex], vb = (*current_ring)[(current_vertex+1)%current_ring->size()];
+        if (va != vb && !label_constraint(va, vb, (int)current_feature, edge_features)) labelled = false;
+      }
+    } if (!labelled) failed_features.push_back(current_feature);
+  }
+  
+  std::vector<std::vector<Triangulation::Face_handle> > faces_of_features(in_geometries.size());
+  tag_coverage(edge_features, faces_of_features);
+  total_time = time(NULL)-this_time;
+  if (time_results) std::cout << "Tagging: " << total_time/60 << " minutes " << total_time%60 << " seconds." << std::endl;
+  
+  prune_exact_numbers(time_results);
+  if (!input_heights.empty()) get_vertex_heights();
+  
+  // Every feature is reconstructed from its own faces only. A feature whose
+  // boundary was lost has faces that are not its own, so it is output empty
+  this_time = time(NULL);
+  std::vector<std::size_t>::const_iterator next_failed_feature = failed_features.begin();
+  for (std::size_t current_feature = 0; current_feature < faces_of_features.size(); ++current_feature) {
+    if (next_failed_feature != failed_features.end() && *next_failed_feature == current_feature) {
+      out_geometries.push_back(new OGRPolygon());
+      ++next_failed_feature;
+      continue;
+    } std::vector<Triangulation::Face_handle> &faces = faces_of_features[current_feature];
+    for (std::vector<Triangulation::Face_handle>::iterator current_face = faces.begin(); current_face != faces.end(); ++current_face) {
+      (*current_face)->info().is_in_interior(true);
+    } out_geometries.push_back(reconstruct(faces));
+    for (std::vector<Triangulation::Face_handle>::iterator current_face = faces.begin(); current_face != faces.end(); ++current_face) {
+      (*current_face)->info().is_in_interior(false);
+    }
+  } total_time = time(NULL)-this_time;
+  if (time_results) std::cout << "Reconstruction: " << total_time/60 << " minutes " << total_time%60 << " seconds." << std::endl;
+}
+
+struct Compare_min_x {
+  const OGREnvelope *envelopes;
+  
+  Compare_min_x(const OGREnvelope *envelopes) : envelopes(envelopes) {}
+  
+  bool operator()(int first, int second) const {
+    return envelopes[first].MinX < envelopes[second].MinX;
+  }
+};
+
+OGRGeometry *Polygon_repair::repair_odd_even_in_clusters(OGRGeometry *in_geometry, Task_scheduler &scheduler, double min_area) {
+  if (wkbFlatten(in_geometry->getGeometryType()) != wkbMultiPolygon) return repair_odd_even(in_geometry, false, min_area);
+  OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(in_geometry);
+  std::vector<std::vector<int> > clusters;
+  get_clusters(multipolygon, clusters);
+  if (clusters.size() < 2) return repair_odd_even(in_geometry, false, min_area);
+  triangulation.clear();
+  
+  // The clusters share what is left of the budget, on the clock of the feature
+  std::atomic<std::size_t> shared_steps(budget.get_steps());
+  std::vector<OGRGeometry *> cluster_geometries(clusters.size()), cluster_outputs(clusters.size(), NULL);
+  std::vector<Work_budget> cluster_budgets(clusters.size());
+  std::vector<std::size_t> cluster_height_conflicts(clusters.size(), 0);
+  Task_group cluster_tasks(scheduler);
+  for (std::size_t current_cluster = 0; current_cluster < clusters.size(); ++current_cluster) {
+    OGRMultiPolygon *cluster_geometry = new OGRMultiPolygon();
+    for (std::vector<int>::const_iterator current_part = clusters[current_cluster].begin(); current_part != clusters[current_cluster].end(); ++current_part) {
+      cluster_geometry->addGeometry(multipolygon->getGeometryRef(*current_part));
+    } cluster_geometries[current_cluster] = cluster_geometry;
+    cluster_budgets[current_cluster].start_shared(budget, &shared_steps);
+    cluster_tasks.run(boost::bind(&Polygon_repair::repair_cluster, cluster_geometry, min_area,
+                                  boost::ref(cluster_outputs[current_cluster]), boost::ref(cluster_budgets[current_cluster]),
+                                  boost::ref(cluster_height_conflicts[current_cluster])));
+  } cluster_tasks.wait();
+  
+  // Clusters are apart, so their polygons can be put together as they are.
+  // The feature is over budget if any cluster was
+  OGRMultiPolygon *out_geometries = new OGRMultiPolygon();
+  for (std::size_t current_cluster = 0; current_cluster < clusters.size(); ++current_cluster) {
+    budget.steps += cluster_budgets[current_cluster].get_steps();
+    number_of_height_conflicts += cluster_height_conflicts[current_cluster];
+    if (cluster_budgets[current_cluster].is_exhausted()) budget.exhausted = true;
+    OGRGeometry *cluster_output = cluster_outputs[current_cluster];
+    if (wkbFlatten(cluster_output->getGeometryType()) == wkbPolygon && !cluster_output->IsEmpty()) out_geometries->addGeometry(cluster_output);
+    else if (wkbFlatten(cluster_output->getGeometryType()) == wkbMultiPolygon) {
+      OGRMultiPolygon *cluster_polygons = static_cast<OGRMultiPolygon *>(cluster_output);
+      for (int current_polygon = 0; current_polygon < cluster_polygons->getNumGeometries(); ++current_polygon) {
+        out_geometries->addGeometry(cluster_polygons->getGeometryRef(current_polygon));
+      }
+    } delete cluster_output;
+    delete cluster_geometries[current_cluster];
+  }
+  
+  if (budget.is_exhausted() || out_geometries->getNumGeometries() == 0) {
+    delete out_geometries;
+    return new OGRPolygon();
+  }
+  
+  if (out_geometries->getNumGeometries() == 1) {
+    OGRPolygon *new_polygon = static_cast<OGRPolygon *>(out_geometries->getGeometryRef(0)->clone());
+    delete out_geometries;
+    return new_polygon;
+  } return out_geometries;
+}
+
+void Polygon_repair::repair_cluster(OGRGeometry *in_geometry, double min_area, OGRGeometry *&out_geometry, Work_budget &used_budget, std::size_t &height_conflicts) {
+  Polygon_repair prepair;
+  prepair.budget = used_budget;
+  out_geometry = prepair.repair_odd_even(in_geometry, false, min_area);
+  
+  // Small clusters finish between two checks, so their last steps are shared here
+  if (!prepair.budget.share_steps()) prepair.budget.exhausted = true;
+  used_budget = prepair.budget;
+  height_conflicts = prepair.number_of_height_conflicts;
+}
+
+bool Polygon_repair::write_snapshot(const std::string &file_name, OGRGeometry *out_geometry) {
+  Snapshot_header header;
+  header.number_of_vertices = triangulation.number_of_vertices();
+  header.number_of_faces = triangulation.number_of_faces();
+  header.output_size = out_geometry != NULL ? out_geometry->WkbSize() : 0;
+  
+  std::vector<double> vertices;
+  vertices.reserve(2*header.number_of_vertices);
+  CGAL::Unique_hash_map<Triangulation::Vertex_handle, std::uint32_t> vertex_indices;
+  std::uint32_t current_index = 0;
+  for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+    vertex_indices[current_vertex] = current_index++;
+    vertices.push_back(CGAL::to_double(current_vertex->point().x()));
+    vertices.push_back(CGAL::to_double(current_vertex->point().y()));
+  }
+  
+  // Interior faces go first so that readers can use them as one range
+  std::vector<std::uint32_t> faces;
+  std::vector<std::uint8_t> face_bits;
+  faces.reserve(3*header.number_of_faces);
+  face_bits.reserve(header.number_of_faces);
+  for (int pass = 0; pass < 2; ++pass) {
+    bool interior = pass == 0;
+    for (Triangulation::Finite_faces_iterator current_face = triangulation.finite_faces_begin(); current_face != triangulation.finite_faces_end(); ++current_face) {
+      if (current_face->info().is_in_interior() != interior) continue;
+      std::uint8_t bits = interior ? Snapshot_header::interior_bit : 0;
+      for (int current_vertex = 0; current_vertex < 3; ++current_vertex) {
+        faces.push_back(vertex_indices[current_face->vertex(current_vertex)]);
+        if (current_face->is_constrained(current_vertex)) bits |= 1 << current_vertex;
+      } face_bits.push_back(bits);
+    } if (interior) header.number_of_interior_faces = face_bits.size();
+  }
+  
+  std::vector<unsigned char> output(header.output_size);
+  if (out_geometry != NULL) out_geometry->exportToWkb(wkbNDR, output.data());
+  
+  std::ofstream file(file_name.c_str(), std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not write snapshot " << file_name << std::endl;
+    return false;
+  } const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  file.write(reinterpret_cast<const char *>(&header), sizeof(Snapshot_header));
+  file.write(padding, header.vertices_offset()-sizeof(Snapshot_header));
+  file.write(reinterpret_cast<const char *>(vertices.data()), vertices.size()*sizeof(double));
+  file.write(padding, header.faces_offset()-header.vertices_offset()-vertices.size()*sizeof(double));
+  file.write(reinterpret_cast<const char *>(faces.data()), faces.size()*sizeof(std::uint32_t));
+  file.write(padding, header.face_bits_offset()-header.faces_offset()-faces.size()*sizeof(std::uint32_t));
+  file.write(reinterpret_cast<const char *>(face_bits.data()), face_bits.size());
+  file.write(padding, header.output_offset()-header.face_bits_offset()-face_bits.size());
+  file.write(reinterpret_cast<const char *>(output.data()), output.size());
+  file.write(padding, header.file_size()-header.output_offset()-output.size());
+  return file.good();
+}
+
 void Polygon_repair::insert_all_constraints(OGRGeometry *in_geometry) {
   Triangulation::Vertex_handle va, vb;
   
-  switch (in_geometry->getGeometryType()) {
+  switch (wkbFlatten(in_geometry->getGeometryType())) {
     case wkbLineString: {
       OGRLinearRing *ring = static_cast<OGRLinearRing *>(in_geometry);
       ring->closeRings();
@@ -254,48 +491,55 @@ void Polygon_repair::insert_all_constraints(OGRGeometry *in_geometry) {
 }
 
 void Polygon_repair::insert_odd_even_constraints(OGRGeometry *in_geometry) {
-  Triangulation::Vertex_handle va, vb;
+  std::vector<std::vector<Point> > rings;
+  get_rings(in_geometry, rings);
+  remove_duplicate_rings(rings);
+  locate_hints.reset(rings);
+  for (std::vector<std::vector<Point> >::iterator current_ring = rings.begin(); current_ring != rings.end(); ++current_ring) {
+    if (budget.is_exhausted()) return;
+    insert_odd_even_ring(*current_ring);
+  }
+}
   
-  switch (in_geometry->getGeometryType()) {
+void Polygon_repair::get_rings(OGRGeometry *in_geometry, std::vector<std::vector<Point> > &rings) {
+  switch (wkbFlatten(in_geometry->getGeometryType())) {
     case wkbLineString: {
       OGRLinearRing *ring = static_cast<OGRLinearRing *>(in_geometry);
-      ring->closeRings();
+      rings.push_back(std::vector<Point>());
+      std::vector<Point> &points = rings.back();
+      points.reserve(ring->getNumPoints());
+      for (int current_point = 0; current_point < ring->getNumPoints(); ++current_point) {
 #ifdef COORDS_3D
-      vb = triangulation.insert(Point(ring->getX(0), ring->getY(0), ring->getZ(0)), walk_start_location);
+        Point point(ring->getX(current_point), ring->getY(current_point), ring->getZ(current_point));
 #else
-      vb = triangulation.insert(Point(ring->getX(0), ring->getY(0)), walk_start_location);
+        Point point(ring->getX(current_point), ring->getY(current_point));
 #endif
-      walk_start_location = triangulation.incident_faces(vb);
-      for (int current_point = 1; current_point < ring->getNumPoints(); ++current_point) {
-        va = vb;
-#ifdef COORDS_3D
-        vb = triangulation.insert(Point(ring->getX(current_point),
-                                        ring->getY(current_point),
-                                        ring->getZ(current_point)),
-                                  walk_start_location);
-#else
-        vb = triangulation.insert(Point(ring->getX(current_point),
-                                        ring->getY(current_point)),
-                                  walk_start_location);
-#endif
-        if (va == vb) continue;
-        triangulation.odd_even_insert_constraint(va, vb);
-        walk_start_location = triangulation.incident_faces(vb);
-      } break;
+        // Zero-length segment
+        if (!points.empty() && points.back() == point) continue;
+        points.push_back(point);
+      }
+      
+      // The ring is closed implicitly
+      while (points.size() > 1 && points.back() == points.front()) points.pop_back();
+      
+      // Degenerate (encloses nothing under odd-even)
+      if (points.size() < 3) rings.pop_back();
+      break;
     }
       
     case wkbPolygon: {
       OGRPolygon *polygon = static_cast<OGRPolygon *>(in_geometry);
-      insert_odd_even_constraints(polygon->getExteriorRing());
+      if (polygon->getExteriorRing() == NULL) break;
+      get_rings(polygon->getExteriorRing(), rings);
       for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
-        insert_odd_even_constraints(polygon->getInteriorRing(current_ring));
+        get_rings(polygon->getInteriorRing(current_ring), rings);
       } break;
     }
       
     case wkbMultiPolygon: {
       OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(in_geometry);
       for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
-        insert_odd_even_constraints(multipolygon->getGeometryRef(current_polygon));
+        get_rings(multipolygon->getGeometryRef(current_polygon), rings);
       } break;
     }
       
@@ -306,6 +550,167 @@ void Polygon_repair::insert_odd_even_constraints(OGRGeometry *in_geometry) {
   }
 }
 
+void Polygon_repair::get_input_heights(OGRGeometry *in_geometry) {
+  switch (wkbFlatten(in_geometry->getGeometryType())) {
+    case wkbLineString: {
+      // The first height at an x and y is kept. The closing point is not a conflict with itself
+      OGRLinearRing *ring = static_cast<OGRLinearRing *>(in_geometry);
+      int number_of_points = ring->getNumPoints();
+      if (number_of_points > 1 && ring->getX(0) == ring->getX(number_of_points-1) && ring->getY(0) == ring->getY(number_of_points-1) && ring->getZ(0) == ring->getZ(number_of_points-1)) --number_of_points;
+      for (int current_point = 0; current_point < number_of_points; ++current_point) {
+        std::pair<Input_heights::iterator, bool> inserted = input_heights.insert(std::make_pair(Coordinates(ring->getX(current_point), ring->getY(current_point)), ring->getZ(current_point)));
+        if (!inserted.second && inserted.first->second != ring->getZ(current_point)) ++number_of_height_conflicts;
+      } break;
+    }
+    
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(in_geometry);
+      if (polygon->getExteriorRing() == NULL) break;
+      get_input_heights(polygon->getExteriorRing());
+      for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        get_input_heights(polygon->getInteriorRing(current_ring));
+      } break;
+    }
+    
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(in_geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        get_input_heights(multipolygon->getGeometryRef(current_polygon));
+      } break;
+    }
+    
+    default:
+      break;
+  }
+}
+
+void Polygon_repair::get_clusters(OGRMultiPolygon *multipolygon, std::vector<std::vector<int> > &clusters) {
+  // Parts whose bounding boxes overlap or touch are merged with a union-find over a sweep in x
+  int number_of_parts = multipolygon->getNumGeometries();
+  if (number_of_parts == 0) return;
+  std::vector<OGREnvelope> envelopes(number_of_parts);
+  std::vector<int> parts_by_min_x(number_of_parts), parent(number_of_parts);
+  for (int current_part = 0; current_part < number_of_parts; ++current_part) {
+    multipolygon->getGeometryRef(current_part)->getEnvelope(&envelopes[current_part]);
+    parts_by_min_x[current_part] = current_part;
+    parent[current_part] = current_part;
+  } std::sort(parts_by_min_x.begin(), parts_by_min_x.end(), Compare_min_x(&envelopes.front()));
+  
+  std::vector<int> active_parts;
+  for (std::vector<int>::const_iterator current_part = parts_by_min_x.begin(); current_part != parts_by_min_x.end(); ++current_part) {
+    const OGREnvelope &envelope = envelopes[*current_part];
+    std::size_t kept_parts = 0;
+    for (std::size_t active_part = 0; active_part < active_parts.size(); ++active_part) {
+      const OGREnvelope &other = envelopes[active_parts[active_part]];
+      if (other.MaxX < envelope.MinX) continue;
+      active_parts[kept_parts++] = active_parts[active_part];
+      if (other.MaxY < envelope.MinY || envelope.MaxY < other.MinY) continue;
+      int first_root = *current_part, second_root = active_parts[active_part];
+      while (parent[first_root] != first_root) first_root = parent[first_root] = parent[parent[first_root]];
+      while (parent[second_root] != second_root) second_root = parent[second_root] = parent[parent[second_root]];
+      parent[first_root] = second_root;
+    } active_parts.resize(kept_parts);
+    active_parts.push_back(*current_part);
+  }
+  
+  // Parts keep their input order within a cluster
+  std::vector<int> cluster_of_root(number_of_parts, -1);
+  for (int current_part = 0; current_part < number_of_parts; ++current_part) {
+    int root = current_part;
+    while (parent[root] != root) root = parent[root];
+    if (cluster_of_root[root] == -1) {
+      cluster_of_root[root] = (int)clusters.size();
+      clusters.push_back(std::vector<int>());
+    } clusters[cluster_of_root[root]].push_back(current_part);
+  }
+}
+
+void Polygon_repair::canonicalise_ring(std::vector<Point> &ring) {
+  std::size_t size = ring.size();
+  std::size_t smallest_vertex = 0;
+  for (std::size_t current_vertex = 1; current_vertex < size; ++current_vertex) {
+    if (ring[current_vertex] < ring[smallest_vertex]) smallest_vertex = current_vertex;
+  }
+  
+  // Try every occurrence of the smallest vertex in both orientations and keep the smallest sequence
+  std::size_t best_start = smallest_vertex;
+  bool best_forward = true;
+  for (std::size_t current_start = smallest_vertex; current_start < size; ++current_start) {
+    if (ring[current_start] != ring[smallest_vertex]) continue;
+    for (int orientation = 0; orientation < 2; ++orientation) {
+      bool forward = orientation == 0;
+      for (std::size_t offset = 0; offset < size; ++offset) {
+        const Point &candidate = ring[forward ? (current_start+offset)%size : (current_start+size-offset)%size];
+        const Point &best = ring[best_forward ? (best_start+offset)%size : (best_start+size-offset)%size];
+        if (candidate < best) {
+          best_start = current_start;
+          best_forward = forward;
+          break;
+        } if (best < candidate) break;
+      }
+    }
+  }
+  
+  std::vector<Point> canonical_ring;
+  canonical_ring.reserve(size);
+  for (std::size_t offset = 0; offset < size; ++offset) {
+    canonical_ring.push_back(ring[best_forward ? (best_start+offset)%size : (best_start+size-offset)%size]);
+  } ring.swap(canonical_ring);
+}
+
+std::size_t Polygon_repair::hash_ring(const std::vector<Point> &ring) {
+  std::size_t seed = ring.size();
+  for (std::vector<Point>::const_iterator current_vertex = ring.begin(); current_vertex != ring.end(); ++current_vertex) {
+    boost::hash_combine(seed, CGAL::to_double(current_vertex->x()));
+    boost::hash_combine(seed, CGAL::to_double(current_vertex->y()));
+  } return seed;
+}
+
+void Polygon_repair::remove_duplicate_rings(std::vector<std::vector<Point> > &rings) {
+  // Identical rings (up to start vertex and orientation) cancel each other in pairs under odd-even
+  std::unordered_map<std::size_t, std::vector<std::size_t> > rings_by_hash;
+  std::vector<bool> keep(rings.size(), true);
+  for (std::size_t current_ring = 0; current_ring < rings.size(); ++current_ring) {
+    canonicalise_ring(rings[current_ring]);
+    std::vector<std::size_t> &candidates = rings_by_hash[hash_ring(rings[current_ring])];
+    bool cancelled = false;
+    for (std::vector<std::size_t>::iterator candidate = candidates.begin(); candidate != candidates.end(); ++candidate) {
+      if (keep[*candidate] && rings[*candidate] == rings[current_ring]) {
+        keep[*candidate] = false;
+        keep[current_ring] = false;
+        cancelled = true;
+        break;
+      }
+    } if (!cancelled) candidates.push_back(current_ring);
+  }
+  
+  std::size_t kept_rings = 0;
+  for (std::size_t current_ring = 0; current_ring < rings.size(); ++current_ring) {
+    if (!keep[current_ring]) continue;
+    if (kept_rings != current_ring) rings[kept_rings].swap(rings[current_ring]);
+    ++kept_rings;
+  } rings.resize(kept_rings);
+}
+
+void Polygon_repair::insert_odd_even_ring(const std::vector<Point> &ring) {
+  // The previous ring may have ended far away, but the next vertex is always close to the last one
+  Triangulation::Vertex_handle va, vb, first;
+  first = vb = triangulation.insert(ring.front(), locate_hints.hint(ring.front(), walk_start_location));
+  locate_hints.insert(vb);
+  walk_start_location = triangulation.incident_faces(vb);
+  for (std::size_t current_point = 1; current_point <= ring.size(); ++current_point) {
+    if (budget.is_exhausted()) return;
+    va = vb;
+    if (current_point < ring.size()) {
+      vb = triangulation.insert(ring[current_point], walk_start_location);
+      locate_hints.insert(vb);
+    } else vb = first;
+    if (va == vb) continue;
+    triangulation.odd_even_insert_constraint(va, vb);
+    walk_start_location = triangulation.incident_faces(vb);
+  }
+}
+
 void Polygon_repair::tag_odd_even() {
   // Clean tags
   for (prepair::Triangulation::Face_handle current_face = triangulation.all_faces_begin(); current_face != triangulation.all_faces_end(); ++current_face)
@@ -324,6 +729,7 @@ void Polygon_repair::tag_odd_even() {
     
     // Give preference to whatever we're already doing
     while (!current_stack->empty()) {
+      if (!budget.spend()) return;
       prepair::Triangulation::Face_handle current_face = current_stack->top();
 			current_stack->pop();
       if (current_face->info().been_tagged()) continue;
@@ -354,7 +760,7 @@ void Polygon_repair::tag_as_to_fill_in(OGRGeometry *geometry) {
   Triangulation::Face_handle face;
   int index_of_opposite_vertex;
   
-  switch (geometry->getGeometryType()) {
+  switch (wkbFlatten(geometry->getGeometryType())) {
       
     case wkbLineString: {
       OGRLinearRing *ring = static_cast<OGRLinearRing *>(geometry);
@@ -409,165 +815,218 @@ void Polygon_repair::tag_point_set_union(std::list<OGRGeometry *> &geometries) {
   // TODO: Implement
 }
 
-OGRGeometry *Polygon_repair::reconstruct() {
-  // std::cout << "Triangulation: " << triangulation.number_of_faces() << " faces, " << triangulation.number_of_vertices() << " vertices." << std::endl;
-  if (triangulation.number_of_faces() < 1) {
-    return new OGRPolygon();
+void Polygon_repair::remove_small_parts(double min_area) {
+  // A separate pass over the whole tagged triangulation, so it applies to
+  // the repaired output rather than to the input rings. As with the old
+  // filter on the output polygons, which dropped small inner rings, it both
+  // removes parts and fills holes smaller than min_area
+  
+  // Drop interior components smaller than min_area
+  for (Triangulation::All_faces_iterator current_face = triangulation.all_faces_begin(); current_face != triangulation.all_faces_end(); ++current_face)
+    current_face->info().been_visited(false);
+  for (Triangulation::Finite_faces_iterator seeding_face = triangulation.finite_faces_begin(); seeding_face != triangulation.finite_faces_end(); ++seeding_face) {
+    if (!seeding_face->info().is_in_interior() || seeding_face->info().been_visited()) continue;
+    std::vector<Triangulation::Face_handle> component;
+    get_component(seeding_face, component);
+    if (!is_smaller_than(component, min_area)) continue;
+    for (std::vector<Triangulation::Face_handle>::iterator current_face = component.begin(); current_face != component.end(); ++current_face)
+      (*current_face)->info().is_in_interior(false);
   }
   
-  // Reconstruct
-  OGRMultiPolygon *out_geometries = new OGRMultiPolygon();
-  for (prepair::Triangulation::Finite_faces_iterator seeding_face = triangulation.finite_faces_begin(); seeding_face != triangulation.finite_faces_end(); ++seeding_face) {
-    
-    if (!seeding_face->info().is_in_interior() || seeding_face->info().been_reconstructed()) continue;
-    seeding_face->info().been_reconstructed(true);
-    if (!seeding_face->info().been_reconstructed()) {
-      std::cout << "Error: Face should be marked as reconstructed!" << std::endl;
-    }
-    
-    // Get boundary
-    std::list<Triangulation::Vertex_handle> vertices = std::list<Triangulation::Vertex_handle>();
-    if (seeding_face->neighbor(2)->info().is_in_interior() && !seeding_face->neighbor(2)->info().been_reconstructed()) {
-      seeding_face->neighbor(2)->info().been_reconstructed(true);
-      std::list<Triangulation::Vertex_handle> l2;
-      get_boundary(seeding_face->neighbor(2), seeding_face->neighbor(2)->index(seeding_face), l2);
-      vertices.splice(vertices.end(), l2);
-    } vertices.push_back(seeding_face->vertex(0));
-    if (seeding_face->neighbor(1)->info().is_in_interior() && !seeding_face->neighbor(1)->info().been_reconstructed()) {
-      seeding_face->neighbor(1)->info().been_reconstructed(true);
-      std::list<Triangulation::Vertex_handle> l1;
-      get_boundary(seeding_face->neighbor(1), seeding_face->neighbor(1)->index(seeding_face), l1);
-      vertices.splice(vertices.end(), l1);
-    } vertices.push_back(seeding_face->vertex(2));
-    if (seeding_face->neighbor(0)->info().is_in_interior() && !seeding_face->neighbor(0)->info().been_reconstructed()) {
-      seeding_face->neighbor(0)->info().been_reconstructed(true);
-      std::list<Triangulation::Vertex_handle> l0;
-      get_boundary(seeding_face->neighbor(0), seeding_face->neighbor(0)->index(seeding_face), l0);
-      vertices.splice(vertices.end(), l0);
-    } vertices.push_back(seeding_face->vertex(1));
-    
-    // Find cutting vertices
-    std::set<Triangulation::Vertex_handle> visited_vertices;
-    std::set<Triangulation::Vertex_handle> repeated_vertices;
-    for (std::list<Triangulation::Vertex_handle>::iterator current_vertex = vertices.begin(); current_vertex != vertices.end(); ++current_vertex) {
-      if (!visited_vertices.insert(*current_vertex).second) repeated_vertices.insert(*current_vertex);
-    } visited_vertices.clear();
-    
-    // Cut and join rings in the correct order
-    std::list<std::list<Triangulation::Vertex_handle> > rings;
-    std::stack<std::list<Triangulation::Vertex_handle> > chains_stack;
-    std::set<Triangulation::Vertex_handle> vertices_where_chains_begin;
-    rings.push_back(std::list<Triangulation::Vertex_handle>());
-    for (std::list<Triangulation::Vertex_handle>::iterator current_vertex = vertices.begin(); current_vertex != vertices.end(); ++current_vertex) {
-      
-      // New chain
-      if (repeated_vertices.count(*current_vertex) > 0) {
-        // Closed by itself
-        if (rings.back().front() == *current_vertex) {
-          // Degenerate (insufficient vertices to be valid)
-          if (rings.back().size() < 3) {
-            rings.back().clear();
-          } else {
-            std::list<Triangulation::Vertex_handle>::iterator second_element = rings.back().begin();
-            ++second_element;
-            // Degenerate (zero area)
-            if (rings.back().back() == *second_element) {
-              rings.back().clear();
-            }
-            // Valid
-            else {
-              rings.push_back(std::list<Triangulation::Vertex_handle>());
-            }
-          }
-        }
-        // Open by itself
-        else {
-          // Closed with others in stack
-          if (vertices_where_chains_begin.count(*current_vertex)) {
-            
-            while (rings.back().front() != *current_vertex) {
-              rings.back().splice(rings.back().begin(), chains_stack.top());
-              chains_stack.pop();
-            } vertices_where_chains_begin.erase(*current_vertex);
-            // Degenerate (insufficient vertices to be valid)
-            if (rings.back().size() < 3) {
-              rings.back().clear();
-            } else {
-              std::list<Triangulation::Vertex_handle>::iterator second_element = rings.back().begin();
-              ++second_element;
-              // Degenerate (zero area)
-              if (rings.back().back() == *second_element) {
-                rings.back().clear();
-              }
-              // Valid
-              else {
-                rings.push_back(std::list<Triangulation::Vertex_handle>());
-              }
-            }
-          }
-          // Open
-          else {
-            // Not first chain
-            if (repeated_vertices.count(rings.back().front()) > 0) {
-              vertices_where_chains_begin.insert(rings.back().front());
-            }
-            chains_stack.push(std::list<Triangulation::Vertex_handle>());
-            chains_stack.top().splice(chains_stack.top().begin(), rings.back());
-          }
-        }
-      } rings.back().push_back(*current_vertex);
-    }
-    // Final ring
-    while (chains_stack.size() > 0) {
-      rings.back().splice(rings.back().begin(), chains_stack.top());
-      chains_stack.pop();
+  // Fill holes smaller than min_area (exterior components that do not reach the infinite face)
+  for (Triangulation::All_faces_iterator current_face = triangulation.all_faces_begin(); current_face != triangulation.all_faces_end(); ++current_face)
+    current_face->info().been_visited(false);
+  std::vector<Triangulation::Face_handle> outside;
+  get_component(triangulation.infinite_face(), outside);
+  for (Triangulation::Finite_faces_iterator seeding_face = triangulation.finite_faces_begin(); seeding_face != triangulation.finite_faces_end(); ++seeding_face) {
+    if (seeding_face->info().is_in_interior() || seeding_face->info().been_visited()) continue;
+    std::vector<Triangulation::Face_handle> component;
+    get_component(seeding_face, component);
+    if (!is_smaller_than(component, min_area)) continue;
+    for (std::vector<Triangulation::Face_handle>::iterator current_face = component.begin(); current_face != component.end(); ++current_face)
+      (*current_face)->info().is_in_interior(true);
+  }
+}
+
+void Polygon_repair::get_component(Triangulation::Face_handle seeding_face, std::vector<Triangulation::Face_handle> &faces) {
+  bool in_interior = seeding_face->info().is_in_interior();
+  std::stack<Triangulation::Face_handle> to_visit;
+  seeding_face->info().been_visited(true);
+  to_visit.push(seeding_face);
+  while (!to_visit.empty()) {
+    Triangulation::Face_handle current_face = to_visit.top();
+    to_visit.pop();
+    faces.push_back(current_face);
+    for (int current_edge = 0; current_edge < 3; ++current_edge) {
+      Triangulation::Face_handle neighbour = current_face->neighbor(current_edge);
+      if (neighbour->info().been_visited() || neighbour->info().is_in_interior() != in_interior) continue;
+      neighbour->info().been_visited(true);
+      to_visit.push(neighbour);
     }
-    // Degenerate (insufficient vertices to be valid)
-    if (rings.back().size() < 3) {
-      rings.back().clear();
-    } else {
-      std::list<Triangulation::Vertex_handle>::iterator second_element = rings.back().begin();
-      ++second_element;
-      // Degenerate (zero area)
-      if (rings.back().back() == *second_element) {
-        rings.back().clear();
+  }
+}
+
+bool Polygon_repair::is_smaller_than(const std::vector<Triangulation::Face_handle> &faces, double min_area) {
+  // Fast path: twice the area in double precision together with a bound on its rounding error
+  const double epsilon = std::numeric_limits<double>::epsilon();
+  double twice_area = 0.0, error_bound = 0.0, magnitude_sum = 0.0;
+  for (std::vector<Triangulation::Face_handle>::const_iterator current_face = faces.begin(); current_face != faces.end(); ++current_face) {
+    if (triangulation.is_infinite(*current_face)) return false;
+    double ax = CGAL::to_double((*current_face)->vertex(0)->point().x());
+    double ay = CGAL::to_double((*current_face)->vertex(0)->point().y());
+    double bx = CGAL::to_double((*current_face)->vertex(1)->point().x());
+    double by = CGAL::to_double((*current_face)->vertex(1)->point().y());
+    double cx = CGAL::to_double((*current_face)->vertex(2)->point().x());
+    double cy = CGAL::to_double((*current_face)->vertex(2)->point().y());
+    double first_product = (bx-ax)*(cy-ay);
+    double second_product = (cx-ax)*(by-ay);
+    double largest_coordinate = std::max(std::max(std::max(std::fabs(ax), std::fabs(ay)), std::max(std::fabs(bx), std::fabs(by))), std::max(std::fabs(cx), std::fabs(cy)));
+    double differences = std::fabs(bx-ax)+std::fabs(by-ay)+std::fabs(cx-ax)+std::fabs(cy-ay);
+    twice_area += first_product-second_product;
+    magnitude_sum += std::fabs(first_product-second_product);
+    error_bound += 8.0*epsilon*(std::fabs(first_product)+std::fabs(second_product)+largest_coordinate*differences);
+  } error_bound += (faces.size()+1)*epsilon*magnitude_sum;
+  if (twice_area+error_bound < 2.0*min_area) return true;
+  if (twice_area-error_bound > 2.0*min_area) return false;
+  
+  // Filter failed: exact sum
+  Triangulation::Geom_traits::FT area = 0;
+  Triangulation::Geom_traits::Compute_area_2 compute_area = triangulation.geom_traits().compute_area_2_object();
+  for (std::vector<Triangulation::Face_handle>::const_iterator current_face = faces.begin(); current_face != faces.end(); ++current_face) {
+    area += compute_area((*current_face)->vertex(0)->point(), (*current_face)->vertex(1)->point(), (*current_face)->vertex(2)->point());
+  } return area < min_area;
+}
+
+std::size_t Polygon_repair::prune_exact_numbers(bool time_results) {
+  // Only the topology and the tags are needed from here on, so every vertex can
+  // be rounded to doubles. This frees the lazy exact DAGs of the constructed
+  // points, which can take more memory than the triangulation itself, and
+  // makes every later conversion to double trivial. Rounding can move a vertex
+  // past a nearby edge, so the exact points are put back if any face is not
+  // counterclockwise afterwards: snapshots, the quality analysis and the viewer
+  // all read this triangulation. Returns the number of coordinates whose
+  // interval approximation could not tell their double
+  std::size_t number_of_exact_coordinates = 0;
+#ifdef EXACT_CONSTRUCTIONS
+  std::time_t this_time = time(NULL);
+  std::size_t number_of_released_points = 0;
+  std::vector<Point> exact_points;
+  exact_points.reserve(triangulation.number_of_vertices());
+  for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+    double coordinates[3];
+#ifdef COORDS_3D
+    const int number_of_coordinates = 3;
+#else
+    const int number_of_coordinates = 2;
+#endif
+    for (int current_coordinate = 0; current_coordinate < number_of_coordinates; ++current_coordinate) {
+      const Triangulation::Geom_traits::FT &coordinate = current_vertex->point()[current_coordinate];
+      
+      // Input points and most intersections have a singleton interval
+      CGAL::Interval_nt<false> interval = coordinate.approx();
+      if (interval.inf() == interval.sup()) coordinates[current_coordinate] = interval.inf();
+      else {
+        coordinates[current_coordinate] = CGAL::to_double(coordinate.exact());
+        ++number_of_exact_coordinates;
       }
     }
     
-    // Remove last ring if too small (or empty)
-    if (rings.back().size() < 3) {
-      rings.pop_back();
-    }
-    
-    // Start rings at the lexicographically smallest vertex
-    for (std::list<std::list<Triangulation::Vertex_handle> >::iterator current_ring = rings.begin(); current_ring != rings.end(); ++current_ring) {
-      std::list<Triangulation::Vertex_handle>::iterator smallest_vertex = current_ring->begin();
-      for (std::list<Triangulation::Vertex_handle>::iterator current_vertex = current_ring->begin(); current_vertex != current_ring->end(); ++current_vertex) {
-        if ((*current_vertex)->point() < (*smallest_vertex)->point()) smallest_vertex = current_vertex;
-      } if (current_ring->back() != *smallest_vertex) {
-        ++smallest_vertex;
-        current_ring->splice(current_ring->begin(), *current_ring, smallest_vertex, current_ring->end());
+    // A point that no other handle shares is freed with the DAG hanging from it
+    if (current_vertex->point().refs() == 1) ++number_of_released_points;
+    exact_points.push_back(current_vertex->point());
+#ifdef COORDS_3D
+    current_vertex->set_point(Point(coordinates[0], coordinates[1], coordinates[2]));
+#else
+    current_vertex->set_point(Point(coordinates[0], coordinates[1]));
+#endif
+  }
+  
+  bool is_valid = true;
+  if (triangulation.dimension() == 2) {
+    Triangulation::Geom_traits::Orientation_2 orientation = triangulation.geom_traits().orientation_2_object();
+    for (Triangulation::Finite_faces_iterator current_face = triangulation.finite_faces_begin(); current_face != triangulation.finite_faces_end(); ++current_face) {
+      if (orientation(current_face->vertex(0)->point(), current_face->vertex(1)->point(), current_face->vertex(2)->point()) != CGAL::COUNTERCLOCKWISE) {
+        is_valid = false;
+        break;
       }
     }
+  }
+  
+  if (!is_valid) {
+    std::vector<Point>::const_iterator current_point = exact_points.begin();
+    for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+      current_vertex->set_point(*current_point);
+      ++current_point;
+    } number_of_exact_coordinates = 0;
+    number_of_released_points = 0;
+  } exact_points.clear();
+  
+  if (time_results) {
+    std::time_t total_time = time(NULL)-this_time;
+    if (is_valid) std::cout << "Pruning exact numbers: " << total_time/60 << " minutes " << total_time%60 << " seconds, " << number_of_exact_coordinates << " coordinates evaluated exactly, lazy exact points of " << number_of_released_points << " of " << triangulation.number_of_vertices() << " vertices released." << std::endl;
+    else std::cout << "Pruning exact numbers: " << total_time/60 << " minutes " << total_time%60 << " seconds, skipped since rounding would invert a face." << std::endl;
+  }
+#endif
+  return number_of_exact_coordinates;
+}
+
+OGRGeometry *Polygon_repair::reconstruct() {
+  // std::cout << "Triangulation: " << triangulation.number_of_faces() << " faces, " << triangulation.number_of_vertices() << " vertices." << std::endl;
+  if (triangulation.number_of_faces() < 1) {
+    return new OGRPolygon();
+  }
+  
+  vertex_heights.clear();
+  if (!input_heights.empty()) get_vertex_heights();
+  
+  std::vector<Triangulation::Face_handle> interior_faces;
+  for (Triangulation::Finite_faces_iterator current_face = triangulation.finite_faces_begin(); current_face != triangulation.finite_faces_end(); ++current_face) {
+    if (current_face->info().is_in_interior()) interior_faces.push_back(current_face);
+  } return reconstruct(interior_faces);
+}
+
+OGRGeometry *Polygon_repair::reconstruct(const std::vector<Triangulation::Face_handle> &interior_faces) {
+  // Label the interior components first. Each one is reconstructed from its
+  // first face in the given order, so the output is the same whether they
+  // are reconstructed one by one or in parallel
+  for (std::vector<Triangulation::Face_handle>::const_iterator current_face = interior_faces.begin(); current_face != interior_faces.end(); ++current_face) {
+    (*current_face)->info().been_visited(false);
+    (*current_face)->info().been_reconstructed(false);
+  } std::vector<Triangulation::Face_handle> seeding_faces;
+  std::vector<std::size_t> first_components_of_tasks(1, 0);
+  std::vector<Triangulation::Face_handle> component;
+  std::size_t faces_in_task = 0;
+  for (std::vector<Triangulation::Face_handle>::const_iterator seeding_face = interior_faces.begin(); seeding_face != interior_faces.end(); ++seeding_face) {
+    if ((*seeding_face)->info().been_visited()) continue;
+    if (faces_in_task >= faces_per_reconstruction_task) {
+      first_components_of_tasks.push_back(seeding_faces.size());
+      faces_in_task = 0;
+    } seeding_faces.push_back(*seeding_face);
+    component.clear();
+    get_component(*seeding_face, component);
+    faces_in_task += component.size();
+  } first_components_of_tasks.push_back(seeding_faces.size());
+  
+  // Reconstruct
+  std::vector<OGRPolygon *> polygons(seeding_faces.size(), NULL);
+  if (scheduler == NULL || first_components_of_tasks.size() < 3) {
+    reconstruct_components(seeding_faces, 0, seeding_faces.size(), NULL, polygons);
+  } else {
     
-    // Make rings
-    if (rings.size() == 0) continue;
-    std::list<OGRLinearRing *> rings_for_polygon;
-    for (std::list<std::list<Triangulation::Vertex_handle> >::iterator current_ring = rings.begin(); current_ring != rings.end(); ++current_ring) {
-      OGRLinearRing *new_ring = new OGRLinearRing();
-      for (std::list<Triangulation::Vertex_handle>::reverse_iterator current_vertex = current_ring->rbegin(); current_vertex != current_ring->rend(); ++current_vertex) {
-        new_ring->addPoint(CGAL::to_double((*current_vertex)->point().x()), CGAL::to_double((*current_vertex)->point().y()));
-      } new_ring->addPoint(CGAL::to_double(current_ring->back()->point().x()), CGAL::to_double(current_ring->back()->point().y()));
-      rings_for_polygon.push_back(new_ring);
-    } OGRPolygon *new_polygon = new OGRPolygon();
-    for (std::list<OGRLinearRing *>::iterator current_ring = rings_for_polygon.begin(); current_ring != rings_for_polygon.end(); ++current_ring) {
-      if (!(*current_ring)->isClockwise()) {
-        new_polygon->addRingDirectly(*current_ring);
-        break;
-      }
-    } for (std::list<OGRLinearRing *>::iterator current_ring = rings_for_polygon.begin(); current_ring != rings_for_polygon.end(); ++current_ring)
-      if ((*current_ring)->isClockwise()) new_polygon->addRingDirectly(*current_ring);
-    out_geometries->addGeometryDirectly(new_polygon);
+    // The coordinates are read here once, so the tasks do not share the reference counted exact numbers of the vertices where components touch
+    Vertex_coordinates coordinates;
+    coordinates.reserve(triangulation.number_of_vertices());
+    for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+      coordinates[&*current_vertex] = Coordinates(CGAL::to_double(current_vertex->point().x()), CGAL::to_double(current_vertex->point().y()));
+    } Task_group reconstruction_tasks(*scheduler);
+    for (std::size_t current_task = 0; current_task+1 < first_components_of_tasks.size(); ++current_task) {
+      reconstruction_tasks.run(boost::bind(&Polygon_repair::reconstruct_components, this, boost::cref(seeding_faces), first_components_of_tasks[current_task], first_components_of_tasks[current_task+1], &coordinates, boost::ref(polygons)));
+    } reconstruction_tasks.wait();
+  }
+  
+  OGRMultiPolygon *out_geometries = new OGRMultiPolygon();
+  for (std::vector<OGRPolygon *>::iterator current_polygon = polygons.begin(); current_polygon != polygons.end(); ++current_polygon) {
+    if (*current_polygon != NULL) out_geometries->addGeometryDirectly(*current_polygon);
   }
   
   if (out_geometries->getNumGeometries() == 0) {
@@ -584,48 +1043,339 @@ OGRGeometry *Polygon_repair::reconstruct() {
   return out_geometries;
 }
 
-void remove_small_parts(OGRGeometry *geometry, double min_area) {
-  switch (geometry->getGeometryType()) {
-    case wkbPolygon: {
-      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
-      if (polygon->getExteriorRing()->get_Area() < min_area) {
-        polygon->empty();
-        return;
-      } OGRPolygon *new_polygon = new OGRPolygon();
-      new_polygon->addRing(polygon->getExteriorRing());
-      for (int currentRing = 0; currentRing < polygon->getNumInteriorRings(); ++currentRing) {
-        if (polygon->getInteriorRing(currentRing)->get_Area() >= min_area) {
-          new_polygon->addRing(polygon->getInteriorRing(currentRing));
+void Polygon_repair::reconstruct_components(const std::vector<Triangulation::Face_handle> &seeding_faces, std::size_t first_component, std::size_t last_component, const Vertex_coordinates *coordinates, std::vector<OGRPolygon *> &polygons) {
+  for (std::size_t current_component = first_component; current_component < last_component; ++current_component) {
+    polygons[current_component] = reconstruct_component(seeding_faces[current_component], coordinates);
+  }
+}
+
+Polygon_repair::Coordinates Polygon_repair::get_coordinates(Triangulation::Vertex_handle vertex, const Vertex_coordinates *coordinates) {
+  if (coordinates == NULL) return Coordinates(CGAL::to_double(vertex->point().x()), CGAL::to_double(vertex->point().y()));
+  return coordinates->find(&*vertex)->second;
+}
+
+OGRPolygon *Polygon_repair::reconstruct_component(Triangulation::Face_handle seeding_face, const Vertex_coordinates *coordinates) {
+  seeding_face->info().been_reconstructed(true);
+  
+  // Get boundary
+  std::vector<Triangulation::Vertex_handle> vertices;
+  if (seeding_face->neighbor(2)->info().is_in_interior() && !seeding_face->neighbor(2)->info().been_reconstructed()) {
+    seeding_face->neighbor(2)->info().been_reconstructed(true);
+    get_boundary(seeding_face->neighbor(2), seeding_face->neighbor(2)->index(seeding_face), vertices);
+  } vertices.push_back(seeding_face->vertex(0));
+  if (seeding_face->neighbor(1)->info().is_in_interior() && !seeding_face->neighbor(1)->info().been_reconstructed()) {
+    seeding_face->neighbor(1)->info().been_reconstructed(true);
+    get_boundary(seeding_face->neighbor(1), seeding_face->neighbor(1)->index(seeding_face), vertices);
+  } vertices.push_back(seeding_face->vertex(2));
+  if (seeding_face->neighbor(0)->info().is_in_interior() && !seeding_face->neighbor(0)->info().been_reconstructed()) {
+    seeding_face->neighbor(0)->info().been_reconstructed(true);
+    get_boundary(seeding_face->neighbor(0), seeding_face->neighbor(0)->index(seeding_face), vertices);
+  } vertices.push_back(seeding_face->vertex(1));
+  
+  // Find cutting vertices
+  std::vector<Triangulation::Vertex_handle> repeated_vertices(vertices);
+  std::sort(repeated_vertices.begin(), repeated_vertices.end());
+  std::vector<Triangulation::Vertex_handle>::iterator last_repeated_vertex = repeated_vertices.begin();
+  for (std::vector<Triangulation::Vertex_handle>::iterator current_vertex = repeated_vertices.begin(); current_vertex != repeated_vertices.end(); ++current_vertex) {
+    std::vector<Triangulation::Vertex_handle>::iterator next_vertex = current_vertex+1;
+    if (next_vertex == repeated_vertices.end() || *next_vertex != *current_vertex) continue;
+    if (last_repeated_vertex == repeated_vertices.begin() || *(last_repeated_vertex-1) != *current_vertex) *last_repeated_vertex++ = *current_vertex;
+  } repeated_vertices.erase(last_repeated_vertex, repeated_vertices.end());
+  
+  // Cut and join rings in the correct order. Finished rings are stored one
+  // after the other in ring_vertices. The open chains and the current ring
+  // are kept in open_vertices in the same way, so closing a ring with the
+  // chains on the stack only moves the start of the current ring back
+  std::vector<Triangulation::Vertex_handle> ring_vertices, open_vertices;
+  std::vector<std::size_t> ring_starts, chain_starts;
+  std::set<Triangulation::Vertex_handle> vertices_where_chains_begin;
+  ring_vertices.reserve(vertices.size());
+  open_vertices.reserve(vertices.size());
+  std::size_t current_ring_start = 0;
+  for (std::vector<Triangulation::Vertex_handle>::iterator current_vertex = vertices.begin(); current_vertex != vertices.end(); ++current_vertex) {
+    
+    // New chain
+    if (std::binary_search(repeated_vertices.begin(), repeated_vertices.end(), *current_vertex)) {
+      // Closed by itself
+      if (current_ring_start < open_vertices.size() && open_vertices[current_ring_start] == *current_vertex) {
+        close_ring(open_vertices, current_ring_start, ring_vertices, ring_starts);
+      }
+      // Open by itself
+      else {
+        // Closed with others in stack
+        if (vertices_where_chains_begin.count(*current_vertex)) {
+          while (!chain_starts.empty() && (current_ring_start == open_vertices.size() || open_vertices[current_ring_start] != *current_vertex)) {
+            current_ring_start = chain_starts.back();
+            chain_starts.pop_back();
+          } vertices_where_chains_begin.erase(*current_vertex);
+          close_ring(open_vertices, current_ring_start, ring_vertices, ring_starts);
         }
-      } delete geometry;
-      geometry = new_polygon;
-      break;
-    }
-      
-    case wkbMultiPolygon: {
-      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
-      for (int current_polygon = multipolygon->getNumGeometries()-1; current_polygon > 0; --current_polygon) {
-        remove_small_parts(multipolygon->getGeometryRef(current_polygon), current_polygon);
-        if (static_cast<OGRPolygon *>(multipolygon->getGeometryRef(current_polygon))->get_Area() < min_area) {
-          multipolygon->removeGeometry(current_polygon);
+        // Open
+        else {
+          // Not first chain
+          if (current_ring_start < open_vertices.size() && std::binary_search(repeated_vertices.begin(), repeated_vertices.end(), open_vertices[current_ring_start])) {
+            vertices_where_chains_begin.insert(open_vertices[current_ring_start]);
+          }
+          chain_starts.push_back(current_ring_start);
+          current_ring_start = open_vertices.size();
         }
-      } break;
+      }
+    } open_vertices.push_back(*current_vertex);
+  }
+  // Final ring
+  if (!chain_starts.empty()) current_ring_start = chain_starts.front();
+  close_ring(open_vertices, current_ring_start, ring_vertices, ring_starts);
+  ring_starts.push_back(ring_vertices.size());
+  
+  // Start rings at the lexicographically smallest vertex
+  for (std::size_t current_ring = 0; current_ring+1 < ring_starts.size(); ++current_ring) {
+    std::size_t smallest_vertex = ring_starts[current_ring];
+    Coordinates smallest_coordinates = get_coordinates(ring_vertices[smallest_vertex], coordinates);
+    for (std::size_t current_vertex = ring_starts[current_ring]+1; current_vertex < ring_starts[current_ring+1]; ++current_vertex) {
+      Coordinates current_coordinates = get_coordinates(ring_vertices[current_vertex], coordinates);
+      if (current_coordinates < smallest_coordinates) {
+        smallest_vertex = current_vertex;
+        smallest_coordinates = current_coordinates;
+      }
+    } if (ring_vertices[ring_starts[current_ring+1]-1] != ring_vertices[smallest_vertex]) {
+      std::rotate(ring_vertices.begin()+ring_starts[current_ring], ring_vertices.begin()+smallest_vertex+1, ring_vertices.begin()+ring_starts[current_ring+1]);
     }
-      
-    default:
-      std::cerr << "Error: Input type not supported" << std::endl;
-      return;
+  }
+  
+  // Make rings. The coordinates of a ring go into one buffer that is handed
+  // to OGR at once, and its orientation comes from the signed area summed
+  // while converting them (relative to the first vertex to keep precision)
+  if (ring_starts.size() < 2) return NULL;
+  std::vector<OGRLinearRing *> rings_for_polygon;
+  std::vector<bool> clockwise_rings;
+  std::vector<double> x, y, z;
+  bool with_heights = !vertex_heights.empty();
+  for (std::size_t current_ring = 0; current_ring+1 < ring_starts.size(); ++current_ring) {
+    int number_of_points = (int)(ring_starts[current_ring+1]-ring_starts[current_ring]+1);
+    x.resize(number_of_points);
+    y.resize(number_of_points);
+    if (with_heights) z.resize(number_of_points);
+    double twice_area = 0.0;
+    int current_point = 0;
+    for (std::size_t current_vertex = ring_starts[current_ring+1]; current_vertex > ring_starts[current_ring]; --current_vertex) {
+      Coordinates current_coordinates = get_coordinates(ring_vertices[current_vertex-1], coordinates);
+      x[current_point] = current_coordinates.first;
+      y[current_point] = current_coordinates.second;
+      if (with_heights) z[current_point] = vertex_heights.find(&*ring_vertices[current_vertex-1])->second;
+      if (current_point > 1) twice_area += (x[current_point-1]-x[0])*(y[current_point]-y[0])-(x[current_point]-x[0])*(y[current_point-1]-y[0]);
+      ++current_point;
+    } x[current_point] = x[0];
+    y[current_point] = y[0];
+    OGRLinearRing *new_ring = new OGRLinearRing();
+    if (with_heights) {
+      z[current_point] = z[0];
+      new_ring->setPoints(number_of_points, &x.front(), &y.front(), &z.front());
+    } else new_ring->setPoints(number_of_points, &x.front(), &y.front());
+    rings_for_polygon.push_back(new_ring);
+    clockwise_rings.push_back(twice_area < 0.0);
+  }
+  
+  // One outer ring and all the inner ones
+  OGRPolygon *new_polygon = new OGRPolygon();
+  bool has_outer_ring = false;
+  for (std::size_t current_ring = 0; current_ring < rings_for_polygon.size(); ++current_ring) {
+    if (clockwise_rings[current_ring] || has_outer_ring) continue;
+    new_polygon->addRingDirectly(rings_for_polygon[current_ring]);
+    rings_for_polygon[current_ring] = NULL;
+    has_outer_ring = true;
+  } for (std::size_t current_ring = 0; current_ring < rings_for_polygon.size(); ++current_ring) {
+    if (rings_for_polygon[current_ring] == NULL) continue;
+    if (clockwise_rings[current_ring]) new_polygon->addRingDirectly(rings_for_polygon[current_ring]);
+    else delete rings_for_polygon[current_ring];
+  } return new_polygon;
+}
+
+void Polygon_repair::get_vertex_heights() {
+  // Input vertices keep their own height
+  std::vector<Triangulation::Vertex_handle> interpolated_vertices;
+  vertex_heights.reserve(triangulation.number_of_vertices());
+  for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+    Input_heights::const_iterator input_height = input_heights.find(Coordinates(CGAL::to_double(current_vertex->point().x()), CGAL::to_double(current_vertex->point().y())));
+    if (input_height != input_heights.end()) vertex_heights[&*current_vertex] = input_height->second;
+    else interpolated_vertices.push_back(current_vertex);
+  }
+  
+  // Vertices created where constraints cross get heights interpolated along them
+  for (std::vector<Triangulation::Vertex_handle>::iterator current_vertex = interpolated_vertices.begin(); current_vertex != interpolated_vertices.end(); ++current_vertex) {
+    vertex_heights[&**current_vertex] = interpolate_height(*current_vertex);
+  }
+}
+
+double Polygon_repair::interpolate_height(Triangulation::Vertex_handle vertex) {
+  // Every pair of constrained neighbours in opposite directions is a constraint
+  // going through the vertex. The height is interpolated along each of them
+  // up to the nearest input vertices, and the results are averaged
+  std::vector<Triangulation::Vertex_handle> neighbours;
+  get_constrained_neighbours(vertex, neighbours);
+  double x = CGAL::to_double(vertex->point().x()), y = CGAL::to_double(vertex->point().y());
+  double height_sum = 0.0;
+  int number_of_constraints = 0;
+  for (std::size_t first_neighbour = 0; first_neighbour < neighbours.size(); ++first_neighbour) {
+    double first_dx = CGAL::to_double(neighbours[first_neighbour]->point().x())-x;
+    double first_dy = CGAL::to_double(neighbours[first_neighbour]->point().y())-y;
+    for (std::size_t second_neighbour = first_neighbour+1; second_neighbour < neighbours.size(); ++second_neighbour) {
+      double second_dx = CGAL::to_double(neighbours[second_neighbour]->point().x())-x;
+      double second_dy = CGAL::to_double(neighbours[second_neighbour]->point().y())-y;
+      double cosine = (first_dx*second_dx+first_dy*second_dy)/std::sqrt((first_dx*first_dx+first_dy*first_dy)*(second_dx*second_dx+second_dy*second_dy));
+      if (cosine > -0.999999) continue;
+      double first_height, first_distance, second_height, second_distance;
+      if (!walk_to_input_height(vertex, neighbours[first_neighbour], first_height, first_distance) ||
+          !walk_to_input_height(vertex, neighbours[second_neighbour], second_height, second_distance)) continue;
+      height_sum += first_height+(second_height-first_height)*first_distance/(first_distance+second_distance);
+      ++number_of_constraints;
+    }
+  } if (number_of_constraints > 0) return height_sum/number_of_constraints;
+  
+  // Not on a constraint between input vertices, so use its neighbours
+  for (std::vector<Triangulation::Vertex_handle>::iterator current_neighbour = neighbours.begin(); current_neighbour != neighbours.end(); ++current_neighbour) {
+    Input_heights::const_iterator input_height = input_heights.find(Coordinates(CGAL::to_double((*current_neighbour)->point().x()), CGAL::to_double((*current_neighbour)->point().y())));
+    if (input_height == input_heights.end()) continue;
+    height_sum += input_height->second;
+    ++number_of_constraints;
+  } if (number_of_constraints > 0) return height_sum/number_of_constraints;
+  return 0.0;
+}
+
+bool Polygon_repair::walk_to_input_height(Triangulation::Vertex_handle from, Triangulation::Vertex_handle to, double &height, double &distance) {
+  // Follows the constraint from -> to in a straight line until an input vertex
+  distance = 0.0;
+  std::vector<Triangulation::Vertex_handle> neighbours;
+  for (std::size_t steps = 0; steps < triangulation.number_of_vertices(); ++steps) {
+    double from_x = CGAL::to_double(from->point().x()), from_y = CGAL::to_double(from->point().y());
+    double to_x = CGAL::to_double(to->point().x()), to_y = CGAL::to_double(to->point().y());
+    double dx = to_x-from_x, dy = to_y-from_y;
+    double length = std::sqrt(dx*dx+dy*dy);
+    distance += length;
+    Input_heights::const_iterator input_height = input_heights.find(Coordinates(to_x, to_y));
+    if (input_height != input_heights.end()) {
+      height = input_height->second;
+      return true;
+    }
+    
+    neighbours.clear();
+    get_constrained_neighbours(to, neighbours);
+    Triangulation::Vertex_handle next = to;
+    for (std::vector<Triangulation::Vertex_handle>::iterator current_neighbour = neighbours.begin(); current_neighbour != neighbours.end(); ++current_neighbour) {
+      if (*current_neighbour == from) continue;
+      double next_dx = CGAL::to_double((*current_neighbour)->point().x())-to_x, next_dy = CGAL::to_double((*current_neighbour)->point().y())-to_y;
+      if ((dx*next_dx+dy*next_dy)/(length*std::sqrt(next_dx*next_dx+next_dy*next_dy)) < 0.999999) continue;
+      next = *current_neighbour;
       break;
+    } if (next == to) return false;
+    from = to;
+    to = next;
+  } return false;
+}
+
+void Polygon_repair::get_constrained_neighbours(Triangulation::Vertex_handle vertex, std::vector<Triangulation::Vertex_handle> &neighbours) {
+  Triangulation::Edge_circulator current_edge = triangulation.incident_edges(vertex), first_edge = current_edge;
+  if (current_edge == NULL) return;
+  do {
+    if (triangulation.is_infinite(current_edge) || !triangulation.is_constrained(*current_edge)) continue;
+    Triangulation::Vertex_handle neighbour = current_edge->first->vertex(current_edge->first->cw(current_edge->second));
+    if (neighbour == vertex) neighbour = current_edge->first->vertex(current_edge->first->ccw(current_edge->second));
+    neighbours.push_back(neighbour);
+  } while (++current_edge != first_edge);
+}
+
+bool Polygon_repair::label_constraint(Triangulation::Vertex_handle va, Triangulation::Vertex_handle vb, int feature, Edge_features &edge_features) {
+  // The pieces of [va, vb] are the constrained edges along it, each one ending
+  // closer to vb. Intersections are constructed exactly on the segments they
+  // split, so the exact predicates find them. With inexact constructions they
+  // can be off the segment, and the piece closest in direction is taken
+  Triangulation::Geom_traits::Orientation_2 orientation = triangulation.geom_traits().orientation_2_object();
+  Triangulation::Geom_traits::Compare_distance_2 compare_distance = triangulation.geom_traits().compare_distance_2_object();
+  Triangulation::Vertex_handle current_vertex = va;
+  std::vector<Triangulation::Vertex_handle> neighbours;
+  for (std::size_t steps = 0; current_vertex != vb && steps < triangulation.number_of_vertices(); ++steps) {
+    neighbours.clear();
+    get_constrained_neighbours(current_vertex, neighbours);
+    Triangulation::Vertex_handle next_vertex = current_vertex;
+    for (std::vector<Triangulation::Vertex_handle>::iterator current_neighbour = neighbours.begin(); current_neighbour != neighbours.end(); ++current_neighbour) {
+      if (*current_neighbour == vb ||
+          (orientation(va->point(), vb->point(), (*current_neighbour)->point()) == CGAL::COLLINEAR &&
+           compare_distance(vb->point(), (*current_neighbour)->point(), current_vertex->point()) == CGAL::SMALLER &&
+           compare_distance(current_vertex->point(), (*current_neighbour)->point(), vb->point()) == CGAL::SMALLER)) {
+        next_vertex = *current_neighbour;
+        break;
+      }
+    }
+    
+#ifndef EXACT_CONSTRUCTIONS
+    if (next_vertex == current_vertex) {
+      double x = CGAL::to_double(current_vertex->point().x()), y = CGAL::to_double(current_vertex->point().y());
+      double dx = CGAL::to_double(vb->point().x())-x, dy = CGAL::to_double(vb->point().y())-y;
+      double best_cosine = 0.999;
+      for (std::vector<Triangulation::Vertex_handle>::iterator current_neighbour = neighbours.begin(); current_neighbour != neighbours.end(); ++current_neighbour) {
+        double next_dx = CGAL::to_double((*current_neighbour)->point().x())-x, next_dy = CGAL::to_double((*current_neighbour)->point().y())-y;
+        double cosine = (dx*next_dx+dy*next_dy)/std::sqrt((dx*dx+dy*dy)*(next_dx*next_dx+next_dy*next_dy));
+        if (cosine <= best_cosine) continue;
+        best_cosine = cosine;
+        next_vertex = *current_neighbour;
+      }
+    }
+#endif
+    if (next_vertex == current_vertex) return false;
+    
+    // Odd-even per feature: a feature that goes over the same edge twice cancels out
+    Vertex_pair edge = &*current_vertex < &*next_vertex ? Vertex_pair(&*current_vertex, &*next_vertex) : Vertex_pair(&*next_vertex, &*current_vertex);
+    std::vector<int> &features = edge_features[edge];
+    std::vector<int>::iterator position = std::lower_bound(features.begin(), features.end(), feature);
+    if (position != features.end() && *position == feature) features.erase(position);
+    else features.insert(position, feature);
+    current_vertex = next_vertex;
+  } return current_vertex == vb;
+}
+
+void Polygon_repair::tag_coverage(const Edge_features &edge_features, std::vector<std::vector<Triangulation::Face_handle> > &faces_of_features) {
+  // The features of a face are those of its neighbour, toggled by the features of the edge between them
+  for (Triangulation::All_faces_iterator current_face = triangulation.all_faces_begin(); current_face != triangulation.all_faces_end(); ++current_face) {
+    current_face->info().clear();
+    current_face->info().is_in_interior(false);
+  }
+  
+  std::unordered_map<const Triangulation::Face *, std::vector<int> > features_of_faces;
+  std::stack<Triangulation::Face_handle> to_visit;
+  triangulation.infinite_face()->info().been_visited(true);
+  features_of_faces[&*triangulation.infinite_face()];
+  to_visit.push(triangulation.infinite_face());
+  while (!to_visit.empty()) {
+    Triangulation::Face_handle current_face = to_visit.top();
+    to_visit.pop();
+    const std::vector<int> &current_features = features_of_faces[&*current_face];
+    if (!triangulation.is_infinite(current_face)) {
+      for (std::vector<int>::const_iterator current_feature = current_features.begin(); current_feature != current_features.end(); ++current_feature) {
+        faces_of_features[*current_feature].push_back(current_face);
+      }
+    }
+    
+    for (int current_edge = 0; current_edge < 3; ++current_edge) {
+      Triangulation::Face_handle neighbour = current_face->neighbor(current_edge);
+      if (neighbour->info().been_visited()) continue;
+      neighbour->info().been_visited(true);
+      to_visit.push(neighbour);
+      std::vector<int> &neighbour_features = features_of_faces[&*neighbour];
+      Edge_features::const_iterator edge_features_entry = edge_features.end();
+      if (current_face->is_constrained(current_edge)) {
+        const Triangulation::Vertex *first_vertex = &*current_face->vertex(current_face->cw(current_edge));
+        const Triangulation::Vertex *second_vertex = &*current_face->vertex(current_face->ccw(current_edge));
+        edge_features_entry = edge_features.find(first_vertex < second_vertex ? Vertex_pair(first_vertex, second_vertex) : Vertex_pair(second_vertex, first_vertex));
+      } if (edge_features_entry == edge_features.end()) neighbour_features = current_features;
+      else std::set_symmetric_difference(current_features.begin(), current_features.end(), edge_features_entry->second.begin(), edge_features_entry->second.end(), std::back_inserter(neighbour_features));
+    }
   }
 }
 
-void Polygon_repair::get_boundary(Triangulation::Face_handle face, int edge, std::list<Triangulation::Vertex_handle> &out_vertices) {
+void Polygon_repair::get_boundary(Triangulation::Face_handle face, int edge, std::vector<Triangulation::Vertex_handle> &out_vertices) {
   // Check clockwise edge
   if (face->neighbor(face->cw(edge))->info().is_in_interior() && !face->neighbor(face->cw(edge))->info().been_reconstructed()) {
 		face->neighbor(face->cw(edge))->info().been_reconstructed(true);
-    std::list<Triangulation::Vertex_handle> v1;
-    get_boundary(face->neighbor(face->cw(edge)), face->neighbor(face->cw(edge))->index(face), v1);
-		out_vertices.splice(out_vertices.end(), v1);
+    get_boundary(face->neighbor(face->cw(edge)), face->neighbor(face->cw(edge))->index(face), out_vertices);
 	}
 	
 	// Add central vertex
@@ -634,8 +1384,15 @@ void Polygon_repair::get_boundary(Triangulation::Face_handle face, int edge, std
 	// Check counterclockwise edge
   if (face->neighbor(face->ccw(edge))->info().is_in_interior() && !face->neighbor(face->ccw(edge))->info().been_reconstructed()) {
 		face->neighbor(face->ccw(edge))->info().been_reconstructed(true);
-		std::list<Triangulation::Vertex_handle> v2;
-    get_boundary(face->neighbor(face->ccw(edge)), face->neighbor(face->ccw(edge))->index(face), v2);
-		out_vertices.splice(out_vertices.end(), v2);
+    get_boundary(face->neighbor(face->ccw(edge)), face->neighbor(face->ccw(edge))->index(face), out_vertices);
 	}
+}
+
+void Polygon_repair::close_ring(std::vector<Triangulation::Vertex_handle> &open_vertices, std::size_t current_ring_start, std::vector<Triangulation::Vertex_handle> &ring_vertices, std::vector<std::size_t> &ring_starts) {
+  // Degenerate rings (insufficient vertices to be valid or zero area) are dropped
+  std::size_t ring_size = open_vertices.size()-current_ring_start;
+  if (ring_size >= 3 && open_vertices.back() != open_vertices[current_ring_start+1]) {
+    ring_starts.push_back(ring_vertices.size());
+    ring_vertices.insert(ring_vertices.end(), open_vertices.begin()+current_ring_start, open_vertices.end());
+  } open_vertices.resize(current_ring_start);
 }
\ No newline at end of file
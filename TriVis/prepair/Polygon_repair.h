@@ -23,31 +23,94 @@
 #define POLYGONREPAIR_H
 
 #include "Definitions.h"
+#include "Triangulation_snapshot.h"
+#include "Locate_hints.h"
+#include "Task_scheduler.h"
 
 class Polygon_repair {
 public:
   typedef prepair::Triangulation Triangulation;
   typedef prepair::Point Point;
   typedef prepair::Vector Vector;
+  typedef std::pair<double, double> Coordinates;
+  typedef std::unordered_map<const Triangulation::Vertex *, Coordinates> Vertex_coordinates;
+  typedef std::unordered_map<Coordinates, double, boost::hash<Coordinates> > Input_heights;
+  typedef std::unordered_map<const Triangulation::Vertex *, double> Vertex_heights;
+  typedef std::pair<const Triangulation::Vertex *, const Triangulation::Vertex *> Vertex_pair;
+  typedef std::unordered_map<Vertex_pair, std::vector<int>, boost::hash<Vertex_pair> > Edge_features;
+  
+  Polygon_repair() {
+    triangulation.budget = &budget;
+    scheduler = NULL;
+    number_of_height_conflicts = 0;
+  }
   
   bool is_iso_and_ogc_valid(OGRGeometry *in_geometry, const std::string &pre_text = std::string("\t"), bool time_results = false);
-  OGRGeometry *repair_odd_even(OGRGeometry *in_geometry, bool time_results = false);
-  OGRGeometry *repair_point_set(OGRGeometry *in_geometry, bool time_results = false);
-  void remove_small_parts(OGRGeometry *geometry, double min_area);
+  OGRGeometry *repair_odd_even(OGRGeometry *in_geometry, bool time_results = false, double min_area = 0.0);
+  OGRGeometry *repair_point_set(OGRGeometry *in_geometry, bool time_results = false, double min_area = 0.0);
+  
+  // Same result as repair_odd_even(), but the parts of a multipolygon whose
+  // bounding boxes are apart are repaired as separate tasks. The triangulation
+  // is left empty if there was more than one cluster
+  OGRGeometry *repair_odd_even_in_clusters(OGRGeometry *in_geometry, Task_scheduler &scheduler, double min_area = 0.0);
+  
+  // Repairs adjacent features in one shared triangulation, so the boundaries
+  // they share are inserted and intersected once and come out the same in all
+  // of them. Every feature is tagged with the odd-even rule on its own rings.
+  // Features whose rings cannot be followed through the triangulation are
+  // output empty and listed in failed_features
+  void repair_coverage(std::vector<OGRGeometry *> &in_geometries, std::vector<OGRGeometry *> &out_geometries, std::vector<std::size_t> &failed_features, bool time_results = false);
+  bool write_snapshot(const std::string &file_name, OGRGeometry *out_geometry);
 
 //private:
   Triangulation triangulation;
   Triangulation::Face_handle walk_start_location;
+  Locate_hints<Triangulation> locate_hints;
+  Work_budget budget;   // features that exhaust it are returned empty
+  Task_scheduler *scheduler;   // if set, the output polygons are reconstructed in parallel
+  
+  // Only filled for inputs with Z, which is then kept in the output. The
+  // triangulation stays 2D, so 2D inputs do not pay for it
+  Input_heights input_heights;
+  Vertex_heights vertex_heights;
+  
+  // Input vertices at the same x and y as an earlier one but at another
+  // height, which is lost since they are one vertex in the triangulation.
+  // Added up over repairs, like the steps of the budget, until reset
+  std::size_t number_of_height_conflicts;
   
   void insert_all_constraints(OGRGeometry *in_geometry);
   void insert_odd_even_constraints(OGRGeometry *in_geometry);
+  void get_rings(OGRGeometry *in_geometry, std::vector<std::vector<Point> > &rings);
+  void get_input_heights(OGRGeometry *in_geometry);
+  void get_clusters(OGRMultiPolygon *multipolygon, std::vector<std::vector<int> > &clusters);
+  static void repair_cluster(OGRGeometry *in_geometry, double min_area, OGRGeometry *&out_geometry, Work_budget &used_budget, std::size_t &height_conflicts);
+  void canonicalise_ring(std::vector<Point> &ring);
+  std::size_t hash_ring(const std::vector<Point> &ring);
+  void remove_duplicate_rings(std::vector<std::vector<Point> > &rings);
+  void insert_odd_even_ring(const std::vector<Point> &ring);
   void tag_odd_even();
   void tag_as_to_fill_in(OGRGeometry *geometry);
   void tag_as_to_carve_out(OGRGeometry *geometry);
   void tag_point_set_difference(std::list<OGRGeometry *> &geometries);
   void tag_point_set_union(std::list<OGRGeometry *> &geometries);
+  bool label_constraint(Triangulation::Vertex_handle va, Triangulation::Vertex_handle vb, int feature, Edge_features &edge_features);
+  void tag_coverage(const Edge_features &edge_features, std::vector<std::vector<Triangulation::Face_handle> > &faces_of_features);
+  void remove_small_parts(double min_area);
+  std::size_t prune_exact_numbers(bool time_results = false);
+  void get_component(Triangulation::Face_handle seeding_face, std::vector<Triangulation::Face_handle> &faces);
+  bool is_smaller_than(const std::vector<Triangulation::Face_handle> &faces, double min_area);
   OGRGeometry *reconstruct();
-  void get_boundary(Triangulation::Face_handle face, int edge, std::list<Triangulation::Vertex_handle> &out_vertices);
+  OGRGeometry *reconstruct(const std::vector<Triangulation::Face_handle> &interior_faces);
+  void get_vertex_heights();
+  double interpolate_height(Triangulation::Vertex_handle vertex);
+  bool walk_to_input_height(Triangulation::Vertex_handle from, Triangulation::Vertex_handle to, double &height, double &distance);
+  void get_constrained_neighbours(Triangulation::Vertex_handle vertex, std::vector<Triangulation::Vertex_handle> &neighbours);
+  void reconstruct_components(const std::vector<Triangulation::Face_handle> &seeding_faces, std::size_t first_component, std::size_t last_component, const Vertex_coordinates *coordinates, std::vector<OGRPolygon *> &polygons);
+  OGRPolygon *reconstruct_component(Triangulation::Face_handle seeding_face, const Vertex_coordinates *coordinates);
+  Coordinates get_coordinates(Triangulation::Vertex_handle vertex, const Vertex_coordinates *coordinates);
+  void get_boundary(Triangulation::Face_handle face, int edge, std::vector<Triangulation::Vertex_handle> &out_vertices);
+  void close_ring(std::vector<Triangulation::Vertex_handle> &open_vertices, std::size_t current_ring_start, std::vector<Triangulation::Vertex_handle> &ring_vertices, std::vector<std::size_t> &ring_starts);
 };
 
 #endif
\ No newline at end of file
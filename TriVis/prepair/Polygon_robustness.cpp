@@ -0,0 +1,197 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "Polygon_robustness.h"
+
+// STL
+#include <atomic>
+
+// Boost
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/thread.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+typedef bg::model::point<double, 2, bg::cs::cartesian> Index_point;
+typedef bg::model::segment<Index_point> Index_segment;
+typedef std::pair<Index_point, std::size_t> Indexed_vertex;
+typedef std::pair<Index_segment, std::size_t> Indexed_edge;   // from a vertex to the next one in its ring
+typedef bgi::rtree<Indexed_vertex, bgi::rstar<16> > Vertex_tree;
+typedef bgi::rtree<Indexed_edge, bgi::rstar<16> > Edge_tree;
+
+class Is_other_vertex {
+public:
+  Is_other_vertex(std::size_t vertex) : vertex(vertex) {}
+  bool operator()(const Indexed_vertex &other) const {
+    return other.second != vertex;
+  }
+private:
+  std::size_t vertex;
+};
+
+class Is_non_incident_edge {
+public:
+  Is_non_incident_edge(std::size_t vertex, const std::vector<std::size_t> &next_vertex) : vertex(vertex), next_vertex(next_vertex) {}
+  bool operator()(const Indexed_edge &edge) const {
+    return edge.second != vertex && next_vertex[edge.second] != vertex;
+  }
+private:
+  std::size_t vertex;
+  const std::vector<std::size_t> &next_vertex;
+};
+
+static void query_nearest(const Vertex_tree &vertex_tree, const Edge_tree &edge_tree, const std::vector<double> &x, const std::vector<double> &y, const std::vector<std::size_t> &next_vertex, std::size_t first_vertex, std::size_t last_vertex, Robustness &robustness) {
+  std::vector<Indexed_vertex> nearest_vertex;
+  std::vector<Indexed_edge> nearest_edge;
+  for (std::size_t current_vertex = first_vertex; current_vertex < last_vertex; ++current_vertex) {
+    Index_point point(x[current_vertex], y[current_vertex]);
+    
+    nearest_vertex.clear();
+    vertex_tree.query(bgi::nearest(point, 1) && bgi::satisfies(Is_other_vertex(current_vertex)), std::back_inserter(nearest_vertex));
+    if (!nearest_vertex.empty()) {
+      double distance = bg::distance(point, nearest_vertex.front().first);
+      if (distance < robustness.vertex_vertex) robustness.vertex_vertex = distance;
+    }
+    
+    nearest_edge.clear();
+    edge_tree.query(bgi::nearest(point, 1) && bgi::satisfies(Is_non_incident_edge(current_vertex, next_vertex)), std::back_inserter(nearest_edge));
+    if (!nearest_edge.empty()) {
+      double distance = bg::distance(point, nearest_edge.front().first);
+      if (distance < robustness.vertex_edge) robustness.vertex_edge = distance;
+    }
+  }
+}
+
+Robustness Polygon_robustness::compute(OGRGeometry *geometry, unsigned int number_of_threads) {
+  std::vector<double> x, y;
+  std::vector<std::size_t> ring_starts;
+  get_rings(geometry, x, y, ring_starts);
+  return compute(x, y, ring_starts, number_of_threads);
+}
+
+void Polygon_robustness::compute(std::vector<OGRGeometry *> &geometries, std::vector<Robustness> &results, unsigned int number_of_threads) {
+  results.assign(geometries.size(), Robustness());
+  if (number_of_threads < 1) number_of_threads = 1;
+  
+  // Every worker takes the next unprocessed geometry, so large geometries do not hold back the rest
+  std::atomic<std::size_t> next_geometry(0);
+  boost::thread_group workers;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    workers.create_thread([this, &geometries, &results, &next_geometry]() {
+      while (true) {
+        std::size_t current_geometry = next_geometry++;
+        if (current_geometry >= geometries.size()) break;
+        results[current_geometry] = compute(geometries[current_geometry]);
+      }
+    });
+  } workers.join_all();
+}
+
+Robustness Polygon_robustness::compute(const std::vector<double> &x, const std::vector<double> &y, const std::vector<std::size_t> &ring_starts, unsigned int number_of_threads) {
+  Robustness robustness;
+  std::size_t number_of_vertices = x.size();
+  if (number_of_vertices < 2) return robustness;
+  
+  // Ring topology
+  std::vector<std::size_t> next_vertex(number_of_vertices);
+  for (std::size_t current_ring = 0; current_ring < ring_starts.size(); ++current_ring) {
+    std::size_t ring_start = ring_starts[current_ring];
+    std::size_t ring_end = current_ring+1 < ring_starts.size() ? ring_starts[current_ring+1] : number_of_vertices;
+    for (std::size_t current_vertex = ring_start; current_vertex < ring_end; ++current_vertex) {
+      next_vertex[current_vertex] = current_vertex+1 < ring_end ? current_vertex+1 : ring_start;
+    }
+  }
+  
+  // Bulk load the indices
+  std::vector<Indexed_vertex> vertices;
+  std::vector<Indexed_edge> edges;
+  vertices.reserve(number_of_vertices);
+  edges.reserve(number_of_vertices);
+  for (std::size_t current_vertex = 0; current_vertex < number_of_vertices; ++current_vertex) {
+    Index_point point(x[current_vertex], y[current_vertex]);
+    vertices.push_back(Indexed_vertex(point, current_vertex));
+    if (next_vertex[current_vertex] == current_vertex) continue;
+    Index_point next_point(x[next_vertex[current_vertex]], y[next_vertex[current_vertex]]);
+    edges.push_back(Indexed_edge(Index_segment(point, next_point), current_vertex));
+  } Vertex_tree vertex_tree(vertices);
+  Edge_tree edge_tree(edges);
+  
+  // Queries are read-only, so large inputs are split among threads
+  if (number_of_threads < 1) number_of_threads = 1;
+  if (number_of_vertices < 4096*number_of_threads) number_of_threads = 1;
+  if (number_of_threads == 1) {
+    query_nearest(vertex_tree, edge_tree, x, y, next_vertex, 0, number_of_vertices, robustness);
+    return robustness;
+  }
+  
+  std::vector<Robustness> partial_results(number_of_threads);
+  boost::thread_group workers;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    std::size_t first_vertex = number_of_vertices*current_thread/number_of_threads;
+    std::size_t last_vertex = number_of_vertices*(current_thread+1)/number_of_threads;
+    workers.create_thread(boost::bind(&query_nearest, boost::cref(vertex_tree), boost::cref(edge_tree), boost::cref(x), boost::cref(y), boost::cref(next_vertex), first_vertex, last_vertex, boost::ref(partial_results[current_thread])));
+  } workers.join_all();
+  for (std::vector<Robustness>::iterator partial_result = partial_results.begin(); partial_result != partial_results.end(); ++partial_result) {
+    if (partial_result->vertex_vertex < robustness.vertex_vertex) robustness.vertex_vertex = partial_result->vertex_vertex;
+    if (partial_result->vertex_edge < robustness.vertex_edge) robustness.vertex_edge = partial_result->vertex_edge;
+  } return robustness;
+}
+
+void Polygon_robustness::get_rings(OGRGeometry *geometry, std::vector<double> &x, std::vector<double> &y, std::vector<std::size_t> &ring_starts) {
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbLineString: {
+      OGRLinearRing *ring = static_cast<OGRLinearRing *>(geometry);
+      int number_of_points = ring->getNumPoints();
+      if (number_of_points < 1) return;
+      // Skip the closing vertex
+      if (number_of_points > 1 && ring->getX(0) == ring->getX(number_of_points-1) && ring->getY(0) == ring->getY(number_of_points-1)) --number_of_points;
+      ring_starts.push_back(x.size());
+      for (int current_point = 0; current_point < number_of_points; ++current_point) {
+        x.push_back(ring->getX(current_point));
+        y.push_back(ring->getY(current_point));
+      } break;
+    }
+    
+    case wkbPolygon: {
+      // Given-up and degenerate features are output as empty polygons
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      if (polygon->getExteriorRing() == NULL) break;
+      get_rings(polygon->getExteriorRing(), x, y, ring_starts);
+      for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        get_rings(polygon->getInteriorRing(current_ring), x, y, ring_starts);
+      } break;
+    }
+    
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        get_rings(multipolygon->getGeometryRef(current_polygon), x, y, ring_starts);
+      } break;
+    }
+    
+    default:
+      std::cerr << "Error: Input type not supported" << std::endl;
+      return;
+      break;
+  }
+}
@@ -0,0 +1,63 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef POLYGONROBUSTNESS_H
+#define POLYGONROBUSTNESS_H
+
+// STL
+#include <vector>
+#include <limits>
+
+// OGR
+#include <gdal/ogrsf_frmts.h>
+
+// The robustness of a polygon is the smallest distance between two of its
+// vertices or between a vertex and an edge that is not incident to it
+class Robustness {
+public:
+  double vertex_vertex;
+  double vertex_edge;
+  
+  Robustness() {
+    vertex_vertex = std::numeric_limits<double>::infinity();
+    vertex_edge = std::numeric_limits<double>::infinity();
+  }
+  
+  double minimum() const {
+    return vertex_vertex < vertex_edge ? vertex_vertex : vertex_edge;
+  }
+};
+
+// Nearest features are found with an R-tree, so the cost is O(n log n) in
+// the number of vertices instead of the O(n^2) of checking all pairs
+class Polygon_robustness {
+public:
+  Robustness compute(OGRGeometry *geometry, unsigned int number_of_threads = 1);
+  void compute(std::vector<OGRGeometry *> &geometries, std::vector<Robustness> &results, unsigned int number_of_threads);
+  
+  // Rings are stored consecutively without their closing vertex, ring_starts holds the index of the first vertex of each ring
+  Robustness compute(const std::vector<double> &x, const std::vector<double> &y, const std::vector<std::size_t> &ring_starts, unsigned int number_of_threads = 1);
+
+//private:
+  void get_rings(OGRGeometry *geometry, std::vector<double> &x, std::vector<double> &y, std::vector<std::size_t> &ring_starts);
+};
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Repair_fuzzer.h"
+
+Fuzz_result Repair_fuzzer::run(const unsigned char *data, std::size_t size) {
+  Fuzz_result result;
+  OGRGeometry *in_geometry = NULL;
+  if (OGRGeometryFactory::createFromWkb(const_cast<unsigned char *>(data), NULL, &in_geometry, (int)size) != OGRERR_NONE || in_geometry == NULL) return result;
+  OGRwkbGeometryType type = wkbFlatten(in_geometry->getGeometryType());
+  if ((type != wkbPolygon && type != wkbMultiPolygon) || !has_finite_coordinates(in_geometry)) {
+    delete in_geometry;
+    return result;
+  } result.vertices = count_vertices(in_geometry);
+  if (result.vertices > max_vertices) {
+    delete in_geometry;
+    return result;
+  } result.accepted = true;
+  
+  OGRGeometry *out_geometry = NULL;
+  for (unsigned int current_repetition = 0; current_repetition < std::max(repetitions, 1u); ++current_repetition) {
+    delete out_geometry;
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    out_geometry = repair(in_geometry, scheduler, result.gave_up);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count();
+    if (current_repetition == 0 || seconds < result.seconds) result.seconds = seconds;
+  }
+  
+  if (!result.gave_up) {
+    result.valid = out_geometry->IsEmpty() || out_geometry->IsValid();
+    result.area = get_area(out_geometry);
+    if (differential) {
+      result.mismatched_samples = count_odd_even_mismatches(in_geometry, out_geometry);
+      result.matches_odd_even = result.mismatched_samples == 0;
+    }
+    
+    // Otherwise both repairs run the same code
+    if (differential && scheduler != NULL && splits_into_clusters(in_geometry)) {
+      bool serial_gave_up;
+      OGRGeometry *serial_geometry = repair(in_geometry, NULL, serial_gave_up);
+      if (serial_gave_up) result.gave_up = true;
+      else {
+        result.serial_area = get_area(serial_geometry);
+        result.matches_serial = have_same_area(result.area, result.serial_area) && (serial_geometry->IsEmpty() || serial_geometry->IsValid()) == result.valid;
+      } delete serial_geometry;
+    }
+  }
+  
+  delete out_geometry;
+  delete in_geometry;
+  return result;
+}
+
+std::size_t Repair_fuzzer::count_vertices(OGRGeometry *geometry) {
+  std::size_t vertices = 0;
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      if (polygon->getExteriorRing() != NULL) vertices += polygon->getExteriorRing()->getNumPoints();
+      for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        vertices += polygon->getInteriorRing(current_ring)->getNumPoints();
+      } break;
+    }
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        vertices += count_vertices(multipolygon->getGeometryRef(current_polygon));
+      } break;
+    }
+    default:
+      break;
+  } return vertices;
+}
+
+double Repair_fuzzer::get_area(OGRGeometry *geometry) {
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbPolygon:
+      return static_cast<OGRPolygon *>(geometry)->get_Area();
+    case wkbMultiPolygon:
+      return static_cast<OGRMultiPolygon *>(geometry)->get_Area();
+    default:
+      return 0.0;
+  }
+}
+
+std::size_t Repair_fuzzer::count_odd_even_mismatches(OGRGeometry *in_geometry, OGRGeometry *out_geometry) {
+  std::vector<OGRLinearRing *> in_rings, out_rings;
+  get_rings(in_geometry, in_rings);
+  get_rings(out_geometry, out_rings);
+  OGREnvelope envelope;
+  in_geometry->getEnvelope(&envelope);
+  double width = envelope.MaxX-envelope.MinX, height = envelope.MaxY-envelope.MinY;
+  if (!(width > 0.0) || !(height > 0.0) || !std::isfinite(width) || !std::isfinite(height)) return 0;
+  
+  // The samples are off the grid lines, where vertices often are. Points near
+  // an edge are skipped, since the output vertices at intersections are rounded
+  double tolerance = 1e-6*std::max(width, height);
+  std::size_t mismatches = 0;
+  for (int row = 0; row < samples_per_side; ++row) {
+    for (int column = 0; column < samples_per_side; ++column) {
+      double x = envelope.MinX+width*(column+0.37)/samples_per_side;
+      double y = envelope.MinY+height*(row+0.61)/samples_per_side;
+      if (distance_to_rings(in_rings, x, y) < tolerance || distance_to_rings(out_rings, x, y) < tolerance) continue;
+      if (is_inside_odd_even(in_rings, x, y) != is_inside_odd_even(out_rings, x, y)) ++mismatches;
+    }
+  } return mismatches;
+}
+
+bool Repair_fuzzer::has_finite_coordinates(OGRGeometry *geometry) {
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      for (int current_ring = -1; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        OGRLinearRing *ring = current_ring < 0 ? polygon->getExteriorRing() : polygon->getInteriorRing(current_ring);
+        if (ring == NULL) continue;
+        for (int current_point = 0; current_point < ring->getNumPoints(); ++current_point) {
+          if (!std::isfinite(ring->getX(current_point)) || !std::isfinite(ring->getY(current_point)) || !std::isfinite(ring->getZ(current_point))) return false;
+        }
+      } return true;
+    }
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        if (!has_finite_coordinates(multipolygon->getGeometryRef(current_polygon))) return false;
+      } return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool Repair_fuzzer::splits_into_clusters(OGRGeometry *geometry) {
+  if (wkbFlatten(geometry->getGeometryType()) != wkbMultiPolygon) return false;
+  Polygon_repair prepair;
+  std::vector<std::vector<int> > clusters;
+  prepair.get_clusters(static_cast<OGRMultiPolygon *>(geometry), clusters);
+  return clusters.size() > 1;
+}
+
+OGRGeometry *Repair_fuzzer::repair(OGRGeometry *in_geometry, Task_scheduler *repair_scheduler, bool &gave_up) {
+  Polygon_repair prepair;
+  prepair.scheduler = repair_scheduler;
+  prepair.budget.start(0.0, max_steps);
+  OGRGeometry *out_geometry;
+  if (repair_scheduler != NULL) out_geometry = prepair.repair_odd_even_in_clusters(in_geometry, *repair_scheduler);
+  else out_geometry = prepair.repair_odd_even(in_geometry);
+  gave_up = prepair.budget.is_exhausted();
+  return out_geometry;
+}
+
+// Both repairs compute the same exact triangulation, so only the rounding of
+// the output coordinates and of the area sums can tell them apart
+bool Repair_fuzzer::have_same_area(double area, double other_area) {
+  return std::abs(area-other_area) <= 1e-9*std::max(std::abs(area), std::abs(other_area));
+}
+
+void Repair_fuzzer::get_rings(OGRGeometry *geometry, std::vector<OGRLinearRing *> &rings) {
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      if (polygon->getExteriorRing() != NULL) rings.push_back(polygon->getExteriorRing());
+      for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        rings.push_back(polygon->getInteriorRing(current_ring));
+      } break;
+    }
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        get_rings(multipolygon->getGeometryRef(current_polygon), rings);
+      } break;
+    }
+    default:
+      break;
+  }
+}
+
+// Counts the crossings of a ray going right from (x, y). Rings are closed
+// here like prepair closes them, from their last point to their first
+bool Repair_fuzzer::is_inside_odd_even(const std::vector<OGRLinearRing *> &rings, double x, double y) {
+  bool inside = false;
+  for (std::vector<OGRLinearRing *>::const_iterator ring = rings.begin(); ring != rings.end(); ++ring) {
+    int number_of_points = (*ring)->getNumPoints();
+    for (int current_point = 0; current_point < number_of_points; ++current_point) {
+      int next_point = (current_point+1)%number_of_points;
+      double x1 = (*ring)->getX(current_point), y1 = (*ring)->getY(current_point);
+      double x2 = (*ring)->getX(next_point), y2 = (*ring)->getY(next_point);
+      if ((y1 > y) == (y2 > y)) continue;
+      if (x < x1+(y-y1)*(x2-x1)/(y2-y1)) inside = !inside;
+    }
+  } return inside;
+}
+
+double Repair_fuzzer::distance_to_rings(const std::vector<OGRLinearRing *> &rings, double x, double y) {
+  double distance = std::numeric_limits<double>::infinity();
+  for (std::vector<OGRLinearRing *>::const_iterator ring = rings.begin(); ring != rings.end(); ++ring) {
+    int number_of_points = (*ring)->getNumPoints();
+    for (int current_point = 0; current_point < number_of_points; ++current_point) {
+      int next_point = (current_point+1)%number_of_points;
+      double x1 = (*ring)->getX(current_point), y1 = (*ring)->getY(current_point);
+      double dx = (*ring)->getX(next_point)-x1, dy = (*ring)->getY(next_point)-y1;
+      double length = dx*dx+dy*dy;
+      double along = length > 0.0 ? std::max(0.0, std::min(1.0, ((x-x1)*dx+(y-y1)*dy)/length)) : 0.0;
+      distance = std::min(distance, std::hypot(x-x1-along*dx, y-y1-along*dy));
+    }
+  } return distance;
+}
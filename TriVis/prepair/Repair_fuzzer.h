@@ -0,0 +1,105 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef REPAIRFUZZER_H
+#define REPAIRFUZZER_H
+
+#include "Polygon_repair.h"
+#include "Task_scheduler.h"
+
+// What happened to one fuzzer input
+class Fuzz_result {
+public:
+  bool accepted;   // the input was a finite polygon or multipolygon within the limits
+  bool gave_up;    // the work budget ran out, so nothing else is checked
+  bool valid;
+  bool matches_odd_even;   // at the sample points, see Repair_fuzzer
+  bool matches_serial;
+  std::size_t vertices;
+  std::size_t mismatched_samples;
+  double seconds;   // the fastest of the repetitions
+  double area, serial_area;
+  
+  Fuzz_result() {
+    accepted = false;
+    gave_up = false;
+    valid = true;
+    matches_odd_even = true;
+    matches_serial = true;
+    vertices = 0;
+    mismatched_samples = 0;
+    seconds = 0.0;
+    area = 0.0;
+    serial_area = 0.0;
+  }
+  
+  bool is_failure() const {
+    return accepted && !gave_up && (!valid || !matches_odd_even || !matches_serial);
+  }
+};
+
+// Repairs WKB inputs with repair_odd_even() and checks that the output is
+// valid. With a scheduler, the input is repaired the way prepair repairs it
+// with several threads, with its clusters and polygons done in parallel.
+// The differential mode checks the output against the odd-even rule without
+// the triangulation: at a grid of sample points away from the rings, a point
+// must be in the output if and only if it is inside an odd number of input
+// rings. Inputs split into clusters are also compared with the plain serial
+// repair, which is then a different code path. Inputs that are not polygons
+// or multipolygons, that have non-finite coordinates or that are larger than
+// max_vertices are rejected, so that the fuzzer spends its time on inputs
+// prepair can actually get
+class Repair_fuzzer {
+public:
+  Repair_fuzzer() {
+    max_vertices = 4096;
+    max_steps = 1000000;
+    repetitions = 1;
+    differential = false;
+    scheduler = NULL;
+  }
+  
+  Fuzz_result run(const unsigned char *data, std::size_t size);
+  
+  static std::size_t count_vertices(OGRGeometry *geometry);
+  static double get_area(OGRGeometry *geometry);
+  static std::size_t count_odd_even_mismatches(OGRGeometry *in_geometry, OGRGeometry *out_geometry);
+
+//private:
+  static const int samples_per_side = 16;
+  
+  std::size_t max_vertices;
+  std::size_t max_steps;   // per repair, zero means no limit
+  unsigned int repetitions;   // more than one gives steadier timings
+  bool differential;
+  Task_scheduler *scheduler;
+  
+  bool has_finite_coordinates(OGRGeometry *geometry);
+  bool splits_into_clusters(OGRGeometry *geometry);
+  OGRGeometry *repair(OGRGeometry *in_geometry, Task_scheduler *repair_scheduler, bool &gave_up);
+  bool have_same_area(double area, double other_area);
+  static void get_rings(OGRGeometry *geometry, std::vector<OGRLinearRing *> &rings);
+  static bool is_inside_odd_even(const std::vector<OGRLinearRing *> &rings, double x, double y);
+  static double distance_to_rings(const std::vector<OGRLinearRing *> &rings, double x, double y);
+};
+
+#endif
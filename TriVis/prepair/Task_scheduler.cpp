@@ -0,0 +1,192 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Task_scheduler.h"
+
+// Boost
+#include <boost/bind.hpp>
+
+boost::thread_specific_ptr<Task_scheduler::Worker_identity> Task_scheduler::current_worker;
+
+static const std::size_t worker_stack_size = 8*1024*1024;
+
+Task_scheduler::Task_scheduler(unsigned int number_of_threads) : pending_tasks(0), queued_tasks(0), next_queue(0), steals(0), stopping(false) {
+  if (number_of_threads < 1) number_of_threads = 1;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    queues.push_back(new Queue());
+  }
+  
+  // Tasks can recurse deeply, e.g. walking the boundary of a large polygon in
+  // Polygon_repair::reconstruct(), so workers get as much stack as a main thread
+  boost::thread::attributes attributes;
+  attributes.set_stack_size(worker_stack_size);
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    workers.add_thread(new boost::thread(attributes, boost::bind(&Task_scheduler::work, this, current_thread)));
+  }
+}
+
+Task_scheduler::~Task_scheduler() {
+  drain();
+  stopping = true;
+  {
+    boost::lock_guard<boost::mutex> lock(sleep_mutex);
+    work_available.notify_all();
+  } workers.join_all();
+  for (std::vector<Queue *>::iterator current_queue = queues.begin(); current_queue != queues.end(); ++current_queue) {
+    delete *current_queue;
+  }
+}
+
+void Task_scheduler::submit(const Task &task) {
+  // Counted before the push, so that the count never goes below zero when the task is taken at once
+  ++pending_tasks;
+  ++queued_tasks;
+  Queue &queue = *queues[own_queue()];
+  {
+    boost::lock_guard<boost::mutex> lock(queue.mutex);
+    queue.tasks.push_back(task);
+  }
+  
+  // Taking the lock orders the notification after a sleeper has checked for work and before it sleeps
+  boost::lock_guard<boost::mutex> lock(sleep_mutex);
+  work_available.notify_one();
+  state_changed.notify_all();
+}
+
+void Task_scheduler::wait() {
+  drain();
+  std::exception_ptr thrown;
+  {
+    boost::lock_guard<boost::mutex> lock(sleep_mutex);
+    thrown.swap(exception);
+  } if (thrown) std::rethrow_exception(thrown);
+}
+
+void Task_scheduler::drain() {
+  while (pending_tasks > 0) {
+    if (!run_one()) sleep_unless(pending_tasks);
+  }
+}
+
+void Task_scheduler::sleep_unless(const std::atomic<std::size_t> &pending) {
+  // Until there is something to run or to return for, checked under the lock so that no notification is missed
+  boost::unique_lock<boost::mutex> lock(sleep_mutex);
+  while (pending > 0 && queued_tasks == 0) state_changed.wait(lock);
+}
+
+bool Task_scheduler::run_one() {
+  Task task;
+  std::size_t queue = own_queue();
+  if (!pop(queue, task) && !steal(queue, task)) return false;
+  run(task);
+  return true;
+}
+
+void Task_scheduler::work(std::size_t queue) {
+  Worker_identity *identity = new Worker_identity();
+  identity->scheduler = this;
+  identity->queue = queue;
+  current_worker.reset(identity);
+  
+  Task task;
+  while (!stopping) {
+    if (pop(queue, task) || steal(queue, task)) {
+      run(task);
+      continue;
+    }
+    
+    // Nothing to do: sleep until a submission. Another worker can take the
+    // submitted task first, then this one goes back to sleep
+    boost::unique_lock<boost::mutex> lock(sleep_mutex);
+    while (!stopping && queued_tasks == 0) work_available.wait(lock);
+  }
+}
+
+std::size_t Task_scheduler::own_queue() {
+  // Threads that are not workers of this scheduler spread their tasks over all the queues
+  Worker_identity *identity = current_worker.get();
+  if (identity != NULL && identity->scheduler == this) return identity->queue;
+  return next_queue++%queues.size();
+}
+
+bool Task_scheduler::pop(std::size_t queue, Task &task) {
+  boost::lock_guard<boost::mutex> lock(queues[queue]->mutex);
+  if (queues[queue]->tasks.empty()) return false;
+  task.swap(queues[queue]->tasks.back());
+  queues[queue]->tasks.pop_back();
+  --queued_tasks;
+  return true;
+}
+
+bool Task_scheduler::steal(std::size_t thief, Task &task) {
+  for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+    Queue &victim = *queues[(thief+offset)%queues.size()];
+    boost::lock_guard<boost::mutex> lock(victim.mutex);
+    if (victim.tasks.empty()) continue;
+    task.swap(victim.tasks.front());
+    victim.tasks.pop_front();
+    --queued_tasks;
+    ++steals;
+    return true;
+  } return false;
+}
+
+void Task_scheduler::run(Task &task) {
+  // An exception must not end the worker nor leave the task pending forever
+  std::exception_ptr thrown;
+  try {
+    task();
+  } catch (...) {
+    thrown = std::current_exception();
+  } task.clear();
+  
+  boost::lock_guard<boost::mutex> lock(sleep_mutex);
+  if (thrown && !exception) exception = thrown;
+  --pending_tasks;
+  state_changed.notify_all();
+}
+
+void Task_group::run(const Task_scheduler::Task &task) {
+  ++pending_tasks;
+  scheduler.submit(boost::bind(&Task_group::run_and_count, this, task));
+}
+
+void Task_group::wait() {
+  while (pending_tasks > 0) {
+    if (!scheduler.run_one()) scheduler.sleep_unless(pending_tasks);
+  }
+  
+  std::exception_ptr thrown;
+  {
+    boost::lock_guard<boost::mutex> lock(exception_mutex);
+    thrown.swap(exception);
+  } if (thrown) std::rethrow_exception(thrown);
+}
+
+void Task_group::run_and_count(Task_scheduler::Task task) {
+  try {
+    task();
+  } catch (...) {
+    boost::lock_guard<boost::mutex> lock(exception_mutex);
+    if (!exception) exception = std::current_exception();
+  } --pending_tasks;
+}
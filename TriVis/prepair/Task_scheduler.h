@@ -0,0 +1,121 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+// STL
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <exception>
+
+// Boost
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+// A work-stealing scheduler. Every worker has its own queue: it runs the
+// newest task of its own queue first and, when that is empty, steals the
+// oldest task of another queue. Tasks can submit more tasks, which go to the
+// queue of the worker that runs them, so a large task that splits itself
+// keeps its pieces local until other workers run out of work
+class Task_scheduler {
+public:
+  typedef boost::function<void ()> Task;
+  
+  Task_scheduler(unsigned int number_of_threads);
+  ~Task_scheduler();
+  
+  void submit(const Task &task);
+  
+  // Runs tasks on the calling thread until every submitted task is done, then
+  // rethrows the first exception thrown by a task submitted here. Tasks must
+  // wait for their subtasks with a Task_group instead
+  void wait();
+  
+  // Runs one pending task on the calling thread, returns false if there was none
+  bool run_one();
+  
+  unsigned int number_of_threads() const {
+    return (unsigned int)queues.size();
+  }
+  
+  std::size_t number_of_steals() const {
+    return steals;
+  }
+
+//private:
+  struct Queue {
+    boost::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  
+  struct Worker_identity {
+    Task_scheduler *scheduler;
+    std::size_t queue;
+  };
+  
+  std::vector<Queue *> queues;
+  boost::thread_group workers;
+  
+  // Pending tasks are queued or running, queued ones wait in a queue
+  std::atomic<std::size_t> pending_tasks, queued_tasks, next_queue, steals;
+  std::atomic<bool> stopping;
+  
+  // Idle workers sleep on work_available, which is notified on every
+  // submission. Waiters sleep on state_changed, which is also notified
+  // every time a task finishes
+  boost::mutex sleep_mutex;
+  boost::condition_variable work_available, state_changed;
+  std::exception_ptr exception;
+  static boost::thread_specific_ptr<Worker_identity> current_worker;
+  
+  void work(std::size_t queue);
+  void drain();
+  void sleep_unless(const std::atomic<std::size_t> &pending);
+  std::size_t own_queue();
+  bool pop(std::size_t queue, Task &task);
+  bool steal(std::size_t thief, Task &task);
+  void run(Task &task);
+};
+
+// Tasks whose completion can be waited on separately from the rest of the
+// scheduler, so a task can wait for its own subtasks. Waiting runs other
+// tasks instead of blocking the worker. An exception thrown by a task is
+// caught on the worker and the first one is rethrown by wait()
+class Task_group {
+public:
+  Task_group(Task_scheduler &scheduler) : scheduler(scheduler), pending_tasks(0) {}
+  
+  void run(const Task_scheduler::Task &task);
+  void wait();
+
+//private:
+  Task_scheduler &scheduler;
+  std::atomic<std::size_t> pending_tasks;
+  boost::mutex exception_mutex;
+  std::exception_ptr exception;
+  
+  void run_and_count(Task_scheduler::Task task);
+};
+
+#endif
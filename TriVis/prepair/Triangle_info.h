@@ -50,6 +50,15 @@ public:
     else info = (info & 0xfd) | 0x01;
   }
   
+  bool been_visited() {
+    return (info & 0x04) == 0x04;
+  }
+  
+  void been_visited(bool visited) {
+    if (visited) info |= 0x04;
+    else info &= 0xfb;
+  }
+  
   bool been_reconstructed() {
     return (info & 0x08) == 0x08;
   }
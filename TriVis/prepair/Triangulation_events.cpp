@@ -0,0 +1,207 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Triangulation_events.h"
+
+// STL
+#include <iostream>
+#include <cstring>
+
+Events_header::Events_header() {
+  std::memcpy(magic, "PREPEVNT", 8);
+  version = current_version;
+  byte_order = native_byte_order;
+  number_of_events = 0;
+  number_of_dropped_events = 0;
+}
+
+bool Events_header::is_valid() const {
+  if (std::memcmp(magic, "PREPEVNT", 8) != 0) {
+    std::cerr << "Error: Not an event file" << std::endl;
+    return false;
+  } if (version != current_version) {
+    std::cerr << "Error: Unsupported event file version " << version << std::endl;
+    return false;
+  } if (byte_order != native_byte_order) {
+    std::cerr << "Error: Event file was written with a different byte order" << std::endl;
+    return false;
+  } return true;
+}
+
+Event_recorder::Event_recorder() {
+  recording = false;
+  next_event = 0;
+  number_of_events = 0;
+}
+
+// A stream cannot be shared, so copies start stopped
+Event_recorder::Event_recorder(const Event_recorder &other) {
+  recording = false;
+  next_event = 0;
+  number_of_events = 0;
+}
+
+Event_recorder &Event_recorder::operator=(const Event_recorder &other) {
+  stop();
+  return *this;
+}
+
+Event_recorder::~Event_recorder() {
+  stop();
+}
+
+void Event_recorder::start(std::size_t capacity) {
+  stop();
+  if (capacity == 0) return;
+  events.assign(capacity, Triangulation_event());
+  next_event = 0;
+  number_of_events = 0;
+  recording = true;
+}
+
+bool Event_recorder::start(const std::string &file_name) {
+  stop();
+  file.open(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not create " << file_name << std::endl;
+    return false;
+  }
+  
+  // The header is rewritten with the final count when stopping
+  Events_header header;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(Events_header));
+  events.clear();
+  events.reserve(file_buffer_size);
+  next_event = 0;
+  number_of_events = 0;
+  recording = true;
+  return true;
+}
+
+bool Event_recorder::stop() {
+  recording = false;
+  if (!file.is_open()) return true;
+  bool written = flush();
+  Events_header header;
+  header.number_of_events = number_of_events;
+  file.seekp(0);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(Events_header));
+  written = written && file.good();
+  file.close();
+  events.clear();
+  number_of_events = 0;
+  if (!written) std::cerr << "Error: Could not write events" << std::endl;
+  return written;
+}
+
+bool Event_recorder::is_recording() const {
+  return recording;
+}
+
+void Event_recorder::get_events(std::vector<Triangulation_event> &out_events) const {
+  out_events.clear();
+  if (file.is_open()) return;
+  if (number_of_events <= events.size()) {
+    out_events.insert(out_events.end(), events.begin(), events.begin()+number_of_events);
+  } else {
+    out_events.insert(out_events.end(), events.begin()+next_event, events.end());
+    out_events.insert(out_events.end(), events.begin(), events.begin()+next_event);
+  }
+}
+
+std::uint64_t Event_recorder::number_of_dropped_events() const {
+  if (file.is_open() || number_of_events <= events.size()) return 0;
+  return number_of_events-events.size();
+}
+
+bool Event_recorder::write(const std::string &file_name) const {
+  std::vector<Triangulation_event> out_events;
+  get_events(out_events);
+  std::ofstream out_file(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out_file.is_open()) {
+    std::cerr << "Error: Could not create " << file_name << std::endl;
+    return false;
+  } Events_header header;
+  header.number_of_events = out_events.size();
+  header.number_of_dropped_events = number_of_dropped_events();
+  out_file.write(reinterpret_cast<const char *>(&header), sizeof(Events_header));
+  if (!out_events.empty()) out_file.write(reinterpret_cast<const char *>(&out_events.front()), out_events.size()*sizeof(Triangulation_event));
+  if (!out_file.good()) {
+    std::cerr << "Error: Could not write " << file_name << std::endl;
+    return false;
+  } return true;
+}
+
+bool Event_recorder::read(const std::string &file_name, std::vector<Triangulation_event> &out_events, std::uint64_t &number_of_dropped_events) {
+  std::ifstream in_file(file_name.c_str(), std::ios::in | std::ios::binary);
+  if (!in_file.is_open()) {
+    std::cerr << "Error: Could not open " << file_name << std::endl;
+    return false;
+  } Events_header header;
+  in_file.read(reinterpret_cast<char *>(&header), sizeof(Events_header));
+  if (!in_file.good()) {
+    std::cerr << "Error: Not an event file" << std::endl;
+    return false;
+  } if (!header.is_valid()) return false;
+  
+  in_file.seekg(0, std::ios::end);
+  std::uint64_t available = ((std::uint64_t)in_file.tellg()-sizeof(Events_header))/sizeof(Triangulation_event);
+  if (header.number_of_events > available) {
+    std::cerr << "Error: Truncated event file" << std::endl;
+    return false;
+  } in_file.seekg(sizeof(Events_header));
+  out_events.resize(header.number_of_events);
+  if (!out_events.empty()) in_file.read(reinterpret_cast<char *>(&out_events.front()), out_events.size()*sizeof(Triangulation_event));
+  if (!in_file.good()) {
+    std::cerr << "Error: Could not read " << file_name << std::endl;
+    return false;
+  } number_of_dropped_events = header.number_of_dropped_events;
+  return true;
+}
+
+void Event_recorder::record(Triangulation_event::Type type, double ax, double ay, double az, double bx, double by, double bz) {
+  Triangulation_event event;
+  event.a[0] = ax;
+  event.a[1] = ay;
+  event.a[2] = az;
+  event.b[0] = bx;
+  event.b[1] = by;
+  event.b[2] = bz;
+  event.type = type;
+  event.padding = 0;
+  ++number_of_events;
+  
+  // Streaming uses the vector as a write buffer, otherwise it is the ring
+  if (file.is_open()) {
+    events.push_back(event);
+    if (events.size() == file_buffer_size) flush();
+  } else {
+    events[next_event] = event;
+    next_event = (next_event+1)%events.size();
+  }
+}
+
+bool Event_recorder::flush() {
+  if (!events.empty()) file.write(reinterpret_cast<const char *>(&events.front()), events.size()*sizeof(Triangulation_event));
+  events.clear();
+  return file.good();
+}
@@ -0,0 +1,139 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef TRIANGULATIONEVENTS_H
+#define TRIANGULATIONEVENTS_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+// CGAL
+#include <CGAL/number_utils.h>
+
+// One step of the construction of a triangulation, with the points that
+// identify the vertices involved. Their third coordinate is 0 for 2D points:
+//   Insert_vertex:        a is the new vertex
+//   Insert_intersection:  segment a-b crossed a constraint and was split there
+//   Mark_constraint:      edge a-b became constrained
+//   Remove_constraint:    edge a-b stopped being constrained
+//   Flip:                 edge a-b was given to propagating_flip()
+//   Triangulate_hole:     the faces crossed by a-b were retriangulated
+class Triangulation_event {
+public:
+  enum Type {
+    Insert_vertex = 0,
+    Insert_intersection,
+    Mark_constraint,
+    Remove_constraint,
+    Flip,
+    Triangulate_hole
+  };
+  
+  double a[3];
+  double b[3];
+  std::uint32_t type;
+  std::uint32_t padding;
+};
+
+// An event file is this header followed by the events as they are in memory
+class Events_header {
+public:
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t number_of_events;
+  std::uint64_t number_of_dropped_events;
+  
+  static const std::uint32_t current_version = 2;
+  static const std::uint32_t native_byte_order = 0x01020304;
+  
+  Events_header();
+  bool is_valid() const;
+};
+
+// Recording policies for Enhanced_constrained_triangulation_2. This one
+// compiles to nothing
+class No_event_recorder {
+public:
+  template <class Point>
+  void record(Triangulation_event::Type type, const Point &a) {}
+  template <class Point>
+  void record(Triangulation_event::Type type, const Point &a, const Point &b) {}
+};
+
+// This one keeps the latest events in a ring buffer, or streams all of them
+// to a file. Recording is off until started, which costs a branch per event
+class Event_recorder {
+public:
+  Event_recorder();
+  Event_recorder(const Event_recorder &other);
+  Event_recorder &operator=(const Event_recorder &other);
+  ~Event_recorder();
+  
+  void start(std::size_t capacity);
+  bool start(const std::string &file_name);
+  bool stop();
+  bool is_recording() const;
+  
+  // The events in the ring buffer, oldest first
+  void get_events(std::vector<Triangulation_event> &events) const;
+  std::uint64_t number_of_dropped_events() const;
+  bool write(const std::string &file_name) const;
+  
+  static bool read(const std::string &file_name, std::vector<Triangulation_event> &events, std::uint64_t &number_of_dropped_events);
+  
+  template <class Point>
+  void record(Triangulation_event::Type type, const Point &a) {
+    if (!recording) return;
+    record(type, CGAL::to_double(a.x()), CGAL::to_double(a.y()), height(a), 0.0, 0.0, 0.0);
+  }
+  
+  template <class Point>
+  void record(Triangulation_event::Type type, const Point &a, const Point &b) {
+    if (!recording) return;
+    record(type, CGAL::to_double(a.x()), CGAL::to_double(a.y()), height(a), CGAL::to_double(b.x()), CGAL::to_double(b.y()), height(b));
+  }
+
+//private:
+  bool recording;
+  std::vector<Triangulation_event> events;
+  std::size_t next_event;
+  std::uint64_t number_of_events;
+  std::ofstream file;
+  
+  static const std::size_t file_buffer_size = 4096;
+  
+  void record(Triangulation_event::Type type, double ax, double ay, double az, double bx, double by, double bz);
+  
+  template <class Point>
+  static double height(const Point &point) {
+    if (point.dimension() < 3) return 0.0;
+    return CGAL::to_double(point[2]);
+  }
+  bool flush();
+};
+
+#endif
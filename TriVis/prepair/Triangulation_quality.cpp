@@ -0,0 +1,234 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Triangulation_quality.h"
+
+// Boost
+#include <boost/thread.hpp>
+
+static const double degrees_per_radian = 180.0/3.14159265358979323846;
+
+void Quality::print(std::ostream &out) const {
+  out << "faces " << number_of_faces << ", edges " << number_of_edges;
+  if (number_of_faces == 0) {
+    out << std::endl;
+    return;
+  } out << ", angles " << min_angle << "-" << max_angle << ", edge lengths " << shortest_edge << "-" << longest_edge << ", slivers " << number_of_slivers << ", near-collinear constraints " << number_of_near_collinear_constraints << std::endl;
+  out << "\tSmallest angle:";
+  for (int current_bin = 0; current_bin < number_of_angle_bins; ++current_bin) {
+    out << " " << 5*current_bin << "-" << 5*(current_bin+1) << ":" << min_angle_histogram[current_bin];
+  } out << std::endl;
+  out << "\tEdge length relative to the longest:";
+  for (int current_bin = 0; current_bin < number_of_length_bins; ++current_bin) {
+    out << " 1/" << (1 << current_bin) << ":" << edge_length_histogram[current_bin];
+  } out << std::endl;
+}
+
+Quality Triangulation_quality::compute(Triangulation &triangulation, unsigned int number_of_threads) {
+  copy_triangulation(triangulation);
+  std::size_t number_of_faces = faces.size();
+  squared_lengths.resize(3*number_of_faces);
+  min_angle_cosines.resize(number_of_faces);
+  max_angle_cosines.resize(number_of_faces);
+  longest_edges.resize(number_of_faces);
+  face_flags.resize(number_of_faces);
+  
+  // Both passes only write to their own faces, so large triangulations are split among threads
+  if (number_of_threads < 1) number_of_threads = 1;
+  if (number_of_faces < 16384*number_of_threads) number_of_threads = 1;
+  Quality quality;
+  if (number_of_threads == 1) {
+    double longest_squared_length = 0.0;
+    compute_faces(0, number_of_faces, longest_squared_length);
+    summarise_faces(0, number_of_faces, std::sqrt(longest_squared_length), quality);
+    return quality;
+  }
+  
+  std::vector<double> longest_squared_lengths(number_of_threads, 0.0);
+  boost::thread_group face_workers;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    std::size_t first_face = number_of_faces*current_thread/number_of_threads;
+    std::size_t last_face = number_of_faces*(current_thread+1)/number_of_threads;
+    face_workers.create_thread(boost::bind(&Triangulation_quality::compute_faces, this, first_face, last_face, boost::ref(longest_squared_lengths[current_thread])));
+  } face_workers.join_all();
+  double longest_edge = std::sqrt(*std::max_element(longest_squared_lengths.begin(), longest_squared_lengths.end()));
+  
+  std::vector<Quality> partial_results(number_of_threads);
+  boost::thread_group summary_workers;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    std::size_t first_face = number_of_faces*current_thread/number_of_threads;
+    std::size_t last_face = number_of_faces*(current_thread+1)/number_of_threads;
+    summary_workers.create_thread(boost::bind(&Triangulation_quality::summarise_faces, this, first_face, last_face, longest_edge, boost::ref(partial_results[current_thread])));
+  } summary_workers.join_all();
+  for (std::vector<Quality>::iterator partial_result = partial_results.begin(); partial_result != partial_results.end(); ++partial_result) {
+    quality.number_of_faces += partial_result->number_of_faces;
+    quality.number_of_edges += partial_result->number_of_edges;
+    quality.number_of_slivers += partial_result->number_of_slivers;
+    quality.number_of_near_collinear_constraints += partial_result->number_of_near_collinear_constraints;
+    if (partial_result->min_angle < quality.min_angle) quality.min_angle = partial_result->min_angle;
+    if (partial_result->max_angle > quality.max_angle) quality.max_angle = partial_result->max_angle;
+    if (partial_result->shortest_edge < quality.shortest_edge) quality.shortest_edge = partial_result->shortest_edge;
+    if (partial_result->longest_edge > quality.longest_edge) quality.longest_edge = partial_result->longest_edge;
+    for (int current_bin = 0; current_bin < Quality::number_of_angle_bins; ++current_bin) {
+      quality.min_angle_histogram[current_bin] += partial_result->min_angle_histogram[current_bin];
+    } for (int current_bin = 0; current_bin < Quality::number_of_length_bins; ++current_bin) {
+      quality.edge_length_histogram[current_bin] += partial_result->edge_length_histogram[current_bin];
+    }
+  } return quality;
+}
+
+void Triangulation_quality::copy_triangulation(Triangulation &triangulation) {
+  std::size_t number_of_faces = triangulation.number_of_faces();
+  faces.clear();
+  x.clear();
+  y.clear();
+  first_vertex.clear();
+  second_vertex.clear();
+  third_vertex.clear();
+  faces.reserve(number_of_faces);
+  x.reserve(triangulation.number_of_vertices());
+  y.reserve(triangulation.number_of_vertices());
+  first_vertex.reserve(number_of_faces);
+  second_vertex.reserve(number_of_faces);
+  third_vertex.reserve(number_of_faces);
+  neighbours.resize(3*number_of_faces);
+  mirror_indices.resize(3*number_of_faces);
+  constrained_edges.resize(number_of_faces);
+  
+  CGAL::Unique_hash_map<Triangulation::Vertex_handle, std::uint32_t> vertex_index(no_face, triangulation.number_of_vertices());
+  for (Triangulation::Finite_vertices_iterator current_vertex = triangulation.finite_vertices_begin(); current_vertex != triangulation.finite_vertices_end(); ++current_vertex) {
+    vertex_index[current_vertex] = (std::uint32_t)x.size();
+    x.push_back(CGAL::to_double(current_vertex->point().x()));
+    y.push_back(CGAL::to_double(current_vertex->point().y()));
+  }
+  
+  CGAL::Unique_hash_map<Triangulation::Face_handle, std::uint32_t> face_index(no_face, number_of_faces);
+  for (Triangulation::Finite_faces_iterator current_face = triangulation.finite_faces_begin(); current_face != triangulation.finite_faces_end(); ++current_face) {
+    face_index[current_face] = (std::uint32_t)faces.size();
+    faces.push_back(current_face);
+    first_vertex.push_back(vertex_index[current_face->vertex(0)]);
+    second_vertex.push_back(vertex_index[current_face->vertex(1)]);
+    third_vertex.push_back(vertex_index[current_face->vertex(2)]);
+  }
+  
+  // Infinite faces are not in the map, so their neighbours stay no_face
+  for (std::size_t current_face = 0; current_face < faces.size(); ++current_face) {
+    constrained_edges[current_face] = 0;
+    for (int current_edge = 0; current_edge < 3; ++current_edge) {
+      Triangulation::Face_handle neighbour = faces[current_face]->neighbor(current_edge);
+      neighbours[3*current_face+current_edge] = face_index[neighbour];
+      mirror_indices[3*current_face+current_edge] = (std::uint8_t)neighbour->index(faces[current_face]);
+      if (faces[current_face]->is_constrained(current_edge)) constrained_edges[current_face] |= 1 << current_edge;
+    }
+  }
+}
+
+void Triangulation_quality::compute_faces(std::size_t first_face, std::size_t last_face, double &longest_squared_length) {
+  // Raw pointers, so the compiler does not reload the vectors after every store and can vectorise the loop.
+  // Law of cosines: the smallest angle is opposite to the shortest edge and the largest to the longest one
+  const double *xs = x.data(), *ys = y.data();
+  const std::uint32_t *as = first_vertex.data(), *bs = second_vertex.data(), *cs = third_vertex.data();
+  double *lengths = squared_lengths.data(), *min_cosines = min_angle_cosines.data(), *max_cosines = max_angle_cosines.data();
+  std::uint8_t *longest_indices = longest_edges.data();
+  for (std::size_t current_face = first_face; current_face < last_face; ++current_face) {
+    double ax = xs[as[current_face]], ay = ys[as[current_face]];
+    double bx = xs[bs[current_face]], by = ys[bs[current_face]];
+    double cx = xs[cs[current_face]], cy = ys[cs[current_face]];
+    double opposite_a = (bx-cx)*(bx-cx)+(by-cy)*(by-cy);
+    double opposite_b = (cx-ax)*(cx-ax)+(cy-ay)*(cy-ay);
+    double opposite_c = (ax-bx)*(ax-bx)+(ay-by)*(ay-by);
+    lengths[3*current_face] = opposite_a;
+    lengths[3*current_face+1] = opposite_b;
+    lengths[3*current_face+2] = opposite_c;
+    double shortest_edge = std::min(opposite_a, std::min(opposite_b, opposite_c));
+    double longest_edge = std::max(opposite_a, std::max(opposite_b, opposite_c));
+    double middle_edge = opposite_a+opposite_b+opposite_c-shortest_edge-longest_edge;
+    min_cosines[current_face] = (middle_edge+longest_edge-shortest_edge)/(2.0*std::sqrt(middle_edge*longest_edge));
+    max_cosines[current_face] = (shortest_edge+middle_edge-longest_edge)/(2.0*std::sqrt(shortest_edge*middle_edge));
+    longest_indices[current_face] = longest_edge == opposite_a ? 0 : (longest_edge == opposite_b ? 1 : 2);
+  }
+  
+  // Reductions and lookups are kept out of the loop above
+  const double sliver_cosine = std::cos(sliver_angle/degrees_per_radian);
+  const double collinear_cosine = std::cos(collinear_angle/degrees_per_radian);
+  double longest = 0.0;
+  for (std::size_t current_face = first_face; current_face < last_face; ++current_face) {
+    std::uint8_t flags = 0;
+    if (min_angle_cosines[current_face] > sliver_cosine) flags |= Sliver;
+    if (max_angle_cosines[current_face] < collinear_cosine && (constrained_edges[current_face] & (1 << longest_edges[current_face]))) flags |= Near_collinear_constraint;
+    face_flags[current_face] = flags;
+    longest = std::max(longest, squared_lengths[3*current_face+longest_edges[current_face]]);
+  } longest_squared_length = longest;
+}
+
+void Triangulation_quality::summarise_faces(std::size_t first_face, std::size_t last_face, double longest_edge, Quality &quality) const {
+  double angle_bin_cosines[Quality::number_of_angle_bins];
+  for (int current_bin = 1; current_bin < Quality::number_of_angle_bins; ++current_bin) {
+    angle_bin_cosines[current_bin] = std::cos(5.0*current_bin/degrees_per_radian);
+  }
+  
+  // Angles are only converted from their cosines for the extremes
+  double largest_min_angle_cosine = -1.0, smallest_max_angle_cosine = 1.0;
+  double shortest_squared_length = std::numeric_limits<double>::infinity(), longest_squared_length = 0.0;
+  for (std::size_t current_face = first_face; current_face < last_face; ++current_face) {
+    ++quality.number_of_faces;
+    largest_min_angle_cosine = std::max(largest_min_angle_cosine, min_angle_cosines[current_face]);
+    smallest_max_angle_cosine = std::min(smallest_max_angle_cosine, max_angle_cosines[current_face]);
+    int angle_bin = 0;
+    for (int current_bin = 1; current_bin < Quality::number_of_angle_bins; ++current_bin) {
+      angle_bin += min_angle_cosines[current_face] <= angle_bin_cosines[current_bin];
+    } ++quality.min_angle_histogram[angle_bin];
+    if (face_flags[current_face] & Sliver) ++quality.number_of_slivers;
+    
+    // Shared edges belong to the face with the lower index
+    for (int current_edge = 0; current_edge < 3; ++current_edge) {
+      std::uint32_t neighbour = neighbours[3*current_face+current_edge];
+      if (neighbour != no_face && neighbour < current_face) continue;
+      ++quality.number_of_edges;
+      double squared_length = squared_lengths[3*current_face+current_edge];
+      shortest_squared_length = std::min(shortest_squared_length, squared_length);
+      longest_squared_length = std::max(longest_squared_length, squared_length);
+      int exponent;
+      std::frexp(std::sqrt(squared_length)/longest_edge, &exponent);
+      int length_bin = std::min(std::max(-exponent, 0), Quality::number_of_length_bins-1);
+      ++quality.edge_length_histogram[length_bin];
+    }
+    
+    // A near-collinear constraint is counted once even if the faces on both sides of it are flagged
+    if (face_flags[current_face] & Near_collinear_constraint) {
+      int current_edge = longest_edges[current_face];
+      std::uint32_t neighbour = neighbours[3*current_face+current_edge];
+      if (neighbour == no_face || neighbour > current_face ||
+          !(face_flags[neighbour] & Near_collinear_constraint) || longest_edges[neighbour] != mirror_indices[3*current_face+current_edge]) {
+        ++quality.number_of_near_collinear_constraints;
+      }
+    }
+  }
+  
+  if (quality.number_of_faces == 0) return;
+  quality.min_angle = std::acos(std::min(largest_min_angle_cosine, 1.0))*degrees_per_radian;
+  quality.max_angle = std::acos(std::max(smallest_max_angle_cosine, -1.0))*degrees_per_radian;
+  if (quality.number_of_edges > 0) {
+    quality.shortest_edge = std::sqrt(shortest_squared_length);
+    quality.longest_edge = std::sqrt(longest_squared_length);
+  }
+}
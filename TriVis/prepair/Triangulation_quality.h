@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef TRIANGULATIONQUALITY_H
+#define TRIANGULATIONQUALITY_H
+
+#include "Definitions.h"
+
+// STL
+#include <cstdint>
+#include <ostream>
+
+// Summary of the shape of the finite faces of a triangulation. Angles are in
+// degrees and edges are counted once even if they are shared by two faces
+class Quality {
+public:
+  static const int number_of_angle_bins = 12;   // 5 degrees each, the smallest angle of a triangle is at most 60
+  static const int number_of_length_bins = 16;  // bin k holds edges with lengths in [longest/2^(k+1), longest/2^k), the last one everything shorter
+  
+  std::size_t number_of_faces;
+  std::size_t number_of_edges;
+  std::size_t number_of_slivers;
+  std::size_t number_of_near_collinear_constraints;
+  double min_angle;
+  double max_angle;
+  double shortest_edge;
+  double longest_edge;
+  std::size_t min_angle_histogram[number_of_angle_bins];
+  std::size_t edge_length_histogram[number_of_length_bins];
+  
+  Quality() {
+    number_of_faces = 0;
+    number_of_edges = 0;
+    number_of_slivers = 0;
+    number_of_near_collinear_constraints = 0;
+    min_angle = std::numeric_limits<double>::infinity();
+    max_angle = 0.0;
+    shortest_edge = std::numeric_limits<double>::infinity();
+    longest_edge = 0.0;
+    std::fill(min_angle_histogram, min_angle_histogram+number_of_angle_bins, 0);
+    std::fill(edge_length_histogram, edge_length_histogram+number_of_length_bins, 0);
+  }
+  
+  void print(std::ostream &out) const;
+};
+
+// The triangulation is copied once into flat arrays (vertex coordinates as
+// doubles and faces as index triples), so the per-face metrics are computed
+// by branch-free loops over contiguous memory that are cheap enough to run on
+// every feature of a batch and that are split among threads for large
+// triangulations
+class Triangulation_quality {
+public:
+  typedef prepair::Triangulation Triangulation;
+  
+  enum Face_flag {
+    Sliver = 1,                     // smallest angle below sliver_angle
+    Near_collinear_constraint = 2   // largest angle above collinear_angle and opposite to a constrained edge
+  };
+  
+  double sliver_angle;
+  double collinear_angle;
+  
+  Triangulation_quality(double sliver_angle = 5.0, double collinear_angle = 179.0) : sliver_angle(sliver_angle), collinear_angle(collinear_angle) {}
+  
+  Quality compute(Triangulation &triangulation, unsigned int number_of_threads = 1);
+  
+  // Valid after compute(), in the same order
+  const std::vector<Triangulation::Face_handle> &get_faces() const {
+    return faces;
+  }
+  
+  const std::vector<std::uint8_t> &get_face_flags() const {
+    return face_flags;
+  }
+
+//private:
+  std::vector<Triangulation::Face_handle> faces;
+  
+  // Input, one entry per vertex and per face
+  std::vector<double> x, y;
+  std::vector<std::uint32_t> first_vertex, second_vertex, third_vertex;
+  std::vector<std::uint32_t> neighbours;          // three per face, the face across the edge opposite to each vertex or no_face
+  std::vector<std::uint8_t> mirror_indices;       // three per face, the index of the same edge in the neighbour
+  std::vector<std::uint8_t> constrained_edges;    // bit i is set if the edge opposite to vertex i is constrained
+  
+  // Output of the per-face pass
+  std::vector<double> squared_lengths;            // three per face, the edge opposite to each vertex
+  std::vector<double> min_angle_cosines;
+  std::vector<double> max_angle_cosines;
+  std::vector<std::uint8_t> longest_edges;
+  std::vector<std::uint8_t> face_flags;
+  
+  static const std::uint32_t no_face = 0xffffffff;
+  
+  void copy_triangulation(Triangulation &triangulation);
+  void compute_faces(std::size_t first_face, std::size_t last_face, double &longest_squared_length);
+  void summarise_faces(std::size_t first_face, std::size_t last_face, double longest_edge, Quality &quality) const;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#include "Triangulation_snapshot.h"
+
+// STL
+#include <iostream>
+#include <cstring>
+
+// POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Snapshot_header::Snapshot_header() {
+  std::memcpy(magic, "PREPSNAP", 8);
+  version = current_version;
+  byte_order = native_byte_order;
+  number_of_vertices = 0;
+  number_of_faces = 0;
+  number_of_interior_faces = 0;
+  output_size = 0;
+}
+
+bool Snapshot_header::is_valid() const {
+  if (std::memcmp(magic, "PREPSNAP", 8) != 0) {
+    std::cerr << "Error: Not a snapshot" << std::endl;
+    return false;
+  } if (version != current_version) {
+    std::cerr << "Error: Unsupported snapshot version " << version << std::endl;
+    return false;
+  } if (byte_order != native_byte_order) {
+    std::cerr << "Error: Snapshot was written with a different byte order" << std::endl;
+    return false;
+  } if (number_of_interior_faces > number_of_faces || number_of_vertices > 0xffffffff) {
+    std::cerr << "Error: Corrupted snapshot" << std::endl;
+    return false;
+  } return true;
+}
+
+std::size_t Snapshot_header::vertices_offset() const {
+  return padded(sizeof(Snapshot_header));
+}
+
+std::size_t Snapshot_header::faces_offset() const {
+  return vertices_offset()+padded(2*number_of_vertices*sizeof(double));
+}
+
+std::size_t Snapshot_header::face_bits_offset() const {
+  return faces_offset()+padded(3*number_of_faces*sizeof(std::uint32_t));
+}
+
+std::size_t Snapshot_header::output_offset() const {
+  return face_bits_offset()+padded(number_of_faces);
+}
+
+std::size_t Snapshot_header::file_size() const {
+  return output_offset()+padded(output_size);
+}
+
+std::size_t Snapshot_header::padded(std::size_t size) {
+  return (size+7) & ~(std::size_t)7;
+}
+
+Triangulation_snapshot::Triangulation_snapshot() {
+  mapping = NULL;
+  mapping_size = 0;
+}
+
+Triangulation_snapshot::~Triangulation_snapshot() {
+  close();
+}
+
+bool Triangulation_snapshot::open(const char *file_name) {
+  close();
+  
+  int file = ::open(file_name, O_RDONLY);
+  if (file < 0) {
+    std::cerr << "Error: Could not open file" << std::endl;
+    return false;
+  } struct stat file_stat;
+  if (fstat(file, &file_stat) != 0 || (std::size_t)file_stat.st_size < sizeof(Snapshot_header)) {
+    std::cerr << "Error: Not a snapshot" << std::endl;
+    ::close(file);
+    return false;
+  }
+  
+  // Nothing is parsed, the sections are used in place
+  mapping_size = file_stat.st_size;
+  mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+  ::close(file);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Error: Could not map file" << std::endl;
+    mapping = NULL;
+    mapping_size = 0;
+    return false;
+  }
+  
+  if (!header().is_valid()) {
+    close();
+    return false;
+  }
+  
+  // The counts are bounded first so that the section offsets cannot overflow
+  if (header().number_of_vertices > mapping_size || header().number_of_faces > mapping_size ||
+      header().output_size > mapping_size || header().file_size() > mapping_size) {
+    std::cerr << "Error: Truncated snapshot" << std::endl;
+    close();
+    return false;
+  } if (header().file_size() != mapping_size) {
+    std::cerr << "Error: Corrupted snapshot (" << mapping_size << " bytes instead of " << header().file_size() << ")" << std::endl;
+    close();
+    return false;
+  }
+  
+  // Readers use the face vertices as indices into the vertices without checking them
+  const std::uint32_t *face_vertices = faces();
+  for (std::uint64_t current_index = 0; current_index < 3*header().number_of_faces; ++current_index) {
+    if (face_vertices[current_index] < header().number_of_vertices) continue;
+    std::cerr << "Error: Corrupted snapshot (face " << current_index/3 << " uses vertex " << face_vertices[current_index] << " of " << header().number_of_vertices << ")" << std::endl;
+    close();
+    return false;
+  } return true;
+}
+
+void Triangulation_snapshot::close() {
+  if (mapping != NULL) munmap(mapping, mapping_size);
+  mapping = NULL;
+  mapping_size = 0;
+}
+
+const Snapshot_header &Triangulation_snapshot::header() const {
+  return *static_cast<const Snapshot_header *>(mapping);
+}
+
+const double *Triangulation_snapshot::vertices() const {
+  return reinterpret_cast<const double *>(static_cast<const char *>(mapping)+header().vertices_offset());
+}
+
+const std::uint32_t *Triangulation_snapshot::faces() const {
+  return reinterpret_cast<const std::uint32_t *>(static_cast<const char *>(mapping)+header().faces_offset());
+}
+
+const std::uint8_t *Triangulation_snapshot::face_bits() const {
+  return reinterpret_cast<const std::uint8_t *>(static_cast<const char *>(mapping)+header().face_bits_offset());
+}
+
+const unsigned char *Triangulation_snapshot::output() const {
+  return reinterpret_cast<const unsigned char *>(static_cast<const char *>(mapping)+header().output_offset());
+}
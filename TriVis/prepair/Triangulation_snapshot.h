@@ -0,0 +1,84 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef TRIANGULATIONSNAPSHOT_H
+#define TRIANGULATIONSNAPSHOT_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+
+// A snapshot is a repaired triangulation laid out so that it can be used
+// straight from a memory-mapped file:
+//   header
+//   vertices:    number_of_vertices pairs of float64 (x, y)
+//   faces:       number_of_faces triples of uint32 vertex indices, interior faces first
+//   face bits:   one byte per face, bit i set if edge i (opposite vertex i) is
+//                constrained, interior_bit set if the face is in the interior
+//   output:      output_size bytes of WKB with the reconstructed geometry
+// Every section starts at a multiple of 8 bytes
+class Snapshot_header {
+public:
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t number_of_vertices;
+  std::uint64_t number_of_faces;
+  std::uint64_t number_of_interior_faces;
+  std::uint64_t output_size;
+  
+  static const std::uint32_t current_version = 1;
+  static const std::uint32_t native_byte_order = 0x01020304;
+  static const std::uint8_t interior_bit = 0x08;
+  
+  Snapshot_header();
+  bool is_valid() const;
+  
+  std::size_t vertices_offset() const;
+  std::size_t faces_offset() const;
+  std::size_t face_bits_offset() const;
+  std::size_t output_offset() const;
+  std::size_t file_size() const;
+  
+  static std::size_t padded(std::size_t size);
+};
+
+class Triangulation_snapshot {
+public:
+  Triangulation_snapshot();
+  ~Triangulation_snapshot();
+  
+  bool open(const char *file_name);
+  void close();
+  
+  const Snapshot_header &header() const;
+  const double *vertices() const;
+  const std::uint32_t *faces() const;
+  const std::uint8_t *face_bits() const;
+  const unsigned char *output() const;
+
+//private:
+  void *mapping;
+  std::size_t mapping_size;
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+#ifndef WORKBUDGET_H
+#define WORKBUDGET_H
+
+// STL
+#include <chrono>
+#include <cstddef>
+#include <atomic>
+
+// A limit on the time and on the number of steps spent on one feature. The
+// long loops spend a step every time around and stop cooperatively once the
+// budget is exhausted, leaving a valid but incomplete triangulation. The
+// clock is only read every clock_interval steps, so an unlimited budget
+// costs an increment and two comparisons per step
+class Work_budget {
+public:
+  static const std::size_t clock_interval = 256;
+  
+  // Another thread can stop the work early by setting this flag, e.g. when
+  // the user cancels. It is read together with the clock and by
+  // is_exhausted(), which is checked for every inserted edge. Ignored if NULL
+  const std::atomic<bool> *cancelled;
+  
+  // Budgets that split one feature across threads add their steps to this
+  // counter together with the clock check, and are exhausted once the total
+  // is over max_steps. Ignored if NULL
+  std::atomic<std::size_t> *shared_steps;
+  
+  Work_budget() : cancelled(NULL), shared_steps(NULL) {
+    start(0.0, 0);
+  }
+  
+  // Zero means no limit
+  void start(double seconds, std::size_t max_steps) {
+    this->seconds = seconds;
+    this->max_steps = max_steps;
+    steps = 0;
+    shared = 0;
+    next_clock_check = clock_interval;
+    exhausted = false;
+    start_time = std::chrono::steady_clock::now();
+  }
+  
+  // Continues the work of feature_budget on another thread, with its limits
+  // and its clock, so time spent waiting to run counts too
+  void start_shared(const Work_budget &feature_budget, std::atomic<std::size_t> *shared_steps) {
+    seconds = feature_budget.seconds;
+    max_steps = feature_budget.max_steps;
+    cancelled = feature_budget.cancelled;
+    this->shared_steps = shared_steps;
+    steps = 0;
+    shared = 0;
+    
+    // The first step checks, so work that starts after the deadline stops at once
+    next_clock_check = 0;
+    exhausted = false;
+    start_time = feature_budget.start_time;
+  }
+  
+  bool spend(std::size_t amount = 1) {
+    if (exhausted) return false;
+    steps += amount;
+    if (max_steps > 0 && steps > max_steps) exhausted = true;
+    else if ((seconds > 0.0 || cancelled != NULL || shared_steps != NULL) && steps >= next_clock_check) {
+      next_clock_check = steps+clock_interval;
+      if ((seconds > 0.0 && elapsed() > seconds) || is_cancelled() || !share_steps()) exhausted = true;
+    } return !exhausted;
+  }
+  
+  // Adds the steps not shared yet, false if the shared total is over max_steps
+  bool share_steps() {
+    if (shared_steps == NULL) return true;
+    std::size_t total = shared_steps->fetch_add(steps-shared, std::memory_order_relaxed)+steps-shared;
+    shared = steps;
+    return max_steps == 0 || total <= max_steps;
+  }
+  
+  bool is_exhausted() const {
+    return exhausted || is_cancelled();
+  }
+  
+  bool is_cancelled() const {
+    return cancelled != NULL && cancelled->load(std::memory_order_relaxed);
+  }
+  
+  std::size_t get_steps() const {
+    return steps;
+  }
+  
+  double elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count();
+  }
+
+//private:
+  double seconds;
+  std::size_t max_steps;
+  std::size_t steps, shared, next_clock_check;
+  bool exhausted;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+#endif
@@ -20,7 +20,272 @@
  */
 
 #include "Polygon_repair.h"
+#include "Polygon_robustness.h"
+#include "Triangulation_quality.h"
+#include "Task_scheduler.h"
+#include "Feature_reader.h"
+#include "Part_files.h"
+#include <sstream>
+#include <deque>
 #include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+// Features are repaired in parallel in batches of this size and output in order
+static const std::size_t features_per_batch = 1024;
+
+// Features read ahead of the repair with --ogr
+static const std::size_t default_features_to_read_ahead = 256;
+
+// Multipolygons with at least this many vertices are split into clusters of parts repaired as separate tasks
+static const std::size_t vertices_to_split = 65536;
+
+struct Repair_options {
+  bool point_set, quality, split_large_features, time_results;
+  double min_area, timeout;
+  std::size_t max_work;
+  unsigned int quality_threads;
+  std::string snapshot_directory;
+  Task_scheduler *scheduler;
+};
+
+// Everything written for a feature is kept here until it is its turn to be output
+struct Feature_result {
+  std::size_t feature;
+  long fid;   // the OGR FID, or the line of a WKT file
+  OGRGeometry *in_geometry, *out_geometry;
+  std::string report, messages, quarantine_line;
+  
+  Feature_result(std::size_t feature, long fid, OGRGeometry *in_geometry) : feature(feature), fid(fid), in_geometry(in_geometry), out_geometry(NULL) {}
+};
+
+std::size_t count_vertices(OGRGeometry *geometry) {
+  std::size_t vertices = 0;
+  switch (wkbFlatten(geometry->getGeometryType())) {
+    case wkbPolygon: {
+      OGRPolygon *polygon = static_cast<OGRPolygon *>(geometry);
+      if (polygon->getExteriorRing() != NULL) vertices += polygon->getExteriorRing()->getNumPoints();
+      for (int current_ring = 0; current_ring < polygon->getNumInteriorRings(); ++current_ring) {
+        vertices += polygon->getInteriorRing(current_ring)->getNumPoints();
+      } break;
+    }
+    case wkbMultiPolygon: {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int current_polygon = 0; current_polygon < multipolygon->getNumGeometries(); ++current_polygon) {
+        vertices += count_vertices(multipolygon->getGeometryRef(current_polygon));
+      } break;
+    }
+    default:
+      break;
+  } return vertices;
+}
+
+// A line of the quarantine file: the feature, the budget it used and its input
+std::string make_quarantine_line(Feature_result &result, Polygon_repair &prepair) {
+  char *input_wkt;
+  result.in_geometry->exportToWkt(&input_wkt);
+  std::stringstream line;
+  line << result.feature << "\t" << prepair.budget.elapsed() << "\t" << prepair.budget.get_steps() << "\t" << prepair.triangulation.number_of_vertices() << "\t" << input_wkt << std::endl;
+  CPLFree(input_wkt);
+  return line.str();
+}
+
+void repair_feature(Polygon_repair &prepair, Feature_result &result, const Repair_options &options) {
+  std::stringstream report, messages;
+  prepair.budget.start(options.timeout, options.max_work);
+  prepair.number_of_height_conflicts = 0;
+  prepair.scheduler = options.scheduler;
+  if (options.point_set) {
+    result.out_geometry = prepair.repair_point_set(result.in_geometry, options.time_results, options.min_area);
+  } else if (options.split_large_features && wkbFlatten(result.in_geometry->getGeometryType()) == wkbMultiPolygon && count_vertices(result.in_geometry) >= vertices_to_split) {
+    result.out_geometry = prepair.repair_odd_even_in_clusters(result.in_geometry, *options.scheduler, options.min_area);
+  } else {
+    result.out_geometry = prepair.repair_odd_even(result.in_geometry, options.time_results, options.min_area);
+  }
+  
+  if (prepair.number_of_height_conflicts > 0) messages << "Warning: Feature " << result.feature << " has " << prepair.number_of_height_conflicts << " vertices at the x and y of another vertex but at a different height, the first height was kept" << std::endl;
+  
+#ifdef RECORD_EVENTS
+  if (prepair.triangulation.recorder.is_recording() && prepair.triangulation.recorder.stop()) messages << "Recorded feature " << result.feature << std::endl;
+#endif
+  
+  // Features over budget are output empty, the rest of the run goes on
+  if (prepair.budget.is_exhausted()) {
+    messages << "Gave up on feature " << result.feature << " after " << prepair.budget.elapsed() << " seconds and " << prepair.budget.get_steps() << " steps" << std::endl;
+    result.quarantine_line = make_quarantine_line(result, prepair);
+  }
+  
+  if (options.quality) {
+    Triangulation_quality quality;
+    report << "Quality of feature " << result.feature << ": ";
+    quality.compute(prepair.triangulation, options.quality_threads).print(report);
+  }
+  
+  // Snapshots of failing features can be opened in TriVis without repairing them again
+  if (!options.snapshot_directory.empty() && (result.out_geometry->IsEmpty() || !result.out_geometry->IsValid())) {
+    std::stringstream file_name;
+    file_name << options.snapshot_directory << "/feature_" << result.feature << ".snap";
+    if (prepair.write_snapshot(file_name.str(), result.out_geometry)) messages << "Wrote snapshot " << file_name.str() << std::endl;
+  }
+  
+  result.report = report.str();
+  result.messages = messages.str();
+}
+
+void repair_feature_in_task(Feature_result &result, const Repair_options &options) {
+  Polygon_repair prepair;
+  repair_feature(prepair, result, options);
+}
+
+// A tile is the next features in read order. The budget applies to it as a whole
+void repair_coverage_tile(std::deque<Feature_result> &results, const Repair_options &options) {
+  Polygon_repair prepair;
+  prepair.scheduler = options.scheduler;
+  prepair.budget.start(options.timeout, options.max_work);
+  std::vector<OGRGeometry *> in_geometries, out_geometries;
+  std::vector<std::size_t> failed_features;
+  for (std::deque<Feature_result>::iterator result = results.begin(); result != results.end(); ++result) {
+    in_geometries.push_back(result->in_geometry);
+  } prepair.repair_coverage(in_geometries, out_geometries, failed_features, options.time_results);
+  for (std::size_t current_geometry = 0; current_geometry < results.size(); ++current_geometry) {
+    results[current_geometry].out_geometry = out_geometries[current_geometry];
+  }
+  
+  if (prepair.budget.is_exhausted()) {
+    std::stringstream messages;
+    messages << "Gave up on features " << results.front().feature << " to " << results.back().feature << " after " << prepair.budget.elapsed() << " seconds and " << prepair.budget.get_steps() << " steps" << std::endl;
+    results.front().messages = messages.str();
+    for (std::deque<Feature_result>::iterator result = results.begin(); result != results.end(); ++result) {
+      result->quarantine_line = make_quarantine_line(*result, prepair);
+    } return;
+  }
+  
+  for (std::vector<std::size_t>::const_iterator current_feature = failed_features.begin(); current_feature != failed_features.end(); ++current_feature) {
+    Feature_result &result = results[*current_feature];
+    std::stringstream messages;
+    messages << "Gave up on feature " << result.feature << ": its boundary could not be followed through the coverage" << std::endl;
+    result.messages = messages.str();
+    result.quarantine_line = make_quarantine_line(result, prepair);
+  }
+  
+  if (prepair.number_of_height_conflicts > 0) {
+    std::stringstream messages;
+    messages << "Warning: Features " << results.front().feature << " to " << results.back().feature << " have " << prepair.number_of_height_conflicts << " vertices at the x and y of another vertex but at a different height, the first height was kept" << std::endl;
+    results.front().messages += messages.str();
+  }
+}
+
+void print_robustness(std::vector<OGRGeometry *> &in_geometries, std::vector<OGRGeometry *> &out_geometries, std::size_t first_feature, unsigned int number_of_threads) {
+  Polygon_robustness robustness;
+  std::vector<Robustness> in_robustness, out_robustness;
+  robustness.compute(in_geometries, in_robustness, number_of_threads);
+  robustness.compute(out_geometries, out_robustness, number_of_threads);
+  for (std::size_t current_geometry = 0; current_geometry < in_geometries.size(); ++current_geometry) {
+    std::cout << "Robustness of feature " << first_feature+current_geometry << ": input " << in_robustness[current_geometry].minimum() << " (vertex-vertex " << in_robustness[current_geometry].vertex_vertex << ", vertex-edge " << in_robustness[current_geometry].vertex_edge << "), output " << out_robustness[current_geometry].minimum() << " (vertex-vertex " << out_robustness[current_geometry].vertex_vertex << ", vertex-edge " << out_robustness[current_geometry].vertex_edge << ")" << std::endl;
+    delete in_geometries[current_geometry];
+    delete out_geometries[current_geometry];
+  } in_geometries.clear();
+  out_geometries.clear();
+}
+
+void write_results(std::deque<Feature_result> &results, std::ofstream &quarantine_file, Part_writer &part_writer, bool robustness, std::vector<OGRGeometry *> &in_geometries, std::vector<OGRGeometry *> &out_geometries, unsigned int number_of_threads) {
+  for (std::deque<Feature_result>::iterator result = results.begin(); result != results.end(); ++result) {
+    std::cerr << result->messages;
+    if (quarantine_file.is_open()) quarantine_file << result->quarantine_line;
+    std::cout << result->report;
+    char *output_wkt;
+    result->out_geometry->exportToWkt(&output_wkt);
+    if (part_writer.is_open()) part_writer.write(result->fid, output_wkt);
+    else std::cout << output_wkt << std::endl;
+    CPLFree(output_wkt);
+    
+    // Robustness is computed in parallel over batches of features
+    if (robustness) {
+      in_geometries.push_back(result->in_geometry);
+      out_geometries.push_back(result->out_geometry);
+      if (in_geometries.size() >= features_per_batch) print_robustness(in_geometries, out_geometries, result->feature+1-in_geometries.size(), number_of_threads);
+    } else {
+      delete result->in_geometry;
+      delete result->out_geometry;
+    }
+  } results.clear();
+}
+
+// Synthetic features for --stress: mostly small stars, with a giant
+// multipolygon of scattered overlapping squares every 1000 features
+OGRGeometry *make_stress_feature(std::size_t feature) {
+  if (feature % 1000 == 999) {
+    const std::size_t number_of_clusters = 8192;
+    OGRMultiPolygon *multipolygon = new OGRMultiPolygon();
+    for (std::size_t current_cluster = 0; current_cluster < number_of_clusters; ++current_cluster) {
+      std::size_t scattered_cluster = (current_cluster*1031) % number_of_clusters;
+      double x = 3.0*(scattered_cluster % 128), y = 3.0*(scattered_cluster / 128);
+      for (int current_square = 0; current_square < 2; ++current_square) {
+        OGRLinearRing ring;
+        double offset = 0.5*current_square;
+        ring.addPoint(x+offset, y+offset);
+        ring.addPoint(x+offset+1.0, y+offset);
+        ring.addPoint(x+offset+1.0, y+offset+1.0);
+        ring.addPoint(x+offset, y+offset+1.0);
+        ring.addPoint(x+offset, y+offset);
+        OGRPolygon square;
+        square.addRing(&ring);
+        multipolygon->addGeometry(&square);
+      }
+    } return multipolygon;
+  }
+  
+  // A self-intersecting star with 10 vertices
+  OGRLinearRing ring;
+  double x = (double)(feature % 1000), y = (double)(feature / 1000);
+  for (int current_vertex = 0; current_vertex < 9; ++current_vertex) {
+    double angle = 4.0*3.14159265358979323846*current_vertex/9.0;
+    ring.addPoint(x+std::cos(angle), y+std::sin(angle));
+  } ring.closeRings();
+  OGRPolygon *star = new OGRPolygon();
+  star->addRing(&ring);
+  return star;
+}
+
+void repair_stress_range(std::vector<OGRGeometry *> &geometries, std::size_t first_geometry, std::size_t last_geometry) {
+  for (std::size_t current_geometry = first_geometry; current_geometry < last_geometry; ++current_geometry) {
+    Polygon_repair prepair;
+    delete prepair.repair_odd_even(geometries[current_geometry]);
+  }
+}
+
+void repair_stress_feature(OGRGeometry *geometry, Task_scheduler *scheduler) {
+  Polygon_repair prepair;
+  prepair.scheduler = scheduler;
+  if (wkbFlatten(geometry->getGeometryType()) == wkbMultiPolygon && count_vertices(geometry) >= vertices_to_split) delete prepair.repair_odd_even_in_clusters(geometry, *scheduler);
+  else delete prepair.repair_odd_even(geometry);
+}
+
+// Compares a static split of the features over the threads with the work-stealing scheduler
+void run_stress(std::size_t number_of_features, unsigned int number_of_threads) {
+  std::vector<OGRGeometry *> geometries;
+  for (std::size_t current_feature = 0; current_feature < number_of_features; ++current_feature) {
+    geometries.push_back(make_stress_feature(current_feature));
+  } std::cout << "Stress test with " << number_of_features << " features on " << number_of_threads << " threads" << std::endl;
+  
+  std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  boost::thread_group workers;
+  for (unsigned int current_thread = 0; current_thread < number_of_threads; ++current_thread) {
+    workers.create_thread(boost::bind(&repair_stress_range, boost::ref(geometries), number_of_features*current_thread/number_of_threads, number_of_features*(current_thread+1)/number_of_threads));
+  } workers.join_all();
+  std::cout << "\tStatic split: " << std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count() << " seconds" << std::endl;
+  
+  start_time = std::chrono::steady_clock::now();
+  Task_scheduler scheduler(number_of_threads);
+  for (std::vector<OGRGeometry *>::iterator current_geometry = geometries.begin(); current_geometry != geometries.end(); ++current_geometry) {
+    scheduler.submit(boost::bind(&repair_stress_feature, *current_geometry, &scheduler));
+  } scheduler.wait();
+  std::cout << "\tWork stealing: " << std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count() << " seconds, " << scheduler.number_of_steals() << " steals" << std::endl;
+  
+  for (std::vector<OGRGeometry *>::iterator current_geometry = geometries.begin(); current_geometry != geometries.end(); ++current_geometry) {
+    delete *current_geometry;
+  }
+}
 
 int main(int argc, const char *argv[]) {
   
@@ -30,6 +295,7 @@ int main(int argc, const char *argv[]) {
   ("wkt,w", po::value<std::string>()->value_name("'POLYGON(...)'"), "Read WKT passed as a parameter")
   ("wktfile,f", po::value<std::string>()->value_name("PATH"), "Read text file containing one WKT per line")
   ("ogr,i", po::value<std::string>()->value_name("PATH"), "Read file using OGR")
+  ("layer", po::value<std::string>()->value_name("NAME"), "Read layer NAME, or the layer with index NAME, with --ogr (default: the first)")
   ("valid,v", "Check if the input is valid")
   ("help,h", "View all options")
   ;
@@ -37,11 +303,29 @@ int main(int argc, const char *argv[]) {
   advanced_options.add_options()
   ("time,t", "Benchmark the different stages of the process")
   ("setdiff", "Uses the point set paradigm (default: odd-even paradigm)")
-  ("minarea", po::value<double>()->value_name("AREA"), "Only output polygons larger than AREA")
+  ("minarea", po::value<double>()->value_name("AREA"), "Remove parts and fill holes smaller than AREA from the repaired output")
   ("isr", po::value<double>()->value_name("GRIDSIZE"), "Snap round the input before repairing")
   ("robustness", "Compute the robustness of the input and output")
+  ("quality", "Print the angles, slivers and edge lengths of the triangulation of every feature")
+  ("threads", po::value<unsigned int>()->value_name("N"), "Use N threads for parallel stages (default: all cores)")
+  ("snapshot", po::value<std::string>()->value_name("DIRECTORY"), "Write a triangulation snapshot of every feature whose output is empty or invalid to DIRECTORY")
+  ("record", po::value<std::string>()->value_name("DIRECTORY"), "Write the construction of the triangulation of every feature to DIRECTORY for replay in TriVis")
+  ("timeout", po::value<double>()->value_name("SECONDS"), "Give up on a feature after SECONDS and output it empty")
+  ("maxwork", po::value<std::size_t>()->value_name("STEPS"), "Give up on a feature after STEPS constraint insertions and tagging steps and output it empty")
+  ("quarantine", po::value<std::string>()->value_name("PATH"), "Write the features given up on to PATH, one per line with their statistics and WKT")
+  ("where", po::value<std::string>()->value_name("'SQL'"), "Only read the features matching the attribute filter SQL with --ogr")
+  ("bbox", po::value<std::string>()->value_name("MINX,MINY,MAXX,MAXY"), "Only read the features that intersect the box with --ogr")
+  ("fids", po::value<std::string>()->value_name("FIRST-LAST"), "Only read the features with FIRST <= FID <= LAST with --ogr")
+  ("readahead", po::value<std::size_t>()->value_name("N"), "Keep up to N features read ahead of the repair with --ogr (default: 256)")
+  ("shard", po::value<std::string>()->value_name("I/N"), "Only repair the features whose FID, or line with --wktfile, is I modulo N, and write them to a part in --parts")
+  ("parts", po::value<std::string>()->value_name("DIRECTORY"), "Write the part of --shard to DIRECTORY, or read the parts to --merge from it")
+  ("merge", po::value<std::size_t>()->value_name("N"), "Check that the N parts in --parts are complete and hold all the features of --ogr or --wktfile, read with the same options, and output them in FID order")
+  ("coverage", po::value<std::size_t>()->value_name("N"), "Repair every N consecutive features together in one triangulation, so the boundaries they share stay the same in all of them. Features are grouped in the order they are read, not by location, so neighbours more than N features apart do not share their boundaries: sort the input spatially first")
   ;
   po::options_description hidden_options("Hidden options");
+  hidden_options.add_options()
+  ("stress", po::value<std::size_t>()->value_name("N"), "Benchmark the scheduler with N synthetic features of skewed sizes")
+  ;
   
   po::options_description all_options;
   all_options.add(main_options).add(advanced_options).add(hidden_options);
@@ -58,17 +342,59 @@ int main(int argc, const char *argv[]) {
   }
   
   time_t start_time = time(NULL);
-////  double min_area = 0;
-////  bool shp_out = false;
+  double min_area = 0.0;
+//  bool shp_out = false;
 //  bool point_set = false;
   bool time_results = false;
+  double timeout = 0.0;
+  std::size_t max_work = 0;
+  std::ofstream quarantine_file;
+  Part_writer part_writer;
+  std::size_t shard = 0, number_of_shards = 1;
+  unsigned int number_of_threads = boost::thread::hardware_concurrency();
+  std::size_t current_feature = 0;
+  std::vector<OGRGeometry *> in_geometries, out_geometries;
+  std::deque<Feature_result> results;
   
   OGRGeometry *in_geometry;
   OGRDataSource *data_source;
   OGRLayer *data_layer;
-  OGRFeature *feature;
+  Feature_reader *feature_reader = NULL;
+  long first_fid = OGRNullFID, last_fid = OGRNullFID;
+  bool fids_filtered_by_driver = false;
+  long fid = 0, current_line = 0;
   std::ifstream infile;
   
+  if (vm.count("threads")) {
+    number_of_threads = vm["threads"].as<unsigned int>();
+  } if (number_of_threads < 1) number_of_threads = 1;
+  
+  if (vm.count("stress")) {
+    run_stress(vm["stress"].as<std::size_t>(), number_of_threads);
+    return 0;
+  }
+  
+  if (vm.count("merge") && (!vm.count("parts") || vm["merge"].as<std::size_t>() < 1 || vm.count("shard") || (!vm.count("ogr") && !vm.count("wktfile")))) {
+    std::cerr << "Error: Merging needs --parts, at least one part and the input of the shards with --ogr or --wktfile" << std::endl;
+    return 1;
+  }
+  
+  // Shards only communicate through their parts, which appear complete or not at all
+  if (vm.count("shard")) {
+    char separator;
+    std::stringstream shard_and_shards(vm["shard"].as<std::string>());
+    if (!(shard_and_shards >> shard >> separator >> number_of_shards) || separator != '/' || number_of_shards < 1 || shard >= number_of_shards) {
+      std::cerr << "Error: Could not parse the shard, use I/N with 0 <= I < N" << std::endl;
+      return 1;
+    } if (!vm.count("parts") || vm.count("wkt")) {
+      std::cerr << "Error: Sharding needs --parts and --ogr or --wktfile" << std::endl;
+      return 1;
+    } if (!part_writer.open(vm["parts"].as<std::string>(), shard, number_of_shards)) {
+      std::cerr << "Error: Could not open part file" << std::endl;
+      return 1;
+    }
+  }
+  
   // Init input
   if (vm.count("wkt")) {
     char *cstr = new char[vm["wkt"].as<std::string>().length()+1];
@@ -81,7 +407,7 @@ int main(int argc, const char *argv[]) {
     if (!infile.is_open()) {
       std::cerr << "Error: Could not open file" << std::endl;
       return 1;
-    } else {
+    } else if (!vm.count("merge")) {
       std::cout << "Opened: " << vm["wktfile"].as<std::string>() << std::endl;
     }
   }
@@ -93,7 +419,68 @@ int main(int argc, const char *argv[]) {
       std::cerr << "Error: Could not open file" << std::endl;
       return 1;
     } data_layer = data_source->GetLayer(0);
-    data_layer->ResetReading();
+    if (vm.count("layer")) {
+      std::string layer_name = vm["layer"].as<std::string>();
+      data_layer = data_source->GetLayerByName(layer_name.c_str());
+      if (data_layer == NULL && !layer_name.empty() && layer_name.find_first_not_of("0123456789") == std::string::npos) data_layer = data_source->GetLayer(std::atoi(layer_name.c_str()));
+    } if (data_layer == NULL) {
+      std::cerr << "Error: Could not find layer" << std::endl;
+      return 1;
+    }
+    
+    if (vm.count("bbox")) {
+      double min_x, min_y, max_x, max_y;
+      char separator[3];
+      std::stringstream bbox(vm["bbox"].as<std::string>());
+      if (!(bbox >> min_x >> separator[0] >> min_y >> separator[1] >> max_x >> separator[2] >> max_y) || separator[0] != ',' || separator[1] != ',' || separator[2] != ',') {
+        std::cerr << "Error: Could not parse the box, use MINX,MINY,MAXX,MAXY" << std::endl;
+        return 1;
+      } data_layer->SetSpatialFilterRect(min_x, min_y, max_x, max_y);
+    }
+    
+    // The FID range and the shard go into the attribute filter too, so drivers that can skip the rest
+    // do. The reader checks both itself, so if a driver cannot evaluate them only --where is kept
+    std::string where_filter;
+    if (vm.count("where")) where_filter = "(" + vm["where"].as<std::string>() + ")";
+    std::string attribute_filter = where_filter;
+    if (vm.count("fids")) {
+      char separator;
+      std::stringstream fids(vm["fids"].as<std::string>());
+      if (!(fids >> first_fid >> separator >> last_fid) || separator != '-' || first_fid < 0 || last_fid < first_fid) {
+        std::cerr << "Error: Could not parse the FID range, use FIRST-LAST" << std::endl;
+        return 1;
+      } std::stringstream fid_filter;
+      fid_filter << "FID >= " << first_fid << " AND FID <= " << last_fid;
+      if (!attribute_filter.empty()) attribute_filter += " AND ";
+      attribute_filter += fid_filter.str();
+    } std::string fid_range_filter = attribute_filter;
+    if (number_of_shards > 1) {
+      std::stringstream shard_filter;
+      shard_filter << "FID % " << number_of_shards << " = " << shard;
+      if (!attribute_filter.empty()) attribute_filter += " AND ";
+      attribute_filter += shard_filter.str();
+    } fids_filtered_by_driver = attribute_filter != where_filter;
+    if (fids_filtered_by_driver && data_layer->SetAttributeFilter(attribute_filter.c_str()) != OGRERR_NONE) {
+      // Fewer drivers can take the modulo than the range
+      if (fid_range_filter != where_filter && data_layer->SetAttributeFilter(fid_range_filter.c_str()) == OGRERR_NONE) {
+        std::cerr << "Warning: The driver cannot select the shard, so its FIDs are checked while reading" << std::endl;
+      } else {
+        std::cerr << "Warning: The driver cannot filter by FID, so the FIDs are checked while reading" << std::endl;
+        fids_filtered_by_driver = false;
+      }
+    } if (!fids_filtered_by_driver && !where_filter.empty() && data_layer->SetAttributeFilter(where_filter.c_str()) != OGRERR_NONE) {
+      std::cerr << "Error: Could not set the attribute filter" << std::endl;
+      return 1;
+    }
+    
+    std::size_t features_to_read_ahead = default_features_to_read_ahead;
+    if (vm.count("readahead")) features_to_read_ahead = vm["readahead"].as<std::size_t>();
+    if (!vm.count("merge")) {
+      feature_reader = new Feature_reader(data_layer, features_to_read_ahead);
+      if (first_fid != OGRNullFID) feature_reader->set_fid_range(first_fid, last_fid);
+      if (number_of_shards > 1) feature_reader->set_shard(shard, number_of_shards);
+      feature_reader->start();
+    }
   }
   
   else {
@@ -101,66 +488,188 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
   
+  // The parts have to add up to the input, read with the same options
+  if (vm.count("merge")) {
+    long input_features = 0;
+    if (vm.count("ogr")) {
+      if (first_fid != OGRNullFID && !fids_filtered_by_driver) {
+        OGRFeature *feature;
+        data_layer->ResetReading();
+        while ((feature = data_layer->GetNextFeature()) != NULL) {
+          if (feature->GetFID() >= first_fid && feature->GetFID() <= last_fid) ++input_features;
+          OGRFeature::DestroyFeature(feature);
+        }
+      } else input_features = data_layer->GetFeatureCount();
+      OGRDataSource::DestroyDataSource(data_source);
+    } else {
+      std::string line;
+      while (std::getline(infile, line)) {
+        if (!line.empty()) ++input_features;
+      }
+    } if (input_features < 0) {
+      std::cerr << "Error: Could not count the features of the input" << std::endl;
+      return 1;
+    } return merge_parts(vm["parts"].as<std::string>(), vm["merge"].as<std::size_t>(), input_features, std::cout) ? 0 : 1;
+  }
+  
   if (vm.count("time")) {
     time_results = true;
   }
   
+  if (vm.count("minarea")) {
+    min_area = vm["minarea"].as<double>();
+  }
+  
+  if (vm.count("timeout")) {
+    timeout = vm["timeout"].as<double>();
+  }
+  
+  if (vm.count("maxwork")) {
+    max_work = vm["maxwork"].as<std::size_t>();
+  }
+  
+  if (vm.count("quarantine")) {
+    quarantine_file.open(vm["quarantine"].as<std::string>().c_str());
+    if (!quarantine_file.is_open()) {
+      std::cerr << "Error: Could not open quarantine file" << std::endl;
+      return 1;
+    } quarantine_file << "feature\tseconds\tsteps\tvertices\twkt" << std::endl;
+  }
+  
+  if (vm.count("coverage") && (vm.count("setdiff") || vm.count("snapshot") || vm.count("record") || vm.count("quality") || vm.count("valid") || vm.count("minarea"))) {
+    std::cerr << "Error: Coverage mode cannot be combined with --setdiff, --snapshot, --record, --quality, --valid or --minarea" << std::endl;
+    return 1;
+  }
+  
+  if (vm.count("snapshot") && vm.count("setdiff")) {
+    std::cerr << "Error: Snapshots are only available with the odd-even paradigm" << std::endl;
+    return 1;
+  }
+  
+  if (vm.count("record")) {
+#ifdef RECORD_EVENTS
+    if (vm.count("setdiff")) {
+      std::cerr << "Error: Recording is only available with the odd-even paradigm" << std::endl;
+      return 1;
+    }
+#else
+    std::cerr << "Error: Recording requires compiling with RECORD_EVENTS" << std::endl;
+    return 1;
+#endif
+  }
+  
+  // Features are repaired as tasks of a work-stealing scheduler, so a few
+  // large features do not leave the other threads idle. Validation, timing
+  // and recording print as they go, so they keep repairing one feature at a time
+  Task_scheduler *scheduler = NULL;
+  if (number_of_threads > 1 && !vm.count("record")) scheduler = new Task_scheduler(number_of_threads);
+  bool in_batches = scheduler != NULL && !vm.count("valid") && !time_results && !vm.count("coverage");
+  std::size_t features_per_tile = 0;
+  if (vm.count("coverage")) features_per_tile = std::max(vm["coverage"].as<std::size_t>(), (std::size_t)1);
+  
+  Repair_options options;
+  options.point_set = vm.count("setdiff") > 0;
+  options.quality = vm.count("quality") > 0;
+  options.time_results = time_results;
+  options.min_area = min_area;
+  options.timeout = timeout;
+  options.max_work = max_work;
+  options.quality_threads = in_batches ? 1 : number_of_threads;
+  if (vm.count("snapshot")) options.snapshot_directory = vm["snapshot"].as<std::string>();
+  options.scheduler = scheduler;
+  
+  // Splitting leaves no triangulation to look at afterwards
+  options.split_large_features = scheduler != NULL && !options.point_set && !options.quality && !time_results && options.snapshot_directory.empty();
+  
   while (true) {
 
     // Get one polygon
     if (vm.count("wktfile")) {
-      if (infile.eof()) {
+      std::string line;
+      if (!std::getline(infile, line)) {
         infile.close();
         break;
-      } std::string line;
-      std::getline(infile, line);
+      } fid = current_line++;
+      if (line.empty() || (std::size_t)fid % number_of_shards != shard) continue;
       char *cstr = new char[line.length()+1];
       std::strcpy(cstr, line.c_str());
       OGRGeometryFactory::createFromWkt(&cstr, NULL, &in_geometry);
     }
     
     else if (vm.count("ogr")) {
-      feature = data_layer->GetNextFeature();
-      if (feature == NULL) {
-        OGRDataSource::DestroyDataSource(data_source);
-        break;
-      } in_geometry = feature->GetGeometryRef();
+      if (!feature_reader->next(in_geometry, fid)) break;
     }
     
-    if (in_geometry == NULL) break;
-    
-    // Do what needs to be done
-    Polygon_repair prepair;
-    
-    if (vm.count("valid")) {
-      prepair.is_iso_and_ogc_valid(in_geometry);
+    // Only the end of the input stops the run, features without a geometry
+    // are skipped. Shards list them in their part, so the merge can account for them
+    if (in_geometry == NULL) {
+      if (vm.count("wkt")) {
+        std::cerr << "Error: Could not read the WKT" << std::endl;
+        break;
+      } std::cerr << "Warning: Skipped FID " << fid << ", it has no geometry that could be read" << std::endl;
+      if (part_writer.is_open()) part_writer.write_not_repaired(fid, "no geometry that could be read");
+      continue;
     }
     
-    OGRGeometry *out_geometry;
-    if (vm.count("setdiff")) {
-      out_geometry = prepair.repair_point_set(in_geometry, time_results);
-    } else {
-      out_geometry = prepair.repair_odd_even(in_geometry, time_results);
+    // Do what needs to be done, the result owns the input from now on
+    results.push_back(Feature_result(current_feature, fid, in_geometry));
+    if (features_per_tile > 0) {
+      if (results.size() >= features_per_tile) {
+        repair_coverage_tile(results, options);
+        write_results(results, quarantine_file, part_writer, vm.count("robustness") > 0, in_geometries, out_geometries, number_of_threads);
+      }
     }
     
-    // Output results
-//    char *output_wkt;
-//    out_geometry->exportToWkt(&output_wkt);
-//    std::cout << output_wkt << std::endl;
-//    delete output_wkt;
-    
-    if (vm.count("wkt")) {
-      delete in_geometry;
-      break;
+    else if (in_batches) {
+      scheduler->submit(boost::bind(&repair_feature_in_task, boost::ref(results.back()), boost::cref(options)));
+      if (results.size() >= features_per_batch) {
+        scheduler->wait();
+        write_results(results, quarantine_file, part_writer, vm.count("robustness") > 0, in_geometries, out_geometries, number_of_threads);
+      }
     }
     
-    else if (vm.count("wktfile")) {
-      delete in_geometry;
+    else {
+      Polygon_repair prepair;
+      
+      if (vm.count("valid")) {
+        prepair.is_iso_and_ogc_valid(in_geometry);
+      }
+      
+#ifdef RECORD_EVENTS
+      if (vm.count("record")) {
+        std::stringstream file_name;
+        file_name << vm["record"].as<std::string>() << "/feature_" << current_feature << ".events";
+        prepair.triangulation.recorder.start(file_name.str());
+      }
+#endif
+      
+      repair_feature(prepair, results.back(), options);
+      write_results(results, quarantine_file, part_writer, vm.count("robustness") > 0, in_geometries, out_geometries, number_of_threads);
     }
+    ++current_feature;
     
-    else if (vm.count("ogr")) {
-      OGRFeature::DestroyFeature(feature);
-    }
+    if (vm.count("wkt")) break;
+  }
+  
+  // The reader has to stop before its layer goes
+  if (vm.count("ogr")) {
+    delete feature_reader;
+    OGRDataSource::DestroyDataSource(data_source);
+  }
+  
+  if (in_batches) {
+    scheduler->wait();
+    write_results(results, quarantine_file, part_writer, vm.count("robustness") > 0, in_geometries, out_geometries, number_of_threads);
+  } else if (!results.empty()) {
+    repair_coverage_tile(results, options);
+    write_results(results, quarantine_file, part_writer, vm.count("robustness") > 0, in_geometries, out_geometries, number_of_threads);
+  } delete scheduler;
+  
+  if (!in_geometries.empty()) print_robustness(in_geometries, out_geometries, current_feature-in_geometries.size(), number_of_threads);
+  
+  if (part_writer.is_open() && !part_writer.close()) {
+    std::cerr << "Error: Could not write part file" << std::endl;
+    return 1;
   }
   
   // Time results
@@ -0,0 +1,242 @@
+/*
+ Copyright (c) 2009-2014,
+ Ken Arroyo Ohori    g.a.k.arroyoohori@tudelft.nl
+ Hugo Ledoux         h.ledoux@tudelft.nl
+ Martijn Meijers     b.m.meijers@tudelft.nl
+ All rights reserved.
+ 
+ This file is part of prepair: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ Licensees holding a valid commercial license may use this file in
+ accordance with the commercial license agreement provided with
+ the software.
+ 
+ This file is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+
+// Fuzzing harness for repair_odd_even(), reading WKB. It builds in two ways:
+// * with -DPREPAIR_LIBFUZZER -fsanitize=fuzzer,address it is a libFuzzer
+//   target that aborts on outputs that are invalid, that break the odd-even
+//   rule or that differ from the serial repair
+// * without it, it is a command-line tool that runs a corpus, or a single
+//   input from stdin as AFL passes it, and can save the interesting inputs.
+//   With --slowdown X it flags the inputs whose time per vertex is more than
+//   X times the median of the corpus. --wktfile turns a file of WKT, e.g. the
+//   quarantine file of prepair, into seeds
+
+#include "Repair_fuzzer.h"
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+// Timings of smaller inputs are mostly overhead, so they are not compared
+static const std::size_t vertices_to_time = 32;
+
+#ifdef PREPAIR_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char *data, std::size_t size) {
+  static Task_scheduler scheduler(2);
+  static Repair_fuzzer fuzzer;
+  fuzzer.differential = true;
+  fuzzer.scheduler = &scheduler;
+  if (fuzzer.run(data, size).is_failure()) std::abort();
+  return 0;
+}
+
+#else
+
+struct Fuzz_input {
+  std::string name;
+  std::string data;
+  Fuzz_result result;
+};
+
+bool read_input(std::istream &stream, Fuzz_input &input) {
+  input.data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  return !stream.bad();
+}
+
+// Named after their contents, as libFuzzer does, so saving an input twice keeps one copy
+bool save_input(const std::string &corpus_directory, const std::string &prefix, const std::string &data) {
+  std::stringstream file_name;
+  file_name << corpus_directory << "/" << prefix << std::hex << std::setw(16) << std::setfill('0') << boost::hash_range(data.begin(), data.end());
+  std::ofstream file(file_name.str().c_str(), std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not write " << file_name.str() << std::endl;
+    return false;
+  } file.write(data.data(), data.size());
+  return true;
+}
+
+// Writes every WKT line of a file as a WKB seed
+int write_seeds(const std::string &wkt_file_name, const std::string &corpus_directory) {
+  std::ifstream infile(wkt_file_name.c_str(), std::ios::in);
+  if (!infile.is_open()) {
+    std::cerr << "Error: Could not open file" << std::endl;
+    return 1;
+  } std::size_t seeds = 0;
+  std::string line;
+  while (std::getline(infile, line)) {
+    
+    // Lines of a quarantine file have the WKT in their last column
+    if (line.find('\t') != std::string::npos) line = line.substr(line.rfind('\t')+1);
+    std::vector<char> wkt(line.begin(), line.end());
+    wkt.push_back('\0');
+    char *wkt_pointer = &wkt.front();
+    OGRGeometry *geometry = NULL;
+    if (OGRGeometryFactory::createFromWkt(&wkt_pointer, NULL, &geometry) != OGRERR_NONE || geometry == NULL) continue;
+    std::vector<unsigned char> wkb(geometry->WkbSize());
+    geometry->exportToWkb(wkbNDR, &wkb.front());
+    delete geometry;
+    if (!save_input(corpus_directory, "seed-", std::string(wkb.begin(), wkb.end()))) return 1;
+    ++seeds;
+  } std::cout << "Wrote " << seeds << " seeds to " << corpus_directory << std::endl;
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  
+  namespace po = boost::program_options;
+  po::options_description main_options("Options");
+  main_options.add_options()
+  ("input", po::value<std::vector<std::string> >()->value_name("PATH"), "WKB files or directories of them to run (default: one input from stdin)")
+  ("differential", "Check every output against the odd-even rule at sample points, and compare the inputs split into clusters with the serial repair")
+  ("slowdown", po::value<double>()->value_name("X"), "Flag the inputs whose time per vertex is more than X times the median")
+  ("corpus", po::value<std::string>()->value_name("DIRECTORY"), "Save the failing and slow inputs to DIRECTORY")
+  ("wktfile", po::value<std::string>()->value_name("PATH"), "Write every WKT of a text file to the corpus as a seed and exit")
+  ("maxvertices", po::value<std::size_t>()->value_name("N"), "Skip inputs with more than N vertices (default: 4096)")
+  ("maxwork", po::value<std::size_t>()->value_name("STEPS"), "Give up on an input after STEPS, 0 for no limit (default: 1000000)")
+  ("threads", po::value<unsigned int>()->value_name("N"), "Repair with N threads as prepair does, 1 for the serial repair (default: 2)")
+  ("repeat", po::value<unsigned int>()->value_name("N"), "Time the fastest of N repairs of every input (default: 3 with --slowdown)")
+  ("help,h", "View all options")
+  ;
+  po::positional_options_description positional_options;
+  positional_options.add("input", -1);
+  
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(main_options).positional(positional_options).run(), vm);
+  po::notify(vm);
+  
+  if (vm.count("help")) {
+    std::cout << "=== prepair fuzzer help ===" << std::endl;
+    std::cout << main_options << std::endl;
+    return 0;
+  }
+  
+  OGRRegisterAll();
+  std::string corpus_directory;
+  if (vm.count("corpus")) {
+    corpus_directory = vm["corpus"].as<std::string>();
+    boost::system::error_code error;
+    boost::filesystem::create_directories(corpus_directory, error);
+    if (error) {
+      std::cerr << "Error: Could not create corpus directory" << std::endl;
+      return 1;
+    }
+  }
+  
+  if (vm.count("wktfile")) {
+    if (corpus_directory.empty()) {
+      std::cerr << "Error: --wktfile needs --corpus" << std::endl;
+      return 1;
+    } return write_seeds(vm["wktfile"].as<std::string>(), corpus_directory);
+  }
+  
+  unsigned int number_of_threads = 2;
+  if (vm.count("threads")) {
+    number_of_threads = vm["threads"].as<unsigned int>();
+  } Task_scheduler *scheduler = NULL;
+  if (number_of_threads > 1) scheduler = new Task_scheduler(number_of_threads);
+  
+  Repair_fuzzer fuzzer;
+  fuzzer.differential = vm.count("differential") > 0;
+  fuzzer.scheduler = scheduler;
+  if (vm.count("maxvertices")) fuzzer.max_vertices = vm["maxvertices"].as<std::size_t>();
+  if (vm.count("maxwork")) fuzzer.max_steps = vm["maxwork"].as<std::size_t>();
+  if (vm.count("slowdown")) fuzzer.repetitions = 3;
+  if (vm.count("repeat")) fuzzer.repetitions = vm["repeat"].as<unsigned int>();
+  
+  // Gather the inputs
+  std::vector<Fuzz_input> inputs;
+  if (!vm.count("input")) {
+    inputs.push_back(Fuzz_input());
+    inputs.back().name = "stdin";
+    if (!read_input(std::cin, inputs.back())) {
+      std::cerr << "Error: Could not read stdin" << std::endl;
+      return 1;
+    }
+  } else {
+    std::vector<std::string> paths = vm["input"].as<std::vector<std::string> >();
+    std::vector<std::string> file_names;
+    for (std::vector<std::string>::const_iterator path = paths.begin(); path != paths.end(); ++path) {
+      if (boost::filesystem::is_directory(*path)) {
+        for (boost::filesystem::directory_iterator entry(*path); entry != boost::filesystem::directory_iterator(); ++entry) {
+          if (boost::filesystem::is_regular_file(entry->status())) file_names.push_back(entry->path().string());
+        }
+      } else file_names.push_back(*path);
+    } std::sort(file_names.begin(), file_names.end());
+    for (std::vector<std::string>::const_iterator file_name = file_names.begin(); file_name != file_names.end(); ++file_name) {
+      std::ifstream file(file_name->c_str(), std::ios::in | std::ios::binary);
+      inputs.push_back(Fuzz_input());
+      inputs.back().name = *file_name;
+      if (!file.is_open() || !read_input(file, inputs.back())) {
+        std::cerr << "Error: Could not read " << *file_name << std::endl;
+        return 1;
+      }
+    }
+  }
+  
+  // Run them
+  std::size_t accepted = 0, gave_up = 0, failures = 0, slow = 0;
+  std::vector<double> seconds_per_vertex;
+  for (std::vector<Fuzz_input>::iterator input = inputs.begin(); input != inputs.end(); ++input) {
+    input->result = fuzzer.run(reinterpret_cast<const unsigned char *>(input->data.data()), input->data.size());
+    if (!input->result.accepted) continue;
+    ++accepted;
+    if (input->result.gave_up) {
+      ++gave_up;
+      std::cout << input->name << ": gave up after " << input->result.seconds << " seconds" << std::endl;
+      continue;
+    } if (input->result.vertices >= vertices_to_time) seconds_per_vertex.push_back(input->result.seconds/input->result.vertices);
+    if (!input->result.is_failure()) continue;
+    ++failures;
+    std::cout << input->name << ": ";
+    if (!input->result.valid) std::cout << "invalid output";
+    else if (!input->result.matches_odd_even) std::cout << "output differs from the odd-even rule at " << input->result.mismatched_samples << " sample points";
+    else std::cout << "area " << std::setprecision(17) << input->result.area << " but " << input->result.serial_area << " with the serial repair" << std::setprecision(6);
+    std::cout << std::endl;
+    if (!corpus_directory.empty()) save_input(corpus_directory, input->result.valid ? "mismatch-" : "invalid-", input->data);
+    
+    // As AFL runs it, a failure has to look like a crash
+    if (!vm.count("input")) std::abort();
+  }
+  
+  if (vm.count("slowdown") && !seconds_per_vertex.empty()) {
+    std::vector<double>::iterator median = seconds_per_vertex.begin()+seconds_per_vertex.size()/2;
+    std::nth_element(seconds_per_vertex.begin(), median, seconds_per_vertex.end());
+    double threshold = vm["slowdown"].as<double>()*(*median);
+    std::cout << "Median time per vertex: " << *median << " seconds" << std::endl;
+    for (std::vector<Fuzz_input>::const_iterator input = inputs.begin(); input != inputs.end(); ++input) {
+      if (!input->result.accepted || input->result.gave_up || input->result.vertices < vertices_to_time) continue;
+      double input_seconds_per_vertex = input->result.seconds/input->result.vertices;
+      if (input_seconds_per_vertex <= threshold) continue;
+      ++slow;
+      std::cout << input->name << ": " << input_seconds_per_vertex/(*median) << " times the median time per vertex (" << input->result.vertices << " vertices in " << input->result.seconds << " seconds)" << std::endl;
+      if (!corpus_directory.empty()) save_input(corpus_directory, "slow-", input->data);
+    }
+  }
+  
+  std::cout << inputs.size() << " inputs, " << accepted << " repaired, " << gave_up << " given up on, " << failures << " failures, " << slow << " slow" << std::endl;
+  delete scheduler;
+  return failures > 0 || slow > 0 ? 1 : 0;
+}
+
+#endif
@@ -1,13 +1,13 @@
 #version 150
 
 in vec2 position;
-in vec3 color;
+in uint color;
 
 uniform mat4 mvp;
 
-out vec3 Color;
+flat out uint ColorIndex;
 
 void main() {
-  Color = color;
+  ColorIndex = color;
   gl_Position = mvp * vec4(position, 0.0, 1.0);
 }
\ No newline at end of file
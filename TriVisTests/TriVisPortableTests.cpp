@@ -0,0 +1,1312 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisTestSuite.h"
+
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "TriVisBufferBuilder.h"
+#include "TriVisTiling.h"
+#include "TriVisLoader.h"
+#include "TriVisReplay.h"
+#include "TriVisBatchRenderer.h"
+#include "TriVisRasterizer.h"
+#include "TriVisColours.h"
+#include "Repair_fuzzer.h"
+#include "Polygon_robustness.h"
+#include "Feature_reader.h"
+#include "Part_files.h"
+
+// The tests that need neither Cocoa nor OpenGL. The benchmarks stay in
+// TriVisTests.mm, where XCTest measures them
+
+namespace {
+  struct Fixtures {
+    OGRGeometry *squareWithHole;
+    TriVisBuffer grid;
+    
+    Fixtures() {
+      char wkt[] = "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,4 2,4 4,2 4,2 2))";
+      char *wktPointer = wkt;
+      OGRGeometryFactory::createFromWkt(&wktPointer, NULL, &squareWithHole);
+      
+      // A 500 x 500 grid of unit lines
+      for (int x = 0; x < 500; ++x) {
+        for (int y = 0; y < 500; ++y) {
+          grid.positions.push_back(x);
+          grid.positions.push_back(y);
+          grid.colours.push_back(exteriorRingColour);
+          if (x+1 < 500) {
+            grid.elements.push_back(500*x+y);
+            grid.elements.push_back(500*(x+1)+y);
+          } if (y+1 < 500) {
+            grid.elements.push_back(500*x+y);
+            grid.elements.push_back(500*x+y+1);
+          }
+        }
+      }
+    }
+    
+    ~Fixtures() {
+      delete squareWithHole;
+    }
+  };
+  
+  // 4096 squares on a 64 x 64 grid, in an order where consecutive parts are far apart
+  OGRGeometry *createScatteredParts() {
+    OGRMultiPolygon *multipolygon = new OGRMultiPolygon();
+    for (int currentPart = 0; currentPart < 4096; ++currentPart) {
+      int cell = (currentPart*1031)%4096;
+      double x = 10.0*(cell%64), y = 10.0*(cell/64);
+      OGRLinearRing square;
+      square.addPoint(x, y);
+      square.addPoint(x+5.0, y);
+      square.addPoint(x+5.0, y+5.0);
+      square.addPoint(x, y+5.0);
+      square.closeRings();
+      OGRPolygon part;
+      part.addRing(&square);
+      multipolygon->addGeometry(&part);
+    } return multipolygon;
+  }
+  
+  OGRGeometry *createFromWkt(const char *wkt) {
+    std::string copy(wkt);
+    char *wktPointer = &copy[0];
+    OGRGeometry *geometry = NULL;
+    OGRGeometryFactory::createFromWkt(&wktPointer, NULL, &geometry);
+    return geometry;
+  }
+  
+  std::string temporaryFile(const char *name) {
+    return (boost::filesystem::temp_directory_path()/name).string();
+  }
+  
+  // Rings of reconstructed polygons pass through every vertex once, closing point aside
+  bool ringsAreSimple(OGRGeometry *geometry) {
+    std::vector<OGRPolygon *> polygons;
+    if (wkbFlatten(geometry->getGeometryType()) == wkbPolygon) polygons.push_back(static_cast<OGRPolygon *>(geometry));
+    else if (wkbFlatten(geometry->getGeometryType()) == wkbMultiPolygon) {
+      OGRMultiPolygon *multipolygon = static_cast<OGRMultiPolygon *>(geometry);
+      for (int currentPolygon = 0; currentPolygon < multipolygon->getNumGeometries(); ++currentPolygon) {
+        polygons.push_back(static_cast<OGRPolygon *>(multipolygon->getGeometryRef(currentPolygon)));
+      }
+    } for (std::vector<OGRPolygon *>::const_iterator currentPolygon = polygons.begin(); currentPolygon != polygons.end(); ++currentPolygon) {
+      for (int currentRing = -1; currentRing < (*currentPolygon)->getNumInteriorRings(); ++currentRing) {
+        OGRLinearRing *ring = currentRing < 0 ? (*currentPolygon)->getExteriorRing() : (*currentPolygon)->getInteriorRing(currentRing);
+        std::vector<std::pair<double, double> > points;
+        for (int currentPoint = 0; currentPoint < ring->getNumPoints()-1; ++currentPoint) {
+          points.push_back(std::make_pair(ring->getX(currentPoint), ring->getY(currentPoint)));
+        } std::sort(points.begin(), points.end());
+        if (std::adjacent_find(points.begin(), points.end()) != points.end()) return false;
+      }
+    } return true;
+  }
+  
+  // A layer in memory with a unit square per feature, except for every third feature, which has no geometry
+  OGRDataSource *createMemoryLayer(int numFeatures) {
+    OGRRegisterAll();
+    OGRSFDriver *driver = OGRSFDriverRegistrar::GetRegistrar()->GetDriverByName("Memory");
+    OGRDataSource *dataSource = driver->CreateDataSource("features");
+    OGRLayer *layer = dataSource->CreateLayer("features", NULL, wkbPolygon);
+    for (int currentFeature = 0; currentFeature < numFeatures; ++currentFeature) {
+      OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+      if (currentFeature%3 != 1) {
+        OGRLinearRing square;
+        square.addPoint(currentFeature, 0.0);
+        square.addPoint(currentFeature+1.0, 0.0);
+        square.addPoint(currentFeature+1.0, 1.0);
+        square.addPoint(currentFeature, 1.0);
+        square.closeRings();
+        OGRPolygon polygon;
+        polygon.addRing(&square);
+        feature->SetGeometry(&polygon);
+      } layer->CreateFeature(feature);
+      OGRFeature::DestroyFeature(feature);
+    } return dataSource;
+  }
+  
+  // The edges of the triangulation of a replay and the ones in its pools are the same, once each
+  bool replayElementsMatch(TriVisReplay &replay) {
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > edges[2], pooledEdges[2];
+    for (TriVisReplay::Triangulation::Finite_edges_iterator currentEdge = replay.triangulation.finite_edges_begin(); currentEdge != replay.triangulation.finite_edges_end(); ++currentEdge) {
+      std::uint32_t first = replay.slot(currentEdge->first->vertex(TriVisReplay::Triangulation::cw(currentEdge->second)));
+      std::uint32_t second = replay.slot(currentEdge->first->vertex(TriVisReplay::Triangulation::ccw(currentEdge->second)));
+      edges[replay.triangulation.is_constrained(*currentEdge)].push_back(std::make_pair(std::min(first, second), std::max(first, second)));
+    } for (int isConstrained = 0; isConstrained < 2; ++isConstrained) {
+      std::size_t firstElement = isConstrained ? 0 : replay.firstUnconstrainedElement;
+      std::size_t numElements = isConstrained ? replay.numConstrainedElements : replay.numUnconstrainedElements;
+      for (std::size_t currentElement = firstElement; currentElement < firstElement+numElements; currentElement += 2) {
+        std::uint32_t first = replay.elements[currentElement], second = replay.elements[currentElement+1];
+        if (first != second) pooledEdges[isConstrained].push_back(std::make_pair(std::min(first, second), std::max(first, second)));
+      } std::sort(edges[isConstrained].begin(), edges[isConstrained].end());
+      std::sort(pooledEdges[isConstrained].begin(), pooledEdges[isConstrained].end());
+    } return edges[0] == pooledEdges[0] && edges[1] == pooledEdges[1];
+  }
+  
+  std::size_t countElements(const TriVisTiling &tiling, const TriVisView &view) {
+    std::vector<TriVisDrawRange> ranges;
+    tiling.cull(view, ranges);
+    std::size_t numElements = 0;
+    for (std::vector<TriVisDrawRange>::const_iterator currentRange = ranges.begin(); currentRange != ranges.end(); ++currentRange) {
+      TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(currentRange->firstElement+currentRange->numElements, tiling.elements.size());
+      numElements += currentRange->numElements;
+    } return numElements;
+  }
+}
+
+TRIVIS_TEST(testInputSharesRingVertices) {
+  Fixtures fixtures;
+  TriVisBuffer buffer;
+  TriVisBufferBuilder::buildInput(fixtures.squareWithHole, buffer);
+  TRIVIS_ASSERT_EQUAL(buffer.numVertices(), (std::size_t)8);
+  TRIVIS_ASSERT_EQUAL(buffer.elements.size(), (std::size_t)16);
+  for (std::size_t currentElement = 0; currentElement < buffer.elements.size(); ++currentElement) {
+    TRIVIS_ASSERT_LESS_THAN(buffer.elements[currentElement], (std::uint32_t)buffer.numVertices());
+  }
+}
+
+TRIVIS_TEST(testTriangulationSharesVertices) {
+  Fixtures fixtures;
+  Polygon_repair prepair;
+  prepair.insert_odd_even_constraints(fixtures.squareWithHole);
+  
+  TriVisBuffer buffer;
+  TriVisBufferBuilder::buildTriangulation(prepair.triangulation, buffer);
+  std::size_t numEdges = 0;
+  for (prepair::Triangulation::Finite_edges_iterator currentEdge = prepair.triangulation.finite_edges_begin(); currentEdge != prepair.triangulation.finite_edges_end(); ++currentEdge) ++numEdges;
+  TRIVIS_ASSERT_EQUAL(buffer.elements.size(), 2*numEdges);
+  TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(buffer.numVertices(), 2*prepair.triangulation.number_of_vertices());
+  
+  prepair.tag_odd_even();
+  buffer.clear();
+  TriVisBufferBuilder::buildTaggedTriangulation(prepair.triangulation, buffer);
+  TRIVIS_ASSERT_EQUAL(buffer.numVertices(), (std::size_t)8);
+  TRIVIS_ASSERT_EQUAL(buffer.elements.size() % 3, (std::size_t)0);
+}
+
+TRIVIS_TEST(testFeatureRangesCoverLayer) {
+  Fixtures fixtures;
+  TriVisBuffer buffer;
+  buffer.beginFeature(3);
+  TriVisBufferBuilder::buildInput(fixtures.squareWithHole, buffer);
+  buffer.endFeature();
+  buffer.beginFeature(5);
+  TriVisBufferBuilder::buildInput(fixtures.squareWithHole, buffer);
+  buffer.endFeature();
+  
+  TRIVIS_ASSERT_EQUAL(buffer.features.ranges.size(), (std::size_t)2);
+  const TriVisFeatureRange *second = buffer.features.find(5);
+  TRIVIS_ASSERT(second != NULL);
+  if (second == NULL) return;
+  TRIVIS_ASSERT_EQUAL(second->firstVertex, (std::size_t)8);
+  TRIVIS_ASSERT_EQUAL(second->numVertices, (std::size_t)8);
+  TRIVIS_ASSERT_EQUAL(second->firstElement, (std::size_t)16);
+  TRIVIS_ASSERT_EQUAL(second->numElements, (std::size_t)16);
+  TRIVIS_ASSERT_EQUAL(second->minX, 0.0);
+  TRIVIS_ASSERT_EQUAL(second->maxY, 10.0);
+  TRIVIS_ASSERT(buffer.features.find(4) == NULL);
+}
+
+TRIVIS_TEST(testTilingSelectsFeatures) {
+  // The left and right halves of the grid
+  Fixtures fixtures;
+  TriVisBuffer &grid = fixtures.grid;
+  TriVisFeatureTable features;
+  features.beginFeature(3, 0, 0);
+  features.endFeature(grid.positions.data(), 250*500, grid.elements.size()/2);
+  features.beginFeature(5, 250*500, grid.elements.size()/2);
+  features.endFeature(grid.positions.data(), grid.numVertices(), grid.elements.size());
+  std::vector<std::uint32_t> primitiveFeatures;
+  features.getPrimitiveFeatures(2, grid.elements.size(), primitiveFeatures);
+  TriVisTiling tiling;
+  tiling.build(grid.positions.data(), grid.colours.data(), grid.numVertices(), grid.elements.data(), grid.elements.size(), 2, primitiveFeatures.data());
+  
+  std::vector<std::uint32_t> indices;
+  std::vector<TriVisDrawRange> ranges;
+  features.getIndices(std::vector<long>(1, 5), indices);
+  tiling.select(TriVisView(250.0, 250.0, 300.0, 300.0, 20.0), indices, ranges);
+  std::size_t numSelected = 0;
+  for (std::vector<TriVisDrawRange>::const_iterator currentRange = ranges.begin(); currentRange != ranges.end(); ++currentRange) {
+    numSelected += currentRange->numElements;
+  } TRIVIS_ASSERT_EQUAL(numSelected, grid.elements.size()/2);
+  
+  // Unknown fids are ignored and unsorted fids fall back to a linear search
+  features.getIndices(std::vector<long>(1, 4), indices);
+  TRIVIS_ASSERT(indices.empty());
+  features.beginFeature(-1, grid.numVertices(), grid.elements.size());
+  features.endFeature(grid.positions.data(), grid.numVertices(), grid.elements.size());
+  TRIVIS_ASSERT(features.find(-1) != NULL);
+  TRIVIS_ASSERT(features.find(5) != NULL);
+}
+
+TRIVIS_TEST(testTilingKeepsMillimetresApart) {
+  // A grid of 1 mm lines at RD coordinates, where floats are about 3 cm apart
+  TriVisBuffer buffer;
+  for (int x = 0; x < 100; ++x) {
+    for (int y = 0; y < 100; ++y) {
+      buffer.positions.push_back(155000.0+0.001*x);
+      buffer.positions.push_back(463000.0+0.001*y);
+      buffer.colours.push_back(exteriorRingColour);
+      if (x+1 < 100) {
+        buffer.elements.push_back(100*x+y);
+        buffer.elements.push_back(100*(x+1)+y);
+      } if (y+1 < 100) {
+        buffer.elements.push_back(100*x+y);
+        buffer.elements.push_back(100*x+y+1);
+      }
+    }
+  } TRIVIS_ASSERT_EQUAL((float)463000.0, (float)463000.001);
+  
+  TriVisTiling tiling;
+  tiling.build(buffer.positions.data(), buffer.colours.data(), buffer.numVertices(), buffer.elements.data(), buffer.elements.size(), 2);
+  std::vector<TriVisDrawRange> ranges;
+  tiling.cull(TriVisView(155000.05, 463000.05, 1.0, 1.0, 0.00001), ranges);
+  std::size_t numElements = 0;
+  for (std::vector<TriVisDrawRange>::const_iterator currentRange = ranges.begin(); currentRange != ranges.end(); ++currentRange) {
+    for (std::size_t currentElement = currentRange->firstElement; currentElement < currentRange->firstElement+currentRange->numElements; currentElement += 2) {
+      const float *a = &tiling.vertices[2*tiling.elements[currentElement]];
+      const float *b = &tiling.vertices[2*tiling.elements[currentElement+1]];
+      TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(hypot((double)a[0]-b[0], (double)a[1]-b[1]), 0.001, 0.00001);
+      TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(currentRange->originX+a[0], 155000.05, 0.06);
+      TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(currentRange->originY+a[1], 463000.05, 0.06);
+    } numElements += currentRange->numElements;
+  } TRIVIS_ASSERT_EQUAL(numElements, buffer.elements.size());
+}
+
+TRIVIS_TEST(testTilingPacksPaletteColours) {
+  // Positions as two floats and the colour as one palette index
+  Fixtures fixtures;
+  TriVisBuffer buffer;
+  TriVisBufferBuilder::buildInput(fixtures.squareWithHole, buffer);
+  TRIVIS_ASSERT_EQUAL(buffer.colours.size(), buffer.numVertices());
+  TriVisTiling tiling;
+  tiling.build(buffer.positions.data(), buffer.colours.data(), buffer.numVertices(), buffer.elements.data(), buffer.elements.size(), 2);
+  TRIVIS_ASSERT_EQUAL(tiling.vertices.size(), 2*tiling.vertexColours.size());
+  TRIVIS_ASSERT_EQUAL(tiling.vertices.size()*sizeof(float)+tiling.vertexColours.size(), 9*tiling.vertexColours.size());
+  
+  // Every encoded vertex keeps the colour of its ring, the hole is 2 to 4
+  std::size_t numInteriorRingVertices = 0;
+  for (std::size_t currentElement = 0; currentElement < tiling.elements.size(); ++currentElement) {
+    std::uint32_t vertex = tiling.elements[currentElement];
+    double x = tiling.tiles[0].originX+tiling.vertices[2*vertex];
+    bool isInteriorRing = x > 1.0 && x < 5.0;
+    TRIVIS_ASSERT_EQUAL(tiling.vertexColours[vertex], isInteriorRing ? interiorRingColour : exteriorRingColour);
+    if (isInteriorRing) ++numInteriorRingVertices;
+  } TRIVIS_ASSERT_EQUAL(numInteriorRingVertices, (std::size_t)8);
+  
+  TRIVIS_ASSERT_EQUAL(paletteColour(interiorFaceColour)[2], 0.0f);
+  TRIVIS_ASSERT_EQUAL(paletteColour(255), paletteColour(0));
+}
+
+TRIVIS_TEST(testTilingKeepsAllPrimitives) {
+  Fixtures fixtures;
+  TriVisBuffer &grid = fixtures.grid;
+  TriVisTiling tiling;
+  tiling.build(grid.positions.data(), grid.colours.data(), grid.numVertices(), grid.elements.data(), grid.elements.size(), 2);
+  TRIVIS_ASSERT_GREATER_THAN(tiling.tiles.size(), (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(tiling.tiles[0].numElements, grid.elements.size());
+  
+  // Zoomed in enough that nothing is simplified
+  TRIVIS_ASSERT_EQUAL(countElements(tiling, TriVisView(250.0, 250.0, 300.0, 300.0, 0.001)), grid.elements.size());
+}
+
+TRIVIS_TEST(testTilingCullsInvisibleTiles) {
+  Fixtures fixtures;
+  TriVisBuffer &grid = fixtures.grid;
+  TriVisTiling tiling;
+  tiling.build(grid.positions.data(), grid.colours.data(), grid.numVertices(), grid.elements.data(), grid.elements.size(), 2);
+  std::size_t numInCorner = countElements(tiling, TriVisView(10.0, 10.0, 10.0, 10.0, 0.001));
+  TRIVIS_ASSERT_GREATER_THAN(numInCorner, (std::size_t)0);
+  TRIVIS_ASSERT_LESS_THAN(numInCorner, grid.elements.size()/4);
+  TRIVIS_ASSERT_EQUAL(countElements(tiling, TriVisView(-100.0, -100.0, 10.0, 10.0, 0.001)), (std::size_t)0);
+  
+  // Rotating around the centre of the grid brings the corner out of view
+  TRIVIS_ASSERT_EQUAL(countElements(tiling, TriVisView(10.0, 10.0, 5.0, 5.0, 0.001, 45.0, 250.0, 250.0)), (std::size_t)0);
+}
+
+TRIVIS_TEST(testTilingSimplifiesWhenZoomedOut) {
+  Fixtures fixtures;
+  TriVisBuffer &grid = fixtures.grid;
+  TriVisTiling tiling;
+  tiling.build(grid.positions.data(), grid.colours.data(), grid.numVertices(), grid.elements.data(), grid.elements.size(), 2);
+  std::size_t numZoomedOut = countElements(tiling, TriVisView(250.0, 250.0, 300.0, 300.0, 20.0));
+  TRIVIS_ASSERT_GREATER_THAN(numZoomedOut, (std::size_t)0);
+  TRIVIS_ASSERT_LESS_THAN(numZoomedOut, grid.elements.size()/10);
+}
+
+TRIVIS_TEST(testDuplicateRingsCancel) {
+  // The second ring is the first one from another vertex and the other way round, the third is different
+  OGRGeometry *polygon = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0),(10 10,10 0,0 0,0 10,10 10),(2 2,4 2,4 4,2 4,2 2))");
+  Polygon_repair prepair;
+  std::vector<std::vector<Polygon_repair::Point> > rings;
+  prepair.get_rings(polygon, rings);
+  TRIVIS_ASSERT_EQUAL(rings.size(), (std::size_t)3);
+  prepair.remove_duplicate_rings(rings);
+  TRIVIS_ASSERT_EQUAL(rings.size(), (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(rings.front().size(), (std::size_t)4);
+  TRIVIS_ASSERT(rings.front().front() == Polygon_repair::Point(2, 2));
+  
+  // What is left is the small square alone
+  OGRGeometry *outGeometry = prepair.repair_odd_even(polygon);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbPolygon);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRPolygon *>(outGeometry)->get_Area(), 4.0, 1e-9);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRPolygon *>(outGeometry)->getNumInteriorRings(), 0);
+  delete outGeometry;
+  
+  // Three copies leave one
+  OGRGeometry *tripled = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0),(0 0,10 0,10 10,0 10,0 0),(0 10,10 10,10 0,0 0,0 10))");
+  rings.clear();
+  prepair.get_rings(tripled, rings);
+  prepair.remove_duplicate_rings(rings);
+  TRIVIS_ASSERT_EQUAL(rings.size(), (std::size_t)1);
+  delete tripled;
+  delete polygon;
+  
+  // Empty parts have no rings at all
+  OGRMultiPolygon withEmptyPart;
+  OGRPolygon emptyPart;
+  withEmptyPart.addGeometry(&emptyPart);
+  OGRGeometry *square = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+  withEmptyPart.addGeometry(square);
+  rings.clear();
+  prepair.get_rings(&withEmptyPart, rings);
+  TRIVIS_ASSERT_EQUAL(rings.size(), (std::size_t)1);
+  outGeometry = prepair.repair_odd_even(&withEmptyPart);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRPolygon *>(outGeometry)->get_Area(), 100.0, 1e-9);
+  delete outGeometry;
+  delete square;
+}
+
+TRIVIS_TEST(testMinAreaRemovesSmallPartsAndFillsSmallHoles) {
+  // A square with a 1 x 1 and a 4 x 4 hole, and a 1 x 1 square on its own
+  OGRGeometry *inGeometry = createFromWkt("MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0),(1 1,2 1,2 2,1 2,1 1),(4 4,8 4,8 8,4 8,4 4)),((20 0,21 0,21 1,20 1,20 0)))");
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(inGeometry);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(outGeometry)->getNumGeometries(), 2);
+  delete outGeometry;
+  
+  // With a minimum area of 2 the small square goes and the small hole is filled, the large hole stays
+  outGeometry = prepair.repair_odd_even(inGeometry, false, 2.0);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbPolygon);
+  if (wkbFlatten(outGeometry->getGeometryType()) == wkbPolygon) {
+    OGRPolygon *polygon = static_cast<OGRPolygon *>(outGeometry);
+    TRIVIS_ASSERT_EQUAL(polygon->getNumInteriorRings(), 1);
+    TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(polygon->get_Area(), 84.0, 1e-9);
+  } delete outGeometry;
+  
+  // Everything is smaller than 1000
+  outGeometry = prepair.repair_odd_even(inGeometry, false, 1000.0);
+  TRIVIS_ASSERT(outGeometry->IsEmpty());
+  delete outGeometry;
+  delete inGeometry;
+}
+
+TRIVIS_TEST(testRobustnessFindsNearestVertexAndEdge) {
+  // The nearest vertices are a corner of the hole and of the square, the nearest edge is one unit from the hole
+  OGRGeometry *polygon = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0),(1 1,9 1,9 9,1 9,1 1))");
+  Polygon_robustness robustness;
+  Robustness result = robustness.compute(polygon);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.vertex_vertex, std::sqrt(2.0), 1e-12);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.vertex_edge, 1.0, 1e-12);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.minimum(), 1.0, 1e-12);
+  
+  // Enough vertices to split the queries among threads, with one vertex pulled towards the centre
+  std::vector<double> x, y;
+  for (int currentVertex = 0; currentVertex < 10000; ++currentVertex) {
+    double angle = 2.0*M_PI*currentVertex/10000.0;
+    double radius = currentVertex == 5000 ? 999.0 : 1000.0;
+    x.push_back(radius*cos(angle));
+    y.push_back(radius*sin(angle));
+  } std::vector<std::size_t> ringStarts(1, 0);
+  Robustness serial = robustness.compute(x, y, ringStarts, 1);
+  Robustness parallel = robustness.compute(x, y, ringStarts, 2);
+  TRIVIS_ASSERT_EQUAL(serial.vertex_vertex, parallel.vertex_vertex);
+  TRIVIS_ASSERT_EQUAL(serial.vertex_edge, parallel.vertex_edge);
+  TRIVIS_ASSERT_LESS_THAN(serial.vertex_edge, 1.0);
+  
+  // A batch gives the same results as one at a time
+  std::vector<OGRGeometry *> geometries(2, polygon);
+  std::vector<Robustness> results;
+  robustness.compute(geometries, results, 2);
+  TRIVIS_ASSERT_EQUAL(results.size(), (std::size_t)2);
+  for (std::size_t currentResult = 0; currentResult < results.size(); ++currentResult) {
+    TRIVIS_ASSERT_EQUAL(results[currentResult].vertex_vertex, result.vertex_vertex);
+    TRIVIS_ASSERT_EQUAL(results[currentResult].vertex_edge, result.vertex_edge);
+  }
+  
+  // Heights are ignored, and empty outputs have nothing to measure
+  OGRGeometry *polygonWithHeights = createFromWkt("POLYGON((0 0 1,10 0 2,10 10 3,0 10 4,0 0 1),(1 1 5,9 1 5,9 9 5,1 9 5,1 1 5))");
+  Robustness resultWithHeights = robustness.compute(polygonWithHeights);
+  TRIVIS_ASSERT_EQUAL(resultWithHeights.vertex_vertex, result.vertex_vertex);
+  TRIVIS_ASSERT_EQUAL(resultWithHeights.vertex_edge, result.vertex_edge);
+  OGRGeometry *emptyPolygon = createFromWkt("POLYGON EMPTY");
+  TRIVIS_ASSERT(emptyPolygon != NULL);
+  TRIVIS_ASSERT_EQUAL(robustness.compute(emptyPolygon).minimum(), std::numeric_limits<double>::infinity());
+  OGRPolygon givenUp;
+  TRIVIS_ASSERT_EQUAL(robustness.compute(&givenUp).minimum(), std::numeric_limits<double>::infinity());
+  delete emptyPolygon;
+  delete polygonWithHeights;
+  delete polygon;
+}
+
+TRIVIS_TEST(testLoaderPublishesAllLayers) {
+  std::string filename = temporaryFile("TriVisTestsBowtie.txt");
+  std::ofstream file(filename.c_str());
+  file << "POLYGON((0 0,10 10,10 0,0 10,0 0))\n\nPOLYGON((20 0,30 10,30 0,20 10,20 0))\n";
+  file.close();
+  
+  TriVisLoader loader;
+  loader.load(filename);
+  while (loader.isLoading()) boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  TRIVIS_ASSERT_EQUAL(loader.progress(), 1.0f);
+  for (int currentLayer = 0; currentLayer < TriVisLoader::NumLayers; ++currentLayer) {
+    TriVisBuffer *buffer = loader.takeLayer((TriVisLoader::Layer)currentLayer);
+    TRIVIS_ASSERT(buffer != NULL);
+    if (buffer == NULL) continue;
+    TRIVIS_ASSERT_GREATER_THAN(buffer->elements.size(), (std::size_t)0);
+    TRIVIS_ASSERT_EQUAL(buffer->features.ranges.size(), (std::size_t)2);
+    TRIVIS_ASSERT(buffer->features.find(0) != NULL && buffer->features.find(2) != NULL);
+    delete buffer;
+  } TRIVIS_ASSERT_FALSE(loader.hasPendingLayers());
+}
+
+TRIVIS_TEST(testCancellationStopsWithinARing) {
+  // A single ring of 1000 vertices, cancelled before the first edge
+  OGRLinearRing ring;
+  for (int currentVertex = 0; currentVertex < 1000; ++currentVertex) {
+    double angle = 2.0*M_PI*currentVertex/1000.0;
+    ring.addPoint(100.0*cos(angle), 100.0*sin(angle));
+  } ring.closeRings();
+  OGRPolygon polygon;
+  polygon.addRing(&ring);
+  std::vector<std::vector<Polygon_repair::Point> > rings;
+  Polygon_repair prepair;
+  prepair.get_rings(&polygon, rings);
+  TRIVIS_ASSERT_EQUAL(rings.size(), (std::size_t)1);
+  
+  std::atomic<bool> cancelled(true);
+  prepair.budget.cancelled = &cancelled;
+  TRIVIS_ASSERT(prepair.budget.is_exhausted());
+  prepair.insert_odd_even_ring(rings.front());
+  TRIVIS_ASSERT_EQUAL(prepair.triangulation.number_of_vertices(), (std::size_t)1);
+  
+  // Without the flag the same budget lets it go through
+  cancelled = false;
+  TRIVIS_ASSERT_FALSE(prepair.budget.is_exhausted());
+  OGRGeometry *outGeometry = prepair.repair_odd_even(&polygon);
+  TRIVIS_ASSERT_FALSE(outGeometry->IsEmpty());
+  TRIVIS_ASSERT_EQUAL(prepair.triangulation.number_of_vertices(), (std::size_t)1000);
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testSnapshotRoundTrip) {
+  OGRGeometry *bowtie = createFromWkt("POLYGON((0 0,10 10,10 0,0 10,0 0))");
+  Polygon_repair prepair;
+  OGRGeometry *repaired = prepair.repair_odd_even(bowtie);
+  
+  std::string filename = temporaryFile("TriVisTestsBowtie.snap");
+  TRIVIS_ASSERT(prepair.write_snapshot(filename, repaired));
+  
+  Triangulation_snapshot snapshot;
+  TRIVIS_ASSERT(snapshot.open(filename.c_str()));
+  TRIVIS_ASSERT_EQUAL(snapshot.header().number_of_vertices, (std::uint64_t)prepair.triangulation.number_of_vertices());
+  TRIVIS_ASSERT_EQUAL(snapshot.header().number_of_faces, (std::uint64_t)prepair.triangulation.number_of_faces());
+  TRIVIS_ASSERT_GREATER_THAN(snapshot.header().number_of_interior_faces, (std::uint64_t)0);
+  for (std::uint64_t currentFace = 0; currentFace < snapshot.header().number_of_faces; ++currentFace) {
+    bool isInterior = (snapshot.face_bits()[currentFace] & Snapshot_header::interior_bit) != 0;
+    TRIVIS_ASSERT_EQUAL(isInterior, currentFace < snapshot.header().number_of_interior_faces);
+    for (int currentVertex = 0; currentVertex < 3; ++currentVertex) {
+      TRIVIS_ASSERT_LESS_THAN(snapshot.faces()[3*currentFace+currentVertex], (std::uint32_t)snapshot.header().number_of_vertices);
+    }
+  }
+  
+  OGRGeometry *output = NULL;
+  TRIVIS_ASSERT_EQUAL(OGRGeometryFactory::createFromWkb(const_cast<unsigned char *>(snapshot.output()), NULL, &output, (int)snapshot.header().output_size), OGRERR_NONE);
+  TRIVIS_ASSERT(output != NULL && output->Equals(repaired));
+  
+  delete output;
+  delete repaired;
+  delete bowtie;
+}
+
+TRIVIS_TEST(testCorruptSnapshotsAreRejected) {
+  OGRGeometry *bowtie = createFromWkt("POLYGON((0 0,10 10,10 0,0 10,0 0))");
+  Polygon_repair prepair;
+  OGRGeometry *repaired = prepair.repair_odd_even(bowtie);
+  std::string filename = temporaryFile("TriVisTestsBowtie.snap");
+  TRIVIS_ASSERT(prepair.write_snapshot(filename, repaired));
+  delete repaired;
+  delete bowtie;
+  
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  file.close();
+  Snapshot_header header;
+  std::memcpy(&header, bytes.data(), sizeof(Snapshot_header));
+  TRIVIS_ASSERT_EQUAL(bytes.size(), header.file_size());
+  
+  // Truncated, with extra bytes, with more faces than the file has and with a face that uses a vertex past the end
+  std::vector<std::vector<char> > corruptions(4, bytes);
+  corruptions[0].resize(bytes.size()-8);
+  corruptions[1].resize(bytes.size()+8, 0);
+  header.number_of_faces += 1000;
+  std::memcpy(corruptions[2].data(), &header, sizeof(Snapshot_header));
+  header.number_of_faces -= 1000;
+  std::uint32_t vertex = (std::uint32_t)header.number_of_vertices;
+  std::memcpy(&corruptions[3][header.faces_offset()+4*sizeof(std::uint32_t)], &vertex, sizeof(std::uint32_t));
+  std::string corruptFilename = temporaryFile("TriVisTestsCorrupt.snap");
+  for (std::size_t currentCorruption = 0; currentCorruption < corruptions.size(); ++currentCorruption) {
+    std::ofstream corruptFile(corruptFilename.c_str(), std::ios::binary | std::ios::trunc);
+    corruptFile.write(corruptions[currentCorruption].data(), corruptions[currentCorruption].size());
+    corruptFile.close();
+    Triangulation_snapshot snapshot;
+    TRIVIS_ASSERT_FALSE(snapshot.open(corruptFilename.c_str()));
+    TRIVIS_ASSERT(snapshot.mapping == NULL);
+  }
+  
+  // The original is still fine
+  Triangulation_snapshot snapshot;
+  TRIVIS_ASSERT(snapshot.open(filename.c_str()));
+}
+
+TRIVIS_TEST(testReplayRebuildsRecordedTriangulation) {
+  // Crossing diagonals split each other and the repeated edge is marked and then removed
+  Enhanced_constrained_triangulation_2<prepair::CDT, Event_recorder> recorded;
+  recorded.recorder.start(1024);
+  recorded.odd_even_insert_constraint(prepair::Point(0, 0), prepair::Point(10, 10));
+  recorded.odd_even_insert_constraint(prepair::Point(10, 10), prepair::Point(10, 0));
+  recorded.odd_even_insert_constraint(prepair::Point(10, 0), prepair::Point(0, 10));
+  recorded.odd_even_insert_constraint(prepair::Point(0, 10), prepair::Point(0, 0));
+  recorded.odd_even_insert_constraint(prepair::Point(3, 0), prepair::Point(3, 10));
+  recorded.odd_even_insert_constraint(prepair::Point(0, 0), prepair::Point(0, 10));
+  std::vector<Triangulation_event> events;
+  recorded.recorder.get_events(events);
+  TRIVIS_ASSERT_EQUAL(events.front().a[2], 0.0);
+  
+  // 3D points keep their height
+  Event_recorder heights;
+  heights.start(4);
+  heights.record(Triangulation_event::Insert_vertex, prepair::TK::Point_3(1, 2, 3));
+  heights.get_events(events);
+  TRIVIS_ASSERT_EQUAL(events.size(), (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(events.front().a[2], 3.0);
+  
+  std::string filename = temporaryFile("TriVisTestsBowtie.events");
+  TRIVIS_ASSERT_EQUAL(recorded.recorder.number_of_dropped_events(), (std::uint64_t)0);
+  TRIVIS_ASSERT(recorded.recorder.write(filename));
+  
+  TriVisReplay replay;
+  TRIVIS_ASSERT(replay.open(filename));
+  TRIVIS_ASSERT_GREATER_THAN(replay.events.size(), (std::size_t)0);
+  replay.step(replay.events.size());
+  TRIVIS_ASSERT(replay.isFinished());
+  TRIVIS_ASSERT_EQUAL(replay.triangulation.number_of_vertices(), recorded.number_of_vertices());
+  TRIVIS_ASSERT_EQUAL(replay.triangulation.number_of_faces(), recorded.number_of_faces());
+  TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(replay.numVertices(), replay.maxVertices());
+  TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(replay.elements.size(), replay.maxElements());
+  
+  std::size_t numConstrainedEdges = 0, numReplayedConstrainedEdges = 0;
+  for (Enhanced_constrained_triangulation_2<prepair::CDT, Event_recorder>::Finite_edges_iterator currentEdge = recorded.finite_edges_begin(); currentEdge != recorded.finite_edges_end(); ++currentEdge) {
+    if (recorded.is_constrained(*currentEdge)) ++numConstrainedEdges;
+  } for (TriVisReplay::Triangulation::Finite_edges_iterator currentEdge = replay.triangulation.finite_edges_begin(); currentEdge != replay.triangulation.finite_edges_end(); ++currentEdge) {
+    if (replay.triangulation.is_constrained(*currentEdge)) ++numReplayedConstrainedEdges;
+  } TRIVIS_ASSERT_EQUAL(numReplayedConstrainedEdges, numConstrainedEdges);
+  TRIVIS_ASSERT(replayElementsMatch(replay));
+  TRIVIS_ASSERT_EQUAL(replay.numEventElements, (std::size_t)0);
+  
+  // Stepping one event at a time patches the pools into the same edges
+  replay.restart();
+  std::size_t numMismatches = 0;
+  while (!replay.isFinished()) {
+    replay.step(1);
+    if (!replayElementsMatch(replay)) ++numMismatches;
+  } TRIVIS_ASSERT_EQUAL(numMismatches, (std::size_t)0);
+}
+
+TRIVIS_TEST(testReplayOnlyPatchesChangedEdges) {
+  // A large irregular ring, then a small bowtie next to one of its vertices
+  Enhanced_constrained_triangulation_2<prepair::CDT, Event_recorder> recorded;
+  recorded.recorder.start(1 << 16);
+  std::vector<prepair::Point> ring;
+  for (int currentVertex = 0; currentVertex < 500; ++currentVertex) {
+    double angle = 2.0*M_PI*currentVertex/500.0;
+    double radius = 1000.0+37.0*((currentVertex*7919)%13);
+    ring.push_back(prepair::Point(radius*cos(angle), radius*sin(angle)));
+  } for (std::size_t currentVertex = 0; currentVertex < ring.size(); ++currentVertex) {
+    recorded.odd_even_insert_constraint(ring[currentVertex], ring[(currentVertex+1)%ring.size()]);
+  } std::size_t numRingEvents = (std::size_t)recorded.recorder.number_of_events;
+  recorded.odd_even_insert_constraint(prepair::Point(990, 0), prepair::Point(991, 1));
+  recorded.odd_even_insert_constraint(prepair::Point(991, 1), prepair::Point(991, 0));
+  recorded.odd_even_insert_constraint(prepair::Point(991, 0), prepair::Point(990, 1));
+  recorded.odd_even_insert_constraint(prepair::Point(990, 1), prepair::Point(990, 0));
+  std::string filename = temporaryFile("TriVisTestsLargeRing.events");
+  TRIVIS_ASSERT(recorded.recorder.write(filename));
+  
+  TriVisReplay replay;
+  TRIVIS_ASSERT(replay.open(filename));
+  std::vector<std::pair<std::size_t, std::size_t> > dirtyRanges;
+  replay.step(numRingEvents);
+  replay.takeDirtyRanges(dirtyRanges);
+  std::size_t numUsedElements = replay.numConstrainedElements+replay.numUnconstrainedElements;
+  TRIVIS_ASSERT_GREATER_THAN(numUsedElements, (std::size_t)2000);
+  
+  // The bowtie only changes the triangles around it
+  replay.step(replay.events.size());
+  TRIVIS_ASSERT(replayElementsMatch(replay));
+  replay.takeDirtyRanges(dirtyRanges);
+  std::size_t numDirtyElements = 0;
+  for (std::vector<std::pair<std::size_t, std::size_t> >::const_iterator dirtyRange = dirtyRanges.begin(); dirtyRange != dirtyRanges.end(); ++dirtyRange) {
+    TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(dirtyRange->first+dirtyRange->second, replay.elements.size());
+    numDirtyElements += dirtyRange->second;
+  } TRIVIS_ASSERT_LESS_THAN(numDirtyElements, numUsedElements/10);
+}
+
+TRIVIS_TEST(testRasterizerFillsTaggedFaces) {
+  // The square with a hole fills a 100 x 100 image at 9 pixels per unit, with a 5 pixel margin
+  Fixtures fixtures;
+  Polygon_repair prepair;
+  OGRGeometry *repaired = prepair.repair_odd_even(fixtures.squareWithHole);
+  TriVisBuffer taggedTriangulation;
+  TriVisBufferBuilder::buildTaggedTriangulation(prepair.triangulation, taggedTriangulation);
+  TriVisRasterizer rasterizer(100, 100);
+  rasterizer.frame(0.0, 0.0, 10.0, 10.0);
+  rasterizer.drawTriangles(taggedTriangulation);
+  
+  // Image rows go down, so (9, 9) is near the top right and (3, 3) in the hole
+  const std::uint8_t *filled = &rasterizer.pixels[3*(100*14+85)];
+  TRIVIS_ASSERT_EQUAL(filled[0], 255);
+  TRIVIS_ASSERT_EQUAL(filled[1], 255);
+  TRIVIS_ASSERT_EQUAL(filled[2], 0);
+  const std::uint8_t *hole = &rasterizer.pixels[3*(100*(100-32)+32)];
+  TRIVIS_ASSERT_EQUAL(hole[2], 255);
+  const std::uint8_t *margin = &rasterizer.pixels[0];
+  TRIVIS_ASSERT_EQUAL(margin[2], 255);
+  
+  // A PNG signature followed by an IHDR chunk with the width as a big-endian integer
+  std::string filename = temporaryFile("TriVisTestsSquareWithHole.png");
+  TRIVIS_ASSERT(rasterizer.writePNG(filename));
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  unsigned char start[20] = {0};
+  file.read(reinterpret_cast<char *>(start), sizeof(start));
+  const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+  TRIVIS_ASSERT(file.good() && std::equal(signature, signature+8, start));
+  TRIVIS_ASSERT(std::equal(start+12, start+16, "IHDR"));
+  TRIVIS_ASSERT_EQUAL((start[16] << 24) | (start[17] << 16) | (start[18] << 8) | start[19], 100);
+  delete repaired;
+}
+
+TRIVIS_TEST(testBatchRendererDrawsInputEdges) {
+  // The spike on top is inserted twice and cancels out, so only the input has it as a black edge
+  OGRGeometry *spike = createFromWkt("POLYGON((0 0,10 0,10 10,5 10,5 15,5 10,0 10,0 0))");
+  Polygon_repair prepair;
+  OGRGeometry *repaired = prepair.repair_odd_even(spike);
+  TriVisBatchRenderer renderer;
+  TriVisRasterizer rasterizer(100, 100);
+  renderer.drawFeature(spike, prepair, repaired, rasterizer);
+  
+  // At 6 pixels per unit the spike is in column 50, from row 5 down to row 35
+  std::size_t numBlackPixels = 0;
+  for (unsigned int row = 8; row < 32; ++row) {
+    for (unsigned int column = 49; column <= 51; ++column) {
+      const std::uint8_t *pixel = &rasterizer.pixels[3*(100*row+column)];
+      if (pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0) ++numBlackPixels;
+    }
+  } TRIVIS_ASSERT_GREATER_THAN(numBlackPixels, (std::size_t)20);
+  delete repaired;
+  delete spike;
+}
+
+TRIVIS_TEST(testBudgetGivesUpOnLargeFeatures) {
+  // The circle needs about one step per edge, the square with a hole a few dozen in total
+  Fixtures fixtures;
+  OGRLinearRing ring;
+  for (int currentVertex = 0; currentVertex < 100000; ++currentVertex) {
+    double angle = 2.0*M_PI*currentVertex/100000.0;
+    ring.addPoint(1000.0*cos(angle), 1000.0*sin(angle));
+  } ring.closeRings();
+  OGRPolygon circle;
+  circle.addRing(&ring);
+  
+  Polygon_repair prepair;
+  prepair.budget.start(0.0, 1000);
+  OGRGeometry *outGeometry = prepair.repair_odd_even(&circle);
+  TRIVIS_ASSERT(prepair.budget.is_exhausted());
+  TRIVIS_ASSERT(outGeometry->IsEmpty());
+  TRIVIS_ASSERT_LESS_THAN(prepair.triangulation.number_of_vertices(), (std::size_t)100000);
+  delete outGeometry;
+  
+  prepair.budget.start(0.0, 1000);
+  outGeometry = prepair.repair_odd_even(fixtures.squareWithHole);
+  TRIVIS_ASSERT_FALSE(prepair.budget.is_exhausted());
+  TRIVIS_ASSERT(outGeometry->Equals(fixtures.squareWithHole));
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testPruningRoundsConstructedVertices) {
+  // The crossing is at (1/3, 1/3), which is not a double
+  Polygon_repair prepair;
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0, 0), prepair::Point(1, 1));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(1, 1), prepair::Point(0.5, 0));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0.5, 0), prepair::Point(0, 1));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0, 1), prepair::Point(0, 0));
+  prepair.tag_odd_even();
+  TRIVIS_ASSERT_EQUAL(prepair.triangulation.number_of_vertices(), (std::size_t)5);
+  TRIVIS_ASSERT_EQUAL(prepair.prune_exact_numbers(), (std::size_t)2);
+  
+  // Once rounded, nothing needs to be evaluated again
+  TRIVIS_ASSERT_EQUAL(prepair.prune_exact_numbers(), (std::size_t)0);
+  bool foundCrossing = false;
+  for (prepair::Triangulation::Finite_vertices_iterator currentVertex = prepair.triangulation.finite_vertices_begin(); currentVertex != prepair.triangulation.finite_vertices_end(); ++currentVertex) {
+    if (CGAL::to_double(currentVertex->point().x()) == 1.0/3.0 && CGAL::to_double(currentVertex->point().y()) == 1.0/3.0) foundCrossing = true;
+  } TRIVIS_ASSERT(foundCrossing);
+  
+  OGRGeometry *outGeometry = prepair.reconstruct();
+  TRIVIS_ASSERT_EQUAL(outGeometry->getGeometryType(), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(outGeometry)->getNumGeometries(), 2);
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testPruningKeepsExactVerticesWhenRoundingInvertsFaces) {
+  // A vertex at the double nearest to the crossing would coincide with it once rounded
+  Polygon_repair prepair;
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0, 0), prepair::Point(1, 1));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(1, 1), prepair::Point(0.5, 0));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0.5, 0), prepair::Point(0, 1));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0, 1), prepair::Point(0, 0));
+  prepair.triangulation.insert(prepair::Point(1.0/3.0, 1.0/3.0));
+  prepair.tag_odd_even();
+  TRIVIS_ASSERT_EQUAL(prepair.triangulation.number_of_vertices(), (std::size_t)6);
+  TRIVIS_ASSERT_EQUAL(prepair.prune_exact_numbers(), (std::size_t)0);
+  
+  bool foundCrossing = false;
+  for (prepair::Triangulation::Finite_vertices_iterator currentVertex = prepair.triangulation.finite_vertices_begin(); currentVertex != prepair.triangulation.finite_vertices_end(); ++currentVertex) {
+    if (currentVertex->point() == prepair::Point(prepair::Triangulation::Geom_traits::FT(1)/3, prepair::Triangulation::Geom_traits::FT(1)/3)) foundCrossing = true;
+  } TRIVIS_ASSERT(foundCrossing);
+  TRIVIS_ASSERT(prepair.triangulation.is_valid());
+  
+  OGRGeometry *outGeometry = prepair.reconstruct();
+  TRIVIS_ASSERT_EQUAL(outGeometry->getGeometryType(), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(outGeometry)->getNumGeometries(), 2);
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testQualityFlagsSliversAndNearCollinearConstraints) {
+  // The apex is a thousandth away from the base, so the face is a sliver and its base is almost collinear with it
+  Polygon_repair prepair;
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(0, 0), prepair::Point(10, 0));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(10, 0), prepair::Point(5, 0.001));
+  prepair.triangulation.odd_even_insert_constraint(prepair::Point(5, 0.001), prepair::Point(0, 0));
+  Triangulation_quality analysis;
+  Quality quality = analysis.compute(prepair.triangulation);
+  TRIVIS_ASSERT_EQUAL(quality.number_of_faces, (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(quality.number_of_edges, (std::size_t)3);
+  TRIVIS_ASSERT_EQUAL(quality.number_of_slivers, (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(quality.number_of_near_collinear_constraints, (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(quality.min_angle_histogram[0], (std::size_t)1);
+  TRIVIS_ASSERT_GREATER_THAN(quality.max_angle, 179.9);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(quality.longest_edge, 10.0, 1e-9);
+  
+  // The overlay only has the flagged face
+  TriVisBuffer buffer;
+  TriVisBufferBuilder::buildQuality(prepair.triangulation, buffer);
+  TRIVIS_ASSERT_EQUAL(buffer.elements.size(), (std::size_t)3);
+  TRIVIS_ASSERT_EQUAL(buffer.colours[0], nearCollinearFaceColour);
+}
+
+TRIVIS_TEST(testClusterRepairMatchesPlainRepair) {
+  // Every part of the scattered parts is a cluster of its own, so each becomes a task
+  OGRGeometry *scatteredParts = createScatteredParts();
+  Polygon_repair prepair;
+  std::vector<std::vector<int> > clusters;
+  prepair.get_clusters(static_cast<OGRMultiPolygon *>(scatteredParts), clusters);
+  TRIVIS_ASSERT_EQUAL(clusters.size(), (std::size_t)4096);
+  
+  Task_scheduler scheduler(4);
+  OGRGeometry *clusteredGeometry = prepair.repair_odd_even_in_clusters(scatteredParts, scheduler);
+  OGRGeometry *plainGeometry = prepair.repair_odd_even(scatteredParts);
+  TRIVIS_ASSERT_EQUAL(clusteredGeometry->getGeometryType(), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(clusteredGeometry)->getNumGeometries(), static_cast<OGRMultiPolygon *>(plainGeometry)->getNumGeometries());
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRMultiPolygon *>(clusteredGeometry)->get_Area(), static_cast<OGRMultiPolygon *>(plainGeometry)->get_Area(), 1e-9);
+  TRIVIS_ASSERT(clusteredGeometry->IsValid());
+  delete clusteredGeometry;
+  delete plainGeometry;
+  delete scatteredParts;
+}
+
+TRIVIS_TEST(testClustersShareTheBudget) {
+  // Each of the 4096 clusters needs a few steps, far fewer than the limit, but together they need more
+  OGRGeometry *scatteredParts = createScatteredParts();
+  Task_scheduler scheduler(4);
+  Polygon_repair prepair;
+  prepair.budget.start(0.0, 2000);
+  OGRGeometry *outGeometry = prepair.repair_odd_even_in_clusters(scatteredParts, scheduler);
+  TRIVIS_ASSERT(prepair.budget.is_exhausted());
+  TRIVIS_ASSERT(outGeometry->IsEmpty());
+  delete outGeometry;
+  
+  // Time spent waiting before the clusters run counts too
+  prepair.budget.start(1e-9, 0);
+  outGeometry = prepair.repair_odd_even_in_clusters(scatteredParts, scheduler);
+  TRIVIS_ASSERT(prepair.budget.is_exhausted());
+  delete outGeometry;
+  
+  prepair.budget.start(0.0, 0);
+  outGeometry = prepair.repair_odd_even_in_clusters(scatteredParts, scheduler);
+  TRIVIS_ASSERT_FALSE(prepair.budget.is_exhausted());
+  TRIVIS_ASSERT_GREATER_THAN(prepair.budget.get_steps(), (std::size_t)2000);
+  delete outGeometry;
+  delete scatteredParts;
+}
+
+TRIVIS_TEST(testTaskExceptionsReachTheWaiter) {
+  // The failing task neither stops its worker nor stays pending, and the other tasks still run
+  Task_scheduler scheduler(2);
+  std::atomic<int> numRun(0);
+  Task_group tasks(scheduler);
+  tasks.run([]() { throw std::runtime_error("task failed"); });
+  for (int currentTask = 0; currentTask < 100; ++currentTask) tasks.run([&numRun]() { ++numRun; });
+  bool caught = false;
+  try {
+    tasks.wait();
+  } catch (const std::runtime_error &) {
+    caught = true;
+  } TRIVIS_ASSERT(caught);
+  TRIVIS_ASSERT_EQUAL(numRun.load(), 100);
+  
+  scheduler.submit([]() { throw std::runtime_error("task failed"); });
+  caught = false;
+  try {
+    scheduler.wait();
+  } catch (const std::runtime_error &) {
+    caught = true;
+  } TRIVIS_ASSERT(caught);
+  TRIVIS_ASSERT_EQUAL(scheduler.pending_tasks.load(), (std::size_t)0);
+}
+
+TRIVIS_TEST(testParallelReconstructionMatchesSerial) {
+  // 8192 interior faces are enough for two reconstruction tasks
+  OGRGeometry *scatteredParts = createScatteredParts();
+  Polygon_repair serialPrepair;
+  OGRGeometry *serialGeometry = serialPrepair.repair_odd_even(scatteredParts);
+  Task_scheduler scheduler(4);
+  Polygon_repair parallelPrepair;
+  parallelPrepair.scheduler = &scheduler;
+  OGRGeometry *parallelGeometry = parallelPrepair.repair_odd_even(scatteredParts);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(parallelGeometry)->getNumGeometries(), 4096);
+  for (int currentPart = 0; currentPart < 4096; ++currentPart) {
+    TRIVIS_ASSERT(static_cast<OGRMultiPolygon *>(parallelGeometry)->getGeometryRef(currentPart)->Equals(static_cast<OGRMultiPolygon *>(serialGeometry)->getGeometryRef(currentPart)));
+  } delete serialGeometry;
+  delete parallelGeometry;
+  delete scatteredParts;
+}
+
+TRIVIS_TEST(testReconstructedRingsAreOriented) {
+  // Outer rings are counterclockwise and inner rings clockwise, as OGR would compute it
+  Fixtures fixtures;
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(fixtures.squareWithHole);
+  TRIVIS_ASSERT_EQUAL(outGeometry->getGeometryType(), wkbPolygon);
+  OGRPolygon *polygon = static_cast<OGRPolygon *>(outGeometry);
+  TRIVIS_ASSERT_EQUAL(polygon->getNumInteriorRings(), 1);
+  TRIVIS_ASSERT_FALSE(polygon->getExteriorRing()->isClockwise());
+  TRIVIS_ASSERT(polygon->getInteriorRing(0)->isClockwise());
+  TRIVIS_ASSERT_EQUAL(polygon->getExteriorRing()->getNumPoints(), 5);
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testReconstructionSplitsRingsAtCutVertices) {
+  // The hourglass goes through (5, 5) twice, so it becomes two triangles touching there
+  OGRGeometry *hourglass = createFromWkt("POLYGON((0 0,10 0,5 5,10 10,0 10,5 5,0 0))");
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(hourglass);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(static_cast<OGRMultiPolygon *>(outGeometry)->getNumGeometries(), 2);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRMultiPolygon *>(outGeometry)->get_Area(), 50.0, 1e-9);
+  TRIVIS_ASSERT(ringsAreSimple(outGeometry));
+  TRIVIS_ASSERT(outGeometry->IsValid());
+  delete outGeometry;
+  delete hourglass;
+  
+  // The hole touches the outer ring at (5, 0), which neither ring may go through twice
+  OGRGeometry *touchingHole = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0),(5 0,7 5,3 5,5 0))");
+  outGeometry = prepair.repair_odd_even(touchingHole);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbPolygon);
+  if (wkbFlatten(outGeometry->getGeometryType()) == wkbPolygon) {
+    TRIVIS_ASSERT_EQUAL(static_cast<OGRPolygon *>(outGeometry)->getNumInteriorRings(), 1);
+    TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRPolygon *>(outGeometry)->get_Area(), 90.0, 1e-9);
+  } TRIVIS_ASSERT(ringsAreSimple(outGeometry));
+  TRIVIS_ASSERT(outGeometry->IsValid());
+  delete outGeometry;
+  delete touchingHole;
+}
+
+TRIVIS_TEST(testPolygonsTouchingAtAVertexStayApart) {
+  // The second square and the triangle share an edge, so they become one polygon, which
+  // touches the first square only at (10, 10)
+  OGRGeometry *touching = createFromWkt("MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0)),((10 10,20 10,20 20,10 20,10 10)),((10 10,10 20,0 20,10 10)))");
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(touching);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbMultiPolygon);
+  OGRMultiPolygon *polygons = static_cast<OGRMultiPolygon *>(outGeometry);
+  TRIVIS_ASSERT_EQUAL(polygons->getNumGeometries(), 2);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(polygons->get_Area(), 250.0, 1e-9);
+  TRIVIS_ASSERT(ringsAreSimple(outGeometry));
+  TRIVIS_ASSERT(outGeometry->IsValid());
+  delete outGeometry;
+  delete touching;
+}
+
+TRIVIS_TEST(testHeightsAreKeptAndInterpolated) {
+  // Both diagonals climb from 0 to 10, so where they cross both say 5
+  Fixtures fixtures;
+  OGRGeometry *bowtie = createFromWkt("POLYGON((0 0 0,10 10 10,10 0 0,0 10 10,0 0 0))");
+  TRIVIS_ASSERT_EQUAL(bowtie->getCoordinateDimension(), 3);
+  Polygon_repair prepair;
+  OGRGeometry *outGeometry = prepair.repair_odd_even(bowtie);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL(outGeometry->getCoordinateDimension(), 3);
+  OGRMultiPolygon *triangles = static_cast<OGRMultiPolygon *>(outGeometry);
+  TRIVIS_ASSERT_EQUAL(triangles->getNumGeometries(), 2);
+  int crossings = 0;
+  for (int currentTriangle = 0; currentTriangle < triangles->getNumGeometries(); ++currentTriangle) {
+    OGRLinearRing *ring = static_cast<OGRPolygon *>(triangles->getGeometryRef(currentTriangle))->getExteriorRing();
+    for (int currentPoint = 0; currentPoint < ring->getNumPoints()-1; ++currentPoint) {
+      if (ring->getX(currentPoint) == 5.0 && ring->getY(currentPoint) == 5.0) {
+        TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(ring->getZ(currentPoint), 5.0, 1e-9);
+        ++crossings;
+      } else TRIVIS_ASSERT_EQUAL(ring->getZ(currentPoint), ring->getY(currentPoint));
+    }
+  } TRIVIS_ASSERT_EQUAL(crossings, 2);
+  delete outGeometry;
+  delete bowtie;
+  
+  // A vertex at the x and y of another one but at another height is counted, and the first height is kept
+  TRIVIS_ASSERT_EQUAL(prepair.number_of_height_conflicts, (std::size_t)0);
+  OGRGeometry *touchingHole = createFromWkt("POLYGON((0 0 0,10 0 0,10 10 0,0 10 0,0 0 0),(0 0 5,1 2 5,2 1 5,0 0 5))");
+  outGeometry = prepair.repair_odd_even(touchingHole);
+  TRIVIS_ASSERT_EQUAL(prepair.number_of_height_conflicts, (std::size_t)1);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometry->getGeometryType()), wkbPolygon);
+  if (wkbFlatten(outGeometry->getGeometryType()) == wkbPolygon) {
+    OGRLinearRing *exteriorRing = static_cast<OGRPolygon *>(outGeometry)->getExteriorRing();
+    for (int currentPoint = 0; currentPoint < exteriorRing->getNumPoints(); ++currentPoint) {
+      if (exteriorRing->getX(currentPoint) == 0.0 && exteriorRing->getY(currentPoint) == 0.0) TRIVIS_ASSERT_EQUAL(exteriorRing->getZ(currentPoint), 0.0);
+    }
+  } prepair.number_of_height_conflicts = 0;
+  delete outGeometry;
+  delete touchingHole;
+  
+  // Empty parts have no heights
+  OGRMultiPolygon withEmptyPart;
+  OGRPolygon emptyPart;
+  withEmptyPart.addGeometry(&emptyPart);
+  OGRGeometry *square = createFromWkt("POLYGON((0 0 1,10 0 1,10 10 1,0 10 1,0 0 1))");
+  withEmptyPart.addGeometry(square);
+  outGeometry = prepair.repair_odd_even(&withEmptyPart);
+  TRIVIS_ASSERT_EQUAL(outGeometry->getCoordinateDimension(), 3);
+  TRIVIS_ASSERT_EQUAL(prepair.number_of_height_conflicts, (std::size_t)0);
+  delete outGeometry;
+  delete square;
+  
+  // 2D inputs stay 2D
+  outGeometry = prepair.repair_odd_even(fixtures.squareWithHole);
+  TRIVIS_ASSERT_EQUAL(outGeometry->getCoordinateDimension(), 2);
+  TRIVIS_ASSERT(prepair.vertex_heights.empty());
+  delete outGeometry;
+}
+
+TRIVIS_TEST(testCoverageSharesBoundaries) {
+  // The right square has a vertex on the shared edge that the left one lacks, and the last feature is a bowtie
+  std::vector<OGRGeometry *> inGeometries, outGeometries;
+  inGeometries.push_back(createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0))"));
+  inGeometries.push_back(createFromWkt("POLYGON((10 0,20 0,20 10,10 10,10 5,10 0))"));
+  inGeometries.push_back(createFromWkt("POLYGON((30 0,40 10,40 0,30 10,30 0))"));
+  std::vector<std::size_t> failedFeatures;
+  Polygon_repair prepair;
+  prepair.repair_coverage(inGeometries, outGeometries, failedFeatures);
+  TRIVIS_ASSERT_EQUAL(outGeometries.size(), (std::size_t)3);
+  TRIVIS_ASSERT(failedFeatures.empty());
+  if (outGeometries.size() != 3) return;
+  
+  OGRPolygon *left = static_cast<OGRPolygon *>(outGeometries[0]);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(left->getGeometryType()), wkbPolygon);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(left->get_Area(), 100.0, 1e-9);
+  TRIVIS_ASSERT_EQUAL(left->getExteriorRing()->getNumPoints(), 6);
+  TRIVIS_ASSERT(outGeometries[1]->Equals(inGeometries[1]));
+  TRIVIS_ASSERT(outGeometries[0]->Touches(outGeometries[1]));
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(outGeometries[2]->getGeometryType()), wkbMultiPolygon);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRMultiPolygon *>(outGeometries[2])->get_Area(), 50.0, 1e-9);
+  for (int currentFeature = 0; currentFeature < 3; ++currentFeature) {
+    delete inGeometries[currentFeature];
+    delete outGeometries[currentFeature];
+  }
+}
+
+TRIVIS_TEST(testCoverageKeepsHeights) {
+  // The shared edge has the same heights in both features, and the bowtie gets 5 where it crosses itself
+  std::vector<OGRGeometry *> inGeometries, outGeometries;
+  inGeometries.push_back(createFromWkt("POLYGON((0 0 1,10 0 2,10 10 3,0 10 4,0 0 1))"));
+  inGeometries.push_back(createFromWkt("POLYGON((10 0 2,20 0 5,20 10 6,10 10 3,10 0 2))"));
+  inGeometries.push_back(createFromWkt("POLYGON((30 0 0,40 10 10,40 0 0,30 10 10,30 0 0))"));
+  std::vector<std::size_t> failedFeatures;
+  Polygon_repair prepair;
+  prepair.repair_coverage(inGeometries, outGeometries, failedFeatures);
+  TRIVIS_ASSERT(failedFeatures.empty());
+  TRIVIS_ASSERT_EQUAL(outGeometries.size(), (std::size_t)3);
+  if (outGeometries.size() != 3) return;
+  TRIVIS_ASSERT_EQUAL(outGeometries[0]->getCoordinateDimension(), 3);
+  TRIVIS_ASSERT(outGeometries[0]->Equals(inGeometries[0]));
+  OGRLinearRing *ring = static_cast<OGRPolygon *>(outGeometries[1])->getExteriorRing();
+  for (int currentPoint = 0; currentPoint < ring->getNumPoints(); ++currentPoint) {
+    if (ring->getX(currentPoint) == 20.0) TRIVIS_ASSERT_EQUAL(ring->getZ(currentPoint), ring->getY(currentPoint) == 0.0 ? 5.0 : 6.0);
+    if (ring->getX(currentPoint) == 10.0) TRIVIS_ASSERT_EQUAL(ring->getZ(currentPoint), ring->getY(currentPoint) == 0.0 ? 2.0 : 3.0);
+  }
+  
+  OGRMultiPolygon *triangles = static_cast<OGRMultiPolygon *>(outGeometries[2]);
+  TRIVIS_ASSERT_EQUAL(wkbFlatten(triangles->getGeometryType()), wkbMultiPolygon);
+  for (int currentTriangle = 0; currentTriangle < triangles->getNumGeometries(); ++currentTriangle) {
+    ring = static_cast<OGRPolygon *>(triangles->getGeometryRef(currentTriangle))->getExteriorRing();
+    for (int currentPoint = 0; currentPoint < ring->getNumPoints(); ++currentPoint) {
+      TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(ring->getZ(currentPoint), ring->getY(currentPoint), 1e-9);
+    }
+  }
+  
+  for (int currentFeature = 0; currentFeature < 3; ++currentFeature) {
+    delete inGeometries[currentFeature];
+    delete outGeometries[currentFeature];
+  }
+}
+
+TRIVIS_TEST(testFuzzerChecksTheOddEvenRule) {
+  // The bowtie is checked against the odd-even rule only, since it is not split into clusters
+  OGRGeometry *bowtie = createFromWkt("POLYGON((0 0,10 10,10 0,0 10,0 0))");
+  OGRGeometry *point = createFromWkt("POINT(0 0)");
+  std::vector<unsigned char> bowtieWkb(bowtie->WkbSize()), pointWkb(point->WkbSize());
+  bowtie->exportToWkb(wkbNDR, &bowtieWkb.front());
+  point->exportToWkb(wkbNDR, &pointWkb.front());
+  
+  Task_scheduler scheduler(2);
+  Repair_fuzzer fuzzer;
+  fuzzer.differential = true;
+  fuzzer.scheduler = &scheduler;
+  Fuzz_result result = fuzzer.run(&bowtieWkb.front(), bowtieWkb.size());
+  TRIVIS_ASSERT(result.accepted);
+  TRIVIS_ASSERT_FALSE(result.is_failure());
+  TRIVIS_ASSERT(result.matches_odd_even);
+  TRIVIS_ASSERT_EQUAL(result.vertices, (std::size_t)5);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.area, 50.0, 1e-9);
+  TRIVIS_ASSERT_EQUAL(result.serial_area, 0.0);
+  
+  // A square is not the odd-even region of the bowtie, half of the samples are outside it
+  OGRGeometry *square = createFromWkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+  TRIVIS_ASSERT_GREATER_THAN(Repair_fuzzer::count_odd_even_mismatches(bowtie, square), (std::size_t)64);
+  TRIVIS_ASSERT_EQUAL(Repair_fuzzer::count_odd_even_mismatches(square, square), (std::size_t)0);
+  delete square;
+  
+  // Two bowties far apart are two clusters, so the serial repair is a different code path to compare with
+  OGRGeometry *bowties = createFromWkt("MULTIPOLYGON(((0 0,10 10,10 0,0 10,0 0)),((100 0,110 10,110 0,100 10,100 0)))");
+  std::vector<unsigned char> bowtiesWkb(bowties->WkbSize());
+  bowties->exportToWkb(wkbNDR, &bowtiesWkb.front());
+  result = fuzzer.run(&bowtiesWkb.front(), bowtiesWkb.size());
+  TRIVIS_ASSERT_FALSE(result.is_failure());
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.area, 100.0, 1e-9);
+  TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(result.serial_area, 100.0, 1e-9);
+  delete bowties;
+  
+  // Points, truncated WKB and non-finite coordinates are not repaired
+  TRIVIS_ASSERT_FALSE(fuzzer.run(&pointWkb.front(), pointWkb.size()).accepted);
+  TRIVIS_ASSERT_FALSE(fuzzer.run(&bowtieWkb.front(), bowtieWkb.size()-1).accepted);
+  static_cast<OGRPolygon *>(bowtie)->getExteriorRing()->setPoint(1, std::numeric_limits<double>::quiet_NaN(), 10.0);
+  bowtie->exportToWkb(wkbNDR, &bowtieWkb.front());
+  TRIVIS_ASSERT_FALSE(fuzzer.run(&bowtieWkb.front(), bowtieWkb.size()).accepted);
+  delete bowtie;
+  delete point;
+}
+
+TRIVIS_TEST(testFeatureReaderHandsOverFeaturesWithoutGeometry) {
+  // Features without a geometry come through as NULL, only the end of the layer stops next()
+  OGRDataSource *dataSource = createMemoryLayer(10);
+  Feature_reader reader(dataSource->GetLayer(0), 3);
+  reader.start();
+  OGRGeometry *geometry;
+  long fid, previousFid = OGRNullFID;
+  int numFeatures = 0, numWithoutGeometry = 0;
+  while (reader.next(geometry, fid)) {
+    TRIVIS_ASSERT_GREATER_THAN(fid, previousFid);
+    previousFid = fid;
+    if (geometry == NULL) ++numWithoutGeometry;
+    else TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(static_cast<OGRPolygon *>(geometry)->get_Area(), 1.0, 1e-9);
+    delete geometry;
+    ++numFeatures;
+  } TRIVIS_ASSERT_EQUAL(numFeatures, 10);
+  TRIVIS_ASSERT_EQUAL(numWithoutGeometry, 3);
+  TRIVIS_ASSERT_FALSE(reader.next(geometry, fid));
+  TRIVIS_ASSERT(reader.finished);
+  TRIVIS_ASSERT_EQUAL(reader.number_ready, (std::size_t)0);
+  OGRDataSource::DestroyDataSource(dataSource);
+}
+
+TRIVIS_TEST(testFeatureReaderStopsWhenDestroyedEarly) {
+  // The reading thread waits on a full buffer, destroying the reader wakes it up and joins it
+  OGRDataSource *dataSource = createMemoryLayer(1000);
+  OGRLayer *layer = dataSource->GetLayer(0);
+  {
+    Feature_reader reader(layer, 2);
+    reader.start();
+    OGRGeometry *geometry;
+    long fid;
+    TRIVIS_ASSERT(reader.next(geometry, fid));
+    delete geometry;
+    while (true) {
+      {
+        boost::lock_guard<boost::mutex> lock(reader.mutex);
+        if (reader.number_ready == reader.ring.size()) break;
+      } boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    } TRIVIS_ASSERT_FALSE(reader.finished);
+  }
+  
+  // Nothing reads the layer any more, so it can be read again from here
+  layer->ResetReading();
+  int numFeatures = 0;
+  while (OGRFeature *feature = layer->GetNextFeature()) {
+    OGRFeature::DestroyFeature(feature);
+    ++numFeatures;
+  } TRIVIS_ASSERT_EQUAL(numFeatures, 1000);
+  
+  // Readers that were never started, or that read everything and were never asked for it, go as well
+  Feature_reader *reader = new Feature_reader(layer, 2);
+  delete reader;
+  reader = new Feature_reader(layer, 2000);
+  reader->start();
+  while (true) {
+    {
+      boost::lock_guard<boost::mutex> lock(reader->mutex);
+      if (reader->finished) break;
+    } boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  } TRIVIS_ASSERT_EQUAL(reader->number_ready, (std::size_t)1000);
+  delete reader;
+  OGRDataSource::DestroyDataSource(dataSource);
+}
+
+TRIVIS_TEST(testMergeOrdersInterleavedShards) {
+  // Every shard reads its own features, and the last one writes them backwards
+  std::string directory = temporaryFile("TriVisTestsParts");
+  boost::filesystem::remove_all(directory);
+  boost::filesystem::create_directories(directory);
+  OGRDataSource *dataSource = createMemoryLayer(10);
+  for (std::size_t currentShard = 0; currentShard < 3; ++currentShard) {
+    Feature_reader reader(dataSource->GetLayer(0), 2);
+    reader.set_shard(currentShard, 3);
+    reader.start();
+    std::vector<std::pair<long, std::string> > features;
+    OGRGeometry *geometry;
+    long fid;
+    while (reader.next(geometry, fid)) {
+      TRIVIS_ASSERT_EQUAL((std::size_t)fid%3, currentShard);
+      std::string wkt;
+      if (geometry != NULL) {
+        char *featureWkt;
+        geometry->exportToWkt(&featureWkt);
+        wkt = featureWkt;
+        CPLFree(featureWkt);
+        delete geometry;
+      } features.push_back(std::make_pair(fid, wkt));
+    } if (currentShard == 2) std::reverse(features.begin(), features.end());
+    Part_writer part;
+    TRIVIS_ASSERT(part.open(directory, currentShard, 3));
+    for (std::vector<std::pair<long, std::string> >::const_iterator feature = features.begin(); feature != features.end(); ++feature) {
+      if (feature->second.empty()) part.write_not_repaired(feature->first, "no geometry that could be read");
+      else part.write(feature->first, feature->second);
+    } TRIVIS_ASSERT(part.close());
+  } OGRDataSource::DestroyDataSource(dataSource);
+  
+  // The features without a geometry are accounted for, but not output
+  std::stringstream merged;
+  TRIVIS_ASSERT(merge_parts(directory, 3, 10, merged));
+  std::string line;
+  std::size_t numLines = 0;
+  double previousX = -1.0;
+  while (std::getline(merged, line)) {
+    OGRGeometry *geometry = createFromWkt(line.c_str());
+    TRIVIS_ASSERT(geometry != NULL);
+    if (geometry == NULL) continue;
+    OGREnvelope envelope;
+    geometry->getEnvelope(&envelope);
+    TRIVIS_ASSERT_GREATER_THAN(envelope.MinX, previousX);
+    TRIVIS_ASSERT_FALSE((int)envelope.MinX%3 == 1);
+    previousX = envelope.MinX;
+    delete geometry;
+    ++numLines;
+  } TRIVIS_ASSERT_EQUAL(numLines, (std::size_t)7);
+  
+  // Nor can the parts stand for an input with more features
+  std::stringstream unused;
+  TRIVIS_ASSERT_FALSE(merge_parts(directory, 3, 11, unused));
+  boost::filesystem::remove_all(directory);
+}
+
+TRIVIS_TEST(testMergeRejectsBrokenParts) {
+  std::string directory = temporaryFile("TriVisTestsBrokenParts");
+  boost::filesystem::remove_all(directory);
+  boost::filesystem::create_directories(directory);
+  Part_writer part;
+  TRIVIS_ASSERT(part.open(directory, 0, 2));
+  part.write(2, "POLYGON((2 0,3 0,3 1,2 1,2 0))");
+  part.write(0, "POLYGON((0 0,1 0,1 1,0 1,0 0))");
+  TRIVIS_ASSERT(part.close());
+  
+  // A part that was never closed is missing
+  TRIVIS_ASSERT(part.open(directory, 1, 2));
+  part.write(1, "POLYGON((1 0,2 0,2 1,1 1,1 0))");
+  std::stringstream merged;
+  TRIVIS_ASSERT_FALSE(merge_parts(directory, 2, 3, merged));
+  TRIVIS_ASSERT(part.close());
+  TRIVIS_ASSERT(merge_parts(directory, 2, 3, merged));
+  TRIVIS_ASSERT_EQUAL(merged.str(), std::string("POLYGON((0 0,1 0,1 1,0 1,0 0))\nPOLYGON((1 0,2 0,2 1,1 1,1 0))\nPOLYGON((2 0,3 0,3 1,2 1,2 0))\n"));
+  
+  // Truncated, repeated and misplaced features are all errors
+  std::string partName = get_part_file_name(directory, 1, 2);
+  const char *brokenParts[] = {
+    "# part 1/2\n1\tPOLYGON((1 0,2 0,2 1,1 1,1 0))\n",
+    "# part 1/2\n1\tPOLYGON((1 0,2 0,2 1,1 1,1 0))\n1\tPOLYGON((1 0,2 0,2 1,1 1,1 0))\n# end 2\n",
+    "# part 1/2\n2\tPOLYGON((2 0,3 0,3 1,2 1,2 0))\n# end 1\n",
+    "# part 1/2\n1\tPOLYGON((1 0,2 0,2 1,1 1,1 0))\n# end 2\n"
+  };
+  for (int currentPart = 0; currentPart < 4; ++currentPart) {
+    std::ofstream brokenPart(partName.c_str());
+    brokenPart << brokenParts[currentPart];
+    brokenPart.close();
+    std::stringstream unused;
+    TRIVIS_ASSERT_FALSE(merge_parts(directory, 2, 3, unused));
+  } boost::filesystem::remove_all(directory);
+}
@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "TriVisTestSuite.h"
+
+#include <vector>
+#include <iostream>
+
+namespace {
+  struct Registered_test {
+    const char *name;
+    TriVisTestSuite::Test test;
+  };
+  
+  // Built on first use, since the tests register themselves during static initialisation
+  std::vector<Registered_test> &registeredTests() {
+    static std::vector<Registered_test> tests;
+    return tests;
+  }
+  
+  std::size_t numFailures = 0;
+}
+
+bool TriVisTestSuite::add(const char *name, Test test) {
+  Registered_test registered = {name, test};
+  registeredTests().push_back(registered);
+  return true;
+}
+
+std::size_t TriVisTestSuite::run(const std::string &filter) {
+  std::size_t numFailuresBefore = numFailures, numTests = 0;
+  for (std::vector<Registered_test>::const_iterator currentTest = registeredTests().begin(); currentTest != registeredTests().end(); ++currentTest) {
+    if (std::string(currentTest->name).find(filter) == std::string::npos) continue;
+    std::size_t numFailuresInTest = numFailures;
+    std::cerr << "Test " << currentTest->name << std::endl;
+    currentTest->test();
+    std::cerr << (numFailures == numFailuresInTest ? "\tpassed" : "\tFAILED") << std::endl;
+    ++numTests;
+  } std::cerr << numTests << " tests, " << numFailures-numFailuresBefore << " failures" << std::endl;
+  return numFailures-numFailuresBefore;
+}
+
+void TriVisTestSuite::fail(const char *file, int line, const std::string &message) {
+  std::cerr << file << ":" << line << ": error: " << message << std::endl;
+  ++numFailures;
+}
@@ -0,0 +1,85 @@
+/*
+ Copyright (c) 2014 Ken Arroyo Ohori
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#ifndef TriVis_TriVisTestSuite_h
+#define TriVis_TriVisTestSuite_h
+
+#include <string>
+#include <sstream>
+#include <cmath>
+
+// A minimal test registry for the parts of TriVis and prepair that do not
+// need Cocoa or OpenGL. The same tests are run by ctest through
+// TriVisTestsMain.cpp and by the XCTest bundle. Failed assertions are
+// reported and counted, and the test keeps going as in XCTest
+class TriVisTestSuite {
+public:
+  typedef void (*Test)();
+  
+  static bool add(const char *name, Test test);
+  
+  // Runs the tests whose name contains filter, returns the number of failures
+  static std::size_t run(const std::string &filter = std::string());
+  
+  static void fail(const char *file, int line, const std::string &message);
+};
+
+#define TRIVIS_TEST(name) \
+  static void name(); \
+  static bool name##Registered = TriVisTestSuite::add(#name, name); \
+  static void name()
+
+#define TRIVIS_ASSERT(condition) \
+  do { \
+    if (!(condition)) TriVisTestSuite::fail(__FILE__, __LINE__, #condition); \
+  } while (false)
+
+#define TRIVIS_ASSERT_FALSE(condition) TRIVIS_ASSERT(!(condition))
+
+// The unary + prints bytes as numbers
+#define TRIVIS_ASSERT_COMPARISON(first, comparison, second) \
+  do { \
+    const auto &firstValue = (first); \
+    const auto &secondValue = (second); \
+    if (!(firstValue comparison secondValue)) { \
+      std::ostringstream message; \
+      message << #first " " #comparison " " #second " (" << +firstValue << " vs " << +secondValue << ")"; \
+      TriVisTestSuite::fail(__FILE__, __LINE__, message.str()); \
+    } \
+  } while (false)
+
+#define TRIVIS_ASSERT_EQUAL(first, second) TRIVIS_ASSERT_COMPARISON(first, ==, second)
+#define TRIVIS_ASSERT_LESS_THAN(first, second) TRIVIS_ASSERT_COMPARISON(first, <, second)
+#define TRIVIS_ASSERT_LESS_THAN_OR_EQUAL(first, second) TRIVIS_ASSERT_COMPARISON(first, <=, second)
+#define TRIVIS_ASSERT_GREATER_THAN(first, second) TRIVIS_ASSERT_COMPARISON(first, >, second)
+
+#define TRIVIS_ASSERT_EQUAL_WITH_ACCURACY(first, second, accuracy) \
+  do { \
+    double firstValue = (first), secondValue = (second); \
+    if (!(std::fabs(firstValue-secondValue) <= (accuracy))) { \
+      std::ostringstream message; \
+      message << #first " == " #second " +/- " #accuracy " (" << firstValue << " vs " << secondValue << ")"; \
+      TriVisTestSuite::fail(__FILE__, __LINE__, message.str()); \
+    } \
+  } while (false)
+
+#endif
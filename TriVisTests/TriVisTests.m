@@ -1,34 +0,0 @@
-//
-//  TriVisTests.m
-//  TriVisTests
-//
-//  Created by Ken Arroyo Ohori on 27/06/14.
-//  Copyright (c) 2014 Ken Arroyo Ohori. All rights reserved.
-//
-
-#import <XCTest/XCTest.h>
-
-@interface TriVisTests : XCTestCase
-
-@end
-
-@implementation TriVisTests
-
-- (void)setUp
-{
-    [super setUp];
-    // Put setup code here. This method is called before the invocation of each test method in the class.
-}
-
-- (void)tearDown
-{
-    // Put teardown code here. This method is called after the invocation of each test method in the class.
-    [super tearDown];
-}
-
-- (void)testExample
-{
-    XCTFail(@"No implementation for \"%s\"", __PRETTY_FUNCTION__);
-}
-
-@end
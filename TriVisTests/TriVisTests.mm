@@ -0,0 +1,137 @@
+//
+//  TriVisTests.mm
+//  TriVisTests
+//
+//  Created by Ken Arroyo Ohori on 27/06/14.
+//  Copyright (c) 2014 Ken Arroyo Ohori. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "TriVisBufferBuilder.h"
+#import "TriVisTiling.h"
+#import "TriVisColours.h"
+#import "TriVisTestSuite.h"
+
+@interface TriVisTests : XCTestCase {
+  OGRGeometry *circle;
+  OGRGeometry *scatteredParts;
+  TriVisBuffer grid;
+}
+
+@end
+
+@implementation TriVisTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    // Large enough for the benchmarks to be meaningful
+    OGRLinearRing ring;
+    for (int currentVertex = 0; currentVertex < 100000; ++currentVertex) {
+      double angle = 2.0*M_PI*currentVertex/100000.0;
+      ring.addPoint(1000.0*cos(angle), 1000.0*sin(angle));
+    } ring.closeRings();
+    OGRPolygon *polygon = new OGRPolygon();
+    polygon->addRing(&ring);
+    circle = polygon;
+    
+    // 4096 squares on a 64 x 64 grid, in an order where consecutive parts are far apart
+    OGRMultiPolygon *multipolygon = new OGRMultiPolygon();
+    for (int currentPart = 0; currentPart < 4096; ++currentPart) {
+      int cell = (currentPart*1031)%4096;
+      double x = 10.0*(cell%64), y = 10.0*(cell/64);
+      OGRLinearRing square;
+      square.addPoint(x, y);
+      square.addPoint(x+5.0, y);
+      square.addPoint(x+5.0, y+5.0);
+      square.addPoint(x, y+5.0);
+      square.closeRings();
+      OGRPolygon part;
+      part.addRing(&square);
+      multipolygon->addGeometry(&part);
+    } scatteredParts = multipolygon;
+    
+    // A 500 x 500 grid of unit lines
+    for (int x = 0; x < 500; ++x) {
+      for (int y = 0; y < 500; ++y) {
+        grid.positions.push_back(x);
+        grid.positions.push_back(y);
+        grid.colours.push_back(exteriorRingColour);
+        if (x+1 < 500) {
+          grid.elements.push_back(500*x+y);
+          grid.elements.push_back(500*(x+1)+y);
+        } if (y+1 < 500) {
+          grid.elements.push_back(500*x+y);
+          grid.elements.push_back(500*x+y+1);
+        }
+      }
+    }
+}
+
+- (void)tearDown
+{
+    delete circle;
+    delete scatteredParts;
+    [super tearDown];
+}
+
+- (void)testPortableTests
+{
+    // Everything that does not need Cocoa or OpenGL is in TriVisPortableTests.cpp, so that it also runs without Xcode
+    XCTAssertEqual(TriVisTestSuite::run(), (std::size_t)0);
+}
+
+- (void)testBuildInputPerformance
+{
+    [self measureBlock:^{
+      TriVisBuffer buffer;
+      TriVisBufferBuilder::buildInput(circle, buffer);
+    }];
+}
+
+- (void)testTilingPerformance
+{
+    [self measureBlock:^{
+      TriVisTiling tiling;
+      tiling.build(grid.positions.data(), grid.colours.data(), grid.numVertices(), grid.elements.data(), grid.elements.size(), 2);
+    }];
+}
+
+- (void)testScatteredPartsPerformance
+{
+    [self measureBlock:^{
+      Polygon_repair prepair;
+      prepair.insert_odd_even_constraints(scatteredParts);
+    }];
+}
+
+- (void)testScatteredPartsWithoutLocateHintsPerformance
+{
+    // The same insertion, but every ring starts its walk where the previous one ended
+    [self measureBlock:^{
+      Polygon_repair prepair;
+      std::vector<std::vector<Polygon_repair::Point> > rings;
+      prepair.get_rings(scatteredParts, rings);
+      for (std::vector<std::vector<Polygon_repair::Point> >::iterator currentRing = rings.begin(); currentRing != rings.end(); ++currentRing) {
+        prepair.insert_odd_even_ring(*currentRing);
+      }
+    }];
+}
+
+- (void)testBuildTriangulationPerformance
+{
+    // Blocks copy captured C++ objects, so the triangulation is captured through a pointer
+    Polygon_repair *prepair = new Polygon_repair();
+    prepair->insert_odd_even_constraints(circle);
+    prepair->tag_odd_even();
+    [self measureBlock:^{
+      TriVisBuffer buffer;
+      TriVisBufferBuilder::buildTriangulation(prepair->triangulation, buffer);
+      TriVisBufferBuilder::buildTaggedTriangulation(prepair->triangulation, buffer);
+    }];
+    delete prepair;
+}
+
+@end